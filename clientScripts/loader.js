@@ -160,6 +160,125 @@
 		return script;
 	}
 
+	// Load the WebAssembly client. main.js and main.wasm are downloaded in
+	// parallel and the binary is compiled, while it is still downloading.
+	function loadWasm() {
+		var compiled = compileWasm("/assets/wasm/main.wasm");
+		window.Module = {
+			instantiateWasm: function (imports, done) {
+				compiled.then(function (mod) {
+					return WebAssembly.instantiate(mod, imports)
+						.then(function (inst) {
+							done(inst, mod);
+						});
+				}).catch(function (err) {
+					console.error(err);
+				});
+				return {};
+			}
+		};
+		var script = document.createElement('script');
+		script.src = "/assets/wasm/main.js";
+		document.head.appendChild(script);
+	}
+
+	// Fetch and compile a WebAssembly module. Compiled modules are cached
+	// in IndexedDB by ETag, if the browser can store them, so repeat visits
+	// skip compilation. Otherwise streaming compilation lets the browser's
+	// own code cache take effect.
+	function compileWasm(url) {
+		return fetch(url).then(function (res) {
+			var etag = res.headers.get("ETag");
+			return readCachedModule(etag).then(function (mod) {
+				if (mod) {
+					return mod;
+				}
+				var fallback = res.clone();
+				var compile;
+				if (WebAssembly.compileStreaming) {
+					compile = WebAssembly.compileStreaming(res)
+						.catch(function () {
+							// Served with the wrong MIME type
+							return compileBuffer(fallback);
+						});
+				} else {
+					compile = compileBuffer(fallback);
+				}
+				return compile.then(function (mod) {
+					cacheModule(etag, mod);
+					return mod;
+				});
+			});
+		});
+	}
+
+	function compileBuffer(res) {
+		return res.arrayBuffer().then(function (bytes) {
+			return WebAssembly.compile(bytes);
+		});
+	}
+
+	// Open the compiled module cache. Kept separate from the "meguca"
+	// database, so its version is not tied to the client's schema.
+	function openModuleCache() {
+		return new Promise(function (resolve, reject) {
+			var r = indexedDB.open("meguca_wasm", 1);
+			r.onupgradeneeded = function (e) {
+				e.target.result.createObjectStore("modules");
+			};
+			r.onsuccess = function () {
+				resolve(r.result);
+			};
+			r.onerror = reject;
+		});
+	}
+
+	// Resolves to the cached module, if its ETag matches, or null
+	function readCachedModule(etag) {
+		if (!etag || !window.indexedDB) {
+			return Promise.resolve(null);
+		}
+		return openModuleCache().then(function (db) {
+			return new Promise(function (resolve) {
+				var r = db.transaction("modules", "readonly")
+					.objectStore("modules")
+					.get("main");
+				r.onsuccess = function () {
+					var rec = r.result;
+					db.close();
+					resolve(rec && rec.etag === etag ? rec.module : null);
+				};
+				r.onerror = function () {
+					db.close();
+					resolve(null);
+				};
+			});
+		}).catch(function () {
+			return null;
+		});
+	}
+
+	function cacheModule(etag, mod) {
+		if (!etag || !window.indexedDB) {
+			return;
+		}
+		openModuleCache().then(function (db) {
+			var t = db.transaction("modules", "readwrite");
+			t.oncomplete = t.onerror = t.onabort = function () {
+				db.close();
+			};
+			try {
+				t.objectStore("modules").put({
+					etag: etag,
+					module: mod
+				}, "main");
+			} catch (e) {
+				// Module serialization not supported by browser
+				t.abort();
+			}
+		}).catch(function () { });
+	}
+
 	function loadClient() {
 		// Iterable NodeList
 		if (!checkFunction('NodeList.prototype[Symbol.iterator]')) {
@@ -168,16 +287,7 @@
 		}
 
 		if (wasm) {
-			window.Module = {};
-			fetch("/assets/wasm/main.wasm").then(function (res) {
-				return res.arrayBuffer();
-			}).then(function (bytes) {
-				// TODO: Parallel downloads of main.js and main.wasm
-				var script = document.createElement('script');
-				script.src = "/assets/wasm/main.js";
-				Module.wasmBinary = bytes;
-				document.head.appendChild(script);
-			});
+			loadWasm();
 		} else {
 			loadScript("js/main").onload = function () {
 				require("main");
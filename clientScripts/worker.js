@@ -1,5 +1,236 @@
-// Pointless service worker, so we can get
-// Android Chrome native app install prompts.
+// Service worker caching the client assets and recently visited thread pages,
+// so returning users can start without waiting on the network. Use only ES5.
 
-self.addEventListener('install', function () {});
-self.addEventListener('activate', function () {});
+var assetCache = "meguca-assets-v1",
+	threadCache = "meguca-threads-v1";
+
+// Maximum total size in bytes and count of cached thread pages
+var threadBudget = 8 << 20,
+	maxThreads = 32;
+
+// Maximum age of a cached thread page in milliseconds, before it is no longer
+// served ahead of the network. Thread synchronisation only carries the posts
+// created or changed in the last 16 minutes, so the client can not reconcile
+// older pages.
+var maxThreadAge = 15 * 60 * 1000;
+
+// Assets, that must always be updated together. The wasm module must match
+// its JS glue code.
+var assetGroups = [
+	["/assets/wasm/main.js", "/assets/wasm/main.wasm"]
+];
+
+// Path prefixes of cached client assets
+var assetPrefixes = [
+	"/assets/wasm/", "/assets/js/", "/assets/css/"
+];
+
+// Minimum interval between revalidations of an asset group in milliseconds
+var revalidateInterval = 60 * 1000;
+
+// Last revalidation time by the first URL of a group
+var revalidated = {};
+
+self.addEventListener("install", function () {
+	self.skipWaiting();
+});
+
+self.addEventListener("activate", function (e) {
+	// Drop caches of previous worker versions
+	e.waitUntil(caches.keys().then(function (keys) {
+		return Promise.all(keys.filter(function (k) {
+			return /^meguca-/.test(k)
+				&& k !== assetCache
+				&& k !== threadCache;
+		}).map(function (k) {
+			return caches.delete(k);
+		}));
+	}).then(function () {
+		return self.clients.claim();
+	}));
+});
+
+self.addEventListener("fetch", function (e) {
+	var req = e.request;
+	if (req.method !== "GET") {
+		return;
+	}
+	var url = new URL(req.url);
+	if (url.origin !== location.origin) {
+		return;
+	}
+	var path = url.pathname;
+	if (isAsset(path)) {
+		e.respondWith(serveAsset(req, path));
+	} else if (isThreadPage(url)) {
+		e.respondWith(serveThread(req, path + url.search));
+	}
+});
+
+function isAsset(path) {
+	if (/worker\.js$/.test(path)) {
+		return false; // Updated by the browser itself
+	}
+	for (var i = 0; i < assetPrefixes.length; i++) {
+		if (path.indexOf(assetPrefixes[i]) === 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Serve an asset from the cache and check for a newer version in the
+// background. Updated assets are used on the next page load.
+function serveAsset(req, path) {
+	return caches.open(assetCache).then(function (cache) {
+		return cache.match(req, { ignoreSearch: true }).then(function (res) {
+			if (res) {
+				revalidate(cache, path);
+				return res;
+			}
+			return fetch(req).then(function (res) {
+				if (res.ok) {
+					cache.put(path, res.clone());
+				}
+				return res;
+			});
+		});
+	});
+}
+
+// Returns the group of assets updated together with the asset
+function assetGroup(path) {
+	for (var i = 0; i < assetGroups.length; i++) {
+		if (assetGroups[i].indexOf(path) !== -1) {
+			return assetGroups[i];
+		}
+	}
+	return [path];
+}
+
+// Fetch the asset's group and replace the cached copies, if any of them
+// changed. A group is only replaced as a whole, if all of it could be
+// fetched.
+function revalidate(cache, path) {
+	var group = assetGroup(path),
+		now = Date.now();
+	if (now - (revalidated[group[0]] || 0) < revalidateInterval) {
+		return;
+	}
+	revalidated[group[0]] = now;
+
+	Promise.all(group.map(function (url) {
+		return Promise.all([
+			cache.match(url),
+			fetch(url, { cache: "no-cache" })
+		]);
+	})).then(function (pairs) {
+		var changed = false;
+		for (var i = 0; i < pairs.length; i++) {
+			var old = pairs[i][0],
+				res = pairs[i][1];
+			if (!res.ok) {
+				return;
+			}
+			if (!old || old.headers.get("ETag") !== res.headers.get("ETag")) {
+				changed = true;
+			}
+		}
+		if (!changed) {
+			return;
+		}
+		return Promise.all(pairs.map(function (p, i) {
+			return cache.put(group[i], p[1]);
+		}));
+	}).catch(function () {
+		// Offline. Keep the cached version.
+	});
+}
+
+// Thread pages of the wasm client embed a binary snapshot of the thread
+function isThreadPage(url) {
+	return /^\/\w+\/\d+$/.test(url.pathname)
+		&& /[?&]wasm=true(&|$)/.test(url.search);
+}
+
+// Serve a thread page from the cache, if it is recent enough to be reconciled
+// on synchronisation, and refresh the cached copy in the background. Older
+// pages are only served, if the network is unavailable.
+function serveThread(req, key) {
+	return caches.open(threadCache).then(function (cache) {
+		return cache.match(key).then(function (cached) {
+			var res = fetch(req).then(function (res) {
+				if (res.ok) {
+					return storeThread(cache, key, res.clone())
+						.then(function () {
+							return res;
+						});
+				}
+				return res;
+			});
+			if (cached && Date.now() - storedAt(cached) < maxThreadAge) {
+				res.catch(function () {
+					// Offline. Keep the cached version.
+				});
+				return cached;
+			}
+			return res.catch(function (err) {
+				if (cached) {
+					return cached;
+				}
+				throw err;
+			});
+		});
+	});
+}
+
+function storedAt(res) {
+	return +res.headers.get("X-Stored") || 0;
+}
+
+// Store a thread page and evict the least recently stored ones over the budget
+function storeThread(cache, key, res) {
+	return res.arrayBuffer().then(function (data) {
+		if (data.byteLength > threadBudget) {
+			return;
+		}
+		var stored = new Response(data, {
+			headers: {
+				"Content-Type": "text/html",
+				"X-Stored": String(Date.now()),
+				"X-Size": String(data.byteLength)
+			}
+		});
+		return cache.put(key, stored).then(function () {
+			return evictThreads(cache);
+		});
+	});
+}
+
+function evictThreads(cache) {
+	return cache.keys().then(function (reqs) {
+		return Promise.all(reqs.map(function (req) {
+			return cache.match(req).then(function (res) {
+				return {
+					req: req,
+					stored: storedAt(res),
+					size: +res.headers.get("X-Size") || 0
+				};
+			});
+		}));
+	}).then(function (entries) {
+		// Most recent first
+		entries.sort(function (a, b) {
+			return b.stored - a.stored;
+		});
+		var total = 0,
+			evict = [];
+		for (var i = 0; i < entries.length; i++) {
+			total += entries[i].size;
+			if (i >= maxThreads || total > threadBudget) {
+				evict.push(cache.delete(entries[i].req));
+			}
+		}
+		return Promise.all(evict);
+	});
+}
@@ -0,0 +1,31 @@
+#include "arena.hh"
+#include <algorithm>
+
+namespace brunhild {
+
+RenderArena* RenderArena::current = nullptr;
+
+RenderArena render_arena;
+
+void* RenderArena::allocate(size_t n, size_t align)
+{
+    while (chunk < chunks.size()) {
+        auto& c = chunks[chunk];
+        const size_t start = (offset + align - 1) & ~(align - 1);
+        if (start + n <= c.size) {
+            offset = start + n;
+            return c.buf.get() + start;
+        }
+        chunk++;
+        offset = 0;
+    }
+
+    // Out of chunks. Allocate a new one at least twice the size of the last.
+    size_t size = chunks.size() ? chunks.back().size << 1 : min_chunk_size;
+    size = std::max(size, n + align);
+    chunks.push_back({ std::unique_ptr<char[]>(new char[size]), size });
+    chunk = chunks.size() - 1;
+    offset = 0;
+    return allocate(n, align);
+}
+}
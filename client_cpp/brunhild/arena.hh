@@ -0,0 +1,152 @@
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+namespace brunhild {
+
+// Linear bump allocator for temporary render trees. Memory is never freed
+// individually, but only all at once by rewinding the arena to a previously
+// taken mark. Chunks are retained between rewinds to avoid reallocation.
+class RenderArena {
+public:
+    // Position in the arena, that can be rewound to
+    struct Mark {
+        size_t chunk, offset;
+    };
+
+    // Arena used by Allocator instances constructed in the current
+    // RenderScope or nullptr, if not rendering
+    static RenderArena* current;
+
+    // Allocate n bytes of memory aligned to align
+    void* allocate(size_t n, size_t align);
+
+    // Returns the current position in the arena
+    Mark mark() const { return { chunk, offset }; }
+
+    // Free all memory allocated since mark was taken
+    void rewind(Mark m)
+    {
+        chunk = m.chunk;
+        offset = m.offset;
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> buf;
+        size_t size;
+    };
+
+    // Size of the first chunk allocated
+    static constexpr size_t min_chunk_size = 64 << 10;
+
+    std::vector<Chunk> chunks;
+    size_t chunk = 0, // Index of the chunk being allocated from
+        offset = 0; // Offset into the current chunk
+};
+
+// Arena for temporary render trees of all views
+extern RenderArena render_arena;
+
+// Makes allocations of render trees constructed during its lifetime use
+// render_arena. On destruction of the outermost scope the arena is rewound,
+// freeing all memory allocated in the scope. Nested scopes do not rewind, as
+// containers of the outer scope may have grown inside them.
+class RenderScope {
+public:
+    RenderScope()
+        : prev(RenderArena::current)
+        , m(render_arena.mark())
+    {
+        RenderArena::current = &render_arena;
+    }
+
+    ~RenderScope()
+    {
+        if (!prev) {
+            render_arena.rewind(m);
+        }
+        RenderArena::current = prev;
+    }
+
+    RenderScope(const RenderScope&) = delete;
+    RenderScope& operator=(const RenderScope&) = delete;
+
+private:
+    RenderArena* const prev;
+    const RenderArena::Mark m;
+};
+
+// Allocator, that allocates from the arena of the RenderScope it was
+// constructed in or from the heap, if constructed outside of any scope.
+//
+// Containers allocated from the arena must not be retained past the end of
+// their scope. See Node::adopt().
+template <class T> class Allocator {
+    template <class U> friend class Allocator;
+
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Allocator() noexcept
+        : arena(RenderArena::current)
+    {
+    }
+
+    // Create an allocator for a specific arena. nullptr allocates from the
+    // heap.
+    explicit Allocator(RenderArena* arena) noexcept
+        : arena(arena)
+    {
+    }
+
+    template <class U>
+    Allocator(const Allocator<U>& other) noexcept
+        : arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (arena) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (!arena) {
+            std::allocator<T>().deallocate(p, n);
+        }
+    }
+
+    // Copies use the allocator of the current scope, so copies of long-lived
+    // subtrees made while rendering are temporary too
+    Allocator select_on_container_copy_construction() const
+    {
+        return Allocator();
+    }
+
+    // Returns, if memory is allocated from an arena
+    bool is_arena() const { return arena; }
+
+    template <class U> bool operator==(const Allocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <class U> bool operator!=(const Allocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+
+private:
+    RenderArena* arena;
+};
+}
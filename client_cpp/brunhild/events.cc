@@ -1,108 +1,303 @@
 #include "events.hh"
+#include "profile.hh"
+#include <deque>
 #include <emscripten.h>
-#include <map>
-#include <unordered_map>
+#include <stdint.h>
+#include <vector>
 
 using std::string;
 
 namespace brunhild {
 
-// used to identify event handler targets
-typedef std::pair<std::string, std::string> Key;
-
-struct pairhash {
-public:
-    template <typename T, typename U>
-    std::size_t operator()(const std::pair<T, U>& x) const
-    {
-        return std::hash<T>()(x.first) ^ (std::hash<U>()(x.second) << 1);
-    }
+// Storage slot of a registered event handler. Handler IDs encode the slot
+// index and generation, so IDs of removed handlers never match a reused slot.
+struct Slot {
+    bool live = false;
+    uint16_t generation = 0;
+    Handler handler;
 };
 
-// All registered event handlers
-static std::unordered_map<Key, std::unordered_map<long, Handler>, pairhash>
-    handlers;
+// Bits of a handler ID used for the slot index
+static const unsigned index_bits = 20;
+
+// std::deque keeps slot addresses stable, so handlers can register new
+// handlers while running
+static std::deque<Slot> slots;
+
+// Slots available for reuse
+static std::vector<uint32_t> free_slots;
+
+// Slots freed while handlers were running. Their handlers are only destroyed
+// after dispatch returns, because a handler might unregister itself.
+static std::vector<uint32_t> pending_free;
+
+// Number of currently running handlers
+static unsigned dispatch_depth = 0;
+
+// Returns the slot of a live handler or nullptr
+static Slot* find_slot(long id)
+{
+    const uint32_t i = id & ((1 << index_bits) - 1);
+    if (i >= slots.size()) {
+        return nullptr;
+    }
+    auto& s = slots[i];
+    if (!s.live || s.generation != (id >> index_bits)) {
+        return nullptr;
+    }
+    return &s;
+}
 
-static long id_counter = 0;
+static void free_slot(uint32_t i)
+{
+    auto& s = slots[i];
+    s.handler = nullptr;
+    // Generation wraps within the bits left in a positive 32 bit long
+    s.generation = (s.generation + 1) & ((1 << (31 - index_bits)) - 1);
+    free_slots.push_back(i);
+}
 
-long register_handler(string type, Handler handler, string selector)
+long register_handler(
+    string type, Handler handler, string selector, string scope)
 {
-    const Key key = { type, selector };
+    uint32_t i;
+    if (free_slots.size()) {
+        i = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        i = slots.size();
+        slots.emplace_back();
+    }
+    auto& s = slots[i];
+    s.live = true;
+    s.handler = std::move(handler);
+    const long id = long(s.generation) << index_bits | i;
 
-    if (!handlers.count(key)) {
-        EM_ASM_INT(
+    EM_ASM_INT(
+        {
+            var type = UTF8ToString($0);
+            var sel = UTF8ToString($1);
+            var scope = UTF8ToString($2);
+            var id = $3;
+
+            if (!window.__bh_handlers) {
+                // Handler buckets by event type. Handlers are indexed by the
+                // class or tag their selector requires of the event target.
+                // Each bucket is a Map of handler ID -> entry.
+                window.__bh_handlers = {};
+                // Buckets each handler is in by handler ID
+                window.__bh_handler_buckets = {};
+            }
+
+            var h = window.__bh_handlers[type];
+            if (!h) {
+                // Parenthesized, so the commas do not split the macro argument
+                h = window.__bh_handlers[type] = ({
+                    byClass : {},
+                    byTag : {},
+                    any : new Map(),
+                    scoped : 0,
+                });
+                document.addEventListener(type, function(e) {
+                    dispatch(h, e);
+                }, { passive : true });
+            }
+
+            var entry = ({ sel : sel, scope : scope });
+            var buckets = window.__bh_handler_buckets[id] = [];
+            if (scope) {
+                h.scoped++;
+                buckets.scoped = h;
+            }
+            function add(m)
+            {
+                m.set(id, entry);
+                buckets.push(m);
+            }
+            function bucket(map, key)
             {
-                var type = UTF8ToString($0);
-                var sel = UTF8ToString($1);
+                return map[key] || (map[key] = new Map());
+            }
 
-                if (!window.__bh_handlers) {
-                    window.__bh_handlers = {};
+            // Index by the rightmost compound selector of each comma-separated
+            // part. Parts without a class or tag go into the catch-all bucket.
+            var parts = sel ? splitTopLevel(sel, ',') : [ '' ];
+            for (var i = 0; i < parts.length; i++) {
+                var comp = rightmostCompound(parts[i]);
+                var dot = comp.indexOf('.');
+                var cls = dot != -1 ? readName(comp, dot + 1) : '';
+                var tag = readName(comp, 0);
+                if (cls) {
+                    add(bucket(h.byClass, cls));
+                } else if (tag) {
+                    add(bucket(h.byTag, tag.toUpperCase()));
+                } else {
+                    add(h.any);
                 }
+            }
 
-                // Pool event handlers of one event type together
-                if (!window.__bh_handlers[type]) {
-                    window.__bh_handlers[type] = {};
-                    document.addEventListener(type,
-                        function(e) {
-                            var t = e.target;
-                            if (!t.tagName) { // Not an element
-                                return;
-                            }
-
-                            for (var sel in window.__bh_handlers[type]) {
-                                if (!sel || t.matches(sel)) {
-                                    Module._run_event_handlers(type, sel, e);
-                                }
-                            }
-                        },
-                        { passive : true });
+            // Read a CSS identifier starting at i
+            function readName(s, i)
+            {
+                var j = i;
+                while (j < s.length) {
+                    var ch = s[j];
+                    if (!(ch >= 'a' && ch <= 'z') && !(ch >= 'A' && ch <= 'Z')
+                        && !(ch >= '0' && ch <= '9') && ch != '-'
+                        && ch != '_') {
+                        break;
+                    }
+                    j++;
                 }
-                window.__bh_handlers[type][sel] = true;
-            },
-            type.c_str(), selector.c_str());
-    }
+                return s.slice(i, j);
+            }
+
+            // Split selector on c outside of brackets and parentheses
+            function splitTopLevel(s, c)
+            {
+                var parts = [];
+                var depth = 0;
+                var start = 0;
+                for (var i = 0; i < s.length; i++) {
+                    var ch = s[i];
+                    if (ch == '(' || ch == '[') {
+                        depth++;
+                    } else if (ch == ')' || ch == ']') {
+                        depth--;
+                    } else if (ch == c && !depth) {
+                        parts.push(s.slice(start, i));
+                        start = i + 1;
+                    }
+                }
+                parts.push(s.slice(start));
+                return parts;
+            }
+
+            // Returns the last compound selector of a complex selector with
+            // any pseudo-class arguments and attribute selectors stripped
+            function rightmostCompound(s)
+            {
+                var out = '';
+                var depth = 0;
+                for (var i = 0; i < s.length; i++) {
+                    var ch = s[i];
+                    if (ch == '(' || ch == '[') {
+                        depth++;
+                    } else if (ch == ')' || ch == ']') {
+                        depth--;
+                    } else if (!depth) {
+                        if (' >+~'.indexOf(ch) != -1) {
+                            out = '';
+                        } else {
+                            out += ch;
+                        }
+                    }
+                }
+                return out;
+            }
+
+            function dispatch(h, e)
+            {
+                var t = e.target;
+                if (!t.tagName) { // Not an element
+                    return;
+                }
+
+                // IDs of the target and its ancestors, collected in one walk,
+                // if any handlers are scoped
+                var ids = null;
+                if (h.scoped) {
+                    ids = {};
+                    for (var a = t; a; a = a.parentElement) {
+                        if (a.id) {
+                            ids[a.id] = true;
+                        }
+                    }
+                }
+
+                // A handler can be in multiple buckets
+                var called = {};
+                function run(m)
+                {
+                    if (!m) {
+                        return;
+                    }
+                    m.forEach(function(entry, id) {
+                        if (called[id]) {
+                            return;
+                        }
+                        if (entry.scope && !ids[entry.scope]) {
+                            return;
+                        }
+                        if (entry.sel && !t.matches(entry.sel)) {
+                            return;
+                        }
+                        called[id] = true;
+                        Module._run_event_handler(id, e);
+                    });
+                }
+
+                var cl = t.classList;
+                for (var i = 0; i < cl.length; i++) {
+                    run(h.byClass[cl[i]]);
+                }
+                run(h.byTag[t.tagName]);
+                run(h.any);
+            }
+        },
+        type.c_str(), selector.c_str(), scope.c_str(), id);
 
-    const long id = id_counter++;
-    handlers[key][id] = handler;
     return id;
 }
 
 void unregister_handler(long id)
 {
-    for (auto & [ key, h_set ] : handlers) {
-        for (auto[h_id, _] : h_set) {
-            if (h_id == id) {
-                h_set.erase(h_id);
-                if (h_set.empty()) {
-                    // Not removing global listener completely, as that would
-                    // require tracking handler functions
-                    EM_ASM_INT(
-                        {
-                            delete window.__bh_handlers[UTF8ToString($0)]
-                                                       [UTF8ToString($1)];
-                        },
-                        key.first.c_str(), key.second.c_str());
-                }
-                return;
-            }
-        }
+    auto s = find_slot(id);
+    if (!s) {
+        return;
     }
+    s->live = false;
+    const uint32_t i = id & ((1 << index_bits) - 1);
+    if (dispatch_depth) {
+        pending_free.push_back(i);
+    } else {
+        free_slot(i);
+    }
+
+    EM_ASM_INT(
+        {
+            var buckets = window.__bh_handler_buckets[$0];
+            delete window.__bh_handler_buckets[$0];
+            for (var i = 0; i < buckets.length; i++) {
+                buckets[i].delete($0);
+            }
+            if (buckets.scoped) {
+                buckets.scoped.scoped--;
+            }
+        },
+        id);
 }
 
-static void run_event_handlers(string type, string sel, emscripten::val event)
+static void run_event_handler(long id, emscripten::val event)
 {
-    const Key key = { type, sel };
-    if (!handlers.count(key)) {
+    profile::boundary.count();
+    auto s = find_slot(id);
+    if (!s) {
         return;
     }
-    auto copy = handlers.at(key); // Handler might invalidate this iterator
-    for (auto & [ id, h ] : copy) {
-        h(event);
+
+    dispatch_depth++;
+    s->handler(event);
+    if (!--dispatch_depth) {
+        for (auto i : pending_free) {
+            free_slot(i);
+        }
+        pending_free.clear();
     }
 }
 
 EMSCRIPTEN_BINDINGS(module_events)
 {
-    emscripten::function("_run_event_handlers", &run_event_handlers);
+    emscripten::function("_run_event_handler", &run_event_handler);
 }
 }
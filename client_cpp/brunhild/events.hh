@@ -14,9 +14,11 @@ typedef std::function<void(emscripten::val&)> Handler;
 // Register a persistent global event handler.
 // type: DOM event type (click, hover, ...).
 // selector: any CSS selector the event target should be matched against
+// scope: if not empty, only match event targets inside the element with this
+// DOM ID, including the element itself
 // Returns handler ID
-long register_handler(
-    std::string type, Handler handler, std::string selector = "");
+long register_handler(std::string type, Handler handler,
+    std::string selector = "", std::string scope = "");
 
 // Remove a global event handler by ID
 void unregister_handler(long id);
@@ -0,0 +1,57 @@
+#include "handle.hh"
+#include <unordered_map>
+
+namespace brunhild {
+
+// Last generated handle
+static Handle handle_counter = 0;
+
+// DOM IDs of named handles, indexed by handle without the high bit
+static std::vector<std::string> names;
+
+// Reverse lookup of names
+static std::unordered_map<std::string, Handle> name_index;
+
+// Named handles not yet propagated to the JS side
+static std::vector<Handle> new_names;
+
+Handle new_handle() { return ++handle_counter; }
+
+Handle last_handle() { return handle_counter; }
+
+Handle named_handle(const std::string& id)
+{
+    if (auto it = name_index.find(id); it != name_index.end()) {
+        return it->second;
+    }
+    const Handle h = names.size() | (1u << 31);
+    names.push_back(id);
+    name_index[id] = h;
+    new_names.push_back(h);
+    return h;
+}
+
+std::string handle_id(Handle h)
+{
+    if (is_named(h)) {
+        return names[h & ~(1u << 31)];
+    }
+    return "bh-" + int_to_string(h);
+}
+
+void write_handle_id(Rope& s, Handle h)
+{
+    if (is_named(h)) {
+        s << names[h & ~(1u << 31)];
+    } else {
+        s << "bh-" << h;
+    }
+}
+
+std::vector<Handle> take_new_names()
+{
+    std::vector<Handle> re;
+    re.swap(new_names);
+    return re;
+}
+}
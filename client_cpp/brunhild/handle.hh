@@ -0,0 +1,42 @@
+#pragma once
+
+#include "util.hh"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace brunhild {
+
+// Integer handle of a DOM element managed by brunhild. 0 is an unassigned
+// handle.
+//
+// Generated handles map to "bh-<handle>" element IDs. Handles with the high bit
+// set are named handles of elements with an externally defined ID.
+//
+// The JS side keeps a handle -> Element table, so patching never needs any
+// string formatting or DOM lookups for known elements.
+typedef uint32_t Handle;
+
+// Allocate a new unique element handle
+Handle new_handle();
+
+// Returns the last generated handle. Generated handles are increasing.
+Handle last_handle();
+
+// Return a handle for the element with the passed fixed DOM ID. Repeated calls
+// with the same ID return the same handle.
+Handle named_handle(const std::string& id);
+
+// Returns, if handle is a named handle of an element with a fixed DOM ID
+constexpr bool is_named(Handle h) { return h & (1u << 31); }
+
+// Returns the DOM ID of the element
+std::string handle_id(Handle);
+
+// Write the DOM ID of the element to Rope
+void write_handle_id(Rope&, Handle);
+
+// Returns and clears the list of named handles registered since the last call.
+// Used to propagate the handle -> ID mapping to the JS side.
+std::vector<Handle> take_new_names();
+}
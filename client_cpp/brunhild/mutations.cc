@@ -1,6 +1,14 @@
 #include "mutations.hh"
+#include "profile.hh"
+#include "view.hh"
 #include <emscripten.h>
+#include <emscripten/bind.h>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <optional>
+#include <stdlib.h>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -12,8 +20,8 @@ using std::string;
 struct Mutations {
     bool remove_el = false, scroll_into_view = false;
     std::optional<std::string> set_inner_html, set_outer_html;
-    std::vector<std::string> append, prepend, before, after, move_prepend,
-        move_after;
+    std::vector<Fragment> append, prepend, before, after;
+    std::vector<Handle> move_prepend, move_after;
     std::unordered_set<std::string> remove_attr;
     std::unordered_map<std::string, std::string> set_attr;
 
@@ -23,106 +31,352 @@ struct Mutations {
     // Clear mutations of element inner and outer content to free up memory
     void free_outer();
 
-    // Execute buffered mutations
-    void exec(const std::string& id);
+    // Call fn with each pending fragment, that inserts elements
+    template <class F> void for_each_fragment(F fn)
+    {
+        for (auto list : { &before, &after, &append, &prepend }) {
+            for (auto& f : *list) {
+                fn(f);
+            }
+        }
+    }
+
+    // Call fn with the handle of each element this mutation set inserts
+    template <class F> void for_each_inserted(F fn);
+
+    // Encode buffered mutations into the command buffer
+    void encode(Handle);
+};
+
+// Operations encoded in the command buffer. Each operation is one byte
+// followed by its handle and string arguments.
+enum class Op : uint8_t {
+    // Select the element all following operations apply to.
+    // Args: handle
+    select,
+    // Args: string, that can contain multiple merged fragments
+    before,
+    after,
+    remove,
+    set_outer_html,
+    set_inner_html,
+    append,
+    prepend,
+    // Args: handle
+    move_prepend,
+    move_after,
+    // Args: key, value
+    set_attr,
+    remove_attr,
+    // No arguments
+    scroll_into_view,
+    // Register the DOM ID of a named handle.
+    // Args: handle, ID
+    name,
+    // Start or stop observing the element's intersection with the viewport.
+    // Args: handle
+    observe,
+    unobserve,
+    // Start or stop tracking changes of the element's visibility.
+    // Args: handle
+    track,
+    untrack,
+    // Register a DOM template.
+    // Args: template ID, HTML
+    define_template,
+    // Clone a template and fill in its elements. The following insert
+    // operation inserts the clone instead of parsing its HTML argument.
+    // Args: template ID, then for each element in preorder: handle, attribute
+    // count, attribute keys and values and inner HTML, that is ignored for
+    // elements with children in the template
+    clone,
+};
+
+// Linear buffer of encoded DOM mutations, that is replayed by a single JS call
+// on flush. Handles are encoded as little-endian uint32. Strings are encoded
+// as a little-endian uint32 byte length followed by the UTF-8 bytes and a null
+// terminator.
+class CommandBuffer {
+public:
+    // Write an operation without arguments
+    void write(Op op) { buf.push_back(static_cast<char>(op)); }
+
+    // Write an operation with handle and string arguments
+    template <class... Args> void write(Op op, const Args&... args)
+    {
+        write(op);
+        (write_arg(args), ...);
+    }
+
+    // Write an insert operation of a fragment
+    void write(Op op, const Fragment& f);
+
+    // Execute all encoded operations and clear the buffer
+    void exec();
+
+private:
+    // Retains capacity between flushes to avoid reallocations
+    std::vector<char> buf;
+
+    void write_arg(uint32_t i)
+    {
+        char b[4];
+        memcpy(b, &i, 4); // wasm is little-endian
+        buf.insert(buf.end(), b, b + 4);
+    }
+
+    void write_arg(const std::string& s)
+    {
+        write_arg(uint32_t(s.size()));
+        buf.insert(buf.end(), s.begin(), s.end());
+        buf.push_back('\0');
+    }
 };
 
+static CommandBuffer command_buffer;
+
+static profile::Metric flush_metric("flush"), exec_metric("exec"),
+    mutation_metric("mutations"), dropped_metric("dropped mutations");
+
 void (*before_flush)() = nullptr;
 void (*after_flush)() = nullptr;
 
-// TODO: Should probably use some smarter data structure, that maintains both
-// mutation set insertion order and is searchable by string
+// All pending mutations quickly accessible by element handle
+static std::unordered_map<Handle, Mutations> mutations;
+
+// Handles of pending mutation sets in order of creation. optimize() reorders
+// them, so elements are inserted before they are mutated.
+static std::vector<Handle> touch_order;
+
+// Elements created since the last flush, whose pending insertion was
+// discarded by a later mutation. Their mutation sets are dropped on flush.
+static std::unordered_set<Handle> discarded;
+
+// Last handle generated before the previous flush. Elements with greater
+// generated handles were created since.
+static Handle flushed_handles = 0;
+
+// Handlers to run, when an element nears the viewport
+static std::unordered_map<Handle, std::function<void()>> visibility_handlers;
+
+// Elements to start observing on the next flush
+static std::vector<Handle> pending_observe;
+
+// Elements, whose visibility changes are reported to visibility_listener
+static std::unordered_set<Handle> tracked;
+
+// Elements to start tracking on the next flush
+static std::vector<Handle> pending_track;
+
+static void (*visibility_listener)(const uint32_t*, size_t) = nullptr;
+
+// Fetches a mutation set by element handle or creates a new one ond registers
+// its creation order
+static Mutations* get_mutation_set(Handle h)
+{
+    if (!mutations.count(h)) {
+        touch_order.push_back(h);
+    }
+    return &mutations[h];
+}
+
+// Returns, if the element of h was created since the last flush
+static bool is_new(Handle h) { return !is_named(h) && h > flushed_handles; }
+
+// Call fn with the handle of each element with a generated ID in html. All
+// writers quote generated IDs and escaped text can not contain quotes, so
+// only the quoted form is matched.
+template <class F> static void for_each_id(std::string_view html, F fn)
+{
+    static constexpr std::string_view prefix = " id=\"bh-";
+    for (size_t i = 0; (i = html.find(prefix, i)) != std::string_view::npos;) {
+        i += prefix.size();
+        Handle h = 0;
+        const size_t start = i;
+        while (i < html.size() && html[i] >= '0' && html[i] <= '9') {
+            h = h * 10 + (html[i++] - '0');
+        }
+        if (i != start) {
+            fn(h);
+        }
+    }
+}
+
+// Call fn with the handle of each element with a generated ID in f
+template <class F> static void for_each_handle(const Fragment& f, F fn)
+{
+    if (auto html = std::get_if<string>(&f)) {
+        for_each_id(*html, fn);
+        return;
+    }
+    for (auto& el : std::get<TemplateInstance>(f).elements) {
+        fn(el.handle);
+        for_each_id(el.inner_html, fn);
+    }
+}
+
+// Returns the handle of the root element of f or 0, if it has no generated ID
+static Handle root_handle(const Fragment& f)
+{
+    if (auto html = std::get_if<string>(&f)) {
+        Handle h = 0;
+        for_each_id(std::string_view(*html).substr(0, html->find('>')),
+            [&](Handle id) {
+                if (!h) {
+                    h = id;
+                }
+            });
+        return h;
+    }
+    auto& els = std::get<TemplateInstance>(f).elements;
+    return els.empty() ? 0 : els.front().handle;
+}
+
+template <class F> void Mutations::for_each_inserted(F fn)
+{
+    for_each_fragment([&](const Fragment& f) { for_each_handle(f, fn); });
+    if (set_inner_html) {
+        for_each_id(*set_inner_html, fn);
+    }
+    if (set_outer_html) {
+        for_each_id(*set_outer_html, fn);
+    }
+}
+
+// Mark new elements in content, that will not be inserted, as discarded
+static void discard_handle(Handle h)
+{
+    if (is_new(h)) {
+        discarded.insert(h);
+    }
+}
+
+static void discard(const std::vector<Fragment>& list)
+{
+    for (auto& f : list) {
+        for_each_handle(f, discard_handle);
+    }
+}
+
+static void discard_html(std::string_view html)
+{
+    for_each_id(html, discard_handle);
+}
 
-// All pending mutations quickly accessible by element ID
-static std::unordered_map<string, Mutations> mutations;
+// Elements can be inserted again after their first insertion was discarded
+static void revive_handle(Handle h) { discarded.erase(h); }
 
-// Stores mutation order, so we can somewhat make sure, new children are not
-// manipulated, before insertion
-static std::vector<std::string> mutation_order;
+static void revive(const Fragment& f)
+{
+    if (discarded.size()) {
+        for_each_handle(f, revive_handle);
+    }
+}
 
-// Fetches a mutation set by element ID or creates a new one ond registers
-// its execution order
-static Mutations* get_mutation_set(string id)
+static void revive_html(std::string_view html)
 {
-    if (!mutations.count(id)) {
-        mutation_order.push_back(id);
+    if (discarded.size()) {
+        for_each_id(html, revive_handle);
     }
-    return &mutations[id];
 }
 
-void append(string id, string html)
+uint32_t define_template(string html)
 {
-    get_mutation_set(id)->append.push_back(html);
+    static uint32_t next_id = 0;
+    const auto id = next_id++;
+
+    // Written ahead of any pending mutations, so instances inserted on the
+    // same flush can be cloned
+    command_buffer.write(Op::define_template, id, html);
+    return id;
 }
 
-void prepend(string id, string html)
+void append(Handle h, Fragment f)
 {
-    get_mutation_set(id)->prepend.push_back(html);
+    revive(f);
+    get_mutation_set(h)->append.push_back(std::move(f));
 }
 
-void before(string id, string html)
+void prepend(Handle h, Fragment f)
 {
-    get_mutation_set(id)->before.push_back(html);
+    revive(f);
+    get_mutation_set(h)->prepend.push_back(std::move(f));
 }
 
-void after(string id, string html)
+void before(Handle h, Fragment f)
 {
-    get_mutation_set(id)->after.push_back(html);
+    revive(f);
+    get_mutation_set(h)->before.push_back(std::move(f));
+}
+
+void after(Handle h, Fragment f)
+{
+    revive(f);
+    get_mutation_set(h)->after.push_back(std::move(f));
 }
 
 // Move child node to the front of the parent
-void move_prepend(string parent_id, string child_id)
+void move_prepend(Handle parent, Handle child)
 {
-    get_mutation_set(parent_id)->move_prepend.push_back(child_id);
+    get_mutation_set(parent)->move_prepend.push_back(child);
 }
 
 // Move child node after a sibling in the parent
-void move_after(string sibling_id, string child_id)
+void move_after(Handle sibling, Handle child)
 {
-    get_mutation_set(sibling_id)->move_prepend.push_back(child_id);
+    get_mutation_set(sibling)->move_after.push_back(child);
 }
 
-void set_inner_html(string id, string html)
+void set_inner_html(Handle h, string html)
 {
-    auto mut = get_mutation_set(id);
+    auto mut = get_mutation_set(h);
     // These would be overwritten, so we can free up used memory
     mut->free_inner();
-    mut->set_inner_html = html;
+    revive_html(html);
+    mut->set_inner_html = std::move(html);
 }
 
-void set_outer_html(string id, string html)
+void set_outer_html(Handle h, string html)
 {
-    auto mut = get_mutation_set(id);
+    auto mut = get_mutation_set(h);
     mut->free_outer();
-    mut->set_outer_html = html;
+    revive_html(html);
+    mut->set_outer_html = std::move(html);
 }
 
-void remove(string id)
+void remove(Handle h)
 {
-    auto mut = get_mutation_set(id);
+    auto mut = get_mutation_set(h);
     mut->free_outer();
     mut->remove_el = true;
 }
 
-void set_attr(string id, string key, string val)
+void set_attr(Handle h, string key, string val)
 {
-    get_mutation_set(id)->set_attr[key] = val;
+    auto mut = get_mutation_set(h);
+    mut->remove_attr.erase(key);
+    mut->set_attr[std::move(key)] = std::move(val);
 }
 
-void remove_attr(string id, string key)
+void remove_attr(Handle h, string key)
 {
-    auto mut = get_mutation_set(id);
+    auto mut = get_mutation_set(h);
     mut->set_attr.erase(key);
-    mut->remove_attr.insert(id);
+    mut->remove_attr.insert(key);
 }
 
-void scroll_into_view(string id)
+void scroll_into_view(Handle h)
 {
-    get_mutation_set(id)->scroll_into_view = true;
+    get_mutation_set(h)->scroll_into_view = true;
 }
 
 void Mutations::free_inner()
 {
+    discard(append);
+    discard(prepend);
+    if (set_inner_html) {
+        discard_html(*set_inner_html);
+    }
     append.clear();
     prepend.clear();
     move_prepend.clear();
@@ -135,137 +389,667 @@ void Mutations::free_outer()
     free_inner();
     remove_attr.clear();
     set_attr.clear();
+    if (set_outer_html) {
+        discard_html(*set_outer_html);
+    }
     set_outer_html = std::nullopt;
 }
 
+void on_visible(Handle h, std::function<void()> fn)
+{
+    if (!visibility_handlers.count(h)) {
+        pending_observe.push_back(h);
+    }
+    visibility_handlers[h] = fn;
+}
+
+void cancel_on_visible(Handle h)
+{
+    // Any pending observation is skipped on flush
+    if (visibility_handlers.erase(h)) {
+        command_buffer.write(Op::unobserve, h);
+    }
+}
+
+void track_visibility(Handle h)
+{
+    if (tracked.insert(h).second) {
+        pending_track.push_back(h);
+    }
+}
+
+void untrack_visibility(Handle h)
+{
+    // Any pending tracking is skipped on flush
+    if (tracked.erase(h)) {
+        command_buffer.write(Op::untrack, h);
+    }
+}
+
+void set_visibility_listener(void (*fn)(const uint32_t*, size_t))
+{
+    visibility_listener = fn;
+}
+
+// Takes ownership of a malloc()ed array of n (handle, visible) records
+static void run_visibility_changes(uintptr_t ptr, size_t n)
+{
+    auto records = reinterpret_cast<uint32_t*>(ptr);
+    if (visibility_listener) {
+        profile::boundary.count();
+        visibility_listener(records, n);
+    }
+    free(records);
+}
+
+static void run_visibility_handler(Handle h)
+{
+    auto it = visibility_handlers.find(h);
+    if (it == visibility_handlers.end()) {
+        return;
+    }
+    profile::boundary.count();
+    auto fn = std::move(it->second);
+    visibility_handlers.erase(it);
+    fn();
+}
+
+EMSCRIPTEN_BINDINGS(module_mutations)
+{
+    emscripten::function("_run_visibility_handler", &run_visibility_handler);
+    emscripten::function("_run_visibility_changes", &run_visibility_changes);
+}
+
+// Location of the pending insertion of an element with a mutation set
+struct Origin {
+    Handle parent; // Mutation set inserting the element
+    Fragment* fragment; // Fragment with the element as its root or nullptr
+};
+
+// Propagate discarded elements to all elements they would insert
+static void propagate_discarded(std::vector<Handle> queue)
+{
+    while (queue.size()) {
+        const auto h = queue.back();
+        queue.pop_back();
+        auto it = mutations.find(h);
+        if (it == mutations.end()) {
+            continue;
+        }
+        it->second.for_each_inserted([&](Handle ch) {
+            if (is_new(ch) && discarded.insert(ch).second) {
+                queue.push_back(ch);
+            }
+        });
+    }
+}
+
+// Returns the order, in which to encode the pending mutation sets, and
+// optimizes them. Mutation sets of elements, that will not be in the DOM, are
+// dropped. Elements created since the last flush, that are removed or
+// replaced before being inserted, are never inserted or are inserted with
+// their replacement directly. Mutation sets of new elements are ordered after
+// the mutation set, that inserts them.
+//
+// Only insertions since the last flush are known, so mutations of older
+// elements inside replaced subtrees are still skipped on the JS side.
+static std::vector<Handle> optimize()
+{
+    std::vector<Handle> order;
+    order.reserve(touch_order.size());
+    if (discarded.size()) {
+        propagate_discarded({ discarded.begin(), discarded.end() });
+    }
+
+    bool any_new = false;
+    for (auto h : touch_order) {
+        if (is_new(h) && !discarded.count(h)) {
+            any_new = true;
+            break;
+        }
+    }
+    if (!any_new) {
+        for (auto h : touch_order) {
+            if (!discarded.count(h)) {
+                order.push_back(h);
+            }
+        }
+        return order;
+    }
+
+    // Find the insertions of all new elements with pending mutations
+    std::unordered_map<Handle, Origin> origins;
+    for (auto h : touch_order) {
+        if (discarded.count(h)) {
+            continue;
+        }
+        auto& m = mutations.at(h);
+        m.for_each_fragment([&](Fragment& f) {
+            const auto root = root_handle(f);
+            for_each_handle(f, [&](Handle ch) {
+                if (ch != h && is_new(ch) && mutations.count(ch)) {
+                    origins[ch] = { h, ch == root ? &f : nullptr };
+                }
+            });
+        });
+        for (auto html : { &m.set_inner_html, &m.set_outer_html }) {
+            if (*html) {
+                for_each_id(**html, [&](Handle ch) {
+                    if (ch != h && is_new(ch) && mutations.count(ch)) {
+                        origins[ch] = { h, nullptr };
+                    }
+                });
+            }
+        }
+    }
+
+    // Apply removals and replacements of new elements to the fragments
+    // inserting them. Insertions relative to the element must still happen,
+    // so those are left as is.
+    for (auto h : touch_order) {
+        auto& m = mutations.at(h);
+        if (discarded.count(h) || !(m.remove_el || m.set_outer_html)
+            || m.before.size() || m.after.size()) {
+            continue;
+        }
+        auto it = origins.find(h);
+        if (it == origins.end() || !it->second.fragment) {
+            continue;
+        }
+        // Copy out before the loop below inserts into origins and possibly
+        // rehashes, invalidating it
+        const Handle parent = it->second.parent;
+        auto& f = *it->second.fragment;
+
+        std::vector<Handle> dropped;
+        std::unordered_set<Handle> kept;
+        if (m.set_outer_html) {
+            for_each_id(*m.set_outer_html, [&](Handle ch) {
+                kept.insert(ch);
+                if (mutations.count(ch)) {
+                    origins.insert_or_assign(ch, Origin { parent, nullptr });
+                }
+            });
+        }
+        for_each_handle(f, [&](Handle ch) {
+            if (is_new(ch) && !kept.count(ch) && discarded.insert(ch).second) {
+                dropped.push_back(ch);
+            }
+        });
+        if (m.remove_el) {
+            f = string();
+        } else {
+            f = std::move(*m.set_outer_html);
+            m.set_outer_html = std::nullopt;
+        }
+        propagate_discarded(std::move(dropped));
+    }
+
+    // Order mutation sets of new elements and of moved new elements after
+    // the mutation sets inserting them
+    std::unordered_set<Handle> emitted;
+    std::function<void(Handle)> emit = [&](Handle h) {
+        if (discarded.count(h) || !emitted.insert(h).second) {
+            return;
+        }
+        auto after_origin = [&](Handle ch) {
+            if (auto it = origins.find(ch); it != origins.end()) {
+                emit(it->second.parent);
+            }
+        };
+        after_origin(h);
+        auto& m = mutations.at(h);
+        for (auto ch : m.move_prepend) {
+            after_origin(ch);
+        }
+        for (auto ch : m.move_after) {
+            after_origin(ch);
+        }
+        order.push_back(h);
+    };
+    for (auto h : touch_order) {
+        emit(h);
+    }
+    return order;
+}
+
 extern "C" void flush()
 {
+    const double start = profile::now();
     if (before_flush) {
         (*before_flush)();
     }
+    patch_scheduled();
+
+    // Propagate DOM IDs of any new named handles
+    for (auto h : take_new_names()) {
+        command_buffer.write(Op::name, h, handle_id(h));
+    }
 
     if (mutations.size()) {
-        for (auto& id : mutation_order) {
-            mutations.at(id).exec(id);
+        mutation_metric.count(mutations.size());
+        const auto order = optimize();
+        dropped_metric.count(mutations.size() - order.size());
+        for (auto h : order) {
+            mutations.at(h).encode(h);
         }
-        mutation_order.clear();
+        touch_order.clear();
         mutations.clear();
     }
+    discarded.clear();
+    flushed_handles = last_handle();
+
+    // Observe after insertion, so the elements can be resolved
+    for (auto h : pending_observe) {
+        if (visibility_handlers.count(h)) {
+            command_buffer.write(Op::observe, h);
+        }
+    }
+    pending_observe.clear();
+    for (auto h : pending_track) {
+        if (tracked.count(h)) {
+            command_buffer.write(Op::track, h);
+        }
+    }
+    pending_track.clear();
+
+    command_buffer.exec();
 
     if (after_flush) {
         (*after_flush)();
     }
+
+    flush_metric.finish(start);
+    profile::end_frame();
 }
 
-void Mutations::exec(const string& id)
+// Write insert operations of fragments, merging runs of adjacent HTML
+// strings into single operations. Dropped fragments are empty strings.
+// stacked: each fragment is inserted at the same position, so later fragments
+// precede earlier ones in the DOM.
+static void write_inserts(Op op, std::vector<Fragment>& list, bool stacked)
 {
-    // Assign element to global variable, so we don't have to look it up each
-    // time
-    const bool exists = (bool)EM_ASM_INT(
-        {
-            window.__el = document.getElementById(UTF8ToString($0));
-            return !!window.__el;
-        },
-        id.c_str());
-    if (!exists) {
-        // Nothing we can do
-        return;
+    auto& b = command_buffer;
+    size_t start = 0;
+    auto write_run = [&](size_t end) {
+        if (end - start == 1) {
+            auto& html = std::get<string>(list[start]);
+            if (html.size()) {
+                b.write(op, html);
+            }
+            return;
+        }
+        string html;
+        for (size_t i = start; i < end; i++) {
+            html += std::get<string>(list[stacked ? end - 1 - i + start : i]);
+        }
+        if (html.size()) {
+            b.write(op, html);
+        }
+    };
+    for (size_t i = 0; i < list.size(); i++) {
+        if (std::holds_alternative<TemplateInstance>(list[i])) {
+            write_run(i);
+            b.write(op, list[i]);
+            start = i + 1;
+        }
     }
+    write_run(list.size());
+}
 
-    // TODO: Do these loops in one JS call, if possible
+void Mutations::encode(Handle h)
+{
+    auto& b = command_buffer;
+    b.write(Op::select, h);
 
     // Before and after inserts need to happen, even if the element is going to
     // be removed
-    for (auto& html : before) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.parentNode.insertBefore(cont.firstChild, el);
-            },
-            html.c_str());
-    }
-    for (auto& html : after) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.parentNode.insertBefore(cont.firstChild, el.nextSibling);
-            },
-            html.c_str());
-    }
+    write_inserts(Op::before, before, false);
+    write_inserts(Op::after, after, true);
 
     if (remove_el) {
-        EM_ASM({
-            var el = window.__el;
-            el.parentNode.removeChild(el);
-        });
         // If the element is to be removed, nothing else needs to be done
+        b.write(Op::remove);
         return;
     }
 
     if (set_outer_html) {
-        EM_ASM_INT({ window.__el.outerHTML = UTF8ToString($0); },
-            set_outer_html->c_str());
+        b.write(Op::set_outer_html, *set_outer_html);
     }
     if (set_inner_html) {
-        EM_ASM_INT({ window.__el.innerHTML = UTF8ToString($0); },
-            set_inner_html->c_str());
+        b.write(Op::set_inner_html, *set_inner_html);
     }
 
-    for (auto& html : append) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.appendChild(cont.firstChild);
-            },
-            html.c_str());
-    }
-    for (auto& html : prepend) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.insertBefore(cont.firstChild, el.firstChild);
-            },
-            html.c_str());
-    }
-    for (auto& child_id : move_prepend) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                el.insertBefore(
-                    document.getElementById(UTF8ToString($0)), el.firstChild);
-            },
-            child_id.c_str());
-    }
-    for (auto& child_id : move_after) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                el.parentNode.insertBefore(
-                    document.getElementById(UTF8ToString($0)), el.nextSibling);
-            },
-            child_id.c_str());
+    write_inserts(Op::append, append, false);
+    write_inserts(Op::prepend, prepend, true);
+    for (auto child : move_prepend) {
+        b.write(Op::move_prepend, child);
+    }
+    for (auto child : move_after) {
+        b.write(Op::move_after, child);
     }
 
-    for (auto& kv : set_attr) {
-        EM_ASM_INT(
-            { window.__el.setAttribute(UTF8ToString($0), UTF8ToString($1)); },
-            kv.first.c_str(), kv.second.c_str());
+    for (auto& [key, val] : set_attr) {
+        b.write(Op::set_attr, key, val);
     }
     for (auto& key : remove_attr) {
-        EM_ASM_INT(
-            { window.__el.removeAttribute(UTF8ToString($0)); }, key.c_str());
+        b.write(Op::remove_attr, key);
     }
 
     if (scroll_into_view) {
-        EM_ASM({ window.__el.scrollIntoView(); });
+        b.write(Op::scroll_into_view);
     }
 }
+
+void CommandBuffer::write(Op op, const Fragment& f)
+{
+    if (auto html = std::get_if<string>(&f)) {
+        write(op, *html);
+        return;
+    }
+
+    auto& inst = std::get<TemplateInstance>(f);
+    write(Op::clone, inst.id);
+    for (auto& el : inst.elements) {
+        write_arg(el.handle);
+        write_arg(uint32_t(el.attrs.size()));
+        for (auto& [key, val] : el.attrs) {
+            write_arg(key);
+            write_arg(val);
+        }
+        write_arg(el.inner_html);
+    }
+    write(op, string());
+}
+
+void CommandBuffer::exec()
+{
+    if (buf.empty()) {
+        return;
+    }
+    profile::Scope scope(exec_metric);
+    profile::boundary.count();
+
+    EM_ASM_INT(
+        {
+            var i = $0;
+            var end = $0 + $1;
+            var el = null;
+
+            // Handle -> Element table and DOM IDs of named handles
+            if (!window.__bh_els) {
+                window.__bh_els = new Map();
+                window.__bh_names = {};
+                window.__bh_templates = [];
+                window.__bh_sweep_at = 1 << 10;
+            }
+            var els = window.__bh_els;
+
+            // Template clone to be inserted by the next insert operation
+            var clone = null;
+
+            // Read the next handle argument from the buffer
+            function u32()
+            {
+                var n = (HEAPU8[i] | (HEAPU8[i + 1] << 8)
+                            | (HEAPU8[i + 2] << 16) | (HEAPU8[i + 3] << 24))
+                    >>> 0;
+                i += 4;
+                return n;
+            }
+
+            // Read the next string argument from the buffer. The length is
+            // known, so decode the bytes in place without scanning for the
+            // null terminator.
+            var decoder = window.__bh_decoder;
+            if (decoder === undefined && window.TextDecoder) {
+                decoder = window.__bh_decoder = new TextDecoder('utf-8');
+            }
+            function str()
+            {
+                var len = u32();
+                var s = decoder ? decoder.decode(HEAPU8.subarray(i, i + len))
+                                : UTF8ToString(i);
+                i += len + 1;
+                return s;
+            }
+
+            // Returns the DOM ID of a handle
+            function dom_id(h)
+            {
+                return h & 0x80000000 ? window.__bh_names[h] : 'bh-' + h;
+            }
+
+            // Resolve element by handle. Cached elements, that have since been
+            // replaced in the DOM, are looked up again.
+            function resolve(h)
+            {
+                var e = els.get(h);
+                if (e && e.isConnected) {
+                    return e;
+                }
+                e = document.getElementById(dom_id(h));
+                if (e) {
+                    els.set(h, e);
+                } else {
+                    els.delete(h);
+                }
+                return e;
+            }
+
+            // Fill a cloned template element and its subtree with the next
+            // element values in the buffer
+            function fill(e)
+            {
+                var h = u32();
+                e.id = dom_id(h);
+                els.set(h, e);
+                for (var n = u32(); n; n--) {
+                    var key = str();
+                    e.setAttribute(key, str());
+                }
+                var html = str();
+                var ch = e.children;
+                if (!ch.length) {
+                    if (html) {
+                        e.innerHTML = html;
+                    }
+                    return;
+                }
+                for (var j = 0; j < ch.length; j++) {
+                    fill(ch[j]);
+                }
+            }
+
+            // Insert HTML, that can contain multiple merged fragments, or a
+            // template clone at a position relative to el
+            function insert(pos, arg)
+            {
+                if (typeof arg == 'string') {
+                    el.insertAdjacentHTML(pos, arg);
+                    return;
+                }
+                switch (pos) {
+                case 'beforebegin':
+                    el.parentNode.insertBefore(arg, el);
+                    break;
+                case 'afterend':
+                    el.parentNode.insertBefore(arg, el.nextSibling);
+                    break;
+                case 'beforeend':
+                    el.appendChild(arg);
+                    break;
+                case 'afterbegin':
+                    el.insertBefore(arg, el.firstChild);
+                    break;
+                }
+            }
+
+            while (i < end) {
+                var op = HEAPU8[i++];
+                var arg;
+                var arg2;
+                switch (op) {
+                case 0: // select
+                    el = resolve(u32());
+                    continue;
+                case 13: // name
+                    arg = u32();
+                    window.__bh_names[arg] = str();
+                    continue;
+                case 18: // define_template
+                    arg = u32();
+                    arg2 = document.createElement('template');
+                    arg2.innerHTML = str();
+                    window.__bh_templates[arg] = arg2;
+                    continue;
+                case 19: // clone
+                    clone = window.__bh_templates[u32()]
+                                .content.cloneNode(true)
+                                .firstChild;
+                    fill(clone);
+                    continue;
+                case 16: // track
+                case 17: // untrack
+                    arg2 = u32();
+                    arg = resolve(arg2);
+                    if (!arg) {
+                        continue;
+                    }
+                    if (!window.__bh_vo) {
+                        // Changes are delivered at most once per frame and
+                        // passed to wasm as a single array of
+                        // (handle, visible) records
+                        window.__bh_vo = new IntersectionObserver(
+                            function(entries) {
+                                var n = entries.length * 2;
+                                var ptr = Module._malloc(n * 4);
+                                var a = HEAPU32.subarray(
+                                    ptr >> 2, (ptr >> 2) + n);
+                                for (var j = 0; j < entries.length; j++) {
+                                    var e = entries[j];
+                                    a[j * 2] = e.target.__bh_track;
+                                    a[j * 2 + 1] = e.isIntersecting ? 1 : 0;
+                                }
+                                Module._run_visibility_changes(ptr, n / 2);
+                            });
+                    }
+                    if (op == 16) {
+                        arg.__bh_track = arg2;
+                        window.__bh_vo.observe(arg);
+                    } else {
+                        window.__bh_vo.unobserve(arg);
+                    }
+                    continue;
+                case 14: // observe
+                case 15: // unobserve
+                    arg2 = u32();
+                    arg = resolve(arg2);
+                    if (!arg) {
+                        continue;
+                    }
+                    if (!window.__bh_io) {
+                        window.__bh_io = new IntersectionObserver(
+                            function(entries) {
+                                entries.forEach(function(e) {
+                                    if (!e.isIntersecting) {
+                                        return;
+                                    }
+                                    window.__bh_io.unobserve(e.target);
+                                    Module._run_visibility_handler(
+                                        e.target.__bh_handle);
+                                });
+                            },
+                            { rootMargin : '100% 0px' });
+                    }
+                    if (op == 14) {
+                        arg.__bh_handle = arg2;
+                        window.__bh_io.observe(arg);
+                    } else {
+                        window.__bh_io.unobserve(arg);
+                    }
+                    continue;
+                case 8: // move_prepend
+                case 9: // move_after
+                    arg = resolve(u32());
+                    break;
+                case 10: // set_attr
+                    arg = str();
+                    arg2 = str();
+                    break;
+                case 3: // remove
+                case 12: // scroll_into_view
+                    break;
+                default:
+                    arg = str();
+                    if (clone) {
+                        arg = clone;
+                        clone = null;
+                    }
+                }
+
+                // Nothing we can do with missing elements
+                if (!el) {
+                    continue;
+                }
+
+                switch (op) {
+                case 1:
+                    insert('beforebegin', arg);
+                    break;
+                case 2:
+                    insert('afterend', arg);
+                    break;
+                case 3:
+                    el.parentNode.removeChild(el);
+                    el = null;
+                    break;
+                case 4:
+                    el.outerHTML = arg;
+                    break;
+                case 5:
+                    el.innerHTML = arg;
+                    break;
+                case 6:
+                    insert('beforeend', arg);
+                    break;
+                case 7:
+                    insert('afterbegin', arg);
+                    break;
+                case 8:
+                    if (arg) {
+                        el.insertBefore(arg, el.firstChild);
+                    }
+                    break;
+                case 9:
+                    if (arg) {
+                        el.parentNode.insertBefore(arg, el.nextSibling);
+                    }
+                    break;
+                case 10:
+                    el.setAttribute(arg, arg2);
+                    break;
+                case 11:
+                    el.removeAttribute(arg);
+                    break;
+                case 12:
+                    el.scrollIntoView();
+                    break;
+                }
+            }
+
+            // Drop references to elements no longer in the DOM, so they can be
+            // garbage collected
+            if (els.size > window.__bh_sweep_at) {
+                els.forEach(function(e, h) {
+                    if (!e.isConnected) {
+                        els.delete(h);
+                    }
+                });
+                window.__bh_sweep_at = Math.max(1 << 10, els.size * 2);
+            }
+        },
+        buf.data(), buf.size());
+    buf.clear();
+}
 }
@@ -1,46 +1,124 @@
 #pragma once
 
+#include "handle.hh"
 #include <functional>
 #include <string>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace brunhild {
+// Instance of a DOM template registered with define_template(). Inserted by
+// cloning the template and filling in its elements, instead of parsing HTML.
+struct TemplateInstance {
+    // Values of a template element
+    struct Element {
+        Handle handle = 0;
+        std::vector<std::pair<std::string, std::string>> attrs;
+
+        // Inner HTML. Only used for elements without children in the template.
+        std::string inner_html;
+    };
+
+    uint32_t id = 0; // Template ID
+    std::vector<Element> elements; // In preorder of the template's elements
+};
+
+// Node to insert, either as HTML or as a template instance
+typedef std::variant<std::string, TemplateInstance> Fragment;
+
+// Register a template of a single element with its subtree, that is
+// instantiated with template.content.cloneNode(). The HTML must not contain
+// any text outside of the leaf elements, that are filled by instances.
+// Returns the ID of the template.
+uint32_t define_template(std::string html);
+
 // Append a node to a parent
-void append(std::string id, std::string html);
+void append(Handle parent, Fragment);
 
 // Prepend a node to a parent
-void prepend(std::string id, std::string html);
+void prepend(Handle parent, Fragment);
 
 // Move child node to the front of the parent
-void move_prepend(std::string parent_id, std::string child_id);
+void move_prepend(Handle parent, Handle child);
 
 // Move child node after a sibling in the parent
-void move_after(std::string sibling_id, std::string child_id);
+void move_after(Handle sibling, Handle child);
 
 // Insert a node before a sibling
-void before(std::string id, std::string html);
+void before(Handle sibling, Fragment);
 
 // Insert a node after a sibling
-void after(std::string id, std::string html);
+void after(Handle sibling, Fragment);
 
 // Set inner html of an element
-void set_inner_html(std::string id, std::string html);
+void set_inner_html(Handle, std::string html);
 
 // Set outer html of an element
-void set_outer_html(std::string id, std::string html);
+void set_outer_html(Handle, std::string html);
 
 // Remove an element
-void remove(std::string id);
+void remove(Handle);
 
 // Set an element attribute to a value
-void set_attr(std::string id, std::string key, std::string val);
+void set_attr(Handle, std::string key, std::string val);
 
 // Remove an element attribute
-void remove_attr(std::string id, std::string key);
+void remove_attr(Handle, std::string key);
 
 // Scroll and element into the viewport
-void scroll_into_view(std::string id);
+void scroll_into_view(Handle);
+
+// Run fn once, when the element comes within one viewport height of the
+// viewport. Observation of the element starts on the next flush(), so the
+// element may still be pending insertion.
+void on_visible(Handle, std::function<void()> fn);
+
+// Cancel a pending on_visible() handler of an element
+void cancel_on_visible(Handle);
+
+// Report changes of the element's intersection with the viewport to the
+// visibility listener, until untrack_visibility(). Tracking starts on the next
+// flush(), so the element may still be pending insertion.
+void track_visibility(Handle);
+
+// Stop tracking the visibility of an element
+void untrack_visibility(Handle);
+
+// Set the function receiving visibility changes of tracked elements. Changes
+// are passed in batches of n interleaved (handle, visible) records, at most
+// once per frame.
+void set_visibility_listener(void (*)(const uint32_t* records, size_t n));
+
+// Overloads for elements with fixed DOM IDs not managed by brunhild
+
+inline void append(const std::string& id, std::string html)
+{
+    append(named_handle(id), std::move(html));
+}
+
+inline void prepend(const std::string& id, std::string html)
+{
+    prepend(named_handle(id), std::move(html));
+}
+
+inline void set_inner_html(const std::string& id, std::string html)
+{
+    set_inner_html(named_handle(id), std::move(html));
+}
+
+inline void set_outer_html(const std::string& id, std::string html)
+{
+    set_outer_html(named_handle(id), std::move(html));
+}
+
+inline void scroll_into_view(const std::string& id)
+{
+    scroll_into_view(named_handle(id));
+}
 
-// Flush all pending DOM mutations
+// Patch all scheduled views and flush all pending DOM mutations. Run on every
+// animation frame.
 extern "C" void flush();
 
 // Function to run before flushing DOM updates. Is run on each call of flush().
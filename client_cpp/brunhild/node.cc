@@ -1,23 +1,169 @@
 #include "node.hh"
 #include "mutations.hh"
 #include "util.hh"
-
-static unsigned long long id_counter = 0;
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <unordered_set>
 
 namespace brunhild {
 
-std::string new_id()
-{
-    std::ostringstream s;
-    s << "bh-" << id_counter++;
-    return s.str();
-}
-
 std::string HTMLWriter::html()
 {
     Rope s;
     write_html(s);
-    return s.str();
+    return s.take();
+}
+
+// Names of common attributes, that are interned without allocating. Must be
+// kept sorted.
+static constexpr std::array<std::string_view, 27> common_attrs = { "action",
+    "alt", "autoplay", "checked", "class", "controls", "data-id", "decoding",
+    "download", "fetchpriority", "height", "hidden", "href", "id", "loading",
+    "loop", "method", "name", "placeholder", "rel", "required", "src", "style",
+    "target", "title", "type", "value" };
+
+std::string_view intern_attr(std::string_view name)
+{
+    auto it = std::lower_bound(common_attrs.begin(), common_attrs.end(), name);
+    if (it != common_attrs.end() && *it == name) {
+        return *it;
+    }
+
+    // Node-based container, so references to elements are stable
+    static std::unordered_set<std::string> pool;
+    return *pool.emplace(name).first;
+}
+
+Attrs::Attrs(std::initializer_list<Attr> attrs)
+{
+    for (auto& a : attrs) {
+        (*this)[a.first] = a.second;
+    }
+}
+
+Attrs::Attrs(const Attrs& other) { *this = other; }
+
+Attrs::Attrs(Attrs&& other) noexcept { *this = std::move(other); }
+
+Attrs& Attrs::operator=(const Attrs& other)
+{
+    if (this == &other) {
+        return *this;
+    }
+    spilled = other.spilled;
+    if (spilled) {
+        heap = other.heap;
+        local_size = 0;
+    } else {
+        heap.clear();
+        local_size = other.local_size;
+        std::copy(other.local, other.local + local_size, local);
+    }
+    return *this;
+}
+
+Attrs& Attrs::operator=(Attrs&& other) noexcept
+{
+    if (this == &other) {
+        return *this;
+    }
+    spilled = other.spilled;
+    if (spilled) {
+        heap = std::move(other.heap);
+        local_size = 0;
+    } else {
+        heap.clear();
+        local_size = other.local_size;
+        std::move(other.local, other.local + local_size, local);
+    }
+    other.clear();
+    return *this;
+}
+
+const Attr* Attrs::lower_bound(std::string_view key) const
+{
+    return std::lower_bound(begin(), end(), key,
+        [](const Attr& a, std::string_view key) { return a.first < key; });
+}
+
+Attrs::iterator Attrs::find(std::string_view key)
+{
+    return const_cast<iterator>(static_cast<const Attrs*>(this)->find(key));
+}
+
+Attrs::const_iterator Attrs::find(std::string_view key) const
+{
+    auto it = lower_bound(key);
+    if (it != end() && it->first == key) {
+        return it;
+    }
+    return end();
+}
+
+const std::string& Attrs::at(std::string_view key) const
+{
+    auto it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("attribute not found");
+    }
+    return it->second;
+}
+
+std::string& Attrs::operator[](std::string_view key)
+{
+    const size_t i = lower_bound(key) - begin();
+    if (i != size() && data()[i].first == key) {
+        return data()[i].second;
+    }
+    return insert(i, key).second;
+}
+
+Attr& Attrs::insert(size_t i, std::string_view key)
+{
+    key = intern_attr(key);
+    if (!spilled && local_size == inline_capacity) {
+        heap.reserve(inline_capacity * 2);
+        for (auto& a : local) {
+            heap.push_back(std::move(a));
+        }
+        local_size = 0;
+        spilled = true;
+    }
+    if (spilled) {
+        return *heap.insert(heap.begin() + i, { key, {} });
+    }
+
+    for (size_t j = local_size; j > i; j--) {
+        local[j] = std::move(local[j - 1]);
+    }
+    local[i] = { key, {} };
+    local_size++;
+    return local[i];
+}
+
+void Attrs::erase(std::string_view key)
+{
+    auto it = find(key);
+    if (it == end()) {
+        return;
+    }
+    if (spilled) {
+        heap.erase(heap.begin() + (it - heap.data()));
+        return;
+    }
+    std::move(it + 1, end(), it);
+    local[--local_size] = {};
+}
+
+void Attrs::clear()
+{
+    for (size_t i = 0; i < local_size; i++) {
+        local[i] = {};
+    }
+    local_size = 0;
+    heap = {};
+    spilled = false;
 }
 
 void Attrs::write_html(Rope& s)
@@ -30,44 +176,58 @@ void Attrs::write_html(Rope& s)
     }
 }
 
-void Attrs::patch(Attrs&& attrs)
+void Attrs::patch(Handle h, Attrs&& attrs)
 {
-    const auto id = (*this)["id"];
     bool patched = false;
 
-    // Attributes added or changed
-    for (auto & [ key, val ] : attrs) {
-        if (key != "id" && (!count(key) || at(key) != val)) {
-            set_attr(id, key, val);
-            patched = true;
-        }
-    }
-
-    // Attributes removed
-    for (auto & [ key, _ ] : *this) {
-        if (key != "id" && !attrs.count(key)) {
-            remove_attr(id, key);
-            patched = true;
+    // Both sets are sorted by key, so a single merge pass finds all added,
+    // changed and removed attributes
+    const Attr *old_it = begin(), *old_end = end();
+    const Attr *new_it = attrs.begin(), *new_end = attrs.end();
+    while (old_it != old_end || new_it != new_end) {
+        if (new_it == new_end
+            || (old_it != old_end && old_it->first < new_it->first)) {
+            // Attribute removed
+            if (old_it->first != "id") {
+                remove_attr(h, std::string(old_it->first));
+                patched = true;
+            }
+            old_it++;
+        } else if (old_it == old_end || new_it->first < old_it->first) {
+            // Attribute added
+            if (new_it->first != "id") {
+                set_attr(h, std::string(new_it->first), new_it->second);
+                patched = true;
+            }
+            new_it++;
+        } else {
+            // Interned keys are equal
+            if (old_it->second != new_it->second && new_it->first != "id") {
+                set_attr(h, std::string(new_it->first), new_it->second);
+                patched = true;
+            }
+            old_it++;
+            new_it++;
         }
     }
 
     if (patched) {
-        *this = attrs;
-        (*this)["id"] = id;
+        *this = std::move(attrs);
+        erase("id");
     }
 }
 
 void Node::write_html(Rope& s)
 {
     s << '<' << tag;
+    if (handle) {
+        s << " id=\"";
+        write_handle_id(s, handle);
+        s << '"';
+    }
     attrs.write_html(s);
     s << '>';
 
-    // These should be left empty and unterminated
-    if (tag == "br" || tag == "wbr") {
-        return;
-    }
-
     if (inner_html) {
         s << *inner_html;
     } else {
@@ -76,7 +236,10 @@ void Node::write_html(Rope& s)
         }
     }
 
-    s << "</" << tag << '>';
+    // Void elements must be left unterminated
+    if (!tag.is_void()) {
+        s << "</" << tag << '>';
+    }
 }
 
 void Node::stringify_subtree()
@@ -85,17 +248,34 @@ void Node::stringify_subtree()
     for (auto& ch : children) {
         ch.write_html(s);
     }
-    inner_html = s.str();
+    inner_html = s.take();
     children.clear();
 }
 
 void Node::clear()
 {
-    tag.clear();
+    tag = Tag();
     attrs.clear();
     children.clear();
     inner_html = std::nullopt;
+    handle = 0;
+    key.clear();
 }
 
 void Node::hide() { attrs["hide"] = ""; }
+
+void Node::adopt()
+{
+    if (children.get_allocator().is_arena()) {
+        Children heap(Allocator<Node>(nullptr));
+        heap.reserve(children.size());
+        for (auto& ch : children) {
+            heap.push_back(std::move(ch));
+        }
+        children = std::move(heap);
+    }
+    for (auto& ch : children) {
+        ch.adopt();
+    }
+}
 }
@@ -1,17 +1,18 @@
 #pragma once
 
+#include "arena.hh"
+#include "handle.hh"
+#include "tag.hh"
 #include "util.hh"
+#include <initializer_list>
 #include <optional>
 #include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 namespace brunhild {
 
-// Generate a new unique element ID
-std::string new_id();
-
 // Helper for serializing to HTML
 class HTMLWriter {
 public:
@@ -22,37 +23,133 @@ public:
     virtual void write_html(Rope&) = 0;
 };
 
-// Element attributes
-class Attrs : public std::unordered_map<std::string, std::string>,
-              public HTMLWriter {
-    typedef std::unordered_map<std::string, std::string> Base;
-    using Base::Base;
+// Returns a view of an interned copy of an attribute name. Interned names are
+// never freed, so the view remains valid for the lifetime of the program.
+std::string_view intern_attr(std::string_view name);
+
+// Element attribute. The key is always interned.
+struct Attr {
+    std::string_view first;
+    std::string second;
+
+    Attr() = default;
+
+    Attr(std::string_view key, std::string val)
+        : first(key)
+        , second(std::move(val))
+    {
+    }
+
+    // Integer values are formatted without std::to_string()
+    template <class T,
+        class = std::enable_if_t<std::is_integral_v<T>
+            && !std::is_same_v<T, bool> && !std::is_same_v<T, char>>>
+    Attr(std::string_view key, T val)
+        : first(key)
+        , second(int_to_string(val))
+    {
+    }
+};
 
+// Element attributes. Stored as a flat vector sorted by key. Up to
+// inline_capacity attributes are stored inline without any heap allocations.
+class Attrs : public HTMLWriter {
 public:
+    typedef Attr* iterator;
+    typedef const Attr* const_iterator;
+
+    // Number of attributes stored without allocating
+    static constexpr size_t inline_capacity = 3;
+
+    Attrs() = default;
+    Attrs(std::initializer_list<Attr>);
+    Attrs(const Attrs&);
+    Attrs(Attrs&&) noexcept;
+    Attrs& operator=(const Attrs&);
+    Attrs& operator=(Attrs&&) noexcept;
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + size(); }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size(); }
+
+    size_t size() const { return spilled ? heap.size() : local_size; }
+    bool empty() const { return !size(); }
+
+    // Returns iterator to attribute with key or end()
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+
+    // Returns 1, if attribute with key exists, 0 otherwise
+    size_t count(std::string_view key) const { return find(key) != end(); }
+
+    // Returns value of an attribute, that must exist
+    const std::string& at(std::string_view key) const;
+
+    // Returns value of an attribute. Inserts an empty one, if none exists.
+    std::string& operator[](std::string_view key);
+
+    // Remove attribute by key, if any
+    void erase(std::string_view key);
+
+    // Remove all attributes and free any heap storage
+    void clear();
+
     // Write attrs as HTML to stream
     void write_html(Rope&);
 
-    // Diff attributes with new value and apply patches to the DOM
-    void patch(Attrs&& attrs);
+    // Diff attributes with new value and apply patches to the DOM element.
+    // The "id" attribute is ignored.
+    void patch(Handle, Attrs&& attrs);
+
+private:
+    Attr local[inline_capacity];
+    std::vector<Attr> heap;
+    uint8_t local_size = 0;
+    bool spilled = false; // Attributes are stored in heap
+
+    Attr* data() { return spilled ? heap.data() : local; }
+    const Attr* data() const { return spilled ? heap.data() : local; }
+
+    // Returns first attribute with a key not less than key
+    const Attr* lower_bound(std::string_view key) const;
+
+    // Insert attribute with interned key at position i and return it
+    Attr& insert(size_t i, std::string_view key);
 };
 
+class Node;
+
+// Subtree of a Node. Allocated from the render arena, when constructed inside
+// a RenderScope.
+typedef std::vector<Node, Allocator<Node>> Children;
+
 // Represents an HTML element. Can be used to construct node trees more easily.
 class Node : public HTMLWriter {
 public:
     // Tag of the Element
-    std::string tag;
+    Tag tag;
 
     // Attributes and properties of the Element
     Attrs attrs;
 
     // Children of the element
-    std::vector<Node> children;
+    Children children;
 
     // Inner HTML of the Element. If set, children are ignored
     std::optional<std::string> inner_html;
 
+    // Handle of the DOM element. Assigned, when the Node is managed by a
+    // VirtualView. Takes precedence over any "id" attribute.
+    Handle handle = 0;
+
+    // Optional key identifying the Node among its siblings. If all children of
+    // a Node have keys, they are matched by key instead of position, when
+    // patching, and only inserted, removed or moved nodes cause DOM mutations.
+    std::string key;
+
     // Creates a Node with optional attributes and children
-    Node(std::string tag, Attrs attrs = {}, std::vector<Node> children = {})
+    Node(Tag tag, Attrs attrs = {}, Children children = {})
         : tag(tag)
         , attrs(attrs)
         , children(children)
@@ -61,7 +158,7 @@ public:
 
     // Creates a Node with html set as the inner contents.
     // Escaped specifies, if the text should be escaped.
-    Node(std::string tag, Attrs attrs, std::string html, bool escape = false)
+    Node(Tag tag, Attrs attrs, std::string html, bool escape = false)
         : tag(tag)
         , attrs(attrs)
         , inner_html(escape ? brunhild::escape(html) : html)
@@ -70,7 +167,7 @@ public:
 
     // Creates a Node with html set as the inner contents.
     // Escaped specifies, if the text should be escaped.
-    Node(std::string tag, std::string html, bool escape = false)
+    Node(Tag tag, std::string html, bool escape = false)
         : Node(tag, {}, html, escape)
     {
     }
@@ -91,8 +188,9 @@ public:
 
     // Shortcut for setting a node as hidden
     void hide();
-};
 
-// Subtree of a Node
-typedef std::vector<Node> Children;
+    // Move any arena-allocated children in the subtree to the heap, so the
+    // subtree can outlive the current RenderScope
+    void adopt();
+};
 }
@@ -0,0 +1,133 @@
+#include "profile.hh"
+#include "util.hh"
+#include <emscripten/bind.h>
+#include <vector>
+
+namespace brunhild::profile {
+bool enabled = false;
+
+// Minimum interval between overlay updates in milliseconds
+static const double overlay_interval = 250;
+
+static double overlay_updated = 0;
+
+// All registered metrics in definition order
+static std::vector<Metric*>& registry()
+{
+    static std::vector<Metric*> r;
+    return r;
+}
+
+Metric::Metric(const char* name)
+    : name(name)
+{
+    registry().push_back(this);
+}
+
+Metric boundary("boundary");
+
+void Metric::finish(double start)
+{
+    if (!enabled) {
+        return;
+    }
+    const double end = emscripten_get_now();
+    frame_count++;
+    frame_time += end - start;
+    EM_ASM_INT(
+        {
+            try {
+                performance.measure(
+                    UTF8ToString($0), ({ start : $1, end : $2 }));
+            } catch (e) {
+                // User Timing Level 3 not supported
+            }
+        },
+        name, start, end);
+}
+
+void end_frame()
+{
+    if (!enabled) {
+        return;
+    }
+
+    for (auto m : registry()) {
+        if (m->frame_count) {
+            m->total_count += m->frame_count;
+            m->total_time += m->frame_time;
+            m->last_count = m->frame_count;
+            m->last_time = m->frame_time;
+            m->frame_count = 0;
+            m->frame_time = 0;
+        }
+    }
+
+    const double now = emscripten_get_now();
+    if (now - overlay_updated < overlay_interval) {
+        return;
+    }
+    overlay_updated = now;
+
+    // Last recorded frame of each metric as "name: calls (ms)" lines
+    Rope s;
+    for (auto m : registry()) {
+        if (!m->last_count) {
+            continue;
+        }
+        s << m->name << ": " << m->last_count;
+        if (m->last_time) {
+            const unsigned us = m->last_time * 1000;
+            s << " (" << us / 1000 << '.' << us / 100 % 10 << us / 10 % 10
+              << " ms)";
+        }
+        s << '\n';
+    }
+    const auto text = s.take();
+
+    // Written directly and not through the mutation buffer, so the overlay
+    // does not skew the metrics it displays
+    EM_ASM_INT(
+        {
+            var el = document.getElementById('bh-profile');
+            if (!el) {
+                el = document.createElement('pre');
+                el.id = 'bh-profile';
+                el.style.cssText = 'position:fixed;right:0;bottom:0;'
+                    + 'z-index:1000;margin:0;padding:4px;font-size:11px;'
+                    + 'background:rgba(0,0,0,.7);color:#fff;'
+                    + 'pointer-events:none';
+                document.body.appendChild(el);
+            }
+            el.textContent = UTF8ToString($0) + 'heap: '
+                + (HEAPU8.length >> 20) + ' MiB';
+        },
+        text.data());
+}
+
+std::string totals()
+{
+    Rope s;
+    s << '{';
+    bool first = true;
+    for (auto m : registry()) {
+        if (!m->total_count) {
+            continue;
+        }
+        if (!first) {
+            s << ',';
+        }
+        first = false;
+        const unsigned long us = m->total_time * 1000;
+        s << '"' << m->name << "\":[" << m->total_count << ',' << us / 1000
+          << '.' << us / 100 % 10 << us / 10 % 10 << us % 10 << ']';
+    }
+    s << '}';
+    return s.take();
+}
+
+EMSCRIPTEN_BINDINGS(module_profile)
+{
+    emscripten::function("profile_totals", &totals);
+}
+}
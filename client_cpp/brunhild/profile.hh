@@ -0,0 +1,78 @@
+#pragma once
+
+#include <emscripten.h>
+#include <string>
+
+// Lightweight instrumentation of hot paths. Metrics are only collected, if
+// enabled, and are exported through the User Timing API and shown in an
+// overlay, that is updated on each flush().
+namespace brunhild::profile {
+// Enables metric collection and the overlay
+extern bool enabled;
+
+// Current high resolution time in milliseconds or 0, if not enabled
+inline double now() { return enabled ? emscripten_get_now() : 0; }
+
+// Named call counter and timer. Must have static storage duration.
+class Metric {
+public:
+    const char* const name;
+
+    Metric(const char* name);
+
+    // Increment the call counter without timing
+    void count(unsigned n = 1)
+    {
+        if (enabled) {
+            frame_count += n;
+        }
+    }
+
+    // Record a timed call, that started at start, as returned by now()
+    void finish(double start);
+
+private:
+    // Metrics of the current frame
+    unsigned frame_count = 0;
+    double frame_time = 0;
+
+    // Metrics of the last frame, that recorded this metric
+    unsigned last_count = 0;
+    double last_time = 0;
+
+    // Metrics of all closed frames
+    unsigned long total_count = 0;
+    double total_time = 0;
+
+    friend void end_frame();
+    friend std::string totals();
+};
+
+// Calls crossing the JS/wasm boundary
+extern Metric boundary;
+
+// Counts and times the enclosing scope
+class Scope {
+public:
+    Scope(Metric& m)
+        : m(m)
+        , start(now())
+    {
+    }
+
+    ~Scope() { m.finish(start); }
+
+private:
+    Metric& m;
+    const double start;
+};
+
+// Close the metrics of the current frame and update the overlay. Called at
+// the end of flush().
+void end_frame();
+
+// Returns the metrics of all closed frames as a JSON object of
+// {"name": [calls, milliseconds]} entries. Exported to JS as
+// Module.profile_totals() for benchmarks.
+std::string totals();
+}
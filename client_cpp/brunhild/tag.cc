@@ -0,0 +1,80 @@
+#include "tag.hh"
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <unordered_map>
+
+namespace brunhild {
+
+// Names of common tags. Must be kept sorted.
+static constexpr std::array<std::string_view, 52> tag_names = { "", "a",
+    "area", "article", "aside", "audio", "b", "base", "blockquote", "br",
+    "button", "code", "col", "del", "div", "em", "embed", "figcaption",
+    "figure", "footer", "form", "h1", "h2", "h3", "header", "hr", "i", "img",
+    "input", "label", "li", "link", "meta", "nav", "ol", "option", "p",
+    "param", "select", "source", "span", "strong", "sup", "table", "td",
+    "textarea", "th", "time", "tr", "track", "ul", "wbr" };
+
+static constexpr bool is_sorted(const decltype(tag_names)& arr)
+{
+    for (size_t i = 1; i < arr.size(); i++) {
+        if (!(arr[i - 1] < arr[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(is_sorted(tag_names), "tag_names must be sorted");
+
+// Returns the bit of a tag in void_tags
+static constexpr uint64_t tag_bit(std::string_view name)
+{
+    for (size_t i = 0; i < tag_names.size(); i++) {
+        if (tag_names[i] == name) {
+            return uint64_t(1) << i;
+        }
+    }
+    return 0;
+}
+
+// Bitmask of void element tags in tag_names
+static constexpr uint64_t void_tags = tag_bit("area") | tag_bit("base")
+    | tag_bit("br") | tag_bit("col") | tag_bit("embed") | tag_bit("hr")
+    | tag_bit("img") | tag_bit("input") | tag_bit("link") | tag_bit("meta")
+    | tag_bit("param") | tag_bit("source") | tag_bit("track")
+    | tag_bit("wbr");
+static_assert(tag_names.size() <= 64, "void_tags bitmask too small");
+
+// Interned tags not in tag_names. Deque keeps references stable.
+static std::deque<std::string> custom_tags;
+static std::unordered_map<std::string_view, uint16_t> custom_tag_index;
+
+Tag::Tag(std::string_view name)
+{
+    auto it = std::lower_bound(tag_names.begin(), tag_names.end(), name);
+    if (it != tag_names.end() && *it == name) {
+        i = it - tag_names.begin();
+        return;
+    }
+
+    if (auto it = custom_tag_index.find(name); it != custom_tag_index.end()) {
+        i = it->second;
+        return;
+    }
+    i = tag_names.size() + custom_tags.size();
+    custom_tag_index[custom_tags.emplace_back(name)] = i;
+}
+
+std::string_view Tag::name() const
+{
+    if (i < tag_names.size()) {
+        return tag_names[i];
+    }
+    return custom_tags[i - tag_names.size()];
+}
+
+bool Tag::is_void() const
+{
+    return i < tag_names.size() && (void_tags & (uint64_t(1) << i));
+}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "util.hh"
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+namespace brunhild {
+
+// HTML element tag. Stored as a small integer index into a table of tag names.
+// Common tags are resolved against a static table without any allocations.
+// Unknown tags are interned on first use.
+class Tag {
+public:
+    // Empty tag
+    constexpr Tag()
+        : i(0)
+    {
+    }
+
+    Tag(std::string_view name);
+    Tag(const std::string& name)
+        : Tag(std::string_view(name))
+    {
+    }
+    Tag(const char* name)
+        : Tag(std::string_view(name))
+    {
+    }
+
+    // Returns the name of the tag
+    std::string_view name() const;
+
+    // Returns, if the tag is a void element, that must not have a closing tag
+    bool is_void() const;
+
+    bool empty() const { return !i; }
+
+    bool operator==(Tag other) const { return i == other.i; }
+    bool operator!=(Tag other) const { return i != other.i; }
+
+private:
+    uint16_t i;
+};
+
+inline Rope& operator<<(Rope& r, Tag t) { return r << t.name(); }
+}
@@ -1,32 +1,150 @@
+#include "util.hh"
+#include <stdint.h>
+#include <string.h>
 #include <string>
 
 namespace brunhild {
 
-std::string escape(const std::string& s)
+// Buffers of destroyed Ropes retained for reuse
+static std::vector<std::string> rope_buffers;
+
+std::string Rope::acquire_buffer()
 {
-    std::string out;
-    out.reserve(s.size() * 1.1);
-    for (auto ch : s) {
-        switch (ch) {
-        case '&':
-            out += "&amp;";
-            break;
-        case '\'':
-            out += "&#39;"; // "&#39;" is shorter than "&apos;"
-            break;
-        case '<':
-            out += "&lt;";
-            break;
-        case '>':
-            out += "&gt;";
-            break;
-        case '\"':
-            out += "&#34;"; // "&#34;" is shorter than "&quot;"
+    if (rope_buffers.size()) {
+        auto s = std::move(rope_buffers.back());
+        rope_buffers.pop_back();
+        return s;
+    }
+    std::string s;
+    s.reserve(1 << 10);
+    return s;
+}
+
+void Rope::release_buffer(std::string&& s)
+{
+    // Do not retain buffers of huge outputs indefinitely
+    if (s.capacity() < 1 << 10 || s.capacity() > 1 << 20
+        || rope_buffers.size() >= 16) {
+        return;
+    }
+    s.clear();
+    rope_buffers.push_back(std::move(s));
+}
+
+// Returns the escaped form of ch or nullptr, if ch needs no escaping
+static const char* escaped(char ch)
+{
+    switch (ch) {
+    case '&':
+        return "&amp;";
+    case '\'':
+        return "&#39;"; // "&#39;" is shorter than "&apos;"
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    case '\"':
+        return "&#34;"; // "&#34;" is shorter than "&quot;"
+    default:
+        return nullptr;
+    }
+}
+
+// Returns non-zero, if any byte of w equals c
+static inline uint32_t has_byte(uint32_t w, char c)
+{
+    const uint32_t v = w ^ (uint32_t(uint8_t(c)) * 0x01010101u);
+    return (v - 0x01010101u) & ~v & 0x80808080u;
+}
+
+// Returns non-zero, if any byte of w needs escaping. Both the asm.js and wasm
+// builds have native 32 bit integers, so this scans 4 bytes per step.
+static inline uint32_t needs_escaping(uint32_t w)
+{
+    return has_byte(w, '&') | has_byte(w, '\'') | has_byte(w, '<')
+        | has_byte(w, '>') | has_byte(w, '\"');
+}
+
+void escape(std::string& out, std::string_view s)
+{
+    const char* p = s.data();
+    const char* const end = p + s.size();
+    const char* clean = p; // Start of the pending clean span
+
+    while (p < end) {
+        // Skip over words without any characters to escape
+        while (end - p >= 4) {
+            uint32_t w;
+            memcpy(&w, p, 4);
+            if (needs_escaping(w)) {
+                break;
+            }
+            p += 4;
+        }
+        if (p == end) {
             break;
-        default:
-            out += ch;
         }
+
+        if (auto rep = escaped(*p)) {
+            out.append(clean, p - clean);
+            out += rep;
+            clean = p + 1;
+        }
+        p++;
     }
+    out.append(clean, end - clean);
+}
+
+std::string escape(std::string_view s)
+{
+    std::string out;
+    out.reserve(s.size() * 1.1);
+    escape(out, s);
     return out;
 }
+
+std::vector<bool> longest_increasing_subsequence(const std::vector<int>& seq)
+{
+    // Indices of the last elements of the smallest tails of increasing
+    // subsequences of each length
+    std::vector<size_t> tails;
+    // Index of the preceding element in the subsequence for each element
+    std::vector<size_t> prev(seq.size());
+    tails.reserve(seq.size());
+
+    for (size_t i = 0; i < seq.size(); i++) {
+        if (seq[i] < 0) {
+            continue;
+        }
+
+        // Binary search for the first tail not smaller than seq[i]
+        size_t lo = 0, hi = tails.size();
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (seq[tails[mid]] < seq[i]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo) {
+            prev[i] = tails[lo - 1];
+        }
+        if (lo == tails.size()) {
+            tails.push_back(i);
+        } else {
+            tails[lo] = i;
+        }
+    }
+
+    std::vector<bool> mask(seq.size(), false);
+    if (tails.size()) {
+        size_t i = tails.back();
+        for (size_t n = tails.size(); n; n--) {
+            mask[i] = true;
+            i = prev[i];
+        }
+    }
+    return mask;
+}
 }
@@ -9,7 +9,53 @@ namespace brunhild {
 
 // Escape a user-submitted unsafe string to protect against XSS and malformed
 // HTML
-std::string escape(const std::string& s);
+std::string escape(std::string_view s);
+
+// Escape s and append it to out. Clean spans are copied in bulk.
+void escape(std::string& out, std::string_view s);
+
+// Returns a mask of the elements of seq, that form its longest strictly
+// increasing subsequence. Negative elements are never part of the subsequence.
+std::vector<bool> longest_increasing_subsequence(const std::vector<int>& seq);
+
+// Writes the decimal representation of integer n into the buffer ending at end
+// and returns the start of the written digits. The buffer must fit at least
+// int_buffer_size characters.
+template <class T> char* format_int(char* end, T n)
+{
+    static_assert(std::is_integral_v<T> && !std::is_same_v<T, bool>);
+    using U = std::make_unsigned_t<T>;
+    U u = n;
+    bool negative = false;
+    if constexpr (std::is_signed_v<T>) {
+        if (n < 0) {
+            negative = true;
+            u = U(0) - u;
+        }
+    }
+    do {
+        *--end = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (negative) {
+        *--end = '-';
+    }
+    return end;
+}
+
+// Buffer size sufficient for format_int() of any integer type
+constexpr size_t int_buffer_size = 24;
+
+// Returns the decimal representation of an integer. Unlike std::to_string()
+// this does not go through snprintf and the result fits into the small string
+// buffer for most values.
+template <class T> std::string int_to_string(T n)
+{
+    char buf[int_buffer_size];
+    char* const end = buf + int_buffer_size;
+    const char* start = format_int(end, n);
+    return std::string(start, end - start);
+}
 
 // Allows returning the size of a std::string, std::string_view, char or char*
 inline size_t string_size(const std::string& s) { return s.size(); }
@@ -17,63 +63,79 @@ inline size_t string_size(const std::string_view& s) { return s.size(); }
 inline size_t string_size(char sep[[maybe_unused]]) { return 1; }
 inline size_t string_size(const char* sep) { return strlen(sep); }
 
-// Append-only rope data structure for more efficient HTML building
+// Append-only buffer for more efficient HTML building. The contiguous buffers
+// of destroyed Ropes are reused by new Ropes, so short-lived Ropes rarely
+// allocate.
 class Rope {
     template <class T> friend Rope& operator<<(Rope& r, const T& s);
     friend Rope& operator<<(Rope& r, const std::string& s);
     friend Rope& operator<<(Rope& r, std::string_view s);
     friend Rope& operator<<(Rope& r, char s);
     friend Rope& operator<<(Rope& r, const char* s);
+    friend void escape(Rope& r, std::string_view s);
 
 public:
     Rope()
+        : buf(acquire_buffer())
     {
-        parts.reserve(16);
-        // Calling .back() on an empty vector would be UB, so place one part
-        // here
-        parts.emplace_back().reserve(1 << 10);
     }
 
-    // Dumps Rope contents to string
-    std::string str()
+    ~Rope() { release_buffer(std::move(buf)); }
+
+    Rope(const Rope&) = delete;
+    Rope& operator=(const Rope&) = delete;
+
+    // Copies Rope contents to string
+    std::string str() const { return buf; }
+
+    // Moves Rope contents out without copying and leaves the Rope empty.
+    // Prefer this over str() for passing rendered HTML on.
+    std::string take()
     {
-        size_t cap = 0;
-        for (auto& s : parts) {
-            cap += s.size();
-        }
-        std::string re;
-        re.reserve(cap);
-        for (auto& s : parts) {
-            re += s;
-        }
+        std::string re = std::move(buf);
+        buf = acquire_buffer();
         return re;
     }
 
+    // View of the current contents, valid until the next write
+    std::string_view view() const { return buf; }
+
 private:
-    std::vector<std::string> parts;
+    std::string buf;
 
     template <class T> Rope& append(const T& s)
     {
-        std::string* last = &parts.back();
-        if (last->size() + string_size(s) > last->capacity()) {
-            const auto last_cap = last->capacity();
-            last = &parts.emplace_back();
-            last->reserve(last_cap << 1);
-        }
-        *last += s;
+        buf += s;
         return *this;
     }
+
+    // Get a cleared buffer from the pool or allocate a new one
+    static std::string acquire_buffer();
+
+    // Return a buffer to the pool
+    static void release_buffer(std::string&&);
 };
 
+// Escape s and append it to the Rope without an intermediate string
+inline void escape(Rope& r, std::string_view s) { escape(r.buf, s); }
+
 // inline prevents these from colliding with the template during linking
 inline Rope& operator<<(Rope& r, const std::string& s) { return r.append(s); }
 inline Rope& operator<<(Rope& r, std::string_view s) { return r.append(s); }
 inline Rope& operator<<(Rope& r, char s) { return r.append(s); }
 inline Rope& operator<<(Rope& r, const char* s) { return r.append(s); }
 
-// Append anything convertable with std::to_string() to Rope
+// Append anything convertable with std::to_string() to Rope. Integers are
+// formatted in place without allocating.
 template <class T> inline Rope& operator<<(Rope& r, const T& s)
 {
-    return r.append(std::to_string(s));
+    if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+        char buf[int_buffer_size];
+        char* const end = buf + int_buffer_size;
+        const char* start = format_int(end, s);
+        return r.append(std::string_view(start, end - start));
+    } else {
+        return r.append(std::to_string(s));
+    }
 }
 }
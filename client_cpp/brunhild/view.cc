@@ -2,6 +2,7 @@
 #include "../src/util.hh"
 #include "events.hh"
 #include "mutations.hh"
+#include "profile.hh"
 #include <algorithm>
 #include <emscripten.h>
 #include <emscripten/bind.h>
@@ -13,50 +14,50 @@ using std::string;
 
 namespace brunhild {
 
+static profile::Metric patch_metric("patch"), patch_node_metric("patch_node");
+
 View::View(std::string id)
-    : id(id)
+    : handle(id.empty() ? new_handle() : named_handle(id))
+    , id(id.empty() ? handle_id(handle) : id)
 {
 }
 
-View::~View() { remove_event_handlers(); }
+// Views pending a patch in order of scheduling. Views are only patched, if
+// still in scheduled_set, as they might have been destroyed since.
+static std::vector<View*> scheduled;
+static std::unordered_set<View*> scheduled_set;
 
-void View::on(std::string type, std::string selector, Handler handler)
+View::~View()
 {
-    // Need to prepend root node ID to all selectors
-    Rope s;
-    if (selector != "") {
-        std::string_view view = { selector };
-        size_t i;
-        while (1) {
-            i = view.find(',');
-            auto frag = view.substr(0, i);
-
-            // If this comma is inside a selector like :not(.foo,.bar), skip the
-            // appropriate amount of closing brackets. Assumes correct CSS
-            // syntax.
-            const auto opening = std::count(frag.begin(), frag.end(), '(');
-            if (opening) {
-                const auto closing = std::count(frag.begin(), frag.end(), ')');
-                if (closing != opening) {
-                    i = view.find(',', view.find(")", i, closing - opening));
-                    frag = view.substr(0, i);
-                }
-            }
+    scheduled_set.erase(this);
+    remove_event_handlers();
+}
 
-            s << '#' << id << ' ' << frag;
-            if (i != std::string::npos) {
-                view = view.substr(i + 1);
-                s << ',';
-            } else {
-                break;
+void View::schedule_patch()
+{
+    if (scheduled_set.insert(this).second) {
+        scheduled.push_back(this);
+    }
+}
+
+void patch_scheduled()
+{
+    // Patching can schedule more patches
+    std::vector<View*> views;
+    while (scheduled.size()) {
+        views.swap(scheduled);
+        for (auto v : views) {
+            if (scheduled_set.erase(v)) {
+                v->patch();
             }
         }
-    } else {
-        // Select all children, if no selector
-        s << '#' << id << " *";
+        views.clear();
     }
+}
 
-    event_handlers.push_back(register_handler(type, handler, s.str()));
+void View::on(std::string type, std::string selector, Handler handler)
+{
+    event_handlers.push_back(register_handler(type, handler, selector, id));
 }
 
 emscripten::val View::el()
@@ -66,9 +67,9 @@ emscripten::val View::el()
     return val::global("document").call<val>("getElementById", id);
 }
 
-void View::scroll_into_view() { brunhild::scroll_into_view(id); }
+void View::scroll_into_view() { brunhild::scroll_into_view(handle); }
 
-void View::remove() { brunhild::remove(id); }
+void View::remove() { brunhild::remove(handle); }
 
 void View::remove_event_handlers()
 {
@@ -80,9 +81,14 @@ void View::remove_event_handlers()
 
 void VirtualView::ensure_id(Node& node)
 {
-    if (!node.attrs.count("id")) {
-        node.attrs["id"] = new_id();
+    if (!node.handle) {
+        if (node.attrs.count("id")) {
+            node.handle = named_handle(node.attrs.at("id"));
+        } else {
+            node.handle = new_handle();
+        }
     }
+    node.attrs.erase("id");
     for (auto& ch : node.children) {
         ensure_id(ch);
     }
@@ -97,38 +103,124 @@ void VirtualView::write_html(Rope& s)
     saved.write_html(s);
 }
 
+// Maximum number of registered templates. Views with further structures are
+// inserted as HTML.
+static const size_t max_templates = 64;
+
+// Template IDs by template HTML
+static std::unordered_map<std::string, uint32_t> templates;
+
+// Write the template HTML of the first depth levels of a node's subtree to s
+// and the values of the node and its subtree to inst
+static void write_template(
+    Rope& s, TemplateInstance& inst, Node& n, size_t depth)
+{
+    s << '<' << n.tag << '>';
+    auto& el = inst.elements.emplace_back();
+    el.handle = n.handle;
+    el.attrs.reserve(n.attrs.size());
+    for (auto& [key, val] : n.attrs) {
+        el.attrs.emplace_back(key, val);
+    }
+
+    if (n.inner_html) {
+        el.inner_html = *n.inner_html;
+    } else if (depth == 1) {
+        Rope inner;
+        for (auto& ch : n.children) {
+            ch.write_html(inner);
+        }
+        el.inner_html = inner.take();
+    } else {
+        for (auto& ch : n.children) {
+            write_template(s, inst, ch, depth - 1);
+        }
+    }
+
+    if (!n.tag.is_void()) {
+        s << "</" << n.tag << '>';
+    }
+}
+
+Fragment VirtualView::fragment()
+{
+    const auto depth = template_depth();
+    if (!depth) {
+        return html();
+    }
+    if (!is_initialized) {
+        init();
+        is_initialized = true;
+    }
+
+    Rope s;
+    TemplateInstance inst;
+    write_template(s, inst, saved, depth);
+    auto html = s.take();
+    if (auto it = templates.find(html); it != templates.end()) {
+        inst.id = it->second;
+    } else if (templates.size() < max_templates) {
+        inst.id = define_template(html);
+        templates.emplace(std::move(html), inst.id);
+    } else {
+        return this->html();
+    }
+    return inst;
+}
+
 void VirtualView::init()
 {
     saved = render();
-    saved.attrs["id"] = id;
+    saved.adopt();
+    saved.handle = handle;
     ensure_id(saved);
 }
 
 void VirtualView::patch()
 {
+    // The rendered tree is temporary. Any parts retained in saved are adopted
+    // into the heap by patch_node().
+    profile::Scope profile_scope(patch_metric);
+    RenderScope scope;
     auto node = render();
-    node.attrs["id"] = id;
+    node.handle = handle;
     patch_node(saved, std::move(node));
 }
 
 void VirtualView::patch_node(Node& old, Node&& node)
 {
+    patch_node_metric.count();
     // Completely replace node and subtree
     const auto replace = old.tag != node.tag
-        || (node.attrs.count("id")
-               && node.attrs.at("id") != old.attrs.at("id"));
+        || (!node.handle && node.attrs.count("id")
+               && named_handle(node.attrs.at("id")) != old.handle);
     if (replace) {
-        const auto old_id = old.attrs.at("id");
+        const auto old_handle = old.handle;
         old = std::move(node);
+        old.adopt();
         ensure_id(old);
-        set_outer_html(old_id, old.html());
+        set_outer_html(old_handle, old.html());
         return;
     }
 
-    old.attrs.patch(std::move(node.attrs));
+    old.attrs.patch(old.handle, std::move(node.attrs));
     patch_children(old, std::move(node));
 }
 
+// Returns, if all nodes are keyed and there is at least one node
+static bool is_keyed(const Children& children)
+{
+    if (children.empty()) {
+        return false;
+    }
+    for (auto& ch : children) {
+        if (ch.key.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void VirtualView::patch_children(Node& old, Node&& node)
 {
     // HTML string contents can not be addressed by ID and require special
@@ -137,7 +229,7 @@ void VirtualView::patch_children(Node& old, Node&& node)
         // Hot path
         if (node.inner_html) {
             if (*old.inner_html != *node.inner_html) {
-                set_inner_html(old.attrs.at("id"), *node.inner_html);
+                set_inner_html(old.handle, *node.inner_html);
                 old.inner_html = move(node.inner_html);
             }
             return;
@@ -149,16 +241,22 @@ void VirtualView::patch_children(Node& old, Node&& node)
             ch.write_html(s);
         }
         old.children = move(node.children);
+        old.adopt();
         old.inner_html = std::nullopt;
-        set_inner_html(old.attrs.at("id"), s.str());
+        set_inner_html(old.handle, s.take());
         return;
     } else if (node.inner_html) {
-        set_inner_html(old.attrs.at("id"), *node.inner_html);
+        set_inner_html(old.handle, *node.inner_html);
         old.children.clear();
         old.inner_html = move(node.inner_html);
         return;
     }
 
+    if (is_keyed(old.children) && is_keyed(node.children)) {
+        patch_keyed_children(old, std::move(node));
+        return;
+    }
+
     // Diff existing nodes
     for (size_t i = 0; i < old.children.size() && i < node.children.size();
          i++) {
@@ -171,14 +269,75 @@ void VirtualView::patch_children(Node& old, Node&& node)
         while (i < node.children.size()) {
             auto& ch = node.children[i++];
             ensure_id(ch);
-            append(old.attrs.at("id"), ch.html());
+            append(old.handle, ch.html());
             old.children.push_back(std::move(ch));
+            old.children.back().adopt();
         }
     } else { // Remove Nodes from the end
         while (diff++ < 0) {
-            brunhild::remove(old.children.back().attrs.at("id"));
+            brunhild::remove(old.children.back().handle);
             old.children.pop_back();
         }
     }
 }
+
+void VirtualView::patch_keyed_children(Node& old, Node&& node)
+{
+    std::unordered_map<std::string, size_t> old_index;
+    old_index.reserve(old.children.size());
+    for (size_t i = 0; i < old.children.size(); i++) {
+        old_index[old.children[i].key] = i;
+    }
+
+    // Positions of matched nodes in the old children or -1 for new nodes
+    std::vector<int> sources(node.children.size(), -1);
+    std::vector<bool> matched(old.children.size(), false);
+    for (size_t i = 0; i < node.children.size(); i++) {
+        if (auto it = old_index.find(node.children[i].key);
+            it != old_index.end() && !matched[it->second]) {
+            sources[i] = it->second;
+            matched[it->second] = true;
+        }
+    }
+
+    for (size_t i = 0; i < old.children.size(); i++) {
+        if (!matched[i]) {
+            brunhild::remove(old.children[i].handle);
+        }
+    }
+
+    // Nodes, that keep their relative order, do not need to be moved
+    const auto stable = longest_increasing_subsequence(sources);
+
+    Children children(Allocator<Node>(nullptr));
+    children.reserve(node.children.size());
+    Handle prev = 0;
+    for (size_t i = 0; i < node.children.size(); i++) {
+        auto& ch = node.children[i];
+        if (sources[i] == -1) {
+            ensure_id(ch);
+            if (prev) {
+                after(prev, ch.html());
+            } else {
+                prepend(old.handle, ch.html());
+            }
+            auto& c = children.emplace_back(std::move(ch));
+            c.adopt();
+            prev = c.handle;
+            continue;
+        }
+
+        auto& c = children.emplace_back(std::move(old.children[sources[i]]));
+        if (!stable[i]) {
+            if (prev) {
+                move_after(prev, c.handle);
+            } else {
+                move_prepend(old.handle, c.handle);
+            }
+        }
+        patch_node(c, std::move(ch));
+        prev = c.handle;
+    }
+    old.children = std::move(children);
+}
 }
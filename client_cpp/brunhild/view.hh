@@ -5,6 +5,7 @@
 #include "node.hh"
 #include <emscripten.h>
 #include <emscripten/val.h>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -13,6 +14,10 @@
 
 namespace brunhild {
 
+// Patch all views scheduled with View::schedule_patch() in order of
+// scheduling. Called by flush() right before DOM mutations are applied.
+void patch_scheduled();
+
 // Base class for views.
 // You are not required to use this class for structureing your applications and
 // can freely build your own abstractions on top of the functions in
@@ -21,11 +26,15 @@ namespace brunhild {
 // handlers to work.
 class View : public HTMLWriter {
 public:
-    // ID of root node
+    // Handle of the root node
+    const Handle handle;
+
+    // DOM ID of root node
     const std::string id;
 
-    // Creates new view with an optional root node ID
-    View(std::string id = new_id());
+    // Creates new view with an optional fixed root node ID. If id is empty, a
+    // new handle is generated.
+    View(std::string id = "");
 
     // Remove all event listeners
     virtual ~View();
@@ -35,7 +44,9 @@ public:
     // is  recommended to use register_handler with View collection lookup on
     // your side to reduce DOM event listener count.
     // type: DOM event type (click, hover, ...)
-    // selector: any CSS selector the event target should be matched against
+    // selector: any CSS selector the event target should be matched against.
+    // Only targets inside the view's root element, including the root itself,
+    // are matched. An empty selector matches all of them.
     // handler: handler for a matched event
     void on(std::string type, std::string selector, Handler handler);
 
@@ -49,6 +60,13 @@ public:
     // Can only be called after the view has been inserted into the DOM.
     virtual void patch() = 0;
 
+    // Schedule the view to be patched on the next flush(). Any number of calls
+    // before the next flush result in a single patch.
+    void schedule_patch();
+
+    // Returns the view's DOM subtree for insertion by a parent view
+    virtual Fragment fragment() { return html(); }
+
 protected:
     // Returns the root element of the view
     emscripten::val el();
@@ -70,19 +88,22 @@ private:
 class VirtualView : public View {
 public:
     // Render the root node and its subtree.
-    // The "id" attribute on the root node is ignored and is always set to
-    // View::id.
+    // The "id" attribute on the root node is ignored and the root node always
+    // uses View::handle.
     virtual Node render() = 0;
 
     // Same as html(), but writes to a stream to reduce allocations
     void write_html(Rope&);
 
+    // Returns a template instance, if the view uses templates, or its HTML
+    Fragment fragment();
+
     // Patch the view's subtree against the updated subtree.
     // Can only be called after the view has been inserted into the DOM.
     virtual void patch();
 
     // Creates a new View with an optional specific root node ID.
-    VirtualView(std::string id = new_id())
+    VirtualView(std::string id = "")
         : View(id)
     {
     }
@@ -95,9 +116,16 @@ protected:
     // call
     Node saved;
 
-    // Ensure the Node and it's subtree all have element IDs defined
+    // Ensure the Node and it's subtree all have element handles assigned
     void ensure_id(Node&);
 
+    // Number of levels of the rendered tree, that are cloned from a shared DOM
+    // template, when the view is inserted with fragment(). A template is
+    // registered for each distinct structure of tags of these levels. Only the
+    // attributes and the inner HTML of the deepest elements are transferred
+    // per instance. 0 disables templates.
+    virtual size_t template_depth() const { return 0; }
+
 private:
     bool is_initialized = false;
 
@@ -106,6 +134,9 @@ private:
 
     // Patch element's subtree
     void patch_children(Node& old, Node&& node);
+
+    // Patch element's children, matching them by Node::key
+    void patch_keyed_children(Node& old, Node&& node);
 };
 
 // Simple constant view that renders a Node with its subtree
@@ -118,7 +149,8 @@ public:
 protected:
     void init()
     {
-        saved.attrs["id"] = id;
+        saved.adopt();
+        saved.handle = handle;
         ensure_id(saved);
     }
 };
@@ -150,8 +182,8 @@ protected:
     M* m;
 
     // Render the root node and its subtree, according to model.
-    // The "id" attribute on the root node is ignored and is always set to
-    // View::id.
+    // The "id" attribute on the root node is ignored and the root node always
+    // uses View::handle.
     virtual Node render(M*) = 0;
 };
 
@@ -162,7 +194,7 @@ public:
     const std::string tag;
 
     // Creates a new view with an optional specific root node ID.
-    ParentView(std::string tag, std::string id = new_id())
+    ParentView(std::string tag, std::string id = "")
         : View(id)
         , tag(tag)
     {
@@ -176,7 +208,9 @@ public:
             is_initialized = true;
         }
 
-        s << '<' << tag;
+        s << '<' << tag << " id=\"";
+        write_handle_id(s, View::handle);
+        s << '"';
         saved_attrs.write_html(s);
         s << '>';
         for (auto v : saved) {
@@ -195,10 +229,13 @@ protected:
     // Returns the attributes of the container view
     virtual Attrs attrs() { return {}; };
 
+    // Returns, if the view has rendered its children
+    bool initialized() const { return is_initialized; }
+
     virtual void init()
     {
         saved_attrs = attrs();
-        saved_attrs["id"] = id;
+        saved_attrs.erase("id");
     }
 
 private:
@@ -221,18 +258,153 @@ public:
             saved.push_back(create_child(m));
         }
         ParentView<V>::init();
+        if (filter_fn) {
+            for (auto& v : saved) {
+                apply_filter(*v);
+            }
+        }
+    }
+
+    // Hide children, whose models do not match fn, by setting the
+    // data-filtered attribute on their root elements. Children are not
+    // patched and the attribute is not part of their rendered attributes, so
+    // it persists through their later patches. Children created later are
+    // filtered as well. Pass an empty function to show all children.
+    void filter(std::function<bool(M*)> fn)
+    {
+        filter_fn = std::move(fn);
+        if (!this->initialized()) {
+            return;
+        }
+        for (auto& v : saved) {
+            apply_filter(*v);
+        }
+    }
+
+    // Append a view of model m, that was appended to the end of get_list().
+    // Unlike patch(), no other children are touched.
+    void push_back(M* m)
+    {
+        // Otherwise rendered by init()
+        if (!this->initialized()) {
+            return;
+        }
+        auto& v = saved.emplace_back(create_child(m));
+        append(View::handle, v->fragment());
+        apply_filter(*v);
+    }
+
+    // Insert a view of model m, that was inserted into get_list() at
+    // position i
+    void insert_at(size_t i, M* m)
+    {
+        if (!this->initialized()) {
+            return;
+        }
+        if (i >= saved.size()) {
+            push_back(m);
+            return;
+        }
+        auto v = create_child(m);
+        if (!i) {
+            prepend(View::handle, v->fragment());
+        } else {
+            after(saved[i - 1]->handle, v->fragment());
+        }
+        apply_filter(*v);
+        saved.insert(saved.begin() + i, v);
+    }
+
+    // Insert views of models, that were inserted into get_list() at
+    // position i in order. All views are inserted next to the same sibling, so
+    // the insertions can be merged on flush.
+    void insert_range(size_t i, const std::vector<M*>& models)
+    {
+        if (!this->initialized() || models.empty()) {
+            return;
+        }
+        if (i >= saved.size()) {
+            for (auto m : models) {
+                push_back(m);
+            }
+            return;
+        }
+        const auto sibling = saved[i]->handle;
+        std::vector<std::shared_ptr<V>> views;
+        views.reserve(models.size());
+        for (auto m : models) {
+            auto& v = views.emplace_back(create_child(m));
+            before(sibling, v->fragment());
+            apply_filter(*v);
+        }
+        saved.insert(saved.begin() + i, views.begin(), views.end());
+    }
+
+    // Insert views of all models, that were inserted anywhere into
+    // get_list(), without touching any existing children. Returns false and
+    // does nothing, if models of existing children were also removed or
+    // reordered. patch() must be used then.
+    bool splice()
+    {
+        if (!this->initialized()) {
+            return true;
+        }
+        const auto list = get_list();
+
+        // Saved views must map to an ordered subsequence of list
+        size_t j = 0;
+        for (size_t i = 0; i < list.size() && j < saved.size(); i++) {
+            if (saved[j]->get_model() == list[i]) {
+                j++;
+            }
+        }
+        if (j != saved.size()) {
+            return false;
+        }
+
+        std::vector<M*> run;
+        j = 0;
+        for (auto m : list) {
+            if (j < saved.size() && saved[j]->get_model() == m) {
+                insert_range(j, run);
+                j += run.size() + 1;
+                run.clear();
+            } else {
+                run.push_back(m);
+            }
+        }
+        insert_range(saved.size(), run);
+        return true;
+    }
+
+    // Remove the view at position i, after its model was removed from
+    // get_list()
+    void erase(size_t i)
+    {
+        if (!this->initialized() || i >= saved.size()) {
+            return;
+        }
+        filtered.erase(saved[i]->handle);
+        saved[i]->remove();
+        saved.erase(saved.begin() + i);
     }
 
     // Patches the attributes of the ListView and reorders its children, while
     // also creating any missing ones an removing no longer actual children.
-    // deep: should patching recurse to the view's child views
+    // If models were only appended to the list, only views for the new models
+    // are created and existing children are not patched.
     void patch()
     {
-        saved_attrs.patch(attrs());
+        saved_attrs.patch(View::handle, attrs());
 
         const auto new_list = get_list();
-        const auto new_set
-            = std::unordered_set<M*>(new_list.begin(), new_list.end());
+        if (is_append(new_list)) {
+            for (size_t i = saved.size(); i < new_list.size(); i++) {
+                push_back(new_list[i]);
+            }
+            return;
+        }
+
         std::unordered_map<M*, std::shared_ptr<V>> saved_set;
         std::vector<M*> saved_list;
 
@@ -248,6 +420,7 @@ public:
                 it++;
             } else {
                 // Get rid of views without models
+                filtered.erase(v->handle);
                 v->remove();
                 it = saved.erase(it);
             }
@@ -263,39 +436,50 @@ public:
             }
 
             std::shared_ptr<V> v;
-            if (saved_set.count(m)) {
-                v = saved_set.at(m);
+            if (auto it = saved_set.find(m); it != saved_set.end()) {
+                v = std::move(it->second);
+                saved_set.erase(it);
                 if (!i) {
-                    move_prepend(View::id, v->id);
+                    move_prepend(View::handle, v->handle);
                 } else {
-                    move_after(saved[i - 1]->id, v->id);
+                    move_after(saved[i - 1]->handle, v->handle);
                 }
-                saved_set[m]->patch();
-                saved_set.erase(m);
+                v->patch();
             } else {
                 v = create_child(m);
                 if (!i) {
-                    prepend(View::id, v->html());
+                    prepend(View::handle, v->fragment());
                 } else {
-                    after(View::id, v->html());
+                    after(saved[i - 1]->handle, v->fragment());
                 }
+                apply_filter(*v);
             }
             saved[i] = v;
         }
 
-        if (saved.size() > new_list.size()) {
-            // Remove all unused old views
-            for (auto& p : saved_set) {
-                p.second->remove();
-            }
-            saved.resize(new_list.size());
-        } else {
-            // Append all missing views
-            for (size_t i = saved.size() - 1; i < new_list.size(); i++) {
-                append(View::id,
-                    saved.emplace_back(create_child(new_list[i]))->html());
+        // Append views past the overlapping range, reusing any saved view of
+        // the model, that was not placed yet
+        const size_t overlap = std::min(saved.size(), new_list.size());
+        saved.resize(overlap);
+        for (size_t i = overlap; i < new_list.size(); i++) {
+            auto m = new_list[i];
+            if (auto it = saved_set.find(m); it != saved_set.end()) {
+                auto& v = saved.emplace_back(std::move(it->second));
+                saved_set.erase(it);
+                move_after(saved[i - 1]->handle, v->handle);
+                v->patch();
+            } else {
+                auto& v = saved.emplace_back(create_child(m));
+                append(View::handle, v->fragment());
+                apply_filter(*v);
             }
         }
+
+        // Remove all unused old views
+        for (auto& p : saved_set) {
+            filtered.erase(p.second->handle);
+            p.second->remove();
+        }
     }
 
 protected:
@@ -304,6 +488,44 @@ protected:
 
     // Create a new instance of a child view
     virtual std::shared_ptr<V> create_child(M*) = 0;
+
+private:
+    // Matches models of visible children. Empty, if not filtering.
+    std::function<bool(M*)> filter_fn;
+
+    // Handles of hidden children
+    std::unordered_set<Handle> filtered;
+
+    // Show or hide child v according to filter_fn
+    void apply_filter(V& v)
+    {
+        auto m = v.get_model();
+        const bool hide = filter_fn && m && !filter_fn(m);
+        if (hide == (filtered.count(v.handle) != 0)) {
+            return;
+        }
+        if (hide) {
+            filtered.insert(v.handle);
+            set_attr(v.handle, "data-filtered", "");
+        } else {
+            filtered.erase(v.handle);
+            remove_attr(v.handle, "data-filtered");
+        }
+    }
+
+    // Returns, if new_list only extends the models of the saved views
+    bool is_append(const std::vector<M*>& new_list)
+    {
+        if (new_list.size() <= saved.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < saved.size(); i++) {
+            if (saved[i]->get_model() != new_list[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
 };
 
 // Combines multiple views as its children. The list and order of the child
@@ -320,7 +542,7 @@ public:
     // deep: should patching recurse to the view's child views
     void patch()
     {
-        saved_attrs.patch(attrs());
+        saved_attrs.patch(View::handle, attrs());
         for (auto& v : saved) {
             v->patch();
         }
@@ -0,0 +1,210 @@
+// Microbenchmarks of the client's rendering and state loading paths, built
+// natively with stubbed browser APIs. DOM mutations are encoded into the
+// command buffer as usual, but never applied.
+//
+// Usage: bench [thread.json]
+// Without an argument a generated thread of 300 posts is used. Recorded
+// threads can be passed in the format of the /json/{board}/{thread} API.
+
+#include "../brunhild/mutations.hh"
+#include "../brunhild/util.hh"
+#include "../src/posts/view.hh"
+#include "../src/state.hh"
+#include "fixture.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::string;
+
+// Minimum duration of a single sample
+static const std::chrono::milliseconds sample_time(200);
+
+// Number of samples per benchmark. The median is reported.
+static const int sample_count = 5;
+
+// Run fn repeatedly and print the median time per run
+static void bench(const char* name, std::function<void()> fn)
+{
+    using clock = std::chrono::steady_clock;
+
+    fn(); // Warm up caches and lazily initialized state
+    std::vector<double> samples;
+    for (int i = 0; i < sample_count; i++) {
+        size_t runs = 0;
+        const auto start = clock::now();
+        auto elapsed = clock::duration::zero();
+        do {
+            fn();
+            runs++;
+            elapsed = clock::now() - start;
+        } while (elapsed < sample_time);
+        samples.push_back(
+            std::chrono::duration<double, std::micro>(elapsed).count() / runs);
+    }
+    std::sort(samples.begin(), samples.end());
+    std::printf("%-24s %12.2f us/op\n", name, samples[sample_count / 2]);
+}
+
+// Per-byte escaping, as implemented before the word-at-a-time scan. Kept as a
+// baseline for the "escape" benchmark and to check its output.
+static void escape_per_byte(string& out, std::string_view s)
+{
+    for (auto ch : s) {
+        switch (ch) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '\'':
+            out += "&#39;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '\"':
+            out += "&#34;";
+            break;
+        default:
+            out += ch;
+        }
+    }
+}
+
+// Returns models of all posts of the current thread
+static std::vector<Post*> thread_models()
+{
+    return thread_posts.at(page.thread);
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        const string data
+            = argc > 1 ? read_file(argv[1]) : generate_thread(1, 300);
+
+        page.board = "a";
+        page.thread = 1; // Placeholder, until the OP ID is known
+        load_posts(data);
+        if (thread_posts.size() != 1) {
+            std::fprintf(stderr, "no thread in input\n");
+            return 1;
+        }
+        page.thread = thread_posts.begin()->first;
+        const auto models = thread_models();
+
+        size_t body_size = 0;
+        for (auto p : models) {
+            body_size += p->body.size();
+        }
+        std::printf("%zu posts, %zu bytes of JSON, %zu bytes of body text\n",
+            models.size(), data.size(), body_size);
+
+        bench("load_posts", [&] {
+            clear_posts();
+            load_posts(data);
+        });
+        const auto list = thread_models();
+
+        for (auto p : list) {
+            string a, b;
+            brunhild::escape(a, p->body);
+            escape_per_byte(b, p->body);
+            if (a != b) {
+                std::fprintf(stderr, "escape mismatch in post %lu\n", p->id);
+                return 1;
+            }
+        }
+        // Escapable characters are rare in most posts. Also measure text
+        // without any.
+        string clean;
+        for (auto p : list) {
+            for (char ch : std::string_view(p->body)) {
+                switch (ch) {
+                case '&':
+                case '\'':
+                case '<':
+                case '>':
+                case '"':
+                    break;
+                default:
+                    clean += ch;
+                }
+            }
+        }
+        bench("escape", [&] {
+            string out;
+            for (auto p : list) {
+                out.clear();
+                brunhild::escape(out, p->body);
+            }
+        });
+        bench("escape (per byte)", [&] {
+            string out;
+            for (auto p : list) {
+                out.clear();
+                escape_per_byte(out, p->body);
+            }
+        });
+        bench("escape clean", [&] {
+            string out;
+            brunhild::escape(out, clean);
+        });
+        bench("escape clean (per byte)", [&] {
+            string out;
+            escape_per_byte(out, clean);
+        });
+
+        bench("render", [&] {
+            brunhild::Rope s;
+            for (auto p : list) {
+                PostView(p->id).write_html(s);
+                s.take();
+            }
+        });
+
+        // Views, that stay rendered between runs
+        std::vector<std::unique_ptr<PostView>> views;
+        for (auto p : list) {
+            auto& v = views.emplace_back(new PostView(p->id));
+            v->html();
+        }
+        brunhild::flush();
+
+        bench("body parse", [&] {
+            for (size_t i = 0; i < list.size(); i++) {
+                list[i]->touch(Post::body_section);
+                static_cast<brunhild::VirtualView&>(*views[i]).render();
+            }
+        });
+
+        // Alternately append a character to and remove it from each post, so
+        // the bodies do not grow between runs
+        bool grow = true;
+        bench("diff", [&] {
+            for (size_t i = 0; i < list.size(); i++) {
+                auto p = list[i];
+                if (grow) {
+                    p->body.append("a");
+                } else {
+                    p->body.backspace();
+                }
+                p->touch(Post::body_section);
+                views[i]->patch();
+            }
+            grow = !grow;
+            brunhild::flush();
+        });
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,94 @@
+// Tests of the binary websocket frame reader against frames produced by the
+// server's encoder. The frames match the cases of common/binary_test.go.
+//
+// Usage: binary_test
+// Exits with a non-zero code, if any test failed.
+
+#include "../src/connection/binary.hh"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void expect(bool ok, const char* test, const char* msg)
+{
+    if (!ok) {
+        std::fprintf(stderr, "FAIL %s: %s\n", test, msg);
+        failures++;
+    }
+}
+
+static BinaryReader reader(const std::vector<uint8_t>& buf)
+{
+    return BinaryReader(buf.data(), buf.size());
+}
+
+int main()
+{
+    {
+        const std::vector<uint8_t> buf { 2, 0xac, 0x02, 2, 0xd3, 0x92 };
+        auto r = reader(buf);
+        expect(r.byte() == 2, "append", "type");
+        expect(r.varint() == 300, "append", "post ID");
+        expect(r.string() == "Ӓ", "append", "text");
+        expect(r.ok() && r.done(), "append", "not fully consumed");
+    }
+    {
+        const std::vector<uint8_t> buf { 4, 1, 2, 3, 3, 'a', 'b', 'c' };
+        auto r = reader(buf);
+        r.byte();
+        expect(r.varint() == 1, "splice", "post ID");
+        expect(r.varint() == 2, "splice", "start");
+        expect(r.varint() == 3, "splice", "length");
+        expect(r.string() == "abc", "splice", "text");
+        expect(r.ok() && r.done(), "splice", "not fully consumed");
+    }
+    {
+        const std::vector<uint8_t> buf { 35, 1, 0xc8, 0x01 };
+        auto r = reader(buf);
+        r.byte();
+        expect(r.varint() == 1, "sync count", "active");
+        expect(r.varint() == 200, "sync count", "total");
+        expect(r.ok() && r.done(), "sync count", "not fully consumed");
+    }
+    {
+        const std::vector<uint8_t> buf { 33, 3, 3, 0xac, 0x02, 2, 7, 7 };
+        auto r = reader(buf);
+        r.byte();
+        std::vector<std::string> frames;
+        while (!r.done() && r.ok()) {
+            frames.emplace_back(r.string());
+        }
+        expect(r.ok(), "concat", "malformed");
+        const std::vector<std::string> std { "\x03\xac\x02", "\x07\x07" };
+        expect(frames == std, "concat", "sub-frames");
+    }
+    {
+        const std::string buf = "\x1e{\"a\":1}";
+        BinaryReader r(
+            reinterpret_cast<const uint8_t*>(buf.data()), buf.size());
+        expect(r.byte() == 30, "JSON payload", "type");
+        expect(r.rest() == "{\"a\":1}", "JSON payload", "payload");
+    }
+    {
+        const std::vector<uint8_t> buf { 2, 0xac };
+        auto r = reader(buf);
+        r.byte();
+        r.varint();
+        expect(!r.ok(), "truncated varint", "no error");
+    }
+    {
+        const std::vector<uint8_t> buf { 2, 1, 5, 'a' };
+        auto r = reader(buf);
+        r.byte();
+        r.varint();
+        expect(r.string().empty() && !r.ok(), "truncated string", "no error");
+    }
+
+    if (failures) {
+        std::fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+}
@@ -0,0 +1,207 @@
+// In-memory implementation of the DOM mutation API of brunhild/mutations.hh
+// for native tests. Linked instead of brunhild/mutations.cc. Mutations are
+// applied immediately to a tree of element handles, that tests can inspect.
+
+#include "fake_dom.hh"
+#include "../brunhild/view.hh"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fake_dom {
+using brunhild::Handle;
+
+struct Element {
+    Handle parent = 0;
+    std::vector<Handle> children;
+    std::string text;
+};
+
+static std::unordered_map<Handle, Element> elements;
+
+// Parse the handle from a DOM ID of the "bh-<handle>" format
+static Handle parse_id(std::string_view id)
+{
+    if (id.substr(0, 3) != "bh-") {
+        throw std::runtime_error("unmanaged element ID: " + std::string(id));
+    }
+    Handle h = 0;
+    for (auto ch : id.substr(3)) {
+        h = h * 10 + (ch - '0');
+    }
+    return h;
+}
+
+// Parse HTML of elements with brunhild handles as IDs and text only in leaf
+// elements. Parsed elements are added to parent. Returns the handles of the
+// top level elements.
+static std::vector<Handle> parse(Handle parent, std::string_view html)
+{
+    std::vector<Handle> top, stack { parent };
+    size_t i = 0;
+    while (i < html.size()) {
+        if (html[i] != '<') {
+            const auto end = std::min(html.find('<', i), html.size());
+            elements[stack.back()].text += html.substr(i, end - i);
+            i = end;
+            continue;
+        }
+
+        const auto end = html.find('>', i);
+        const auto tag = html.substr(i, end - i);
+        i = end + 1;
+        if (tag[1] == '/') {
+            stack.pop_back();
+            continue;
+        }
+
+        const auto start = tag.find("id=\"") + 4;
+        const auto h
+            = parse_id(tag.substr(start, tag.find('"', start) - start));
+        auto& el = elements[h];
+        el.parent = stack.back();
+        el.children.clear();
+        el.text.clear();
+        if (stack.size() == 1) {
+            top.push_back(h);
+        } else {
+            elements[stack.back()].children.push_back(h);
+        }
+        stack.push_back(h);
+    }
+    return top;
+}
+
+// Parse a fragment as a child of parent and return its root handle
+static Handle parse_fragment(Handle parent, const brunhild::Fragment& f)
+{
+    auto html = std::get_if<std::string>(&f);
+    if (!html) {
+        throw std::runtime_error("templates are not supported");
+    }
+    const auto top = parse(parent, std::string_view(*html));
+    if (top.size() != 1) {
+        throw std::runtime_error("fragment must have one root element");
+    }
+    return top.front();
+}
+
+// Remove child from the children of its parent
+static void detach(Handle child)
+{
+    auto& siblings = elements.at(elements.at(child).parent).children;
+    siblings.erase(std::find(siblings.begin(), siblings.end(), child));
+}
+
+// Insert child into parent at position i
+static void insert(Handle parent, size_t i, Handle child)
+{
+    auto& children = elements[parent].children;
+    children.insert(children.begin() + i, child);
+    elements[child].parent = parent;
+}
+
+// Returns the position of a child in its parent
+static size_t position(Handle child)
+{
+    const auto& siblings = elements.at(elements.at(child).parent).children;
+    return std::find(siblings.begin(), siblings.end(), child)
+        - siblings.begin();
+}
+
+void reset() { elements.clear(); }
+
+std::vector<Handle> children(Handle h)
+{
+    if (auto it = elements.find(h); it != elements.end()) {
+        return it->second.children;
+    }
+    return {};
+}
+
+std::string text(Handle h)
+{
+    if (auto it = elements.find(h); it != elements.end()) {
+        return it->second.text;
+    }
+    return {};
+}
+}
+
+namespace brunhild {
+using namespace fake_dom;
+
+void (*before_flush)() = nullptr;
+void (*after_flush)() = nullptr;
+
+uint32_t define_template(std::string) { return 0; }
+
+void append(Handle parent, Fragment f)
+{
+    const auto h = parse_fragment(parent, f);
+    insert(parent, elements[parent].children.size(), h);
+}
+
+void prepend(Handle parent, Fragment f)
+{
+    insert(parent, 0, parse_fragment(parent, f));
+}
+
+void before(Handle sibling, Fragment f)
+{
+    const auto parent = elements.at(sibling).parent;
+    insert(parent, position(sibling), parse_fragment(parent, f));
+}
+
+void after(Handle sibling, Fragment f)
+{
+    const auto parent = elements.at(sibling).parent;
+    insert(parent, position(sibling) + 1, parse_fragment(parent, f));
+}
+
+void move_prepend(Handle parent, Handle child)
+{
+    detach(child);
+    insert(parent, 0, child);
+}
+
+void move_after(Handle sibling, Handle child)
+{
+    detach(child);
+    insert(elements.at(sibling).parent, position(sibling) + 1, child);
+}
+
+void set_inner_html(Handle h, std::string html)
+{
+    auto& el = elements[h];
+    el.text.clear();
+    el.children = parse(h, std::string_view(html));
+}
+
+void set_outer_html(Handle h, std::string html)
+{
+    const auto parent = elements.at(h).parent;
+    const auto i = position(h);
+    detach(h);
+    insert(parent, i, parse_fragment(parent, Fragment(std::move(html))));
+}
+
+void remove(Handle h)
+{
+    if (auto it = elements.find(h); it != elements.end() && it->second.parent) {
+        detach(h);
+        it->second.parent = 0;
+    }
+}
+
+void set_attr(Handle, std::string, std::string) {}
+void remove_attr(Handle, std::string) {}
+void scroll_into_view(Handle) {}
+void on_visible(Handle, std::function<void()>) {}
+void cancel_on_visible(Handle) {}
+void track_visibility(Handle) {}
+void untrack_visibility(Handle) {}
+void set_visibility_listener(void (*)(const uint32_t*, size_t)) {}
+
+extern "C" void flush() { patch_scheduled(); }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../brunhild/mutations.hh"
+#include <string>
+#include <vector>
+
+// Inspection of the in-memory DOM of native tests
+namespace fake_dom {
+// Remove all elements
+void reset();
+
+// Returns the handles of the child elements of an element in order
+std::vector<brunhild::Handle> children(brunhild::Handle);
+
+// Returns the text content of an element, excluding its children
+std::string text(brunhild::Handle);
+}
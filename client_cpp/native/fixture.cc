@@ -0,0 +1,194 @@
+#include "fixture.hh"
+#include <fstream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using nlohmann::json;
+using std::string;
+
+static const char* const words[] = {
+    "the",
+    "of",
+    "and",
+    "a",
+    "to",
+    "in",
+    "is",
+    "you",
+    "that",
+    "it",
+    "anon",
+    "thread",
+    "image",
+    "post",
+    "because",
+    "actually",
+    "never",
+    "something",
+    "<b>not</b>",
+    "R&D",
+    "\"quoted\"",
+    "it's",
+    "ありがとう",
+    "привет",
+    "https://example.com/watch?v=dQw4w9WgXcQ&t=42",
+};
+
+// Produces deterministic pseudo-random thread contents
+class Generator {
+public:
+    Generator(unsigned long op)
+        : op(op)
+        , rng(op)
+    {
+    }
+
+    json post(unsigned long id, size_t i)
+    {
+        json p = {
+            { "editing", false },
+            { "id", id },
+            { "time", 1500000000 + i * 37 },
+            { "body", body(id) },
+        };
+        if (chance(0.1)) {
+            p["name"] = "Anonymous " + std::to_string(pick(100));
+        }
+        if (chance(0.05)) {
+            p["sage"] = true;
+        }
+        if (chance(0.3)) {
+            p["image"] = image(i);
+        }
+        if (links.size()) {
+            json l = json::array();
+            for (auto target : links) {
+                l.push_back({ { "id", target }, { "op", op },
+                    { "board", "a" } });
+            }
+            p["links"] = l;
+        }
+        return p;
+    }
+
+private:
+    const unsigned long op;
+    std::mt19937 rng;
+
+    // Posts linked by the last generated body
+    std::vector<unsigned long> links;
+
+    bool chance(double p)
+    {
+        return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+    }
+
+    size_t pick(size_t n)
+    {
+        return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    }
+
+    string body(unsigned long id)
+    {
+        links.clear();
+        std::ostringstream s;
+        const size_t lines = 1 + pick(6);
+        for (size_t i = 0; i < lines; i++) {
+            if (i) {
+                s << '\n';
+            }
+            if (id > op && chance(0.3)) {
+                const unsigned long target = op + pick(id - op);
+                links.push_back(target);
+                s << ">>" << target << ' ';
+            }
+            if (chance(0.15)) {
+                s << '>';
+            }
+            const bool spoiler = chance(0.05), code = chance(0.03);
+            if (spoiler) {
+                s << "**";
+            }
+            if (code) {
+                s << "``";
+            }
+            const size_t n = 3 + pick(20);
+            for (size_t j = 0; j < n; j++) {
+                if (j) {
+                    s << ' ';
+                }
+                s << words[pick(std::size(words))];
+            }
+            if (code) {
+                s << "``";
+            }
+            if (spoiler) {
+                s << "**";
+            }
+        }
+        return s.str();
+    }
+
+    json image(size_t i)
+    {
+        static const char hex[] = "0123456789abcdef";
+        string sha1, md5;
+        for (int j = 0; j < 40; j++) {
+            sha1 += hex[pick(16)];
+        }
+        for (int j = 0; j < 22; j++) {
+            md5 += hex[pick(16)];
+        }
+        const unsigned w = 200 + pick(3000), h = 200 + pick(3000);
+        const unsigned tw = w > h ? 250 : 250 * w / h;
+        const unsigned th = w > h ? 250 * h / w : 250;
+        return {
+            { "fileType", pick(3) },
+            { "thumbType", 0 },
+            { "dims", { w, h, tw, th } },
+            { "size", 10000 + pick(4000000) },
+            { "md5", md5 },
+            { "sha1", sha1 },
+            { "name", "image_" + std::to_string(i) },
+            { "spoiler", chance(0.05) },
+        };
+    }
+};
+
+string generate_thread(unsigned long id, size_t n)
+{
+    Generator g(id);
+    json posts = json::array();
+    size_t images = 0;
+    for (size_t i = 0; i < n; i++) {
+        auto& p = posts.emplace_back(g.post(id + i, i));
+        images += p.count("image");
+    }
+
+    json thread = {
+        { "postCtr", n },
+        { "imageCtr", images },
+        { "time", 1500000000 },
+        { "replyTime", 1500000000 + n * 37 },
+        { "bumpTime", 1500000000 + n * 37 },
+        { "board", "a" },
+        { "subject", "Benchmark thread" },
+        { "posts", posts },
+    };
+    return thread.dump();
+}
+
+string read_file(const string& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        throw std::runtime_error("could not open " + path);
+    }
+    std::ostringstream s;
+    s << f.rdbuf();
+    return s.str();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+// Returns thread page JSON of a thread with OP id and n posts in total.
+// Bodies mix plain text with quotes, links, spoilers, code and characters
+// needing escaping in roughly the proportions of live threads. The output only
+// depends on the arguments.
+std::string generate_thread(unsigned long id, size_t n);
+
+// Read an entire file. Throws on failure.
+std::string read_file(const std::string& path);
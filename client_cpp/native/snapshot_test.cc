@@ -0,0 +1,123 @@
+// Tests of binary page snapshot decoding against the snapshot produced by the
+// server's encoder. The snapshot matches the case of common/snapshot_test.go.
+//
+// Usage: snapshot_test
+// Exits with a non-zero code, if any test failed.
+
+#include "../src/snapshot.hh"
+#include "../src/state.hh"
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static int failures = 0;
+
+static void expect(bool ok, const char* test, const char* msg)
+{
+    if (!ok) {
+        std::fprintf(stderr, "FAIL %s: %s\n", test, msg);
+        failures++;
+    }
+}
+
+static const std::vector<uint8_t> snapshot {
+    snapshot_version, 2,
+    // String table
+    2, 1, 'a', 4, 'a', 'n', 'o', 'n',
+    // Thread
+    1, thread_sticky, 100, 2, 1, 3, 5, 4, 1, 1, 's', 2,
+    // OP
+    post_has_image, 0, 3, 2, 0, 0, 0, 0, 2, 'o', 'p', 1, 101, 100, 1, 1,
+    uint8_t(Command::Type::flip), 1, image_spoiler, uint8_t(FileType::png),
+    uint8_t(FileType::jpg), 1, 2, 3, 4, 0, 0xac, 0x02, 1, 'm', 1, 'h', 1, 'f',
+    // Reply
+    post_deleted | post_sage, 1, 4, 2, 0, 0, 0, 0, 1, 'r', 0, 0
+};
+
+static std::string_view view(const std::vector<uint8_t>& buf)
+{
+    return std::string_view(
+        reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+int main()
+{
+    load_snapshot(view(snapshot));
+
+    expect(page.page_total == 2, "page", "page total");
+    {
+        const auto it = threads.find(100);
+        expect(it != threads.end(), "thread", "not decoded");
+        if (it != threads.end()) {
+            const auto& t = it->second;
+            expect(t.sticky && !t.locked && !t.deleted, "thread", "flags");
+            expect(t.post_ctr == 2 && t.image_ctr == 1, "thread", "counters");
+            expect(t.time == 3 && t.reply_time == 5 && t.bump_time == 4,
+                "thread", "times");
+            expect(t.board == Atom("a"), "thread", "board");
+            expect(t.subject == "s", "thread", "subject");
+        }
+        expect(thread_posts[100].size() == 2, "thread", "post index");
+    }
+    if (auto p = posts.find(100); p) {
+        expect(p->op == 100 && p->board == Atom("a"), "OP", "parent");
+        expect(p->time == 3, "OP", "time");
+        expect(p->name == "anon" && !p->trip && !p->auth && !p->flag,
+            "OP", "poster");
+        expect(std::string_view(p->body) == "op", "OP", "body");
+        expect(p->links.size() == 1 && p->links.count(101)
+                && p->links[101].op == 100,
+            "OP", "links");
+        expect(p->commands.size() == 1
+                && p->commands[0].typ == Command::Type::flip
+                && std::get<bool>(p->commands[0].val),
+            "OP", "commands");
+        expect(p->image && p->image->spoiler && !p->image->audio, "OP",
+            "image flags");
+        if (p->image) {
+            const auto& img = *p->image;
+            expect(img.file_type == FileType::png
+                    && img.thumb_type == FileType::jpg,
+                "OP", "image types");
+            expect(img.dims[0] == 1 && img.dims[3] == 4, "OP", "image dims");
+            expect(img.size == 300, "OP", "image size");
+            expect(img.md5 == "m" && img.sha1 == "h" && img.name == "f",
+                "OP", "image strings");
+        }
+    } else {
+        expect(false, "OP", "not decoded");
+    }
+    if (auto p = posts.find(101); p) {
+        expect(p->op == 100, "reply", "parent");
+        expect(p->deleted && p->sage && !p->editing && !p->banned, "reply",
+            "flags");
+        expect(p->name == "anon", "reply", "name");
+        expect(std::string_view(p->body) == "r", "reply", "body");
+        expect(!p->image && p->links.empty() && p->commands.empty(), "reply",
+            "attachments");
+    } else {
+        expect(false, "reply", "not decoded");
+    }
+
+    // Unchanged posts are skipped on a repeated load
+    const auto hash = posts.find(101)->source_hash;
+    load_snapshot(view(snapshot));
+    expect(posts.find(101)->source_hash == hash && hash, "reload", "hash");
+
+    {
+        // Truncated snapshots must not crash the decoder
+        clear_posts();
+        threads.clear();
+        for (size_t i = 1; i < snapshot.size(); i++) {
+            std::vector<uint8_t> buf(snapshot.begin(), snapshot.begin() + i);
+            load_snapshot(view(buf));
+        }
+    }
+
+    if (failures) {
+        std::fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+}
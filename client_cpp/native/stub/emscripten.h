@@ -0,0 +1,30 @@
+#pragma once
+
+// Native stand-ins for the Emscripten runtime. Inline JS is not run and
+// returns zero, so code depending on the DOM or browser APIs only takes its
+// fallback paths.
+
+#include <chrono>
+#include <cstdlib>
+
+#define EMSCRIPTEN_KEEPALIVE
+#define EM_ASM(...) ((void)0)
+#define EM_ASM_INT(...) emscripten_stub_asm<int>()
+#define EM_ASM_DOUBLE(...) emscripten_stub_asm<double>()
+
+template <class T> inline T emscripten_stub_asm() { return T(); }
+
+inline double emscripten_get_now()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(
+        steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline float emscripten_random()
+{
+    return static_cast<float>(std::rand()) / (float(RAND_MAX) + 1);
+}
+
+inline void emscripten_set_main_loop(void (*)(), int, int) {}
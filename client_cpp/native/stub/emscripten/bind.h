@@ -0,0 +1,11 @@
+#pragma once
+
+#include "val.h"
+
+// Bindings are only registered with the JS runtime, so they are compiled, but
+// never run
+#define EMSCRIPTEN_BINDINGS(name) [[maybe_unused]] static void name##_bind()
+
+namespace emscripten {
+template <class F> void function(const char*, F) {}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace emscripten {
+// Handle of a JS value. Every value is undefined and every operation on it
+// yields undefined or a default constructed result.
+class val {
+public:
+    val() = default;
+    explicit val(const char*) {}
+    template <class T> explicit val(const T&) {}
+
+    static val global(const char* = nullptr) { return {}; }
+    static val object() { return {}; }
+    static val array() { return {}; }
+    static val null() { return {}; }
+    static val undefined() { return {}; }
+
+    template <class T> T as() const { return T(); }
+    template <class K> val operator[](const K&) const { return {}; }
+    template <class... Args> val operator()(Args&&...) const { return {}; }
+    template <class R = val, class... Args>
+    R call(const char*, Args&&...) const
+    {
+        return R();
+    }
+    template <class K, class V> void set(const K&, const V&) {}
+
+    bool isNull() const { return false; }
+    bool isUndefined() const { return true; }
+    bool isString() const { return false; }
+    bool isNumber() const { return false; }
+};
+
+template <class T> std::vector<T> vecFromJSArray(const val&) { return {}; }
+}
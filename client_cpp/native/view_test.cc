@@ -0,0 +1,165 @@
+// Tests of brunhild views against the in-memory DOM of fake_dom.cc
+//
+// Usage: view_test
+// Exits with a non-zero code, if any test failed.
+
+#include "../brunhild/view.hh"
+#include "fake_dom.hh"
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using brunhild::Handle;
+
+struct Item {
+    int id;
+};
+
+class ItemView : public brunhild::ModelView<Item> {
+public:
+    ItemView(Item* item)
+        : item(item)
+    {
+    }
+
+    Item* get_model() { return item; }
+
+protected:
+    brunhild::Node render(Item* m)
+    {
+        return brunhild::Node("li", std::to_string(m->id));
+    }
+
+private:
+    Item* item;
+};
+
+class ItemList : public brunhild::ListView<Item, ItemView> {
+public:
+    std::vector<Item*> list;
+
+    ItemList()
+        : ListView("ul")
+    {
+    }
+
+protected:
+    std::vector<Item*> get_list() { return list; }
+
+    std::shared_ptr<ItemView> create_child(Item* m)
+    {
+        return std::make_shared<ItemView>(m);
+    }
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const std::string& test, const std::string& msg)
+{
+    if (!ok) {
+        std::fprintf(stderr, "FAIL %s: %s\n", test.c_str(), msg.c_str());
+        failures++;
+    }
+}
+
+// Returns the IDs of the items rendered in the DOM in order
+static std::vector<int> rendered(const ItemList& list)
+{
+    std::vector<int> ids;
+    for (auto h : fake_dom::children(list.handle)) {
+        ids.push_back(std::stoi(fake_dom::text(h)));
+    }
+    return ids;
+}
+
+static std::string format(const std::vector<int>& ids)
+{
+    std::string s = "[";
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i) {
+            s += ',';
+        }
+        s += std::to_string(ids[i]);
+    }
+    return s + ']';
+}
+
+// Pool of items with stable addresses, indexed by ID
+static std::unordered_map<int, std::unique_ptr<Item>> items;
+
+static std::vector<Item*> to_items(const std::vector<int>& ids)
+{
+    std::vector<Item*> list;
+    for (auto id : ids) {
+        auto& it = items[id];
+        if (!it) {
+            it.reset(new Item { id });
+        }
+        list.push_back(it.get());
+    }
+    return list;
+}
+
+// Render a list of from, patch it to to and check the DOM
+static void test_patch(const std::string& name, const std::vector<int>& from,
+    const std::vector<int>& to)
+{
+    fake_dom::reset();
+    const Handle root = brunhild::new_handle();
+    ItemList list;
+    list.list = to_items(from);
+    brunhild::append(root, list.html());
+    expect(rendered(list) == from, name, "initial render");
+
+    // Map handles of rendered items to verify reuse of views
+    std::unordered_map<int, Handle> before;
+    for (auto h : fake_dom::children(list.handle)) {
+        before[std::stoi(fake_dom::text(h))] = h;
+    }
+
+    list.list = to_items(to);
+    list.patch();
+    const auto got = rendered(list);
+    expect(got == to, name,
+        "expected " + format(to) + ", got " + format(got));
+
+    const auto children = fake_dom::children(list.handle);
+    for (size_t i = 0; i < to.size() && i < children.size(); i++) {
+        if (auto it = before.find(to[i]); it != before.end()) {
+            expect(children[i] == it->second, name,
+                "view of item " + std::to_string(to[i]) + " not reused");
+        }
+    }
+}
+
+int main()
+{
+    test_patch("append", { 1, 2 }, { 1, 2, 3 });
+    test_patch("middle insert", { 1, 2, 4 }, { 1, 2, 3, 4 });
+    test_patch("front insert", { 2, 3 }, { 1, 2, 3 });
+    test_patch("reorder", { 1, 2, 3 }, { 3, 1, 2 });
+    test_patch("reorder with growth", { 1, 2, 3 }, { 3, 1, 4, 2, 5 });
+    test_patch("reorder with shrinking", { 1, 2, 3, 4 }, { 4, 2 });
+    test_patch("replace", { 1, 2 }, { 3, 4, 5 });
+    test_patch("clear", { 1, 2, 3 }, {});
+
+    // Random permutations of random subsets of a small pool
+    std::mt19937 rng(1);
+    for (int i = 0; i < 500; i++) {
+        std::vector<int> pool { 1, 2, 3, 4, 5, 6, 7, 8 };
+        std::shuffle(pool.begin(), pool.end(), rng);
+        std::vector<int> from(pool.begin(), pool.begin() + rng() % 8);
+        std::shuffle(pool.begin(), pool.end(), rng);
+        std::vector<int> to(pool.begin(), pool.begin() + rng() % 8);
+        test_patch("random " + format(from) + " -> " + format(to), from, to);
+    }
+
+    if (failures) {
+        std::fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+}
@@ -0,0 +1,29 @@
+#include "atom.hh"
+#include <deque>
+#include <unordered_map>
+
+// Interned strings by atom index. std::deque keeps references stable on
+// insertion. Function-local, so atoms can be created during static
+// initialization.
+static std::deque<std::string>& strings()
+{
+    static std::deque<std::string> s = { "" };
+    return s;
+}
+
+Atom::Atom(std::string_view s)
+{
+    // Reverse lookup of interned strings. Keys point into strings().
+    static std::unordered_map<std::string_view, uint32_t> index
+        = { { strings()[0], 0 } };
+
+    if (auto it = index.find(s); it != index.end()) {
+        i = it->second;
+        return;
+    }
+    auto& str = strings();
+    i = str.size();
+    index[str.emplace_back(s)] = i;
+}
+
+const std::string& Atom::str() const { return strings()[i]; }
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+// Interned immutable string. Equal strings always map to the same atom, so
+// atoms are copied and compared as integers. Interned strings are never freed,
+// so atoms should only be used for strings from a small set, like board IDs,
+// country flags or staff titles.
+class Atom {
+public:
+    // Atom of the empty string
+    Atom() = default;
+
+    // Intern a string
+    Atom(std::string_view);
+    Atom(const std::string& s)
+        : Atom(std::string_view(s))
+    {
+    }
+    Atom(const char* s)
+        : Atom(std::string_view(s))
+    {
+    }
+
+    // Returns the interned string
+    const std::string& str() const;
+
+    operator const std::string&() const { return str(); }
+
+    bool empty() const { return !i; }
+    bool operator==(Atom other) const { return i == other.i; }
+    bool operator!=(Atom other) const { return i != other.i; }
+
+private:
+    // Index into the intern table
+    uint32_t i = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, Atom a)
+{
+    return os << a.str();
+}
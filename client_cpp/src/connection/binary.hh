@@ -0,0 +1,89 @@
+// Decoding of binary websocket protocol frames
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+// Sequential reader of a binary protocol frame. All fields are decoded in
+// place from the frame buffer. Reading past the end of the frame sets the
+// error flag and returns zero values.
+//
+// Frames consist of a one byte message type followed by type-specific fields.
+// Integers are encoded as unsigned LEB128 varints. Strings are UTF-8 prefixed
+// with their varint byte length. Synchronisation frames of board pages carry a
+// binary snapshot of the page. See snapshot.hh.
+class BinaryReader {
+public:
+    BinaryReader(const uint8_t* buf, size_t size)
+        : pos(buf)
+        , end(buf + size)
+    {
+    }
+
+    // Read a single byte
+    uint8_t byte()
+    {
+        if (pos == end) {
+            failed = true;
+            return 0;
+        }
+        return *pos++;
+    }
+
+    // Read an unsigned LEB128 varint
+    uint64_t varint()
+    {
+        uint64_t n = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            const uint8_t b = byte();
+            n |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return n;
+            }
+        }
+        failed = true;
+        return 0;
+    }
+
+    // Read a length-prefixed string. The returned view points into the frame.
+    std::string_view string()
+    {
+        const uint64_t len = varint();
+        if (len > uint64_t(end - pos)) {
+            failed = true;
+            pos = end;
+            return {};
+        }
+        std::string_view s(reinterpret_cast<const char*>(pos), len);
+        pos += len;
+        return s;
+    }
+
+    // Return all unread bytes of the frame
+    std::string_view rest()
+    {
+        std::string_view s(reinterpret_cast<const char*>(pos), end - pos);
+        pos = end;
+        return s;
+    }
+
+    // Returns the number of unread bytes
+    size_t remaining() const { return end - pos; }
+
+    // Returns, if the frame was fully consumed
+    bool done() const { return pos == end; }
+
+    // Returns, if no reads past the end of the frame or malformed varints
+    // were encountered
+    bool ok() const { return !failed; }
+
+    // Mark the frame as malformed
+    void fail() { failed = true; }
+
+private:
+    const uint8_t* pos;
+    const uint8_t* const end;
+    bool failed = false;
+};
@@ -1,18 +1,33 @@
 #include "connection.hh"
 #include "../../brunhild/mutations.hh"
+#include "../../brunhild/profile.hh"
 #include "../../utf8/utf8.h"
+#include "../http.hh"
+#include "../json_scan.hh"
 #include "../lang.hh"
+#include "../page/board.hh"
+#include "../page/catalog.hh"
+#include "../page/gallery.hh"
 #include "../page/thread.hh"
 #include "../posts/commands.hh"
+#include "../posts/search.hh"
+#include "../snapshot.hh"
 #include "../state.hh"
 #include "../util.hh"
+#include "binary.hh"
+#include "heartbeat.hh"
 #include "posts.hh"
+#include "reconnect.hh"
 #include "sync.hh"
 #include <emscripten.h>
 #include <emscripten/bind.h>
+#include <cctype>
+#include <deque>
 #include <functional>
 #include <iterator>
 #include <nlohmann/json.hpp>
+#include <stdlib.h>
+#include <unordered_set>
 
 using nlohmann::json;
 using std::string;
@@ -55,29 +70,283 @@ static void if_post_exists(
     if_post_exists(j["id"].get<unsigned long>(), [&](auto& p) { fn(j, p); });
 }
 
-// Mimics JS Array.splice() method for inserting and removing text from UTF-8
-// strings at a certain position, but in place
-static void splice(string& s, int start, int len, string text)
+// Set synced IP counts to active and total. Both are 0, if unknown.
+static void render_sync_count(unsigned active, unsigned total)
 {
-    auto start_pos = s.begin();
-    utf8::advance(start_pos, start, s.end());
-    auto end_pos = start_pos;
-    utf8::advance(end_pos, len, s.end());
-    string end(end_pos, s.end());
-    s = s.substr(0, start_pos - s.begin());
-    s.reserve(s.size() + text.size() + end.size());
-    s += text;
-    s += end;
+    string s;
+    if (total) {
+        s = std::to_string(active) + " / " + std::to_string(total);
+    }
+    brunhild::set_inner_html("sync-counter", s);
 }
 
-// Set synced IP count to n
-static void render_sync_count(unsigned n)
+// Parse a decimal post ID or other unsigned integer from a text message
+static unsigned long parse_uint(std::string_view s)
 {
-    string s;
-    if (n) {
-        s = std::to_string(n);
+    unsigned long n = 0;
+    for (char ch : s) {
+        if (ch < '0' || ch > '9') {
+            break;
+        }
+        n = n * 10 + (ch - '0');
+    }
+    return n;
+}
+
+// Guard against messages possibly resulted from rapid changing of feeds and
+// high latency
+static bool is_accepted(Message type)
+{
+    if (conn_SM.state() == ConnState::synced) {
+        return true;
+    }
+    switch (type) {
+    case Message::invalid:
+    case Message::synchronise:
+        return true;
+    default:
+        return false;
     }
-    brunhild::set_inner_html("sync-counter", s);
+}
+
+// Append UTF-8 encoded text to the body of a post
+static void append_body(unsigned long id, std::string_view text)
+{
+    if_post_exists(id, [text](auto& p) {
+        p.body.append(text);
+        p.touch(Post::body_section);
+        p.patch();
+    });
+}
+
+// Handle messages, that only carry the ID of the target post
+static void on_post_id_message(Message type, unsigned long id)
+{
+    if_post_exists(id, [type](auto& p) {
+        switch (type) {
+        case Message::backspace: {
+            if (!p.body.size()) {
+                return;
+            }
+            p.body.backspace();
+            p.touch(Post::body_section);
+        } break;
+        case Message::spoiler:
+            if (!p.image) {
+                return;
+            }
+            p.image->spoiler = true;
+            p.touch(Post::image_section);
+            index_gallery_image(p);
+            break;
+        default:
+            return;
+        }
+        p.patch();
+    });
+}
+
+// Moderation actions of moderate_post messages. Matches
+// common.ModerationAction on the server.
+enum class ModerationAction : uint8_t {
+    ban_post,
+    unban_post,
+    delete_post,
+    delete_image,
+    spoiler_image,
+    lock_thread,
+    delete_board,
+    meido_vision,
+    purge_post,
+};
+
+// Apply a moderation log entry to a post
+static void moderate_post(Post& p, const json& j)
+{
+    switch (static_cast<ModerationAction>(j["type"].get<unsigned>())) {
+    case ModerationAction::ban_post:
+        p.banned = true;
+        break;
+    case ModerationAction::unban_post:
+        p.banned = false;
+        break;
+    case ModerationAction::delete_post:
+        p.deleted = true;
+        break;
+    case ModerationAction::delete_image:
+        if (!p.image) {
+            return;
+        }
+        p.image = std::nullopt;
+        p.touch(Post::image_section);
+        index_gallery_image(p);
+        break;
+    case ModerationAction::spoiler_image:
+        if (!p.image) {
+            return;
+        }
+        p.image->spoiler = true;
+        p.touch(Post::image_section);
+        index_gallery_image(p);
+        break;
+    case ModerationAction::lock_thread:
+        if (auto it = threads.find(p.id); it != threads.end()) {
+            it->second.locked = j["data"].get<string>() == "true";
+        }
+        return;
+    case ModerationAction::purge_post:
+        if (p.image) {
+            p.image = std::nullopt;
+            p.touch(Post::image_section);
+            index_gallery_image(p);
+        }
+        p.body = "";
+        p.touch(Post::body_section);
+        break;
+    default:
+        return;
+    }
+    p.patch();
+}
+
+// Fetch a post, that changed in ways the thread's sync message does not
+// describe, and merge it into the current thread. recent is the post's entry in
+// the recently changed posts of the message, if any, and moderation its
+// moderation log.
+static void fetch_post(unsigned long id, json recent, json moderation)
+{
+    const auto thread = page.thread;
+    http_request("/json/post/" + std::to_string(id),
+        [=](unsigned short code, string data) mutable {
+            if (code != 200 || page.thread != thread) {
+                return;
+            }
+            if (!posts.count(id)) {
+                insert_post(data);
+            } else {
+                auto j = json::parse(data);
+                Post p(j);
+                p.op = thread;
+                p.board = page.board;
+                auto& ref = add_post(std::move(p));
+                if (!ref.editing) {
+                    ref.propagate_links();
+                }
+                index_post(ref);
+                index_gallery_image(ref);
+            }
+
+            auto& p = posts.at(id);
+            // Bodies of open posts are only current in the sync message
+            if (p.editing && recent.is_object()) {
+                p.body = recent["body"].get<string>();
+                p.touch(Post::body_section);
+                p.patch();
+            }
+            for (auto& e : moderation) {
+                moderate_post(p, e);
+            }
+        });
+}
+
+// Reconcile the posts of the current thread with the thread's sync message.
+// It contains the posts created or changed in the last 16 minutes and the
+// moderation log of the thread. Posts missing from the page or closed since are
+// fetched individually.
+static void reconcile_thread(std::string_view data)
+{
+    if (!threads.count(page.thread)) {
+        console::error("thread not loaded");
+        return;
+    }
+
+    auto j = json::parse(data);
+    auto& recent = j["recent"];
+    auto& moderation = j["moderation"];
+    auto log_of = [&](const string& id) {
+        return moderation.count(id) ? moderation[id] : json::array();
+    };
+
+    std::unordered_set<unsigned long> fetched;
+    for (auto& it : recent.items()) {
+        const unsigned long id = std::stoul(it.key());
+        auto& val = it.value();
+        auto p = posts.find(id);
+        if (!p || (val["has_image"].get<bool>() && !p->image)
+            || (val["closed"].get<bool>() && p->editing)) {
+            fetch_post(id, val, log_of(it.key()));
+            fetched.insert(id);
+            continue;
+        }
+
+        bool changed = false;
+        if (p->editing) {
+            const auto body = val["body"].get<string>();
+            if (std::string_view(p->body) != body) {
+                p->body = body;
+                p->touch(Post::body_section);
+                changed = true;
+            }
+        }
+        if (val["spoilered"].get<bool>() && p->image && !p->image->spoiler) {
+            p->image->spoiler = true;
+            p->touch(Post::image_section);
+            index_gallery_image(*p);
+            changed = true;
+        }
+        if (changed) {
+            p->patch();
+        }
+    }
+
+    // Posts open on the page, but missing from the recently changed posts,
+    // have been closed long ago
+    for (auto p : thread_posts[page.thread]) {
+        const auto key = std::to_string(p->id);
+        if (p->editing && !recent.count(key)) {
+            fetch_post(p->id, json(), log_of(key));
+            fetched.insert(p->id);
+        }
+    }
+
+    for (auto& it : moderation.items()) {
+        const unsigned long id = std::stoul(it.key());
+        if (fetched.count(id)) {
+            continue;
+        }
+        if_post_exists(id, [&](auto& p) {
+            for (auto& e : it.value()) {
+                moderate_post(p, e);
+            }
+        });
+    }
+}
+
+// Handle messages with the same JSON payload in text and binary frames
+static void on_message(Message type, std::string_view data);
+
+static brunhild::profile::Metric on_message_metric("on_message");
+
+// Merge posts received on a resync into an already rendered page. Posts, that
+// did not change since the last sync, keep their views untouched. New posts
+// are picked up by patching the thread views.
+static void patch_synced_page()
+{
+    if (page.catalog) {
+        // Catalog pages have no thread views
+        patch_catalog();
+        return;
+    }
+    if (ThreadView::instances.empty()) {
+        return;
+    }
+    for (auto [_, v] : ThreadView::instances) {
+        v->schedule_patch();
+    }
+    if (!page.thread) {
+        patch_board_index();
+    }
+    render_post_counter();
 }
 
 // Handler for messages received from the server.
@@ -95,52 +364,145 @@ static void on_message(std::string_view msg, bool extracted)
         console::log(s);
     }
 
-    const Message type
-        = static_cast<Message>(std::stoul(string(msg.substr(0, 2))));
-
-    // Guard against messages possibly resulted from rapid changing of feeds and
-    // high latency
-    if (conn_SM.state() != ConnState::synced) {
-        switch (type) {
-        case Message::invalid:
-        case Message::synchronise:
-            break;
-        default:
-            return;
-        }
+    if (msg.size() < 2) {
+        console::warn("malformed websocket message: " + string(msg));
+        return;
+    }
+    const auto type = static_cast<Message>(parse_uint(msg.substr(0, 2)));
+    if (!is_accepted(type)) {
+        return;
     }
 
     auto data = msg.substr(2);
     switch (type) {
-    case Message::invalid:
-        alert(string(data));
-        conn_SM.feed(ConnEvent::error);
-        break;
-    case Message::insert_post:
-        insert_post(data);
-        break;
     case Message::append: {
         auto j = json::parse(data);
-        if_post_exists(j[0].get<unsigned long>(), [&](auto& p) {
-            utf8::unchecked::append(j[1], std::back_inserter(p.body));
-            p.patch();
-        });
+        string ch;
+        utf8::unchecked::append(j[1], std::back_inserter(ch));
+        append_body(j[0].get<unsigned long>(), ch);
     } break;
     case Message::backspace:
-        if_post_exists(std::stoul(string(data)), [](auto& p) {
-            // Removes the last UTF-8 char from the post's text
-            auto it = p.body.end();
-            utf8::unchecked::prior(it);
-            p.body = p.body.substr(0, it - p.body.begin());
-            p.patch();
-        });
+    case Message::spoiler:
+        on_post_id_message(type, parse_uint(data));
         break;
     case Message::splice:
         if_post_exists(data, [](auto& j, auto& p) {
-            splice(p.body, j["start"], j["len"], j["text"]);
+            p.body.splice(j["start"].template get<size_t>(),
+                j["len"].template get<size_t>(),
+                j["text"].template get<string>());
+            p.touch(Post::body_section);
             p.patch();
         });
         break;
+    case Message::concat: {
+        // Split several concatenated messages
+        if (!json_scan::for_each_string(data,
+                [](std::string_view msg) { on_message(msg, true); })) {
+            console::warn("malformed concatenated message");
+        }
+    } break;
+    case Message::sync_count: {
+        auto j = json::parse(data);
+        render_sync_count(
+            j["active"].get<unsigned>(), j["total"].get<unsigned>());
+    } break;
+    default:
+        on_message(type, data);
+    }
+}
+
+// Handler for binary frames received from the server. The format is
+// described in common/binary.go of the server.
+// extracted specifies, the frame was extracted from a concatenated frame.
+static void on_binary_message(BinaryReader& r, bool extracted)
+{
+    const auto type = static_cast<Message>(r.byte());
+    if (debug) {
+        string s = extracted ? "\t> binary " : "> binary ";
+        s += std::to_string(static_cast<unsigned>(type));
+        console::log(s);
+    }
+    if (!r.ok() || !is_accepted(type)) {
+        return;
+    }
+
+    switch (type) {
+    case Message::append: {
+        const auto id = r.varint();
+        const auto text = r.string();
+        if (r.ok()) {
+            append_body(id, text);
+        }
+    } break;
+    case Message::backspace:
+    case Message::spoiler: {
+        const auto id = r.varint();
+        if (r.ok()) {
+            on_post_id_message(type, id);
+        }
+    } break;
+    case Message::splice: {
+        const auto id = r.varint();
+        const size_t start = r.varint();
+        const size_t len = r.varint();
+        const auto text = r.string();
+        if (r.ok()) {
+            if_post_exists(id, [=](auto& p) {
+                p.body.splice(start, len, text);
+                p.touch(Post::body_section);
+                p.patch();
+            });
+        }
+    } break;
+    case Message::concat:
+        // Length-prefixed sub-frames
+        while (!r.done() && r.ok()) {
+            const auto frame = r.string();
+            BinaryReader sub(
+                reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+            on_binary_message(sub, true);
+        }
+        break;
+    case Message::sync_count: {
+        const auto active = r.varint();
+        const auto total = r.varint();
+        if (r.ok()) {
+            render_sync_count(active, total);
+        }
+    } break;
+    case Message::synchronise: {
+        // Board pages are synchronised with a snapshot, threads with JSON
+        const auto data = r.rest();
+        if (data.size() && uint8_t(data[0]) == snapshot_version) {
+            load_snapshot(data);
+            patch_synced_page();
+            conn_SM.feed(ConnEvent::sync);
+        } else {
+            on_message(type, data);
+        }
+    } break;
+    default:
+        on_message(type, r.rest());
+        return;
+    }
+
+    if (!r.ok()) {
+        console::warn("malformed binary websocket message of type "
+            + std::to_string(static_cast<unsigned>(type)));
+    }
+}
+
+// Handle messages with the same JSON payload in text and binary frames
+static void on_message(Message type, std::string_view data)
+{
+    switch (type) {
+    case Message::invalid:
+        alert(string(data));
+        conn_SM.feed(ConnEvent::error);
+        break;
+    case Message::insert_post:
+        insert_post(data);
+        break;
     case Message::close_post:
         if_post_exists(data, [](auto& j, auto& p) {
             if (j.count("links")) {
@@ -149,12 +511,16 @@ static void on_message(std::string_view msg, bool extracted)
             }
             p.parse_commands(j);
             p.close();
+            index_post(p);
         });
         break;
     case Message::insert_image:
         if_post_exists(data, [](auto& j, auto& p) {
             p.image = Image(j);
+            p.touch(Post::image_section);
             p.patch();
+            index_post(p);
+            index_gallery_image(p);
             threads.at(page.thread).image_ctr++;
             render_post_counter();
 
@@ -162,32 +528,18 @@ static void on_message(std::string_view msg, bool extracted)
 
         });
         break;
-    case Message::spoiler:
-        if_post_exists(std::stoul(string(data)), [](auto& p) {
-            p.image->spoiler = true;
-            p.patch();
-        });
-        break;
-    case Message::delete_post:
-        if_post_exists(std::stoul(string(data)), [](auto& p) {
-            p.deleted = true;
-            p.patch();
-        });
-        break;
-    case Message::banned:
-        if_post_exists(std::stoul(string(data)), [](auto& p) {
-            p.banned = true;
-            p.patch();
-        });
-        break;
-    case Message::delete_image:
-        if_post_exists(std::stoul(string(data)), [](auto& p) {
-            p.image = std::nullopt;
-            p.patch();
-        });
+    case Message::moderate_post:
+        if_post_exists(data, [](auto& j, auto& p) { moderate_post(p, j); });
         break;
     case Message::synchronise:
-        load_posts(data);
+        if (page.thread) {
+            // Thread pages are loaded from a snapshot and synchronised with
+            // the changes since
+            reconcile_thread(data);
+        } else {
+            load_posts(data);
+        }
+        patch_synced_page();
         conn_SM.feed(ConnEvent::sync);
         break;
     case Message::configs:
@@ -195,20 +547,8 @@ static void on_message(std::string_view msg, bool extracted)
         break;
     // TODO: reclaim
     // TODO: post_id
-    case Message::concat: {
-        // Split several concatenated messages
-        string s;
-        for (auto& msg : json::parse(data)) {
-            s = msg;
-            on_message(std::string_view(s), true);
-        }
-        return;
-    }
-    case Message::sync_count:
-        render_sync_count(std::stoul(string(data)));
-        break;
     case Message::server_time:
-        server_time_offset = json::parse(data);
+        on_server_time(json::parse(data));
         break;
     // TODO: redirect
     // TODO: notification
@@ -216,7 +556,6 @@ static void on_message(std::string_view msg, bool extracted)
     default:
         console::warn(
             "unknown websocket message: " + encode_message(type, string(data)));
-        return;
     }
 }
 
@@ -225,24 +564,39 @@ static void on_message(std::string_view msg, bool extracted)
 // copying.
 static void on_message_raw(int msg_ptr)
 {
+    brunhild::profile::boundary.count();
+    brunhild::profile::Scope scope(on_message_metric);
+
     // Binding to a variable keeps the underlying char* from dealocating till
     // scope exit
     auto v = c_string_view((char*)(msg_ptr));
     on_message(v.substr(), false);
 }
 
+// Takes a raw pointer to a binary frame copied into the wasm heap and its
+// length. Takes ownership of the buffer.
+static void on_binary_message_raw(int buf_ptr, int len)
+{
+    brunhild::profile::boundary.count();
+    brunhild::profile::Scope scope(on_message_metric);
+
+    auto buf = (uint8_t*)(buf_ptr);
+    BinaryReader r(buf, len);
+    on_binary_message(r, false);
+    free(buf);
+}
+
 static void retry_to_connect() { conn_SM.feed(ConnEvent::retry); }
 
+static void flush_outgoing();
+
 // Work around browser slowing down/suspending tabs and keep the FSM up to
 // date with the actual status.
 static void resync_conn_SM()
 {
     switch (conn_SM.state()) {
-    // Ensure still connected, in case the computer went to sleep or
-    // hibernate or the mobile browser tab was suspended.
+    // Checked by the heartbeat on becoming visible
     case ConnState::synced:
-        send_message(Message::NOP, "");
-        break;
     case ConnState::desynced:
         break;
     default:
@@ -257,38 +611,343 @@ EMSCRIPTEN_BINDINGS(module_conn)
     function("on_socket_open", &on_open);
     function("on_socket_close", &on_close);
     function("on_socket_message", &on_message_raw);
+    function("on_socket_binary_message", &on_binary_message_raw);
     function("retry_to_connect", &retry_to_connect);
     function("resync_conn_SM", &resync_conn_SM);
+    function("flush_outgoing", &flush_outgoing);
+}
+
+// Tabs synced to the same feed share one socket, unless this tab has sent a
+// message, that the server responds to only on the sending socket
+static bool exclusive_socket = false;
+
+// Returns, if the current socket is shared with other tabs
+static bool is_shared()
+{
+    return EM_ASM_INT({ return window.__socket && window.__socket.shared; });
+}
+
+// Returns the key of the feed the current page syncs to. Tabs with the same
+// key can share a socket.
+static string feed_key()
+{
+    string s = page.board;
+    for (unsigned long v : { (unsigned long)(page.catalog),
+             (unsigned long)(page.last_100), (unsigned long)(page.page),
+             page.thread }) {
+        s += '/';
+        s += std::to_string(v);
+    }
+    return s;
 }
 
 static void connect()
 {
-    EM_ASM({
-        if (window.__socket) {
-            window.__socket.close();
-        }
-        var path = (location.protocol == 'https:' ? 'wss' : 'ws') + '://'
-            + location.host + '/api/socket';
-        var s = window.__socket = new WebSocket(path);
-        s.onopen = function() { Module.on_socket_open(); };
-        s.onclose = function() { Module.on_socket_close(); };
-        s.onmessage = function(e)
-        {
-            var s = e.data;
-            var len = lengthBytesUTF8(s) + 1;
-            var buf = Module._malloc(len);
-            stringToUTF8(s, buf, len);
-            Module.on_socket_message(buf);
-        };
-        s.onerror = function(e)
+    const string key = feed_key();
+    EM_ASM(
         {
-            console.error(e);
-            Module.on_socket_close();
-        };
-    });
+            if (window.__socket) {
+                window.__socket.close();
+            }
+            var path = (location.protocol == 'https:' ? 'wss' : 'ws') + '://'
+                + location.host + '/api/socket';
+
+            // Message types, whose replies are only meant for the sending tab
+            var SYNC = $2;
+            var NOP = $3;
+            var SERVER_TIME = $4;
+
+            // Socket shared by all tabs synced to the same feed. The tab
+            // holding the feed's lock opens the actual WebSocket and relays
+            // received feed messages to all tabs over a BroadcastChannel. The
+            // other tabs relay their sent messages through it. Replies to
+            // synchronisation requests and heartbeats are only passed to the
+            // tab, that sent the request. Provides the subset of the WebSocket
+            // API used by this module.
+            function SharedSocket(path, name)
+            {
+                var self = this;
+                var ch = new BroadcastChannel(name);
+                var abort = new AbortController();
+                var ws = null; // Actual socket, if this tab is the leader
+                var open = false;
+                var closed = false;
+
+                // Routing ID of this tab
+                var tab = Math.random().toString(36).slice(2);
+
+                // IDs of the tabs awaiting a reply by reply message type in
+                // request order. The server replies in the same order.
+                var pending = {};
+                var firstSync = true;
+
+                self.shared = true;
+                Object.defineProperty(self, 'bufferedAmount', {
+                    get : function() { return ws ? ws.bufferedAmount : 0; }
+                });
+
+                function emitOpen()
+                {
+                    if (!open && !closed) {
+                        open = true;
+                        self.onopen();
+                    }
+                }
+                function emitClose(code, reason)
+                {
+                    if (closed) {
+                        return;
+                    }
+                    closed = true;
+                    open = false;
+                    abort.abort();
+                    ch.close();
+                    self.onclose({ code : code || 1006, reason : reason || '' });
+                }
+
+                // Send a message of the tab with the passed ID on the actual
+                // socket
+                function relay(data, from)
+                {
+                    if (ws.readyState != 1) {
+                        return;
+                    }
+                    switch (+data.substr(0, 2)) {
+                    case SYNC:
+                        // The server sends its time on the first sync too
+                        if (firstSync) {
+                            firstSync = false;
+                            pending[SERVER_TIME].push(from);
+                        }
+                        pending[SYNC].push(from);
+                        break;
+                    case NOP:
+                        pending[SERVER_TIME].push(from);
+                        break;
+                    }
+                    ws.send(data);
+                }
+
+                // Pass a received frame to the tab, that awaits it, or to all
+                // tabs
+                function dispatch(e)
+                {
+                    var d = e.data;
+                    var q = pending[typeof d == 'string'
+                            ? +d.substr(0, 2)
+                            : new Uint8Array(d)[0]];
+                    var to = q && q.length ? q.shift() : null;
+                    if (to === null) {
+                        ch.postMessage({ t : 'msg', d : e.data });
+                        self.onmessage(e);
+                    } else if (to == tab) {
+                        self.onmessage(e);
+                    } else {
+                        ch.postMessage({ t : 'msg', d : e.data, to : to });
+                    }
+                }
+
+                ch.onmessage = function(e)
+                {
+                    var m = e.data;
+                    if (ws) {
+                        switch (m.t) {
+                        case 'send':
+                            relay(m.d, m.from);
+                            break;
+                        case 'hello':
+                            if (ws.readyState == 1) {
+                                ch.postMessage({ t : 'open' });
+                            }
+                            break;
+                        }
+                        return;
+                    }
+                    switch (m.t) {
+                    case 'open':
+                        emitOpen();
+                        break;
+                    case 'msg':
+                        if (open && (!m.to || m.to == tab)) {
+                            self.onmessage({ data : m.d });
+                        }
+                        break;
+                    case 'close':
+                        emitClose(m.code, m.reason);
+                        break;
+                    }
+                };
+
+                self.send = function(data)
+                {
+                    if (ws) {
+                        relay(data, tab);
+                    } else {
+                        ch.postMessage({ t : 'send', d : data, from : tab });
+                    }
+                };
+                self.close = function()
+                {
+                    if (ws) {
+                        ws.close();
+                    } else {
+                        emitClose(1000, '');
+                    }
+                };
+
+                navigator.locks
+                    .request(name, { signal : abort.signal },
+                        function() {
+                            if (closed) {
+                                return;
+                            }
+                            if (open) {
+                                // The leader has gone away. Frames might have
+                                // been missed, so resync through a new socket.
+                                emitClose(1006, '');
+                                return;
+                            }
+
+                            // Followers of a previous leader resync
+                            ch.postMessage({ t : 'close' });
+                            return new Promise(function(release) {
+                                ws = new WebSocket(path);
+                                ws.binaryType = 'arraybuffer';
+                                pending[SYNC] = [];
+                                pending[SERVER_TIME] = [];
+                                ws.onopen = function()
+                                {
+                                    ch.postMessage({ t : 'open' });
+                                    emitOpen();
+                                };
+                                ws.onmessage = dispatch;
+                                ws.onclose = function(e)
+                                {
+                                    ch.postMessage({
+                                        t : 'close',
+                                        code : e.code,
+                                        reason : e.reason
+                                    });
+                                    emitClose(e.code, e.reason);
+                                    release();
+                                };
+                                ws.onerror = function(e) { console.error(e); };
+                            });
+                        })
+                    .catch(function() {}); // Aborted request
+
+                // Ask an existing leader to report its socket as open
+                ch.postMessage({ t : 'hello' });
+            }
+
+            var s;
+            if ($1 && window.BroadcastChannel && navigator.locks
+                && window.AbortController) {
+                s = window.__socket
+                    = new SharedSocket(path, 'meguca-socket:' + UTF8ToString($0));
+            } else {
+                s = window.__socket = new WebSocket(path);
+                s.binaryType = 'arraybuffer';
+            }
+
+            // Socket events are queued and handled in bounded time slices, so
+            // bursts of messages do not block input and rendering. Closing and
+            // errors go through the same queue to preserve event order.
+            var queue = [];
+            var head = 0;
+            var scheduled = false;
+            function push(fn)
+            {
+                queue.push(fn);
+                if (!scheduled) {
+                    scheduled = true;
+                    setTimeout(drain, 0);
+                }
+            }
+            function drain()
+            {
+                var deadline = performance.now() + 8;
+                while (head < queue.length && performance.now() < deadline) {
+                    if (window.__socket != s) { // Replaced by a newer socket
+                        queue = [];
+                        head = 0;
+                        break;
+                    }
+                    queue[head++]();
+                }
+                if (head < queue.length) {
+                    setTimeout(drain, 0);
+                    return;
+                }
+                queue = [];
+                head = 0;
+                scheduled = false;
+            }
+
+            s.onopen = function() { push(Module.on_socket_open); };
+            s.onclose = function(e)
+            {
+                // 1013 "Try Again Later" carries the minimum delay of the next
+                // attempt in seconds as the reason
+                var sec = parseInt(e.reason, 10);
+                if (e.code == 1013 && sec > 0) {
+                    Module.set_retry_after(sec);
+                }
+                push(Module.on_socket_close);
+            };
+            s.onmessage = function(e)
+            {
+                var data = e.data;
+                push(function() {
+                    if (data instanceof ArrayBuffer) {
+                        // Copy the frame into the wasm heap once and decode it
+                        // there
+                        var arr = new Uint8Array(data);
+                        var buf = Module._malloc(arr.length || 1);
+                        HEAPU8.set(arr, buf);
+                        Module.on_socket_binary_message(buf, arr.length);
+                        return;
+                    }
+                    var len = lengthBytesUTF8(data) + 1;
+                    var buf = Module._malloc(len);
+                    stringToUTF8(data, buf, len);
+                    Module.on_socket_message(buf);
+                });
+            };
+            s.onerror = function(e)
+            {
+                console.error(e);
+                push(Module.on_socket_close);
+            };
+        },
+        key.c_str(), !exclusive_socket, int(Message::synchronise),
+        int(Message::NOP), int(Message::server_time));
 }
 
-void send_message(Message type, string msg)
+// Bytes buffered by the socket, above which sending is deferred
+static const int max_buffered = 1 << 16;
+
+// Delay of retrying to send deferred messages in milliseconds
+static const int backpressure_delay = 50;
+
+// Message pending to be sent
+struct Outgoing {
+    Message type;
+    string msg;
+
+    // Coalesced appends to the open post. Sent as an append message, if only
+    // one character, and as a splice otherwise.
+    size_t start = 0, // Body length in characters before the first append
+        len = 0; // Number of appended characters
+};
+
+// Messages pending to be sent in order
+static std::deque<Outgoing> outgoing;
+
+// A retry of sending deferred messages is scheduled
+static bool flush_scheduled = false;
+
+static void send_now(Message type, const string& msg)
 {
     const string s = encode_message(type, msg);
     if (debug) {
@@ -297,6 +956,83 @@ void send_message(Message type, string msg)
     EM_ASM_INT({ window.__socket.send(UTF8ToString($0)); }, s.c_str());
 }
 
+static void flush_outgoing()
+{
+    flush_scheduled = false;
+    while (outgoing.size() && conn_SM.state() == ConnState::synced) {
+        if (EM_ASM_INT({ return window.__socket.bufferedAmount; })
+            > max_buffered) {
+            if (!flush_scheduled) {
+                flush_scheduled = true;
+                EM_ASM_INT(
+                    { setTimeout(Module.flush_outgoing, $0); },
+                    backpressure_delay);
+            }
+            return;
+        }
+
+        auto& m = outgoing.front();
+        if (m.type != Message::append) {
+            send_now(m.type, m.msg);
+        } else if (m.len == 1) {
+            auto it = m.msg.begin();
+            send_now(Message::append,
+                std::to_string(utf8::unchecked::next(it)));
+        } else {
+            send_now(Message::splice,
+                json({ { "start", m.start }, { "len", 0 }, { "text", m.msg } })
+                    .dump());
+        }
+        outgoing.pop_front();
+    }
+}
+
+// Responses to messages other than heartbeats are only meant for this tab.
+// Reconnect on a socket of its own, if the current one is shared. Queued
+// messages are sent, once synced on the new socket.
+static void claim_socket()
+{
+    if (exclusive_socket) {
+        return;
+    }
+    exclusive_socket = true;
+    if (is_shared()) {
+        conn_SM.feed(ConnEvent::close);
+        conn_SM.feed(ConnEvent::retry);
+    }
+}
+
+void send_message(Message type, string msg)
+{
+    // Synchronisation requests are sent right after the socket opens, so they
+    // can not wait for a synced connection
+    if (type == Message::synchronise) {
+        return send_now(type, msg);
+    }
+    outgoing.push_back({ type, std::move(msg) });
+    if (type != Message::NOP) {
+        claim_socket();
+    }
+    flush_outgoing();
+}
+
+void send_append(size_t start, char32_t ch)
+{
+    if (outgoing.size()) {
+        auto& last = outgoing.back();
+        if (last.type == Message::append && last.start + last.len == start) {
+            utf8::unchecked::append(ch, std::back_inserter(last.msg));
+            last.len++;
+            return;
+        }
+    }
+    Outgoing m{ Message::append, "", start, 1 };
+    utf8::unchecked::append(ch, std::back_inserter(m.msg));
+    outgoing.push_back(std::move(m));
+    claim_socket();
+    flush_outgoing();
+}
+
 // Render connection status indicator
 static void render_status(SyncStatus status)
 {
@@ -307,18 +1043,6 @@ static void render_status(SyncStatus status)
     brunhild::set_inner_html("sync", s);
 }
 
-// Schedule an attempt to reconnect after a connection loss
-static void schedule_reconnect()
-{
-    EM_ASM({
-        // Wait maxes out at ~1min
-        var wait
-            = Math.min(Math.floor(++window.__connection_attempt_count / 2), 12);
-        wait = 500 * Math.pow(1.5, wait);
-        setTimeout(Module.retry_to_connect, wait);
-    });
-}
-
 void init_connectivity()
 {
     // Define some JS-side functions and listeners
@@ -338,6 +1062,10 @@ void init_connectivity()
         });
     });
 
+    init_reconnect();
+    init_heartbeat();
+    conn_SM.on(ConnState::synced, flush_outgoing);
+
     // Define transition rules for the connection FSM
 
     conn_SM.act(ConnState::loading, ConnEvent::start, []() {
@@ -355,8 +1083,13 @@ void init_connectivity()
         return ConnState::synced;
     });
 
-    // Switching from one update feed to another
+    // Switching from one update feed to another. Shared sockets are specific
+    // to a feed.
     conn_SM.act(ConnState::synced, ConnEvent::switch_sync, []() {
+        if (is_shared()) {
+            connect();
+            return ConnState::connecting;
+        }
         send_sync_request();
         return ConnState::syncing;
     });
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "../fsm.hh"
+#include <cstdint>
+#include <string>
 
 // Websocket connection and synchronization with server states
 enum class SyncStatus {
@@ -19,11 +21,21 @@ enum class ConnState {
     syncing,
     synced,
     dropped,
-    desynced
+    desynced,
+    _count
 };
 
 // Events passable to the connection FSM
-enum class ConnEvent { start, open, close, retry, error, sync, switch_sync };
+enum class ConnEvent {
+    start,
+    open,
+    close,
+    retry,
+    error,
+    sync,
+    switch_sync,
+    _count
+};
 
 // Finite state machine for managing websocket connectivity
 inline FSM<ConnState, ConnEvent> conn_SM = { ConnState::loading };
@@ -33,18 +45,14 @@ enum class Message : uint8_t {
     invalid,
 
     // 1 - 29 modify post model state
-    _,
     insert_post,
     append,
     backspace,
     splice,
     close_post,
-    __,
     insert_image,
     spoiler,
-    delete_post,
-    banned,
-    delete_image,
+    moderate_post,
 
     // >= 30 are miscellaneous and do not write to post models
     synchronise = 30,
@@ -85,5 +93,12 @@ enum class Message : uint8_t {
 // Initialize websocket connectivity module
 void init_connectivity();
 
-// Send a websocket message the server
+// Send a websocket message the server. Messages other than synchronisation
+// requests are queued, while the connection is not synced or the socket's send
+// buffer is full, and sent in order later.
 void send_message(Message, std::string);
+
+// Send a character appended to the open post. start is the length of the
+// post's body in characters before the append. Consecutive appends, that are
+// still queued, are coalesced into a single splice.
+void send_append(size_t start, char32_t ch);
@@ -0,0 +1,135 @@
+#include "heartbeat.hh"
+#include "../../brunhild/profile.hh"
+#include "../posts/commands.hh"
+#include "connection.hh"
+#include <cmath>
+#include <emscripten.h>
+#include <emscripten/bind.h>
+
+// Heartbeat intervals of visible and hidden tabs and the timeout of a
+// heartbeat response in milliseconds
+static const int visible_interval = 30000, hidden_interval = 300000,
+                 response_timeout = 10000;
+
+// IDs of the pending JS timeouts of the next heartbeat and the response
+// deadline or 0
+static int next_timer = 0, deadline_timer = 0;
+
+// Time the pending heartbeat was sent at or 0
+static double sent_at = 0;
+
+static brunhild::profile::Metric rtt_metric("heartbeat_rtt");
+
+static void clear_timer(int& timer)
+{
+    if (timer) {
+        EM_ASM_INT({ clearTimeout($0); }, timer);
+        timer = 0;
+    }
+}
+
+// Call the bound function fn after delay milliseconds and return the timeout
+// ID
+static int set_timer(const char* fn, int delay)
+{
+    return EM_ASM_INT(
+        {
+            var fn = UTF8ToString($0);
+            return setTimeout(function() { Module[fn](); }, $1);
+        },
+        fn, delay);
+}
+
+static void schedule_heartbeat()
+{
+    clear_timer(next_timer);
+    const bool hidden = EM_ASM_INT({ return document.hidden ? 1 : 0; });
+    next_timer = set_timer(
+        "run_heartbeat_timer", hidden ? hidden_interval : visible_interval);
+}
+
+static void stop_heartbeat()
+{
+    clear_timer(next_timer);
+    clear_timer(deadline_timer);
+    sent_at = 0;
+}
+
+void send_heartbeat()
+{
+    if (conn_SM.state() != ConnState::synced) {
+        return;
+    }
+    if (!sent_at) {
+        sent_at = emscripten_get_now();
+        deadline_timer = set_timer("run_heartbeat_deadline", response_timeout);
+        send_message(Message::NOP, "");
+    }
+    schedule_heartbeat();
+}
+
+void on_server_time(long time)
+{
+    // The server sends whole seconds, so correcting for half of the round
+    // trip would be below its resolution
+    const double now = EM_ASM_DOUBLE({ return Date.now(); }) / 1000;
+    server_time_offset = std::lround(time - now);
+    if (sent_at) {
+        rtt_metric.finish(sent_at);
+        sent_at = 0;
+        clear_timer(deadline_timer);
+    }
+}
+
+static void run_heartbeat_timer()
+{
+    next_timer = 0;
+    send_heartbeat();
+}
+
+// No response in time. The socket is likely half-open, so close it and let
+// the connection FSM reconnect.
+static void run_heartbeat_deadline()
+{
+    deadline_timer = 0;
+    sent_at = 0;
+    EM_ASM({
+        if (window.__socket) {
+            window.__socket.close();
+        }
+    });
+}
+
+void init_heartbeat()
+{
+    conn_SM.on(ConnState::synced, send_heartbeat);
+    conn_SM.on(ConnState::dropped, stop_heartbeat);
+    conn_SM.on(ConnState::desynced, stop_heartbeat);
+
+    // Switch to the interval of the new visibility state
+    EM_ASM({
+        document.addEventListener('visibilitychange',
+            function() { Module.reschedule_heartbeat(); });
+    });
+}
+
+// Visible tabs check the connection right away, in case the computer went to
+// sleep or the mobile browser suspended the tab
+static void reschedule_heartbeat()
+{
+    if (conn_SM.state() != ConnState::synced) {
+        return;
+    }
+    if (EM_ASM_INT({ return document.hidden ? 1 : 0; })) {
+        schedule_heartbeat();
+    } else {
+        send_heartbeat();
+    }
+}
+
+EMSCRIPTEN_BINDINGS(module_heartbeat)
+{
+    emscripten::function("run_heartbeat_timer", &run_heartbeat_timer);
+    emscripten::function("run_heartbeat_deadline", &run_heartbeat_deadline);
+    emscripten::function("reschedule_heartbeat", &reschedule_heartbeat);
+}
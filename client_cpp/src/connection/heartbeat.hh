@@ -0,0 +1,14 @@
+// Periodic application-level heartbeat over the websocket connection
+
+#pragma once
+
+// Send heartbeats while synced and stop on connection loss
+void init_heartbeat();
+
+// Send a heartbeat right away. The connection is closed, if the server does
+// not respond in time.
+void send_heartbeat();
+
+// Handle the current server Unix time, that is sent on the first sync and in
+// response to heartbeats
+void on_server_time(long time);
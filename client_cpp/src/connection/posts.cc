@@ -1,7 +1,10 @@
 #include "posts.hh"
 #include "../../brunhild/mutations.hh"
+#include "../page/gallery.hh"
 #include "../page/thread.hh"
 #include "../posts/models.hh"
+#include "../posts/search.hh"
+#include "../posts/seen.hh"
 #include "../state.hh"
 #include <nlohmann/json.hpp>
 
@@ -21,8 +24,7 @@ void insert_post(std::string_view msg)
 
     // Need to ensure the post is queued to render and in the global collection
     // for all further operations
-    (posts)[p.id] = p;
-    auto& ref = posts.at(p.id);
+    auto& ref = add_post(std::move(p));
     if (!ref.editing) {
         ref.propagate_links();
     }
@@ -31,11 +33,18 @@ void insert_post(std::string_view msg)
     t.post_ctr++;
     if (ref.image) {
         t.image_ctr++;
+        index_gallery_image(ref);
     }
     if (auto v = ThreadView::instances[page.thread]; v) {
-        v->patch();
+        // New posts nearly always arrive at the end of the thread
+        const auto& index = thread_posts[page.thread];
+        if (ref.views.empty() && index.size() && index.back() == &ref) {
+            v->push_back(&ref);
+        } else {
+            v->patch();
+        }
     }
     render_post_counter();
-
-    // TODO: Unread post counting
+    add_unread(ref);
+    index_post(ref);
 }
@@ -0,0 +1,102 @@
+#include "reconnect.hh"
+#include "connection.hh"
+#include <algorithm>
+#include <cmath>
+#include <emscripten.h>
+#include <emscripten/bind.h>
+
+// Base and maximum delay of reconnection attempts in milliseconds
+static const double base_delay = 500, max_delay = 60000;
+
+// Number of failed attempts since the last successful sync
+static unsigned attempts = 0;
+
+// ID of the pending JS timeout or 0
+static int timer = 0;
+
+// Minimum delay of the next attempt in milliseconds, as requested by the
+// server
+static double retry_after = 0;
+
+static void cancel_timer()
+{
+    if (timer) {
+        EM_ASM_INT({ clearTimeout($0); }, timer);
+        timer = 0;
+    }
+}
+
+static void start_timer(double delay)
+{
+    cancel_timer();
+    timer = EM_ASM_INT(
+        {
+            return setTimeout(function() {
+                Module.run_reconnect_timer();
+            }, $0);
+        },
+        int(delay));
+}
+
+static void run_reconnect_timer()
+{
+    timer = 0;
+    conn_SM.feed(ConnEvent::retry);
+}
+
+void schedule_reconnect()
+{
+    // Caps the exponent too, so the power does not overflow
+    const double cap = std::min(
+        max_delay, base_delay * std::pow(2, std::min(attempts++, 16u)));
+    double delay = cap * emscripten_random();
+    if (retry_after) {
+        // Still spread out the clients told to wait
+        delay += retry_after;
+        retry_after = 0;
+    }
+    start_timer(delay);
+}
+
+void reset_reconnect()
+{
+    cancel_timer();
+    attempts = 0;
+    retry_after = 0;
+}
+
+// Server-provided minimum delay of the next attempt in seconds
+static void set_retry_after(unsigned sec) { retry_after = sec * 1000.0; }
+
+// A network change makes previous failures meaningless. Retry soon, but still
+// spread out the clients on the same network.
+static void on_network_change()
+{
+    if (conn_SM.state() != ConnState::dropped) {
+        return;
+    }
+    attempts = 0;
+    start_timer(base_delay * emscripten_random());
+}
+
+void init_reconnect()
+{
+    conn_SM.on(ConnState::synced, reset_reconnect);
+    EM_ASM({
+        var c = navigator.connection;
+        if (c && c.addEventListener) {
+            c.addEventListener('change', function() {
+                if (navigator.onLine) {
+                    Module.on_network_change();
+                }
+            });
+        }
+    });
+}
+
+EMSCRIPTEN_BINDINGS(module_reconnect)
+{
+    emscripten::function("run_reconnect_timer", &run_reconnect_timer);
+    emscripten::function("set_retry_after", &set_retry_after);
+    emscripten::function("on_network_change", &on_network_change);
+}
@@ -0,0 +1,14 @@
+// Scheduling of reconnection attempts after a connection loss
+
+#pragma once
+
+// Schedule an attempt to reconnect after a connection loss. Delays back off
+// exponentially with full jitter, so clients dropped at the same time do not
+// reconnect in lockstep.
+void schedule_reconnect();
+
+// Cancel any pending attempt and reset the backoff after a successful sync
+void reset_reconnect();
+
+// Listen for network changes, that warrant an immediate reconnection attempt
+void init_reconnect();
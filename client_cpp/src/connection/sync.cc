@@ -13,6 +13,8 @@ void send_sync_request()
         { "protocolVersion", protocol_version }, { "last100", page.last_100 },
         { "catalog", page.catalog }, { "board", page.board },
         { "page", page.page }, { "thread", page.thread },
+        // Server sends binary frames instead of text ones, if supported
+        { "binary", true },
     });
     send_message(Message::synchronise, j.dump());
 
@@ -1,8 +1,11 @@
+#include "../brunhild/profile.hh"
+#include "posts/hide.hh"
 #include "state.hh"
 #include "util.hh"
 #include <cstdint>
 #include <emscripten.h>
 #include <emscripten/bind.h>
+#include <stdlib.h>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -15,8 +18,22 @@ static bool has_erred = false;
 // Has completed or erred out of loading the database at least once
 static bool has_loaded = false;
 
+// Buffered post ID writes as interleaved (id, op) pairs, indexed by
+// StorageType
+static std::vector<uint32_t> pending_writes[4];
+
+// A flush of pending_writes is scheduled
+static bool flush_scheduled = false;
+
+static brunhild::profile::Metric open_metric("db_open"),
+    load_metric("db_load");
+
+// Start time of the pending database open or post ID load
+static double load_started = 0;
+
 void open_db(WaitGroup* wg)
 {
+    load_started = brunhild::profile::now();
     EM_ASM_INT(
         {
             // Expiring post ID object stores
@@ -42,6 +59,19 @@ void open_db(WaitGroup* wg)
                 Module._handle_db_error(e.toString(), $1);
             };
 
+            // Post ID changes of other tabs as (id, op) pairs
+            if (window.BroadcastChannel) {
+                var ch = window.__post_ids_channel
+                    = new BroadcastChannel('meguca-post-ids');
+                ch.onmessage = function(e)
+                {
+                    var ids = e.data.ids;
+                    var ptr = Module._malloc(ids.length * 4 || 4);
+                    HEAPU32.set(ids, ptr >> 2);
+                    Module.on_remote_post_ids(e.data.typ, ptr, ids.length);
+                };
+            }
+
             var r = indexedDB.open('meguca', $0);
             r.onerror = function(e)
             {
@@ -102,34 +132,66 @@ void open_db(WaitGroup* wg)
 
                 Module.db_is_ready($1);
 
-                // Delete expired keys from post ID object stores.
-                // Delay for quicker starts.
-                setTimeout(
-                    function() {
-                        var arr = postStores.concat(threadStores);
-                        for (var i = 0; i < arr.length; i++) {
-                            var name = arr[i];
-                            var t = db.transaction(name, 'readwrite');
-                            t.onerror = handle_db_error;
-
-                            var range = IDBKeyRange.upperBound(Date.now());
-                            var req = t.objectStore(name)
-                                          .index('expires')
-                                          .openCursor(range);
-                            req.onerror = handle_db_error;
-                            req.onsuccess = function(event)
-                            {
-                                var cursor = event.result;
-                                if (!cursor) {
-                                    return;
-                                }
-                                cursor.delete();
-                                cursor.continue();
-                            };
+                // Write buffered changes before the page is possibly unloaded
+                document.addEventListener('visibilitychange', function() {
+                    if (document.hidden) {
+                        Module._flush_db_writes();
+                    }
+                });
+
+                sweepExpired();
+            };
+
+            // Delete expired keys from all expiring object stores in bounded
+            // chunks on idle callbacks. Skipped, if any tab swept recently.
+            function sweepExpired()
+            {
+                var key = 'lastDBSweep';
+                var now = Date.now();
+                var last = parseInt(localStorage.getItem(key)) || 0;
+                if (now - last < 60 * 60 * 1000) {
+                    return;
+                }
+                localStorage.setItem(key, now);
+
+                var stores = postStores.concat(threadStores);
+                var chunk = 256;
+                var idle = window.requestIdleCallback || function(fn)
+                {
+                    return setTimeout(fn, 100);
+                };
+
+                function sweep(i)
+                {
+                    if (i == stores.length) {
+                        return;
+                    }
+                    var t = db.transaction(stores[i], 'readwrite');
+                    t.onerror = handle_db_error;
+                    var s = t.objectStore(stores[i]);
+                    var req = s.index('expires').getAllKeys(
+                        IDBKeyRange.upperBound(now), chunk);
+                    req.onerror = handle_db_error;
+                    req.onsuccess = function(event)
+                    {
+                        var keys = event.target.result;
+                        for (var j = 0; j < keys.length; j++) {
+                            s.delete(keys[j]);
                         }
-                    },
+
+                        // Continue with the same store, if the chunk was full
+                        var next = keys.length == chunk ? i : i + 1;
+                        t.oncomplete = function()
+                        {
+                            idle(function() { sweep(next); });
+                        };
+                    };
+                }
+
+                // Delay for quicker starts
+                setTimeout(function() { idle(function() { sweep(0); }); },
                     10000);
-            };
+            }
 
             function createExpiringStore(db, name)
             {
@@ -153,6 +215,8 @@ void load_post_ids(WaitGroup* wg)
         return wg->done();
     }
 
+    load_started = brunhild::profile::now();
+
     // Map to vector, so we can pass it to JS
     std::vector<unsigned long> ids;
     ids.reserve(threads.size());
@@ -162,38 +226,47 @@ void load_post_ids(WaitGroup* wg)
 
     EM_ASM_INT(
         {
-            var left = 0;
-
-            for (var i = 0; i < $1; i++) {
-                var id = getValue($0 + i * 8, 'i64');
-                left += postStores.length;
-                for (var j = 0; j < postStores.length; j++) {
-                    read(id, j, postStores[j]);
+            // Read all stores in one transaction. Post IDs are the primary
+            // keys, so they can be read in bulk from the "op" index.
+            var t = db.transaction(postStores, 'readonly');
+            t.onerror = handle_db_error;
+            t.onabort = function()
+            {
+                // Do not block rendering on failed reads
+                Module.db_is_ready($2);
+            };
+            var results = [];
+            for (var j = 0; j < postStores.length; j++) {
+                results.push([]);
+                var index = t.objectStore(postStores[j]).index('op');
+                for (var i = 0; i < $1; i++) {
+                    read(index, HEAPU32[($0 >> 2) + i], results[j]);
                 }
             }
 
+            // Pass each store's IDs as one typed array
+            t.oncomplete = function()
+            {
+                for (var j = 0; j < results.length; j++) {
+                    var ids = results[j];
+                    var buf = Module._malloc(ids.length * 4 || 4);
+                    HEAPU32.set(ids, buf >> 2);
+                    Module.add_to_storage(j, buf, ids.length);
+                }
+                Module.db_is_ready($2);
+            };
+
             // Need to scope variables to function, because async. ES5 a
             // shit.
-            function read(op, typ, name)
+            function read(index, op, dst)
             {
-                var ids = new Module.VectorUint64();
-                var t = db.transaction(name, 'readonly');
-                t.onerror = handle_db_error;
-
-                var range = IDBKeyRange.bound(op, op);
-                var req = t.objectStore(name).index('op').openCursor(range);
+                var req = index.getAllKeys(IDBKeyRange.only(op));
                 req.onerror = handle_db_error;
                 req.onsuccess = function(event)
                 {
-                    var cursor = event.target.result;
-                    if (cursor) {
-                        ids.push_back(cursor.value.id);
-                        cursor.continue();
-                    } else {
-                        Module.add_to_storage(typ, ids);
-                        if (--left == 0) {
-                            Module.db_is_ready($2);
-                        }
+                    var keys = event.target.result;
+                    for (var i = 0; i < keys.length; i++) {
+                        dst.push(keys[i]);
                     }
                 };
             }
@@ -201,9 +274,161 @@ void load_post_ids(WaitGroup* wg)
         ids.data(), ids.size(), wg);
 }
 
+// Schedule flushing of pending writes, when the browser is idle
+static void schedule_flush()
+{
+    if (flush_scheduled) {
+        return;
+    }
+    flush_scheduled = true;
+    EM_ASM({
+        var fn = function() { Module._flush_db_writes(); };
+        if (window.requestIdleCallback) {
+            requestIdleCallback(fn, { timeout : 5000 });
+        } else {
+            setTimeout(fn, 1000);
+        }
+    });
+}
+
+// Write all pending post ID changes in one transaction
+static void flush_db_writes()
+{
+    flush_scheduled = false;
+    if (has_erred) {
+        for (auto& w : pending_writes) {
+            w.clear();
+        }
+        return;
+    }
+    if (!has_loaded) {
+        return schedule_flush();
+    }
+
+    auto& w = pending_writes;
+    EM_ASM_INT(
+        {
+            var names = [];
+            var args = ([ [ $0, $1 ], [ $2, $3 ], [ $4, $5 ], [ $6, $7 ] ]);
+            for (var j = 0; j < args.length; j++) {
+                if (args[j][1]) {
+                    names.push(postStores[j]);
+                }
+            }
+            if (!names.length) {
+                return;
+            }
+
+            // Expiry times are computed once per batch. Hidden posts are
+            // retained longer.
+            var tenDays = 10 * 24 * 60 * 60 * 1000;
+            var now = Date.now();
+            var expiry = ([ tenDays, tenDays, tenDays, tenDays * 18 ]);
+
+            // Other tabs apply the changes without writing them again
+            var ch = window.__post_ids_channel;
+            for (var j = 0; ch && j < args.length; j++) {
+                if (args[j][1]) {
+                    var start = args[j][0] >> 2;
+                    ch.postMessage({
+                        typ : j,
+                        ids : HEAPU32.slice(start, start + args[j][1])
+                    });
+                }
+            }
+
+            var t = db.transaction(names, 'readwrite');
+            t.onerror = handle_db_error;
+            for (var j = 0; j < args.length; j++) {
+                var ptr = args[j][0] >> 2;
+                var len = args[j][1];
+                if (!len) {
+                    continue;
+                }
+                var s = t.objectStore(postStores[j]);
+                var expires = now + expiry[j];
+                for (var i = 0; i < len; i += 2) {
+                    var id = HEAPU32[ptr + i];
+                    s.put({ id : id, op : HEAPU32[ptr + i + 1],
+                        expires : expires }, id);
+                }
+            }
+        },
+        w[0].data(), w[0].size(), w[1].data(), w[1].size(), w[2].data(),
+        w[2].size(), w[3].data(), w[3].size());
+    for (auto& v : w) {
+        v.clear();
+    }
+}
+
+void store_post_id(StorageType typ, unsigned long id, unsigned long op)
+{
+    IDSet* set = nullptr;
+    switch (typ) {
+    case StorageType::mine:
+        set = &post_ids.mine;
+        break;
+    case StorageType::seen_replies:
+        set = &post_ids.seen_replies;
+        break;
+    case StorageType::seen_posts:
+        set = &post_ids.seen_posts;
+        break;
+    case StorageType::hidden:
+        set = &post_ids.hidden;
+        break;
+    }
+    if (!set->insert(id) || has_erred) {
+        return;
+    }
+
+    auto& w = pending_writes[static_cast<int>(typ)];
+    w.push_back(id);
+    w.push_back(op);
+    schedule_flush();
+}
+
+// Apply post ID changes made by another tab. Takes ownership of a malloc()ed
+// array of n interleaved (id, op) pairs passed as int.
+static void on_remote_post_ids(int typ, int ptr, int n)
+{
+    auto ids = reinterpret_cast<uint32_t*>(ptr);
+    const auto t = static_cast<StorageType>(typ);
+    for (int i = 0; i < n; i += 2) {
+        const unsigned long id = ids[i];
+        switch (t) {
+        case StorageType::hidden:
+            if (auto p = posts.find(id); p) {
+                hide_recursively(*p);
+            } else {
+                post_ids.hidden.insert(id);
+            }
+            break;
+        case StorageType::mine:
+            if (post_ids.mine.insert(id)) {
+                // Links to the post are marked as the user's
+                for (auto& [linker, _] : link_graph.backlinks(id)) {
+                    if (auto p = posts.find(linker); p) {
+                        p->patch();
+                    }
+                }
+            }
+            break;
+        case StorageType::seen_replies:
+            post_ids.seen_replies.insert(id);
+            break;
+        case StorageType::seen_posts:
+            post_ids.seen_posts.insert(id);
+            break;
+        }
+    }
+    free(ids);
+}
+
 // Signals the database is ready. Called from the JS side.
 static void db_is_ready(int wg)
 {
+    (has_loaded ? load_metric : open_metric).finish(load_started);
     has_loaded = true;
     reinterpret_cast<WaitGroup*>(wg)->done();
 }
@@ -221,4 +446,6 @@ EMSCRIPTEN_BINDINGS(module_db)
 {
     emscripten::function("_handle_db_error", &handle_db_error);
     emscripten::function("db_is_ready", &db_is_ready);
+    emscripten::function("on_remote_post_ids", &on_remote_post_ids);
+    emscripten::function("_flush_db_writes", &flush_db_writes);
 }
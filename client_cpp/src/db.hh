@@ -1,5 +1,6 @@
 #pragma once
 
+#include "state.hh"
 #include "util.hh"
 #include <string>
 #include <unordered_set>
@@ -9,3 +10,8 @@ void open_db(WaitGroup*);
 
 // Load post ID sets from the database. Reports readiness to WaitGroup*.
 void load_post_ids(WaitGroup*);
+
+// Add a post ID to one of the post ID sets and persist it. Writes are
+// buffered and flushed in one transaction, when the browser is idle or the
+// page is hidden.
+void store_post_id(StorageType, unsigned long id, unsigned long op);
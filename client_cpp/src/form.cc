@@ -32,13 +32,13 @@ brunhild::Node Form::render_controls()
             {
                 "input",
                 {
-                    { "type", "submit" }, { "value", lang.ui.at("submit") },
+                    { "type", "submit" }, { "value", lang.ui[UIKey::submit] },
                 },
             },
             {
                 "input",
                 {
-                    { "type", "button" }, { "value", lang.ui.at("cancel") },
+                    { "type", "button" }, { "value", lang.ui[UIKey::cancel] },
                     { "name", "cancel" },
                 },
             },
@@ -1,20 +1,24 @@
 #pragma once
 
+#include <array>
 #include <functional>
-#include <map>
+#include <stddef.h>
 #include <type_traits>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
-// Finite State Machine
+// Finite State Machine with a dense state x event transition table. Both enums
+// must be contiguous, start at 0 and end with a _count member.
 template <class S, class E> class FSM {
     static_assert(std::is_enum<S>::value, "must be an enum type");
     static_assert(std::is_enum<E>::value, "must be an enum type");
 
+    static constexpr size_t state_count = static_cast<size_t>(S::_count);
+    static constexpr size_t event_count = static_cast<size_t>(E::_count);
+
 public:
-    // Defines a type transition and executes arbitrary code
-    typedef std::function<S()> Handler;
+    // Defines a type transition and executes arbitrary code. Must not capture
+    // any state, so the transition table needs no allocations.
+    typedef S (*Handler)();
 
     // Create a new FSM with the supplied start state
     FSM(S state)
@@ -28,76 +32,77 @@ public:
     // Assign a handler to be execute on arrival to a new state
     void on(S state, std::function<void()> fn)
     {
-        state_handlers[state].push_back(fn);
+        state_handlers[index(state)].push_back(fn);
     }
 
     // Like on, but handler is removed after execution
     void once(S state, std::function<void()> fn)
     {
-        once_handlers[state].push_back(fn);
+        once_handlers[index(state)].push_back(fn);
     }
 
     // Specify state transition and a handler to execute on it. The handler must
     // return the next state of FSM.
     void act(S start, E event, Handler fn)
     {
-        transitions[{ start, event }] = fn;
+        transitions[index(start)][index(event)] = fn;
     }
 
     // Specify an event and handler, that will execute, when this event is
     // fired, on any state
-    void wild_act(E event, Handler fn) { wilds[event] = fn; }
+    void wild_act(E event, Handler fn) { wilds[index(event)] = fn; }
 
     // Feed an event to the FSM
     void feed(E event)
     {
-        S result;
-
-        if (wilds.count(event)) {
-            result = wilds[event]();
-        } else {
-            const std::pair<S, E> key = { _state, event };
-            if (!transitions.count(key)) {
+        Handler fn = wilds[index(event)];
+        if (!fn) {
+            fn = transitions[index(_state)][index(event)];
+            if (!fn) {
                 // Not registered - NOP
                 return;
             }
-            result = transitions[key]();
         }
 
+        const S result = fn();
         if (result == _state) {
             return;
         }
-        for (auto& fn : state_handlers[result]) {
-            fn();
-        }
-        for (auto& fn : once_handlers[result]) {
-            fn();
-        }
-        once_handlers[result].clear();
 
+        // Handlers observe the new state
         _state = result;
+        const size_t i = index(result);
+        for (auto& h : state_handlers[i]) {
+            h();
+        }
+        if (once_handlers[i].size()) {
+            // Handlers may register new handlers for the next arrival
+            std::vector<std::function<void()>> once;
+            once.swap(once_handlers[i]);
+            for (auto& h : once) {
+                h();
+            }
+        }
     }
 
 private:
     // Current state
     S _state;
 
-    struct EnumHasher {
-        template <class T> size_t operator()(T t) const
-        {
-            return static_cast<size_t>(t);
-        }
-    };
+    template <class T> static constexpr size_t index(T t)
+    {
+        return static_cast<size_t>(t);
+    }
 
-    std::unordered_map<S, std::vector<std::function<void()>>, EnumHasher>
+    std::array<std::vector<std::function<void()>>, state_count>
         // Handlers executed on arival to a new state
         state_handlers,
         // Handlers executed on arival to a new state, but only once
         once_handlers;
 
     // Functions to execute, when an event fires on a state
-    std::map<std::pair<S, E>, Handler> transitions;
+    std::array<std::array<Handler, event_count>, state_count> transitions = {};
 
     // Functions to execute on an event no matter what state FSM is in
-    std::unordered_map<E, Handler> wilds;
+    std::array<Handler, event_count> wilds = {};
 };
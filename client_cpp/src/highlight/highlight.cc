@@ -0,0 +1,274 @@
+#include "highlight.hh"
+#include <array>
+#include <string_view>
+
+using std::string_view;
+
+enum token_type { unmatched, identifier, quoted, double_quoted, comment };
+
+// Character classes of bytes in code
+enum char_class : uint8_t { identifier_char = 1, operator_char = 1 << 1 };
+
+// Returns the character class table for all bytes
+static constexpr std::array<uint8_t, 256> char_classes()
+{
+    std::array<uint8_t, 256> t{};
+    for (int ch = 0; ch < 128; ch++) {
+        if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')
+            || (ch >= '0' && ch <= '9') || ch == '_' || ch == '$') {
+            t[ch] = identifier_char;
+        }
+    }
+    for (unsigned char ch : { '!', '%', '&', '*', '+', '-', '/', ':', '<', '=',
+             '>', '?', '@', '^', '|', '~' }) {
+        t[ch] = operator_char;
+    }
+    return t;
+}
+
+static constexpr auto char_class_table = char_classes();
+
+// Return, if char could be a part of an identifier in most languages
+static inline bool is_identifier_char(const char b)
+{
+    return char_class_table[uint8_t(b)] & identifier_char;
+}
+
+// Return, if char is one of the supported operators
+static inline bool is_operator(const char b)
+{
+    return char_class_table[uint8_t(b)] & operator_char;
+}
+
+// Supported keywords
+static constexpr std::array<string_view, 167> keywords = { "NULL", "NaN",
+    "abstract", "alias", "and", "arguments", "array", "asm", "assert", "async",
+    "auto", "await", "base", "begin", "bool", "boolean", "break", "byte",
+    "case", "catch", "char", "checked", "class", "clone", "compl", "const",
+    "constexpr", "continue", "debugger", "decimal", "declare", "default",
+    "defer", "deinit", "delegate", "delete", "do", "double", "echo", "elif",
+    "else", "elseif", "elsif", "end", "ensure", "enum", "event", "except",
+    "exec", "explicit", "export", "extends", "extension", "extern",
+    "fallthrough", "false", "final", "finally", "fixed", "float", "fn", "for",
+    "foreach", "friend", "from", "func", "function", "global", "go", "goto",
+    "guard", "if", "impl", "implements", "implicit", "import", "in", "include",
+    "inline", "inout", "instanceof", "int", "interface", "internal", "is",
+    "lambda", "let", "lock", "long", "module", "mut", "mutable", "namespace",
+    "native", "new", "next", "nil", "not", "null", "object", "operator", "or",
+    "out", "override", "package", "params", "private", "protected", "protocol",
+    "pub", "public", "raise", "readonly", "redo", "ref", "register", "repeat",
+    "require", "rescue", "restrict", "retry", "return", "sbyte", "sealed",
+    "short", "signed", "sizeof", "static", "str", "string", "struct",
+    "subscript", "super", "switch", "synchronized", "template", "then",
+    "throws", "transient", "true", "try", "type", "typealias", "typedef",
+    "typeid", "typename", "typeof", "uint", "unchecked", "undef", "undefined",
+    "union", "unless", "unsigned", "until", "use", "using", "var", "virtual",
+    "void", "volatile", "when", "where", "while", "with", "xor", "yield" };
+
+// Seeded FNV-1a hash of a keyword
+static constexpr uint32_t keyword_hash(string_view s, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (char ch : s) {
+        h = (h ^ uint8_t(ch)) * 16777619u;
+    }
+    return h;
+}
+
+// Perfect hash table of keywords built with hash and displace. Keywords are
+// first distributed into buckets, then each bucket is assigned the first hash
+// seed, that places all of its keywords into free slots.
+struct KeywordTable {
+    static constexpr unsigned bucket_count = 64, slot_bits = 8,
+                              max_bucket_size = 16;
+
+    uint32_t seeds[bucket_count] = {};
+    string_view slots[1 << slot_bits] = {};
+    bool ok = true; // All keywords placed
+
+    static constexpr unsigned bucket(string_view s)
+    {
+        return keyword_hash(s, 0) % bucket_count;
+    }
+
+    static constexpr unsigned slot(string_view s, uint32_t seed)
+    {
+        return keyword_hash(s, seed) >> (32 - slot_bits);
+    }
+
+    constexpr KeywordTable()
+    {
+        string_view members[bucket_count][max_bucket_size] = {};
+        unsigned sizes[bucket_count] = {};
+        for (auto kw : keywords) {
+            const auto b = bucket(kw);
+            if (sizes[b] == max_bucket_size) {
+                ok = false;
+                return;
+            }
+            members[b][sizes[b]++] = kw;
+        }
+
+        // Place the largest buckets first, while there are more free slots
+        for (unsigned size = max_bucket_size; size; size--) {
+            for (unsigned b = 0; b < bucket_count; b++) {
+                if (sizes[b] == size && !place(members[b], size, b)) {
+                    ok = false;
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    // Find a seed for bucket b, that places all of its n members into
+    // distinct free slots
+    constexpr bool place(const string_view* members, unsigned n, unsigned b)
+    {
+        for (uint32_t seed = 1; seed < 1 << 16; seed++) {
+            unsigned taken[max_bucket_size] = {};
+            bool fits = true;
+            for (unsigned i = 0; i < n && fits; i++) {
+                const auto s = slot(members[i], seed);
+                fits = slots[s].empty();
+                for (unsigned j = 0; j < i && fits; j++) {
+                    fits = taken[j] != s;
+                }
+                taken[i] = s;
+            }
+            if (fits) {
+                for (unsigned i = 0; i < n; i++) {
+                    slots[taken[i]] = members[i];
+                }
+                seeds[b] = seed;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static constexpr KeywordTable keyword_table;
+static_assert(keyword_table.ok, "failed to build keyword perfect hash");
+
+// Return, if word is one of the supported keywords
+static inline bool is_keyword(string_view word)
+{
+    const auto& t = keyword_table;
+    return t.slots[t.slot(word, t.seeds[t.bucket(word)])] == word;
+}
+
+extern "C" size_t highlight_code(
+    const char* data, size_t size, CodeToken* tokens)
+{
+    const string_view frag(data, size);
+    size_t n = 0;
+
+    // Append a token ending before byte offset end
+    auto emit = [&](code_token_kind kind, size_t end) {
+        if (kind == code_plain && n && tokens[n - 1].kind == code_plain) {
+            tokens[n - 1].end = end;
+        } else {
+            tokens[n++] = { kind, uint32_t(end) };
+        }
+    };
+
+    // Emit a run of operator characters starting at i as a single token and
+    // advance i to its last character. Stops before comment openings.
+    auto wrap_operators = [&](size_t& i) {
+        size_t j = i + 1;
+        while (j < frag.size() && is_operator(frag[j])
+            && !(frag[j] == '/' && j + 1 < frag.size() && frag[j + 1] == '/')) {
+            j++;
+        }
+        emit(code_operator, j);
+        i = j - 1;
+    };
+
+    size_t token_start = 0; // Start of the current identifier in frag
+    token_type type = unmatched;
+    char prev = 0;
+    char b = 0;
+    char next = 0;
+    for (size_t i = 0; i < frag.size(); i++) {
+        b = frag[i];
+        next = i != frag.size() - 1 ? frag[i + 1] : 0;
+
+        switch (type) {
+        case unmatched:
+            switch (b) {
+            case '/':
+                if (next == '/') {
+                    type = comment;
+                    i++;
+                } else {
+                    wrap_operators(i);
+                }
+                break;
+            case '\'':
+                type = quoted;
+                break;
+            case '"':
+                type = double_quoted;
+                break;
+            default:
+                if (is_operator(b)) {
+                    wrap_operators(i);
+                } else if (is_identifier_char(b)) {
+                    type = identifier;
+                    token_start = i;
+                } else {
+                    emit(code_plain, i + 1);
+                }
+            }
+            break;
+        case identifier:
+            if (!is_identifier_char(next)) {
+                if (next == '(') {
+                    emit(code_function, i + 1);
+                } else if (is_keyword(
+                               frag.substr(token_start, i - token_start + 1))) {
+                    emit(code_operator, i + 1);
+                } else {
+                    emit(code_plain, i + 1);
+                }
+                type = unmatched;
+            }
+            break;
+        case quoted:
+            if (b == '\'' && prev != '\\') {
+                type = unmatched;
+                emit(code_string, i + 1);
+            }
+            break;
+        case double_quoted:
+            if (b == '"' && prev != '\\') {
+                type = unmatched;
+                emit(code_string, i + 1);
+            }
+            break;
+        case comment:
+            // We only have line-terminated commnets and those are terminated
+            // upstream the call stack
+            break;
+        }
+
+        prev = frag[i];
+    }
+
+    // Close any open token
+    switch (type) {
+    case identifier:
+        emit(code_plain, frag.size());
+        break;
+    case quoted:
+    case double_quoted:
+        emit(code_string, frag.size());
+        break;
+    case comment:
+        emit(code_comment, frag.size());
+        break;
+    }
+
+    return n;
+}
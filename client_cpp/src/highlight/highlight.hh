@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Syntax highlighting of code tags. Built as a separate side module in split
+// builds and loaded on first use. See highlight_syntax() in
+// ../posts/code.cc.
+
+// Kinds of highlighted code tokens
+enum code_token_kind : uint32_t {
+    code_plain,
+    code_operator, // Operators and keywords
+    code_function,
+    code_string,
+    code_comment,
+};
+
+// Token of a code fragment, that ends at byte offset end and starts at the end
+// of the previous token
+struct CodeToken {
+    uint32_t kind, end;
+};
+
+// Split a fragment of code of size bytes into tokens and return their count.
+// tokens must have room for size tokens. Adjacent plain text is merged into
+// one token.
+extern "C" size_t highlight_code(
+    const char* frag, size_t size, CodeToken* tokens);
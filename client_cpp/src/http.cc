@@ -2,39 +2,240 @@
 #include "util.hh"
 #include <emscripten.h>
 #include <emscripten/bind.h>
-#include <map>
+#include <list>
+#include <stdlib.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-// All registered callbacks
-static std::map<unsigned, HTTPCallback> callbacks;
+// Maximum total size of cached response bodies in bytes
+static const size_t cache_budget = 2 << 20;
 
-// Last ID used
-static unsigned last_id = 0;
+// Fetch in progress
+struct Fetch {
+    std::string url, body;
 
-void http_request(std::string url, HTTPCallback cb)
+    // Requests sharing the fetch and their callbacks
+    std::vector<std::pair<unsigned, HTTPCallback>> requests;
+};
+
+// Response retained for revalidation with its ETag
+struct CachedResponse {
+    std::string url, etag, body;
+};
+
+// Fetches in progress by fetch ID
+static std::unordered_map<unsigned, Fetch> fetches;
+
+// IDs of fetches in progress by URL
+static std::unordered_map<std::string, unsigned> fetches_by_url;
+
+// Fetch IDs of running requests by request ID
+static std::unordered_map<unsigned, unsigned> requests;
+
+// Cached responses ordered from most to least recently used
+static std::list<CachedResponse> cache;
+static size_t cache_size = 0;
+
+// Last IDs used
+static unsigned last_fetch_id = 0, last_request_id = 0;
+
+// Find a cached response and mark it as recently used
+static CachedResponse* find_cached(const std::string& url)
 {
-    const unsigned id = last_id++;
-    callbacks[id] = cb;
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+        if (it->url == url) {
+            cache.splice(cache.begin(), cache, it);
+            return &cache.front();
+        }
+    }
+    return nullptr;
+}
+
+static void store_cached(std::string url, std::string etag, std::string body)
+{
+    if (body.size() > cache_budget) {
+        return;
+    }
+    if (auto c = find_cached(url)) {
+        cache_size -= c->body.size();
+        cache.pop_front();
+    }
+    cache_size += body.size();
+    cache.push_front({ std::move(url), std::move(etag), std::move(body) });
+    while (cache_size > cache_budget) {
+        cache_size -= cache.back().body.size();
+        cache.pop_back();
+    }
+}
+
+// Start a fetch of url and return its ID. The response body is streamed into
+// the fetch's buffer chunk by chunk.
+static unsigned start_fetch(const std::string& url)
+{
+    const unsigned id = ++last_fetch_id;
+    fetches[id].url = url;
+    fetches_by_url[url] = id;
+
+    std::string etag;
+    if (auto c = find_cached(url)) {
+        etag = c->etag;
+    }
     EM_ASM_INT(
         {
-            var xhr = new XMHLHTTPRequest();
-            xhr.open(UTF8ToString($0), "GET");
-            xhr.onload = function()
+            if (!window.__http_aborts) {
+                window.__http_aborts = {};
+            }
+            var id = $1;
+            var ctrl = window.AbortController ? new AbortController() : null;
+            window.__http_aborts[id] = ctrl;
+            var opts = { signal : ctrl && ctrl.signal };
+            var etag = UTF8ToString($2);
+            if (etag) {
+                opts.headers = { 'If-None-Match' : etag };
+            }
+
+            // Copy a chunk of the response body into wasm memory. Ownership
+            // of the buffer passes to the fetch.
+            var push = function(chunk)
+            {
+                if (!(id in window.__http_aborts) || !chunk.length) {
+                    return;
+                }
+                var ptr = Module._malloc(chunk.length);
+                HEAPU8.set(chunk, ptr);
+                Module.push_http_chunk(id, ptr, chunk.length);
+            };
+            var done = function(code, etag)
             {
-                Module.run_http_callback($1, xhr.status, xhr.response);
+                if (id in window.__http_aborts) {
+                    delete window.__http_aborts[id];
+                    Module.run_http_callback(id, code, etag);
+                }
             };
-            xhr.send();
+
+            fetch(UTF8ToString($0), opts)
+                .then(function(res) {
+                    var etag = res.headers.get('ETag') || '';
+                    if (!res.body || !res.body.getReader) {
+                        return res.arrayBuffer().then(function(buf) {
+                            push(new Uint8Array(buf));
+                            done(res.status, etag);
+                        });
+                    }
+                    var reader = res.body.getReader();
+                    var read = function()
+                    {
+                        return reader.read().then(function(r) {
+                            if (r.done) {
+                                done(res.status, etag);
+                            } else {
+                                push(r.value);
+                                return read();
+                            }
+                        });
+                    };
+                    return read();
+                })
+                .catch(function() { done(0, ''); });
         },
-        url.c_str(), id);
+        url.c_str(), id, etag.c_str());
+    return id;
+}
+
+unsigned http_request(std::string url, HTTPCallback cb)
+{
+    const unsigned id = ++last_request_id;
+    unsigned fetch_id;
+    if (auto it = fetches_by_url.find(url); it != fetches_by_url.end()) {
+        fetch_id = it->second;
+    } else {
+        fetch_id = start_fetch(url);
+    }
+    fetches.at(fetch_id).requests.push_back({ id, cb });
+    requests[id] = fetch_id;
+    return id;
+}
+
+void http_abort(unsigned id)
+{
+    auto it = requests.find(id);
+    if (it == requests.end()) {
+        return;
+    }
+    const unsigned fetch_id = it->second;
+    requests.erase(it);
+
+    auto& f = fetches.at(fetch_id);
+    auto& reqs = f.requests;
+    for (auto r = reqs.begin(); r != reqs.end(); ++r) {
+        if (r->first == id) {
+            reqs.erase(r);
+            break;
+        }
+    }
+    if (reqs.size()) {
+        return;
+    }
+
+    fetches_by_url.erase(f.url);
+    fetches.erase(fetch_id);
+    EM_ASM_INT(
+        {
+            var ctrl = window.__http_aborts[$0];
+            delete window.__http_aborts[$0];
+            if (ctrl) {
+                ctrl.abort();
+            }
+        },
+        fetch_id);
+}
+
+// Append a chunk of the response body at ptr to a fetch and free it
+static void push_http_chunk(unsigned id, uintptr_t ptr, size_t len)
+{
+    char* buf = reinterpret_cast<char*>(ptr);
+    if (auto it = fetches.find(id); it != fetches.end()) {
+        it->second.body.append(buf, len);
+    }
+    free(buf);
 }
 
 static void run_http_callback(
-    unsigned id, unsigned short code, std::string data)
+    unsigned id, unsigned short code, std::string etag)
 {
-    callbacks.at(id)(code, data);
-    callbacks.erase(id);
+    auto it = fetches.find(id);
+    if (it == fetches.end()) {
+        return;
+    }
+    Fetch f = std::move(it->second);
+    fetches.erase(it);
+    fetches_by_url.erase(f.url);
+
+    if (code == 304) {
+        if (auto c = find_cached(f.url)) {
+            code = 200;
+            f.body = c->body;
+        } else {
+            // Evicted since the request
+            code = 0;
+        }
+    } else if (code == 200 && etag.size()) {
+        store_cached(f.url, etag, f.body);
+    }
+
+    // Callbacks might abort or start other requests
+    for (auto& [req_id, _] : f.requests) {
+        requests.erase(req_id);
+    }
+    for (size_t i = 0; i < f.requests.size(); i++) {
+        const bool last = i + 1 == f.requests.size();
+        f.requests[i].second(code, last ? std::move(f.body) : f.body);
+    }
 }
 
 EMSCRIPTEN_BINDINGS(module_http)
 {
-    emscripten::function("run_HTTP_callback", &run_http_callback);
+    emscripten::function("push_http_chunk", &push_http_chunk);
+    emscripten::function("run_http_callback", &run_http_callback);
 }
@@ -3,8 +3,18 @@
 #include <functional>
 #include <string>
 
-// Callback executed after finishing or failing an HTTP request
+// Callback executed after finishing or failing an HTTP request. A status code
+// of 0 signifies a network error.
 typedef std::function<void(unsigned short, std::string)> HTTPCallback;
 
-// Run an HTTP request on URL and execute cb on result or error
-void http_request(std::string url, HTTPCallback cb);
+// Run an HTTP GET request on URL and execute cb on result or error. Returns a
+// request ID, that can be passed to http_abort().
+//
+// Concurrent requests of the same URL share a single fetch. Responses with an
+// ETag are cached and revalidated on the next request of the URL. A response
+// of 304 Not Modified is passed to cb as 200 with the cached body.
+unsigned http_request(std::string url, HTTPCallback cb);
+
+// Abort a running request. Its callback is never called. The underlying fetch
+// is only cancelled, once no other requests share it.
+void http_abort(unsigned id);
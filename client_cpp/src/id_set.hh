@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Compact set of post IDs stored as a sorted vector. Takes 4 bytes per ID and
+// lookups are binary searches over contiguous memory. Inserting single IDs is
+// linear, but IDs mostly arrive in ascending order or in bulk.
+class IDSet {
+public:
+    typedef std::vector<uint32_t>::const_iterator iterator;
+
+    iterator begin() const { return ids.begin(); }
+    iterator end() const { return ids.end(); }
+
+    size_t size() const { return ids.size(); }
+
+    // Returns 1, if the ID is in the set, 0 otherwise
+    size_t count(unsigned long id) const
+    {
+        return std::binary_search(ids.begin(), ids.end(), uint32_t(id));
+    }
+
+    // Insert an ID. Returns, if the ID was not in the set yet.
+    bool insert(unsigned long id)
+    {
+        if (!ids.size() || ids.back() < id) {
+            ids.push_back(id);
+            return true;
+        }
+        auto it = std::lower_bound(ids.begin(), ids.end(), uint32_t(id));
+        if (*it == id) {
+            return false;
+        }
+        ids.insert(it, id);
+        return true;
+    }
+
+    // Insert an unordered array of IDs at once
+    void insert(const uint32_t* arr, size_t n)
+    {
+        const size_t old = ids.size();
+        ids.insert(ids.end(), arr, arr + n);
+        std::sort(ids.begin() + old, ids.end());
+        std::inplace_merge(ids.begin(), ids.begin() + old, ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+
+    // Remove an ID. Returns, if the ID was in the set.
+    bool erase(unsigned long id)
+    {
+        auto it = std::lower_bound(ids.begin(), ids.end(), uint32_t(id));
+        if (it == ids.end() || *it != id) {
+            return false;
+        }
+        ids.erase(it);
+        return true;
+    }
+
+    void clear() { ids.clear(); }
+
+private:
+    std::vector<uint32_t> ids;
+};
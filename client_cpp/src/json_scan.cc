@@ -0,0 +1,286 @@
+#include "json_scan.hh"
+#include "../utf8/utf8.h"
+#include <cctype>
+#include <iterator>
+#include <string>
+
+namespace json_scan {
+
+static void skip_space(std::string_view s, size_t& i)
+{
+    while (i < s.size() && isspace(s[i])) {
+        i++;
+    }
+}
+
+// Advance i past the JSON value starting at s[i]. Values are only checked for
+// balanced nesting and string termination. Full validation is left to the
+// decoder, that receives the value.
+static bool skip_value(std::string_view s, size_t& i)
+{
+    skip_space(s, i);
+    if (i == s.size()) {
+        return false;
+    }
+    if (s[i] != '"' && s[i] != '{' && s[i] != '[') {
+        // Number or literal
+        const size_t start = i;
+        while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ']'
+            && !isspace(s[i])) {
+            i++;
+        }
+        return i != start;
+    }
+
+    unsigned depth = 0;
+    while (i < s.size()) {
+        switch (s[i++]) {
+        case '"':
+            while (1) {
+                if (i == s.size()) {
+                    return false;
+                }
+                const char ch = s[i++];
+                if (ch == '"') {
+                    break;
+                }
+                if (ch == '\\') {
+                    i++;
+                }
+            }
+            break;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if (!depth) {
+                return false;
+            }
+            depth--;
+            break;
+        }
+        if (!depth) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Shared iteration over JSON arrays and objects
+static bool for_each(std::string_view s, char open, char close,
+    std::function<void(std::string_view key, std::string_view val)> fn)
+{
+    size_t i = 0;
+    skip_space(s, i);
+    if (i == s.size() || s[i++] != open) {
+        return false;
+    }
+    skip_space(s, i);
+    if (i < s.size() && s[i] == close) {
+        return true;
+    }
+
+    while (1) {
+        std::string_view key;
+        if (open == '{') {
+            skip_space(s, i);
+            if (i == s.size() || s[i++] != '"') {
+                return false;
+            }
+            const size_t start = i;
+            while (i < s.size() && s[i] != '"') {
+                if (s[i] == '\\') {
+                    return false;
+                }
+                i++;
+            }
+            if (i == s.size()) {
+                return false;
+            }
+            key = s.substr(start, i++ - start);
+            skip_space(s, i);
+            if (i == s.size() || s[i++] != ':') {
+                return false;
+            }
+        }
+
+        skip_space(s, i);
+        const size_t start = i;
+        if (!skip_value(s, i)) {
+            return false;
+        }
+        fn(key, s.substr(start, i - start));
+
+        skip_space(s, i);
+        if (i == s.size()) {
+            return false;
+        }
+        const char ch = s[i++];
+        if (ch == close) {
+            return true;
+        }
+        if (ch != ',') {
+            return false;
+        }
+    }
+}
+
+bool for_each_element(
+    std::string_view arr, std::function<void(std::string_view)> fn)
+{
+    return for_each(arr, '[', ']',
+        [&](std::string_view, std::string_view val) { fn(val); });
+}
+
+bool for_each_member(std::string_view obj,
+    std::function<void(std::string_view key, std::string_view val)> fn)
+{
+    return for_each(obj, '{', '}', fn);
+}
+
+bool for_each_string(
+    std::string_view data, std::function<void(std::string_view)> fn)
+{
+    std::string buf;
+    size_t i = 0;
+
+    auto skip_space = [&]() {
+        while (i < data.size() && isspace(data[i])) {
+            i++;
+        }
+    };
+    // Read 4 hex digits of an \u escape sequence
+    auto read_hex = [&](uint32_t& out) {
+        if (i + 4 > data.size()) {
+            return false;
+        }
+        out = 0;
+        for (size_t end = i + 4; i < end; i++) {
+            const char ch = data[i];
+            out <<= 4;
+            if (ch >= '0' && ch <= '9') {
+                out |= ch - '0';
+            } else if (ch >= 'a' && ch <= 'f') {
+                out |= ch - 'a' + 10;
+            } else if (ch >= 'A' && ch <= 'F') {
+                out |= ch - 'A' + 10;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    skip_space();
+    if (i == data.size() || data[i++] != '[') {
+        return false;
+    }
+    skip_space();
+    if (i < data.size() && data[i] == ']') {
+        return true;
+    }
+
+    while (1) {
+        skip_space();
+        if (i == data.size() || data[i++] != '"') {
+            return false;
+        }
+
+        // Fast path for strings without escapes
+        const size_t start = i;
+        while (i < data.size() && data[i] != '"' && data[i] != '\\') {
+            i++;
+        }
+        if (i == data.size()) {
+            return false;
+        }
+        if (data[i] == '"') {
+            fn(data.substr(start, i - start));
+            i++;
+        } else {
+            buf.assign(data.data() + start, i - start);
+            while (1) {
+                if (i == data.size()) {
+                    return false;
+                }
+                const char ch = data[i++];
+                if (ch == '"') {
+                    break;
+                }
+                if (ch != '\\') {
+                    buf += ch;
+                    continue;
+                }
+                if (i == data.size()) {
+                    return false;
+                }
+                switch (data[i++]) {
+                case '"':
+                    buf += '"';
+                    break;
+                case '\\':
+                    buf += '\\';
+                    break;
+                case '/':
+                    buf += '/';
+                    break;
+                case 'b':
+                    buf += '\b';
+                    break;
+                case 'f':
+                    buf += '\f';
+                    break;
+                case 'n':
+                    buf += '\n';
+                    break;
+                case 'r':
+                    buf += '\r';
+                    break;
+                case 't':
+                    buf += '\t';
+                    break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!read_hex(cp)) {
+                        return false;
+                    }
+                    // Surrogate pair
+                    if (cp >= 0xd800 && cp < 0xdc00) {
+                        uint32_t low;
+                        if (i + 2 > data.size() || data[i] != '\\'
+                            || data[i + 1] != 'u') {
+                            return false;
+                        }
+                        i += 2;
+                        if (!read_hex(low) || low < 0xdc00 || low > 0xdfff) {
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    utf8::unchecked::append(cp, std::back_inserter(buf));
+                } break;
+                default:
+                    return false;
+                }
+            }
+            fn(buf);
+        }
+
+        skip_space();
+        if (i == data.size()) {
+            return false;
+        }
+        switch (data[i++]) {
+        case ',':
+            continue;
+        case ']':
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+}
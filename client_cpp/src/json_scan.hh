@@ -0,0 +1,26 @@
+// Lightweight scanning of JSON text without building a JSON DOM
+
+#pragma once
+
+#include <functional>
+#include <string_view>
+
+namespace json_scan {
+
+// Call fn on the raw JSON text of each element of a JSON array.
+// Returns false, if the array is malformed.
+bool for_each_element(
+    std::string_view arr, std::function<void(std::string_view)> fn);
+
+// Call fn on the key and raw JSON text of the value of each member of a JSON
+// object. Keys are passed without quotes and must not contain escape
+// sequences. Returns false, if the object is malformed.
+bool for_each_member(std::string_view obj,
+    std::function<void(std::string_view key, std::string_view val)> fn);
+
+// Call fn on each element of a JSON array of strings. Elements without escape
+// sequences are passed as views into arr. Escaped elements are decoded into a
+// reused buffer. Returns false, if the array is malformed.
+bool for_each_string(
+    std::string_view arr, std::function<void(std::string_view)> fn);
+}
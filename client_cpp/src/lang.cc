@@ -9,13 +9,14 @@ void LanguagePack::load()
     auto j = json::parse(get_inner_html("lang-data"));
     auto& t = j["time"];
 
-    load_map(posts, j["posts"]);
-    load_map(ui, j["ui"]);
-    load_tuple_map(plurals, j["plurals"]);
+    load_table(posts, j["posts"]);
+    load_table(ui, j["ui"]);
+    load_table(plurals, j["plurals"]);
     load_tuple_map(forms, j["forms"]);
     load_array(calendar, t["calendar"]);
     load_array(week, t["week"]);
     load_array(sync, j["sync"]);
+    generation++;
 }
 
 template <class T> void LanguagePack::load_array(T& arr, json& j)
@@ -25,11 +26,26 @@ template <class T> void LanguagePack::load_array(T& arr, json& j)
     }
 }
 
-void LanguagePack::load_map(LanguagePack::StringMap& m, json& j)
+template <class K> void LanguagePack::load_table(LangTable<K>& t, json& j)
 {
-    m.reserve(j.size());
-    for (json::iterator it = j.begin(); it != j.end(); it++) {
-        m[it.key()] = it.value();
+    for (size_t i = 0; i < t.size; i++) {
+        json::iterator it = j.find(t.names[i]);
+        t.values[i] = it != j.end() ? it->get<std::string>() : "";
+    }
+}
+
+template <class K>
+void LanguagePack::load_table(
+    LangTable<K, std::tuple<std::string, std::string>>& t, json& j)
+{
+    for (size_t i = 0; i < t.size; i++) {
+        json::iterator it = j.find(t.names[i]);
+        if (it != j.end()) {
+            t.values[i] = { (*it)[0].get<std::string>(),
+                (*it)[1].get<std::string>() };
+        } else {
+            t.values[i] = {};
+        }
     }
 }
 
@@ -1,27 +1,136 @@
 #pragma once
 
+#include <array>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
 
+// Language pack keys used by the client as X(identifier, JSON key) pairs.
+// Identifiers clashing with C++ keywords are suffixed with an underscore.
+#define LANG_POSTS_KEYS(X)                                                     \
+    X(admin, "admin")                                                          \
+    X(ago, "ago")                                                              \
+    X(and_, "and")                                                             \
+    X(anon, "anon")                                                            \
+    X(banned, "banned")                                                        \
+    X(contractImages, "contractImages")                                        \
+    X(expand, "expand")                                                        \
+    X(expandImages, "expandImages")                                            \
+    X(hide, "hide")                                                            \
+    X(in, "in")                                                                \
+    X(janitors, "janitors")                                                    \
+    X(justNow, "justNow")                                                      \
+    X(moderators, "moderators")                                                \
+    X(omitted, "omitted")                                                      \
+    X(owners, "owners")                                                        \
+    X(seeAll, "seeAll")                                                        \
+    X(show, "show")                                                            \
+    X(spoiler, "spoiler")                                                      \
+    X(you, "you")
+
+#define LANG_UI_KEYS(X)                                                        \
+    X(bottom, "bottom")                                                        \
+    X(cancel, "cancel")                                                        \
+    X(catalog, "catalog")                                                      \
+    X(finished, "finished")                                                    \
+    X(last, "last")                                                            \
+    X(lockedToBottom, "lockedToBottom")                                        \
+    X(newThread, "newThread")                                                  \
+    X(pointToCatalog, "pointToCatalog")                                        \
+    X(refresh, "refresh")                                                      \
+    X(reply, "reply")                                                          \
+    X(return_, "return")                                                       \
+    X(rules, "rules")                                                          \
+    X(search, "search")                                                        \
+    X(showNotice, "showNotice")                                                \
+    X(submit, "submit")                                                        \
+    X(top, "top")
+
+#define LANG_PLURALS_KEYS(X)                                                   \
+    X(second, "second")                                                        \
+    X(minute, "minute")                                                        \
+    X(hour, "hour")                                                            \
+    X(day, "day")                                                              \
+    X(month, "month")                                                          \
+    X(year, "year")                                                            \
+    X(post, "post")                                                            \
+    X(image, "image")
+
+#define LANG_KEY_ENUM_MEMBER(id, _) id,
+
+// Index of a post-related language pack string
+enum class PostsKey : uint8_t { LANG_POSTS_KEYS(LANG_KEY_ENUM_MEMBER) _count };
+
+// Index of an UI-related language pack string
+enum class UIKey : uint8_t { LANG_UI_KEYS(LANG_KEY_ENUM_MEMBER) _count };
+
+// Index of a singular and plural word pair
+enum class PluralKey : uint8_t {
+    LANG_PLURALS_KEYS(LANG_KEY_ENUM_MEMBER) _count
+};
+
+#undef LANG_KEY_ENUM_MEMBER
+
+// Language pack values addressed by key enum K. Keys missing in the language
+// pack map to empty values.
+template <class K, class V = std::string> class LangTable {
+public:
+    static constexpr size_t size = static_cast<size_t>(K::_count);
+
+    const V& operator[](K k) const { return values[static_cast<size_t>(k)]; }
+
+    // Find a key by its JSON name. Only intended for keys not known at compile
+    // time.
+    std::optional<K> find(std::string_view name) const
+    {
+        for (size_t i = 0; i < size; i++) {
+            if (names[i] == name) {
+                return static_cast<K>(i);
+            }
+        }
+        return {};
+    }
+
+private:
+    friend class LanguagePack;
+
+    // JSON keys in enum order
+    std::array<const char*, size> names;
+
+    std::array<V, size> values;
+
+    LangTable(std::array<const char*, size> names)
+        : names(names)
+    {
+    }
+};
+
 // Contains the plugable langauge pack
 class LanguagePack {
 public:
-    typedef std::unordered_map<std::string, std::string> StringMap;
     typedef std::unordered_map<std::string,
         std::tuple<std::string, std::string>>
         TupleMap;
 
-    StringMap posts, // Definitions related to posts
-        ui; // Related to UI
+#define LANG_KEY_NAME(_, key) key,
+    LangTable<PostsKey> posts // Definitions related to posts
+        = { { LANG_POSTS_KEYS(LANG_KEY_NAME) } };
+    LangTable<UIKey> ui // Related to UI
+        = { { LANG_UI_KEYS(LANG_KEY_NAME) } };
 
-    TupleMap
-        // Contains tuples of the word in singular and plural form
-        plurals,
-        // Data for rendering input forms
-        forms;
+    // Contains tuples of the word in singular and plural form
+    LangTable<PluralKey, std::tuple<std::string, std::string>> plurals
+        = { { LANG_PLURALS_KEYS(LANG_KEY_NAME) } };
+#undef LANG_KEY_NAME
+
+    // Data for rendering input forms
+    TupleMap forms;
 
     // Months names
     std::string calendar[12];
@@ -32,12 +141,18 @@ public:
     // Syncronization state labels
     std::string sync[5];
 
+    // Incremented on each load(). Used to invalidate cached localized text.
+    unsigned generation = 0;
+
     // Load from inlined JSON in the DOM
     void load();
 
 private:
-    // Load <string, string> map from JSON
-    void load_map(StringMap&, nlohmann::json&);
+    // Load the values of a table from a JSON object
+    template <class K> void load_table(LangTable<K>&, nlohmann::json&);
+    template <class K>
+    void load_table(
+        LangTable<K, std::tuple<std::string, std::string>>&, nlohmann::json&);
 
     // Load a map of string tuples from JSON
     void load_tuple_map(TupleMap&, nlohmann::json&);
@@ -1,5 +1,6 @@
 #include <emscripten.h>
 #include <optional>
+#include <stdlib.h>
 #include <string>
 
 using std::string;
@@ -32,6 +33,6 @@ std::optional<string> local_storage_get(const string& key)
         return {};
     }
     const string s = string(val); // Coppies
-    delete[] val;
+    free(val);
     return { s };
 }
@@ -3,33 +3,41 @@
 #include "connection/connection.hh"
 #include "db.hh"
 #include "local_storage.hh"
+#include "page/board.hh"
 #include "page/header.hh"
 #include "page/navigation.hh"
 #include "page/page.hh"
-#include "posts/commands.hh"
 #include "posts/init.hh"
 #include "state.hh"
+#include "upload.hh"
 #include <emscripten.h>
 
 static void start()
 {
     init_connectivity();
-    auto wg = new WaitGroup(2, []() {
+
+    // Thread pages loaded from a snapshot render without waiting for the
+    // websocket. Changes since the snapshot are merged on the first sync.
+    const bool loaded = page.thread && threads.count(page.thread);
+    auto wg = new WaitGroup(loaded ? 1 : 2, []() {
         auto wg = new WaitGroup(1, &render_page);
         load_post_ids(wg);
     });
     open_db(wg);
     conn_SM.feed(ConnEvent::start);
-    conn_SM.once(ConnState::synced, [=]() { wg->done(); });
+    if (!loaded) {
+        conn_SM.once(ConnState::synced, [=]() { wg->done(); });
+    }
 }
 
 int main()
 {
-    brunhild::before_flush = &rerender_syncwatches;
     brunhild::init();
     load_state();
     init_posts();
     init_navigation();
+    init_board();
+    init_upload();
     brunhild::prepend("banner", board_navigation_view.html());
 
     start();
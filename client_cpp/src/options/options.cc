@@ -1,73 +1,158 @@
 #include "options.hh"
 #include "../local_storage.hh"
+#include <emscripten.h>
+#include <stdlib.h>
+#include <string_view>
+#include <utility>
 
 // TODO: Implement observer pattern. We don't actually need unregistering
 // though and can use function pointers only as observers.
 
-void Options::load()
-{
-    load_bool(hide_thumbs, "hideThumbs");
-    load_bool(image_hover, "imageHover");
-    load_bool(webm_hover, "webmHover");
-    load_bool(notification, "notification");
-    load_bool(anonymise, "anonymise");
-    load_bool(post_inline_expand, "postInlineExpand");
-    load_bool(relative_time, "relativeTime");
-    load_bool(now_playing, "nowPlaying");
-    load_bool(illya_dance, "illyaDance");
-    load_bool(illya_dance_mute, "illyaDanceMute");
-    load_bool(horizontal_posting, "horizontalPosting");
-    load_bool(hide_recursively, "hideRecursively");
-    load_bool(work_mode_toggle, "workModeToggle");
-    load_bool(user_BG, "userBG");
-    load_bool(custom_css_toggle, "customCSS");
-    load_bool(mascot, "mascot");
-    load_bool(always_lock, "alwaysLock");
-    load_bool(google, "google");
-    load_bool(iqdb, "iqdb");
-    load_bool(sauce_nao, "saucenao");
-    load_bool(what_anime, "whatAnime");
-    load_bool(desu_storage, "desustorage");
-    load_bool(exhentai, "exhentai");
-    load_bool(gallery_mode_toggle, "galleryModeToggle");
-    load_bool(megu_tv, "meguTV");
-
-    load_uint(new_post, "newPost");
-    load_uint(toggle_spoiler, "toggleSpoiler");
-    load_uint(done, "done");
-    load_uint(expand_all, "expandAll");
-    load_uint(work_mode, "workMode");
-    load_uint(audio_volume, "audioVolume");
+// Version of the options blob. Must be incremented on any change to the
+// properties below, which causes the blob to be migrated anew.
+static const unsigned version = 1;
 
-    if (auto s = local_storage_get("inlineFit")) {
-        if (*s == "width") {
-            inline_fit = FittingMode::width;
-        } else if (*s == "screen") {
-            inline_fit = FittingMode::screen;
-        }
-    }
+// Separates the fields of the options blob
+static const char sep = '\x1f';
 
-    load_string(theme, "theme");
-    load_string(custom_css, "customCSS");
-}
+// Properties in the order of the options blob fields and their legacy
+// per-option localStorage keys. Fields are empty, if not set.
+static const std::pair<bool Options::*, const char*> bools[] = {
+    { &Options::hide_thumbs, "hideThumbs" },
+    { &Options::image_hover, "imageHover" },
+    { &Options::webm_hover, "webmHover" },
+    { &Options::notification, "notification" },
+    { &Options::anonymise, "anonymise" },
+    { &Options::post_inline_expand, "postInlineExpand" },
+    { &Options::relative_time, "relativeTime" },
+    { &Options::now_playing, "nowPlaying" },
+    { &Options::illya_dance, "illyaDance" },
+    { &Options::illya_dance_mute, "illyaDanceMute" },
+    { &Options::horizontal_posting, "horizontalPosting" },
+    { &Options::hide_recursively, "hideRecursively" },
+    { &Options::work_mode_toggle, "workModeToggle" },
+    { &Options::user_BG, "userBG" },
+    { &Options::custom_css_toggle, "customCSS" },
+    { &Options::mascot, "mascot" },
+    { &Options::always_lock, "alwaysLock" },
+    { &Options::google, "google" },
+    { &Options::iqdb, "iqdb" },
+    { &Options::sauce_nao, "saucenao" },
+    { &Options::what_anime, "whatAnime" },
+    { &Options::desu_storage, "desustorage" },
+    { &Options::exhentai, "exhentai" },
+    { &Options::gallery_mode_toggle, "galleryModeToggle" },
+    { &Options::megu_tv, "meguTV" },
+    { &Options::lazy_thumbnails, "lazyThumbnails" },
+    { &Options::strict_url_validation, "strictURLValidation" },
+};
+static const std::pair<unsigned Options::*, const char*> uints[] = {
+    { &Options::new_post, "newPost" },
+    { &Options::toggle_spoiler, "toggleSpoiler" },
+    { &Options::done, "done" },
+    { &Options::expand_all, "expandAll" },
+    { &Options::work_mode, "workMode" },
+    { &Options::audio_volume, "audioVolume" },
+};
+static const char inline_fit_key[] = "inlineFit";
+static const std::pair<std::string Options::*, const char*> strings[] = {
+    { &Options::theme, "theme" },
+    { &Options::custom_css, "customCSS" },
+};
 
-void Options::load_bool(bool& val, const std::string& key)
+// Returns the legacy keys of all fields joined by sep
+static std::string legacy_keys()
 {
-    if (auto s = local_storage_get(key)) {
-        val = *s == "true";
+    std::string s;
+    auto add = [&](const char* key) {
+        if (s.size()) {
+            s += sep;
+        }
+        s += key;
+    };
+    for (auto& [_, key] : bools) {
+        add(key);
+    }
+    for (auto& [_, key] : uints) {
+        add(key);
+    }
+    add(inline_fit_key);
+    for (auto& [_, key] : strings) {
+        add(key);
     }
+    return s;
 }
 
-void Options::load_uint(unsigned& val, const std::string& key)
+void Options::load()
 {
-    if (auto s = local_storage_get(key)) {
-        val = std::stoul(*s);
+    const auto keys = legacy_keys();
+    char* buf = (char*)EM_ASM_INT(
+        {
+            var sep = '\x1f';
+            var version = String($1);
+            var blob = localStorage.getItem('options');
+            if (!blob || blob.slice(0, blob.indexOf(sep)) != version) {
+                var vals = UTF8ToString($0).split(sep).map(function(k) {
+                    return localStorage.getItem(k) || '';
+                });
+                blob = version + sep + vals.join(sep);
+                localStorage.setItem('options', blob);
+            }
+            var len = lengthBytesUTF8(blob) + 1;
+            var buf = Module._malloc(len);
+            stringToUTF8(blob, buf, len);
+            return buf;
+        },
+        keys.c_str(), version);
+
+    // Skip the version
+    std::string_view blob(buf);
+    auto next = [&]() {
+        auto i = blob.find(sep);
+        blob = i == std::string_view::npos ? "" : blob.substr(i + 1);
+        return blob.substr(0, blob.find(sep));
+    };
+
+    for (auto& [member, _] : bools) {
+        if (auto s = next(); s.size()) {
+            this->*member = s == "true";
+        }
+    }
+    for (auto& [member, _] : uints) {
+        if (auto s = next(); s.size()) {
+            this->*member = std::stoul(std::string(s));
+        }
+    }
+    if (auto s = next(); s == "width") {
+        inline_fit = FittingMode::width;
+    } else if (s == "screen") {
+        inline_fit = FittingMode::screen;
     }
+    for (auto& [member, _] : strings) {
+        if (auto s = next(); s.size()) {
+            this->*member = s;
+        }
+    }
+
+    free(buf);
 }
 
-void Options::load_string(std::string& val, const std::string& key)
+void Options::save() const
 {
-    if (auto s = local_storage_get(key)) {
-        val = *s;
+    std::string s = std::to_string(version);
+    for (auto& [member, _] : bools) {
+        s += sep;
+        s += this->*member ? "true" : "false";
+    }
+    for (auto& [member, _] : uints) {
+        s += sep;
+        s += std::to_string(this->*member);
+    }
+    s += sep;
+    s += inline_fit == FittingMode::width ? "width" : "screen";
+    for (auto& [member, _] : strings) {
+        s += sep;
+        s += this->*member;
     }
+    local_storage_set("options", s);
 }
@@ -23,7 +23,9 @@ public:
         mascot = false, // Show user-set mascot
         always_lock = false, // Lock to thread bottom, even when tab hidden
         gallery_mode_toggle = false, // Mode for better image viewing
-        megu_tv = false; // Play random videos
+        megu_tv = false, // Play random videos
+        lazy_thumbnails = true, // Load thumbnails only near the viewport
+        strict_url_validation = false; // Also validate post URLs in JS
 
     // Reverse image search engines
     bool google = true, iqdb = false, sauce_nao = true, what_anime = false,
@@ -48,18 +50,12 @@ public:
     std::string theme = "moe", // CSS theme; TODO: Read default from configs
         custom_css = ""; // Custom user-set CSS
 
-    // Load properties from localStorage
+    // Load properties from the options blob in localStorage. If there is no
+    // blob of the current version, it is migrated from the per-option keys.
     void load();
 
-private:
-    // Load a boolean property from localStorage, or a default
-    void load_bool(bool& val, const std::string& key);
-
-    // Load a uint property from localStorage, or a default
-    void load_uint(unsigned& val, const std::string& key);
-
-    // Load a string property from localStorage, or a default
-    void load_string(std::string& val, const std::string& key);
+    // Write all properties to the options blob in localStorage
+    void save() const;
 };
 
 // Client-side options
@@ -1,232 +1,458 @@
 #include "board.hh"
+#include "../../brunhild/events.hh"
 #include "../../brunhild/mutations.hh"
+#include "../http.hh"
 #include "../lang.hh"
 #include "../posts/etc.hh"
 #include "../posts/models.hh"
 #include "../state.hh"
 #include "../util.hh"
+#include "catalog.hh"
+#include "chrome.hh"
 #include "page.hh"
-#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory>
 #include <optional>
+#include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using brunhild::Node;
 using brunhild::Rope;
-using std::ostringstream;
 using std::string;
 
 // Modes for sorting threads
 enum class SortMode { bump, last_reply, creation, reply_count, file_count };
+static const size_t sort_mode_count = 5;
 
 // Current thread sorting mode
 static SortMode sort_mode = SortMode::bump;
 
-// Generate a sorted vector of thread references according to current sorting
-// mode
-static std::vector<Thread*> sort_threads()
-{
-    std::vector<Thread*> t;
-    t.reserve(threads.size());
-    for (auto& [_, thread] : threads) {
-        t.push_back(&thread);
+// Position of a thread in the board index ordering of one SortMode
+struct IndexKey {
+    bool pinned; // Stickies are pinned to the top, except on /all/
+    unsigned long val, id;
+
+    bool operator==(const IndexKey& o) const
+    {
+        return pinned == o.pinned && val == o.val && id == o.id;
     }
 
-    const bool is_all = page.board == "all";
-    std::sort(t.begin(), t.end(), [=](auto a, auto b) {
-        if (!is_all && !(a->sticky && b->sticky)) {
-            if (a->sticky) {
-                return true;
-            }
-            if (b->sticky) {
-                return false;
+    // Orders keys from the top of the index to the bottom
+    bool operator<(const IndexKey& o) const
+    {
+        if (pinned != o.pinned) {
+            return pinned;
+        }
+        if (val != o.val) {
+            return val > o.val;
+        }
+        return id > o.id;
+    }
+};
+
+typedef std::array<IndexKey, sort_mode_count> IndexKeys;
+
+// Board index threads kept in order for every SortMode, so a changed thread
+// only needs to be repositioned and switching modes needs no sort
+static std::array<std::set<IndexKey>, sort_mode_count> index_order;
+
+// Current keys of all indexed threads
+static std::unordered_map<unsigned long, IndexKeys> index_keys;
+
+// Rendered thread views of the board index
+static std::unordered_map<unsigned long, std::unique_ptr<BoardThreadView>>
+    index_views;
+
+static IndexKeys compute_keys(const Thread& t)
+{
+    const bool pinned = t.sticky && page.board != "all";
+    return { {
+        { pinned, t.bump_time, t.id },
+        { pinned, t.reply_time, t.id },
+        { pinned, t.time, t.id },
+        { pinned, t.post_ctr, t.id },
+        { pinned, t.image_ctr, t.id },
+    } };
+}
+
+// Insert a thread into the index or update its position. Returns, if its
+// position under the current sort mode changed.
+static bool index_thread(const Thread& t)
+{
+    const auto keys = compute_keys(t);
+    const auto mode = static_cast<size_t>(sort_mode);
+    bool moved = true;
+    if (auto it = index_keys.find(t.id); it != index_keys.end()) {
+        moved = !(it->second[mode] == keys[mode]);
+        for (size_t i = 0; i < sort_mode_count; i++) {
+            if (!(it->second[i] == keys[i])) {
+                index_order[i].erase(it->second[i]);
+                index_order[i].insert(keys[i]);
             }
         }
-        switch (sort_mode) {
-        case SortMode::bump:
-            return a->bump_time > b->bump_time;
-        case SortMode::last_reply:
-            return a->reply_time > b->reply_time;
-        case SortMode::creation:
-            return a->time > b->time;
-        case SortMode::reply_count:
-            return a->post_ctr > b->post_ctr;
-        case SortMode::file_count:
-            return a->image_ctr > b->image_ctr;
+        it->second = keys;
+    } else {
+        for (size_t i = 0; i < sort_mode_count; i++) {
+            index_order[i].insert(keys[i]);
+        }
+        index_keys[t.id] = keys;
+    }
+    return moved;
+}
+
+static void unindex_thread(unsigned long id)
+{
+    if (auto it = index_keys.find(id); it != index_keys.end()) {
+        for (size_t i = 0; i < sort_mode_count; i++) {
+            index_order[i].erase(it->second[i]);
         }
-    });
+        index_keys.erase(it);
+    }
+}
 
-    return t;
+// Returns the nearest rendered view preceding thread id under the current
+// sort mode or NULL, if there is none
+static BoardThreadView* preceding_view(unsigned long id)
+{
+    const auto mode = static_cast<size_t>(sort_mode);
+    const auto& order = index_order[mode];
+    auto it = order.find(index_keys.at(id)[mode]);
+    while (it != order.begin()) {
+        if (auto v = index_views.find((--it)->id); v != index_views.end()) {
+            return v->second.get();
+        }
+    }
+    return nullptr;
+}
+
+// Running inline thread expansion requests by thread ID
+static std::unordered_map<unsigned long, unsigned> expansions;
+
+void clear_board_index()
+{
+    for (auto& set : index_order) {
+        set.clear();
+    }
+    index_keys.clear();
+    index_views.clear();
+    for (auto [_, req] : expansions) {
+        http_abort(req);
+    }
+    expansions.clear();
+}
+
+void BoardThreadView::expand()
+{
+    const auto list = get_list();
+    if (list.size() > eager_posts) {
+        defer_before = list[list.size() - eager_posts]->id;
+    }
+    if (!splice()) {
+        patch();
+    }
+    defer_before = 0;
+
+    // Omitted post counter
+    if (auto op = posts.find(thread_id); op) {
+        op->patch();
+    }
+}
+
+// Insert the posts of an inline thread expansion
+static void on_expansion(
+    unsigned long id, unsigned short code, std::string_view data)
+{
+    expansions.erase(id);
+    auto it = index_views.find(id);
+    if (it == index_views.end()) {
+        return;
+    }
+    if (code != 200 || !load_thread(data)) {
+        console::error("could not expand thread " + std::to_string(id));
+        return;
+    }
+    it->second->expand();
+}
+
+// Fetch the posts of a board index thread, that the expand or last 100 link
+// points to, and insert them in place instead of navigating to the thread.
+// The rest of the page is not touched.
+static void expand_thread(emscripten::val& event)
+{
+    const Page p(event["target"].call<string>("getAttribute", string("href")));
+    const auto id = p.thread;
+    if (!id || page.thread || !index_views.count(id) || expansions.count(id)) {
+        return;
+    }
+
+    std::ostringstream url;
+    url << "/json/boards/" << p.board << '/' << id;
+    if (p.last_100) {
+        url << "?last=100";
+    }
+    expansions[id] = http_request(url.str(),
+        [id](unsigned short code, auto data) { on_expansion(id, code, data); });
+}
+
+void init_board()
+{
+    brunhild::register_handler("click", &expand_thread, "a.expand-thread");
+}
+
+void patch_board_index()
+{
+    if (index_views.empty()) {
+        return;
+    }
+    const auto container = brunhild::named_handle("index-thread-container");
+
+    // Threads, that are no longer on the page
+    for (auto it = index_views.begin(); it != index_views.end();) {
+        if (!threads.count(it->first)) {
+            it->second->remove();
+            unindex_thread(it->first);
+            it = index_views.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto& [id, thread] : threads) {
+        if (!index_thread(thread)) {
+            continue;
+        }
+        const auto prev = preceding_view(id);
+        if (auto it = index_views.find(id); it != index_views.end()) {
+            const auto v = it->second.get();
+            if (prev) {
+                brunhild::move_after(prev->handle, v->handle);
+            } else {
+                brunhild::move_prepend(container, v->handle);
+            }
+        } else {
+            // New threads preceding this one, that are not rendered yet, are
+            // inserted before it later in this pass
+            auto v = new BoardThreadView(id);
+            index_views[id].reset(v);
+            if (prev) {
+                brunhild::after(prev->handle, v->html());
+            } else {
+                brunhild::prepend(container, v->html());
+            }
+        }
+    }
 }
 
 // Render threads on a board page
 static void render_index_threads(Rope& s)
 {
-    // TODO: Port to a ListView
     // TODO: Seperate with <hr>
     sort_mode = SortMode::bump;
+    clear_board_index();
+    for (auto& [_, thread] : threads) {
+        index_thread(thread);
+    }
+
     s << "<div id=index-thread-container>";
-    const auto sorted = sort_threads();
-    for (size_t i = 0; i < sorted.size(); i++) {
-        auto v = new BoardThreadView(sorted[i]->id);
+    for (auto& key : index_order[static_cast<size_t>(sort_mode)]) {
+        auto v = new BoardThreadView(key.id);
+        index_views[key.id].reset(v);
         v->write_html(s);
     }
-    s << "</div><hr>";
+    s << "</div>";
 }
 
-// Render Links to different pages of the board index
-static Node render_pagination()
+// Decimal representations of page numbers. Grown on demand and never freed.
+static std::vector<string> page_digits;
+
+// Pagination views at the top and bottom of the board index
+static std::array<std::unique_ptr<PaginationView>, 2> paginations;
+
+// Board the pagination views were rendered for
+static string paginated_board;
+
+static const string& digits(unsigned i)
 {
-    const unsigned n = page.page;
-    const unsigned total = page.page_total;
-    ostringstream s;
+    while (page_digits.size() <= i) {
+        page_digits.push_back(brunhild::int_to_string(page_digits.size()));
+    }
+    return page_digits[i];
+}
 
-    auto link = [&s](unsigned i, string text) {
-        s << "<a href=\"?page=" << i << "\">" << text << "</a>";
-    };
+PaginationView::PaginationView()
+    : prev(brunhild::new_handle())
+    , next(brunhild::new_handle())
+{
+}
 
-    if (n) {
-        if (n - 1) {
-            link(0, "<<");
-        }
-        link(n - 1, "<");
+void PaginationView::write_link(Rope& s, unsigned i, const char* text)
+{
+    s << "<a href=\"?page=" << digits(i) << "\">" << text << "</a>";
+}
+
+void PaginationView::write_page(Rope& s, unsigned i)
+{
+    if (i == current) {
+        s << "<b id=\"";
+        brunhild::write_handle_id(s, links[i]);
+        s << "\">" << digits(i) << "</b>";
+    } else {
+        s << "<a id=\"";
+        brunhild::write_handle_id(s, links[i]);
+        s << "\" href=\"?page=" << digits(i) << "\">" << digits(i) << "</a>";
     }
-    for (unsigned i = 0; i < total; i++) {
-        if (i != n) {
-            link(i, std::to_string(i));
-        } else {
-            s << "<b>" << i << "</b>";
+}
+
+void PaginationView::write_prev(Rope& s)
+{
+    if (current) {
+        if (current - 1) {
+            write_link(s, 0, "&lt;&lt;");
         }
+        write_link(s, current - 1, "&lt;");
     }
-    if (n != total - 1) {
-        link(n + 1, ">");
-        if (n + 1 != total - 1) {
-            link(total - 1, ">>");
+}
+
+void PaginationView::write_next(Rope& s)
+{
+    if (current + 1 < total) {
+        write_link(s, current + 1, "&gt;");
+        if (current + 2 != total) {
+            write_link(s, total - 1, "&gt;&gt;");
         }
     }
+}
+
+void PaginationView::write_html(Rope& s)
+{
+    current = page.page;
+    total = page.page_total;
+    while (links.size() < total) {
+        links.push_back(brunhild::new_handle());
+    }
+
+    s << "<aside class=glass id=\"";
+    brunhild::write_handle_id(s, handle);
+    s << "\"><span id=\"";
+    brunhild::write_handle_id(s, prev);
+    s << "\">";
+    write_prev(s);
+    s << "</span>";
+    for (unsigned i = 0; i < total; i++) {
+        write_page(s, i);
+    }
+    s << "<span id=\"";
+    brunhild::write_handle_id(s, next);
+    s << "\">";
+    write_next(s);
+    s << "</span></aside>";
+}
+
+void PaginationView::patch()
+{
+    const unsigned old = current;
+    current = page.page;
+    if (current == old || current >= total) {
+        return;
+    }
+
+    Rope s;
+    write_page(s, old);
+    brunhild::set_outer_html(links[old], s.take());
+    write_page(s, current);
+    brunhild::set_outer_html(links[current], s.take());
+    write_prev(s);
+    brunhild::set_inner_html(prev, s.take());
+    write_next(s);
+    brunhild::set_inner_html(next, s.take());
+}
 
-    return { "aside", { { "class", "glass" } }, s.str() };
+bool PaginationView::can_patch()
+{
+    return total == page.page_total && !el().isNull();
 }
 
 // Render a link to a catalog or board page
 static Node render_catalog_link()
 {
-    // render_button(page.catalog ? "." : "catalog",
-    //     lang.ui.at(page.catalog ? "return" : "catalog"), true);
-    return { "aside", "TODO: Catalog" };
+    return render_button(page.catalog ? "." : "catalog",
+        lang.ui[page.catalog ? UIKey::return_ : UIKey::catalog], true);
 }
 
-// Render form for creating new threads
-static Node render_thread_form()
-{
-    Node form("form",
-        {
-            { "id", "new-thread-form" },
-            { "action", "/api/create-thread" },
-            { "method", "post" },
-            { "enctype", "multipart/form-data" },
-            { "class", "hidden" },
-        });
-    form.children.reserve(10);
+// Static markup of the new thread form
+
+static constexpr chrome::Part thread_form_parts[] = {
+    chrome::text("<aside class=glass id=thread-form-container>"
+                 "<span class=act><a>"),
+    chrome::ui(UIKey::newThread),
+    chrome::text("</a></span><form action=\"/api/create-thread\" "
+                 "class=hidden enctype=\"multipart/form-data\" "
+                 "id=new-thread-form method=post>"),
+    chrome::slot(), // Board selection
+    chrome::slot(), // File upload
+    chrome::text("<input type=submit value=\""),
+    chrome::ui(UIKey::submit),
+    chrome::text("\"><input name=cancel type=button value=\""),
+    chrome::ui(UIKey::cancel),
+    chrome::text("\"><div class=\"form-response admin\"></div>"
+                 "</form></aside>"),
+};
+static_assert(chrome::slot_count(thread_form_parts) == 2);
 
+static constexpr chrome::Part upload_parts[] = {
+    chrome::text("<span class=upload-container><span><label>"
+                 "<input name=spoiler type=checkbox><span>"),
+    chrome::posts(PostsKey::spoiler),
+    chrome::text("</span></label></span><br>"
+                 "<input accept=\"image/png, image/gif, image/jpeg, "
+                 "video/webm, video/ogg, audio/ogg, application/ogg, "
+                 "video/mp4, audio/mp4, audio/mp3, application/zip, "
+                 "application/x-7z-compressed, application/x-xz, "
+                 "application/x-gzip, audio/x-flac, text/plain, "
+                 "application/pdf, video/quicktime, audio/x-flac\" "
+                 "name=image type=file>"
+                 "<span id=upload-progress></span><br></span>"),
+};
+
+static constexpr chrome::Part refresh_parts[] = {
+    chrome::text("<aside class=\"act glass\" id=refresh><a>"),
+    chrome::ui(UIKey::refresh),
+    chrome::text("</a></aside>"),
+};
+
+static const chrome::Fragment thread_form(thread_form_parts),
+    upload_input(upload_parts), refresh_button(refresh_parts);
+
+// Write form for creating new threads
+static void write_thread_form(Rope& s)
+{
     // Board selection input
+    Rope board;
     if (page.board == "all") {
-        Node sel("select",
-            {
-                { "name", "board" },
-                { "required", "" },
-            });
-        sel.children.reserve(boards.size());
-        for (auto& [board, title] : boards) {
-            sel.children.push_back({
-                "option",
-                {
-                    { "value", board },
-                },
-                format_title(board, title),
-            });
+        board << "<select name=board required>";
+        for (auto& [b, title] : boards) {
+            board << "<option value=\"" << b << "\">"
+                  << format_title(b, title) << "</option>";
         }
-
-        form.children.push_back(sel);
-        form.children.push_back({ "br" });
+        board << "</select><br>";
     } else {
-        form.children.push_back({
-            "input",
-            {
-                { "type", "text" },
-                { "name", "board" },
-                { "value", page.board },
-                { "hidden", "" },
-            },
-        });
+        board << "<input hidden name=board type=text value=\"" << page.board
+              << "\">";
     }
 
     // File upload form
+    std::string upload;
     if (page.board == "all" || !board_config.text_only) {
-        form.children.push_back({
-            "span",
-            { { "class", "upload-container" } },
-            {
-                {
-                    "span",
-                    {},
-                    {
-                        {
-                            "label",
-                            {},
-                            {
-                                {
-                                    "input",
-                                    {
-                                        { "type", "checkbox" },
-                                        { "name", "spoiler" },
-                                    },
-                                },
-                                { "span", lang.posts.at("spoiler") },
-                            },
-                        },
-                    },
-                },
-                { "br" },
-                {
-                    "input",
-                    {
-                        { "type", "file" },
-                        { "name", "image" },
-                        {
-                            "accept",
-                            "image/png, image/gif, image/jpeg, video/webm, "
-                            "video/ogg, audio/ogg, application/ogg, video/mp4, "
-                            "audio/mp4, audio/mp3, application/zip, "
-                            "application/x-7z-compressed, application/x-xz, "
-                            "application/x-gzip, audio/x-flac, text/plain, "
-                            "application/pdf, video/quicktime, audio/x-flac",
-                        },
-                    },
-                },
-                { "br" },
-            },
-        });
+        upload = upload_input.str();
     }
 
     // TODO: Captcha
 
-    auto submit = render_submit(true);
-    form.children.insert(form.children.end(), submit.begin(), submit.end());
-
-    return {
-        "aside",
-        {
-            { "id", "thread-form-container" },
-            { "class", "glass" },
-        },
-        // Disambiguate constructor
-        brunhild::Children({
-            render_button(std::nullopt, lang.ui.at("newThread")),
-            form,
-        }),
-    };
+    thread_form.write(s, { board.take(), upload });
 }
 
 // Render board index page
@@ -249,46 +475,61 @@ static void render_index_page()
     s << "<h1 id=page-title>" << format_title(page.board, board_config.title)
       << "</h1>";
 
-    Node aside_container("span", { { "class", "aside-container" } });
-    auto& ch = aside_container.children;
-    const Node cat_link = render_catalog_link();
-    const Node pagination = render_pagination();
-    ch.reserve(8);
-    ch.push_back(render_thread_form());
-    ch.push_back({
-        "aside",
-        {
-            { "id", "refresh" },
-            { "class", "act glass" },
-        },
-        { { "a", lang.ui.at("refresh") } },
-    });
-    ch.push_back(cat_link);
+    // Pagination is written straight to the Rope, so the aside rows are
+    // written element by element
+    Node cat_link = render_catalog_link();
     if (!page.catalog) {
-        ch.push_back(pagination);
+        paginated_board = page.board;
+        for (auto& p : paginations) {
+            p.reset(new PaginationView());
+        }
     }
-    push_board_hover_info(ch);
-    aside_container.write_html(s);
-
-    s << "<hr>";
+    s << "<span class=aside-container>";
+    write_thread_form(s);
+    refresh_button.write(s);
+    cat_link.write_html(s);
+    if (!page.catalog) {
+        paginations[0]->write_html(s);
+    }
+    brunhild::Children hover_info;
+    push_board_hover_info(hover_info);
+    for (auto& n : hover_info) {
+        n.write_html(s);
+    }
+    s << "</span><hr>";
 
-    render_index_threads(s);
+    if (page.catalog) {
+        render_catalog(s);
+    } else {
+        render_index_threads(s);
+        s << "<hr>";
+    }
 
-    ch.clear();
-    ch.push_back(cat_link);
+    s << "<span class=aside-container>";
+    cat_link.write_html(s);
     if (!page.catalog) {
-        ch.push_back(pagination);
+        paginations[1]->write_html(s);
     }
+    s << "</span>";
 
     // TODO: Render loading image
 
-    aside_container.write_html(s);
-
-    brunhild::set_inner_html("threads", s.str());
+    brunhild::set_inner_html("threads", s.take());
 }
 
 void render_board()
 {
-    // TODO: catalog
+    // Pages of the same board only differ in their threads and the current
+    // page marker, if the index is still in the DOM
+    if (!page.catalog && paginations[0] && paginated_board == page.board
+        && paginations[0]->can_patch()) {
+        Rope s;
+        render_index_threads(s);
+        brunhild::set_outer_html("index-thread-container", s.take());
+        for (auto& p : paginations) {
+            p->patch();
+        }
+        return;
+    }
     render_index_page();
 }
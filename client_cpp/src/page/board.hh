@@ -5,14 +5,62 @@
 // Render a board or catalog page
 void render_board();
 
+// Reposition threads on the board index, whose metadata changed, and insert
+// or remove threads. Only the affected thread elements are moved.
+void patch_board_index();
+
+// Free all board index thread views and ordering data and abort any inline
+// thread expansions
+void clear_board_index();
+
+// Register handlers of the board index
+void init_board();
+
 // TODO: Deleted thread toggle
 class BoardThreadView : public ThreadView {
     using ThreadView::ThreadView;
 
+public:
+    // Insert views of the posts loaded by an inline expansion of the thread
+    // between the existing ones. Existing views are not touched. Posts far
+    // from the end of the thread are deferred like on thread pages.
+    void expand();
+
 protected:
     brunhild::Attrs attrs() { return { { "class", "index-thread" } }; }
 };
 
+// Links to the pages of the board index. Switching between pages of the same
+// board only patches the current page marker and the previous and next links.
+class PaginationView : public brunhild::View {
+public:
+    PaginationView();
+
+    void write_html(brunhild::Rope&);
+
+    // Patch the view to match page.page
+    void patch();
+
+    // Returns, if the view is still in the DOM and can be patched to match
+    // the current page
+    bool can_patch();
+
+private:
+    // Rendered current page and page count
+    unsigned current = 0, total = 0;
+
+    // Containers of the links before and after the page links
+    const brunhild::Handle prev, next;
+
+    // Handles of the page links
+    std::vector<brunhild::Handle> links;
+
+    static void write_link(brunhild::Rope&, unsigned i, const char* text);
+    void write_page(brunhild::Rope&, unsigned i);
+    void write_prev(brunhild::Rope&);
+    void write_next(brunhild::Rope&);
+};
+
 // Contains the post-related portion of the board page
 class BoardPageView : public PageView {
 protected:
@@ -0,0 +1,125 @@
+#include "cache.hh"
+#include "../db.hh"
+#include <list>
+
+// Maximum number of cached pages
+static const size_t max_pages = 8;
+
+// Approximate memory budget of all cached pages in bytes
+static const size_t budget = 4 << 20;
+
+struct CachedPage {
+    Page page;
+    PostStore posts;
+    std::unordered_map<unsigned long, std::vector<Post*>> thread_posts;
+    LinkGraph link_graph;
+    std::unordered_map<unsigned long, Thread> threads;
+    size_t size;
+};
+
+// Cached pages ordered from most to least recently visited
+static std::list<CachedPage> pages;
+
+static size_t total_size = 0;
+
+// Approximate memory usage of the currently loaded posts
+static size_t estimate_size()
+{
+    size_t n = 0;
+    for (auto [_, p] : posts) {
+        n += sizeof(Post) + p.body.size()
+            + p.links.size() * sizeof(std::pair<unsigned long, LinkData>)
+            + p.body_tokens.size() * sizeof(BodyToken);
+    }
+    return n;
+}
+
+// Move the global post collections into a new cache entry for page p,
+// leaving them empty
+static void take_globals(const Page& p)
+{
+    const auto size = estimate_size();
+    if (size > budget) {
+        clear_posts();
+        threads.clear();
+        return;
+    }
+    pages.push_front({ p, std::move(posts), std::move(thread_posts),
+        std::move(link_graph), std::move(threads), size });
+    total_size += size;
+    thread_posts.clear();
+    link_graph.clear();
+    threads.clear();
+
+    while (pages.size() > max_pages || total_size > budget) {
+        total_size -= pages.back().size;
+        pages.pop_back();
+    }
+}
+
+void cache_page()
+{
+    // Catalog thread summaries are not part of the cache
+    if (page.catalog) {
+        return;
+    }
+
+    // Views are bound to the DOM of the page being left
+    for (auto [_, p] : posts) {
+        p.views.clear();
+    }
+    take_globals(page);
+}
+
+bool is_cached(const Page& p)
+{
+    for (auto& c : pages) {
+        if (c.page.same_page(p)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void cache_page_data(const Page& p, std::string_view data)
+{
+    if (is_cached(p) || p.same_page(page)) {
+        return;
+    }
+
+    // The loaders operate on the global collections, so the current page's
+    // collections are set aside, while decoding
+    CachedPage current{ page, std::move(posts), std::move(thread_posts),
+        std::move(link_graph), std::move(threads), 0 };
+    thread_posts.clear();
+    link_graph.clear();
+    threads.clear();
+
+    page = p;
+    load_posts(data);
+    load_post_ids(new WaitGroup(1, []() {}));
+    take_globals(page); // Also retains the decoded page count
+
+    page = current.page;
+    posts = std::move(current.posts);
+    thread_posts = std::move(current.thread_posts);
+    link_graph = std::move(current.link_graph);
+    threads = std::move(current.threads);
+}
+
+bool restore_page(const Page& p)
+{
+    for (auto it = pages.begin(); it != pages.end(); ++it) {
+        if (it->page.same_page(p)) {
+            posts = std::move(it->posts);
+            thread_posts = std::move(it->thread_posts);
+            link_graph = std::move(it->link_graph);
+            threads = std::move(it->threads);
+            page.page_total = it->page.page_total;
+            total_size -= it->size;
+            pages.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
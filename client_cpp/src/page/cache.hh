@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../state.hh"
+
+// Decoded post data of recently visited pages. Navigating back to a cached
+// page renders it right away, while the page resynchronises in the
+// background.
+
+// Move the post data of the current page into the cache, leaving the global
+// post collections empty
+void cache_page();
+
+// Decode JSON page data of a page, that is not the current one, and cache it.
+// Also loads the post IDs of its threads from the database.
+void cache_page_data(const Page&, std::string_view data);
+
+// Returns, if the page is cached
+bool is_cached(const Page&);
+
+// Move cached post data of a page into the global post collections. Returns
+// false, if the page is not cached.
+bool restore_page(const Page&);
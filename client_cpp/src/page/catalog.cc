@@ -0,0 +1,255 @@
+#include "catalog.hh"
+#include "../../brunhild/mutations.hh"
+#include "../json_scan.hh"
+#include "../lang.hh"
+#include "../state.hh"
+#include "../util.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emscripten.h>
+#include <emscripten/bind.h>
+#include <memory>
+#include <nlohmann/json.hpp>
+
+using brunhild::Rope;
+using emscripten::val;
+using nlohmann::json;
+
+// Number of threads rendered before the grid geometry is known
+static const size_t initial_cells = 48;
+
+// Number of rows rendered above and below the viewport
+static const size_t overscan_rows = 2;
+
+// Grid of the current catalog page
+static std::unique_ptr<CatalogView> view;
+
+// Copy at most size bytes of s to dst without splitting a UTF-8 sequence.
+// Returns the number of bytes copied.
+static uint8_t copy_truncated(char* dst, size_t size, std::string_view s)
+{
+    size_t n = s.size();
+    if (n > size) {
+        n = size;
+        // Back off to the start of a sequence
+        while (n && (s[n] & 0xC0) == 0x80) {
+            n--;
+        }
+    }
+    memcpy(dst, s.data(), n);
+    return n;
+}
+
+std::string CatalogThread::thumb_path() const
+{
+    std::string s = config.image_root_override != ""
+        ? config.image_root_override
+        : "/assets/images";
+    s += "/thumb/";
+    s += get_sha1();
+    s += '.';
+    s += file_extentions.at(thumb_type);
+    return s;
+}
+
+bool extract_catalog_thread(std::string_view data)
+{
+    CatalogThread t;
+    bool ok = json_scan::for_each_member(
+        data, [&](std::string_view key, std::string_view value) {
+            if (key == "id") {
+                t.id = json::parse(value);
+            } else if (key == "postCtr") {
+                t.post_ctr = json::parse(value);
+            } else if (key == "imageCtr") {
+                t.image_ctr = json::parse(value);
+            } else if (key == "time") {
+                t.time = json::parse(value);
+            } else if (key == "replyTime") {
+                t.reply_time = json::parse(value);
+            } else if (key == "bumpTime") {
+                t.bump_time = json::parse(value);
+            } else if (key == "sticky") {
+                t.sticky = value == "true";
+            } else if (key == "locked") {
+                t.locked = value == "true";
+            } else if (key == "deleted") {
+                t.deleted = value == "true";
+            } else if (key == "board") {
+                t.board = Atom(json::parse(value).get<std::string>());
+            } else if (key == "subject") {
+                t.subject_len = copy_truncated(t.subject,
+                    CatalogThread::subject_size,
+                    json::parse(value).get<std::string>());
+            } else if (key == "body") {
+                t.body_len = copy_truncated(t.body, CatalogThread::body_size,
+                    json::parse(value).get<std::string>());
+            } else if (key == "image") {
+                auto j = json::parse(value);
+                const std::string sha1 = j["sha1"];
+                if (sha1.size() != sizeof(t.sha1)) {
+                    return;
+                }
+                memcpy(t.sha1, sha1.data(), sizeof(t.sha1));
+                t.has_image = true;
+                if (j.count("spoiler")) {
+                    t.spoiler = j["spoiler"];
+                }
+                t.thumb_type = static_cast<FileType>(j["thumbType"]);
+                t.thumb_width = j["dims"][2];
+                t.thumb_height = j["dims"][3];
+            }
+        });
+    if (!ok || !t.id) {
+        return false;
+    }
+    catalog.push_back(t);
+    return true;
+}
+
+void render_catalog(Rope& s)
+{
+    view.reset(new CatalogView());
+    view->write_html(s);
+}
+
+void clear_catalog()
+{
+    view.reset();
+    catalog.clear();
+}
+
+// Schedule a patch of the catalog grid on the next frame
+static void schedule_patch()
+{
+    if (view) {
+        view->schedule_patch();
+    }
+}
+
+void patch_catalog()
+{
+    if (view) {
+        view->invalidate();
+        view->schedule_patch();
+    }
+}
+
+CatalogView::CatalogView()
+    : View("catalog")
+{
+    static bool bound = false;
+    if (!bound) {
+        bound = true;
+        EM_ASM({
+            var patch = function() { Module.schedule_catalog_patch(); };
+            window.addEventListener('scroll', patch, { passive : true });
+            window.addEventListener('resize', patch, { passive : true });
+        });
+    }
+
+    // The grid geometry can only be measured after insertion into the DOM
+    brunhild::on_visible(handle, ::schedule_patch);
+}
+
+void CatalogView::write_html(Rope& s)
+{
+    s << "<div id=catalog class=virtual>";
+    write_cells(s, 0, std::min(initial_cells, catalog.size()));
+    s << "</div>";
+}
+
+void CatalogView::patch()
+{
+    auto el = this->el();
+    if (el.isNull()) {
+        return;
+    }
+
+    // Grid geometry is defined by the stylesheet. Each column is a separate
+    // track in the computed style.
+    auto style = val::global("getComputedStyle")(el);
+    const auto tracks = style["gridTemplateColumns"].as<std::string>();
+    const double row_height
+        = val::global("parseFloat")(style["gridAutoRows"]).as<double>();
+    if (!(row_height > 0)) {
+        return;
+    }
+    const size_t cols = std::count(tracks.begin(), tracks.end(), ' ') + 1;
+    const size_t rows = (catalog.size() + cols - 1) / cols;
+
+    const double top
+        = el.call<val>("getBoundingClientRect")["top"].as<double>();
+    const double viewport = val::global("innerHeight").as<double>();
+    const long first_visible = std::floor(-top / row_height);
+    const long last_visible = std::ceil((viewport - top) / row_height);
+    const size_t first = std::clamp<long>(
+        first_visible - long(overscan_rows), 0, rows);
+    const size_t last = std::clamp<long>(
+        last_visible + long(overscan_rows), first, rows);
+    if (cols == columns && first == first_row && last == last_row) {
+        return;
+    }
+    columns = cols;
+    first_row = first;
+    last_row = last;
+
+    Rope s;
+    s << "padding-top:" << long(first * row_height)
+      << "px;padding-bottom:" << long((rows - last) * row_height) << "px";
+    brunhild::set_attr(handle, "style", s.take());
+    write_cells(s, first * cols, std::min(last * cols, catalog.size()));
+    brunhild::set_inner_html(handle, s.take());
+}
+
+void CatalogView::write_cells(Rope& s, size_t start, size_t end)
+{
+    for (size_t i = start; i < end; i++) {
+        auto& t = catalog[i];
+        const std::string& board = t.board;
+
+        s << "<article id=p" << t.id << " class=\"glass";
+        if (t.sticky) {
+            s << " sticky";
+        }
+        if (t.locked) {
+            s << " locked";
+        }
+        if (t.deleted) {
+            s << " deleted";
+        }
+        s << "\" data-id=" << t.id << '>';
+
+        if (t.has_image) {
+            s << "<figure><a href=\"/" << board << '/' << t.id << "\">";
+            if (t.spoiler) {
+                s << "<img src=\"/assets/spoil/default.jpg\" width=150 "
+                     "height=150 class=catalog>";
+            } else {
+                s << "<img width=" << t.thumb_width
+                  << " height=" << t.thumb_height << " class=catalog src=\""
+                  << t.thumb_path() << "\">";
+            }
+            s << "</a></figure>";
+        }
+
+        s << "<span class=\"spaced thread-links hide-empty\"><b class=board>/"
+          << board << "/</b><span class=counters>" << t.post_ctr << " / "
+          << t.image_ctr << "</span>";
+        if (!t.has_image) {
+            render_expand_link(board, t.id).write_html(s);
+        }
+        render_last_100_link(board, t.id).write_html(s);
+        s << "</span><br><h3>「";
+        escape(s, t.get_subject());
+        s << "」</h3><blockquote>";
+        escape(s, t.get_body());
+        s << "</blockquote></article>";
+    }
+}
+
+EMSCRIPTEN_BINDINGS(module_catalog)
+{
+    emscripten::function("schedule_catalog_patch", &schedule_patch);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../../brunhild/view.hh"
+#include "../atom.hh"
+#include "../posts/models.hh"
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compact fixed-size summary of a thread on a catalog page. Catalog pages never
+// decode threads into full Post objects.
+struct CatalogThread {
+    // Maximum lengths of the stored subject and body prefixes in bytes
+    static const size_t subject_size = 64, body_size = 128;
+
+    bool sticky = false, locked = false, deleted = false,
+         has_image = false, // Thread has a thumbnail
+        spoiler = false; // Thumbnail is spoilered
+    FileType thumb_type = FileType::jpg;
+    uint8_t subject_len = 0, body_len = 0;
+    uint16_t thumb_width = 0, thumb_height = 0;
+    Atom board;
+    uint32_t post_ctr = 0, image_ctr = 0;
+    unsigned long id = 0, time = 0, reply_time = 0, bump_time = 0;
+    char sha1[40]; // SHA1 hash of the thumbnail's source file
+    char subject[subject_size], body[body_size];
+
+    std::string_view get_subject() const { return { subject, subject_len }; }
+    std::string_view get_body() const { return { body, body_len }; }
+    std::string_view get_sha1() const { return { sha1, has_image ? 40u : 0u }; }
+
+    // Returns the path to the thread's thumbnail
+    std::string thumb_path() const;
+};
+
+// Threads of the current catalog page in server order
+inline std::vector<CatalogThread> catalog;
+
+// Decode a catalog thread from raw JSON text and append it to catalog.
+// Returns false, if the data is malformed.
+bool extract_catalog_thread(std::string_view data);
+
+// Write the catalog grid of the current page to s
+void render_catalog(brunhild::Rope& s);
+
+// Rerender the catalog grid, after the catalog threads changed
+void patch_catalog();
+
+// Free the catalog grid view and thread summaries
+void clear_catalog();
+
+// Grid of catalog threads, that only renders the rows within or near the
+// viewport. Rows are of fixed height, so the skipped rows are substituted with
+// padding.
+class CatalogView : public brunhild::View {
+public:
+    CatalogView();
+
+    void write_html(brunhild::Rope&);
+
+    // Render the rows near the viewport, if they changed since the last patch
+    void patch();
+
+    // Force the next patch to rerender all rows
+    void invalidate() { columns = 0; }
+
+private:
+    // Rendered range of rows. Before the first patch, the grid geometry is
+    // not known and a fixed number of threads is rendered instead.
+    size_t first_row = 0, last_row = 0, columns = 0;
+
+    // Write threads in the range [start, end) to s
+    void write_cells(brunhild::Rope& s, size_t start, size_t end);
+};
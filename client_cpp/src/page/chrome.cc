@@ -0,0 +1,65 @@
+#include "chrome.hh"
+
+namespace chrome {
+
+void Fragment::resolve() const
+{
+    if (generation == lang.generation && segments.size()) {
+        return;
+    }
+    generation = lang.generation;
+    segments.clear();
+    segments.emplace_back();
+    for (size_t i = 0; i < size; i++) {
+        auto& p = parts[i];
+        switch (p.kind) {
+        case Part::Kind::text:
+            segments.back() += p.html;
+            break;
+        case Part::Kind::ui:
+            segments.back() += lang.ui[static_cast<UIKey>(p.key)];
+            break;
+        case Part::Kind::posts:
+            segments.back() += lang.posts[static_cast<PostsKey>(p.key)];
+            break;
+        case Part::Kind::slot:
+            segments.emplace_back();
+            break;
+        }
+    }
+}
+
+void Fragment::write(brunhild::Rope& s, const std::string_view* slots,
+    size_t slot_count) const
+{
+    resolve();
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (i && i <= slot_count) {
+            s << slots[i - 1];
+        }
+        s << segments[i];
+    }
+}
+
+std::string Fragment::str(std::initializer_list<std::string_view> slots) const
+{
+    brunhild::Rope s;
+    write(s, slots);
+    return s.take();
+}
+
+void StaticView::write_html(brunhild::Rope& s)
+{
+    brunhild::Rope id;
+    id << " id=\"";
+    brunhild::write_handle_id(id, handle);
+    id << '"';
+    const auto id_attr = id.take();
+
+    std::vector<std::string_view> values;
+    values.reserve(slots.size() + 1);
+    values.push_back(id_attr);
+    values.insert(values.end(), slots.begin(), slots.end());
+    html.write(s, values.data(), values.size());
+}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../../brunhild/view.hh"
+#include "../lang.hh"
+#include <initializer_list>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Static page chrome, that is defined at compile time as constexpr arrays of
+// parts. Only the language pack strings are resolved at runtime, once per
+// language pack generation. Values, that differ between renders, are spliced
+// into slots.
+namespace chrome {
+
+// Part of a static HTML fragment
+struct Part {
+    enum class Kind : uint8_t {
+        text, // Literal HTML
+        ui, // String of LanguagePack::ui
+        posts, // String of LanguagePack::posts
+        slot, // Value passed on write
+    };
+
+    Kind kind;
+    std::string_view html;
+    uint8_t key;
+};
+
+constexpr Part text(std::string_view html)
+{
+    return { Part::Kind::text, html, 0 };
+}
+
+constexpr Part ui(UIKey k) { return { Part::Kind::ui, {}, uint8_t(k) }; }
+
+constexpr Part posts(PostsKey k)
+{
+    return { Part::Kind::posts, {}, uint8_t(k) };
+}
+
+constexpr Part slot() { return { Part::Kind::slot, {}, 0 }; }
+
+// Returns the number of slots of a fragment
+template <size_t N> constexpr size_t slot_count(const Part (&parts)[N])
+{
+    size_t n = 0;
+    for (auto& p : parts) {
+        n += p.kind == Part::Kind::slot;
+    }
+    return n;
+}
+
+// HTML fragment compiled from a constexpr array of parts
+class Fragment {
+public:
+    template <size_t N>
+    Fragment(const Part (&parts)[N])
+        : parts(parts)
+        , size(N)
+    {
+    }
+
+    // Write the fragment to s with the values of its slots in order. Missing
+    // values are left empty.
+    void write(brunhild::Rope& s, const std::string_view* slots,
+        size_t slot_count) const;
+
+    void write(brunhild::Rope& s,
+        std::initializer_list<std::string_view> slots = {}) const
+    {
+        write(s, slots.begin(), slots.size());
+    }
+
+    // Returns the fragment as a string
+    std::string str(std::initializer_list<std::string_view> slots = {}) const;
+
+private:
+    const Part* parts;
+    size_t size;
+
+    // HTML between the slots with language pack strings resolved
+    mutable std::vector<std::string> segments;
+
+    // Language pack generation segments were resolved with
+    mutable unsigned generation = 0;
+
+    // Resolve the segments, if the language pack changed
+    void resolve() const;
+};
+
+// View of a static element. The fragment must start with the opening tag of
+// the element with a slot, that receives the DOM ID attribute of the view,
+// followed by any other slots.
+class StaticView : public brunhild::View {
+public:
+    StaticView(const Fragment& html, std::vector<std::string> slots = {},
+        std::string id = "")
+        : View(id)
+        , html(html)
+        , slots(std::move(slots))
+    {
+    }
+
+    void write_html(brunhild::Rope&);
+
+    void patch() {}
+
+private:
+    const Fragment& html;
+    std::vector<std::string> slots;
+};
+}
@@ -0,0 +1,219 @@
+#include "gallery.hh"
+#include "../../brunhild/mutations.hh"
+#include "../state.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emscripten.h>
+#include <emscripten/bind.h>
+#include <unordered_map>
+#include <vector>
+
+using brunhild::Rope;
+using emscripten::val;
+
+// Number of images rendered before the grid geometry is known
+static const size_t initial_cells = 48;
+
+// Number of rows rendered above and below the viewport
+static const size_t overscan_rows = 2;
+
+// Images of each indexed thread sorted by post ID
+static std::unordered_map<unsigned long, std::vector<GalleryImage>> images;
+
+// Gallery of the current thread page, if any
+static GalleryView* instance = nullptr;
+
+GalleryImage::GalleryImage(unsigned long id, const Image& img)
+    : id(id)
+    , spoiler(img.spoiler)
+    , file_type(img.file_type)
+    , thumb_type(img.thumb_type)
+{
+    memcpy(dims, img.dims, sizeof(dims));
+    memset(sha1, 0, sizeof(sha1));
+    memcpy(sha1, img.sha1.data(), std::min(img.sha1.size(), sizeof(sha1)));
+}
+
+static std::string image_root()
+{
+    return config.image_root_override != "" ? config.image_root_override
+                                             : "/assets/images";
+}
+
+std::string GalleryImage::thumb_path() const
+{
+    if (spoiler) {
+        return "/assets/spoil/default.jpg";
+    }
+    if (thumb_type == FileType::no_file) {
+        switch (file_type) {
+        case FileType::mp4:
+        case FileType::mp3:
+        case FileType::ogg:
+        case FileType::flac:
+            return "/assets/audio.png";
+        default:
+            return "/assets/file.png";
+        }
+    }
+    std::string s = image_root();
+    s += "/thumb/";
+    s += get_sha1();
+    s += '.';
+    s += file_extentions.at(thumb_type);
+    return s;
+}
+
+std::string GalleryImage::source_path() const
+{
+    std::string s = image_root();
+    s += "/src/";
+    s += get_sha1();
+    s += '.';
+    s += file_extentions.at(file_type);
+    return s;
+}
+
+// Schedule a patch of the gallery grid on the next frame
+static void schedule_patch()
+{
+    if (instance) {
+        instance->schedule_patch();
+    }
+}
+
+void index_gallery_image(const Post& p)
+{
+    auto it = images.find(p.op);
+    if (it == images.end()) {
+        return;
+    }
+    auto& list = it->second;
+    auto pos = std::lower_bound(list.begin(), list.end(), p.id,
+        [](const GalleryImage& img, unsigned long id) { return img.id < id; });
+    const bool found = pos != list.end() && pos->id == p.id;
+    if (p.image) {
+        if (found) {
+            *pos = GalleryImage(p.id, *p.image);
+        } else {
+            list.insert(pos, GalleryImage(p.id, *p.image));
+        }
+    } else if (found) {
+        list.erase(pos);
+    } else {
+        return;
+    }
+
+    if (instance && instance->thread == p.op) {
+        instance->invalidate();
+        instance->schedule_patch();
+    }
+}
+
+void clear_gallery() { images.clear(); }
+
+GalleryView::GalleryView(unsigned long thread)
+    : View("gallery")
+    , thread(thread)
+{
+    static bool bound = false;
+    if (!bound) {
+        bound = true;
+        EM_ASM({
+            var patch = function() { Module.schedule_gallery_patch(); };
+            window.addEventListener('scroll', patch, { passive : true });
+            window.addEventListener('resize', patch, { passive : true });
+        });
+    }
+
+    // Index the thread on first display
+    if (auto [it, inserted] = images.try_emplace(thread); inserted) {
+        for (auto p : thread_posts[thread]) {
+            if (p->image) {
+                it->second.emplace_back(p->id, *p->image);
+            }
+        }
+    }
+    instance = this;
+
+    // The grid geometry can only be measured after insertion into the DOM
+    brunhild::on_visible(handle, ::schedule_patch);
+}
+
+GalleryView::~GalleryView()
+{
+    if (instance == this) {
+        instance = nullptr;
+    }
+}
+
+void GalleryView::write_html(Rope& s)
+{
+    s << "<div id=gallery>";
+    write_cells(s, 0, std::min(initial_cells, images[thread].size()));
+    s << "</div>";
+}
+
+void GalleryView::patch()
+{
+    auto el = this->el();
+    if (el.isNull()) {
+        return;
+    }
+    const size_t count = images[thread].size();
+
+    // Grid geometry is defined by the stylesheet. Each column is a separate
+    // track in the computed style.
+    auto style = val::global("getComputedStyle")(el);
+    const auto tracks = style["gridTemplateColumns"].as<std::string>();
+    const double row_height
+        = val::global("parseFloat")(style["gridAutoRows"]).as<double>();
+    if (!(row_height > 0)) {
+        return;
+    }
+    const size_t cols = std::count(tracks.begin(), tracks.end(), ' ') + 1;
+    const size_t rows = (count + cols - 1) / cols;
+
+    const double top
+        = el.call<val>("getBoundingClientRect")["top"].as<double>();
+    const double viewport = val::global("innerHeight").as<double>();
+    const long first_visible = std::floor(-top / row_height);
+    const long last_visible = std::ceil((viewport - top) / row_height);
+    const size_t first = std::clamp<long>(
+        first_visible - long(overscan_rows), 0, rows);
+    const size_t last = std::clamp<long>(
+        last_visible + long(overscan_rows), first, rows);
+    if (cols == columns && first == first_row && last == last_row) {
+        return;
+    }
+    columns = cols;
+    first_row = first;
+    last_row = last;
+
+    Rope s;
+    s << "padding-top:" << long(first * row_height)
+      << "px;padding-bottom:" << long((rows - last) * row_height) << "px";
+    brunhild::set_attr(handle, "style", s.take());
+    write_cells(s, first * cols, std::min(last * cols, count));
+    brunhild::set_inner_html(handle, s.take());
+}
+
+void GalleryView::write_cells(Rope& s, size_t start, size_t end)
+{
+    const auto& list = images[thread];
+    for (size_t i = start; i < end; i++) {
+        auto& img = list[i];
+        s << "<figure data-id=" << img.id << "><a target=_blank href=\""
+          << img.source_path() << "\"><img src=\"" << img.thumb_path() << '"';
+        if (!img.spoiler && img.thumb_type != FileType::no_file) {
+            s << " width=" << img.dims[2] << " height=" << img.dims[3];
+        }
+        s << "></a></figure>";
+    }
+}
+
+EMSCRIPTEN_BINDINGS(module_gallery)
+{
+    emscripten::function("schedule_gallery_patch", &schedule_patch);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../../brunhild/view.hh"
+#include "../posts/models.hh"
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+// Compact fixed-size summary of a post's image. Gallery mode renders only
+// these and never builds post bodies.
+struct GalleryImage {
+    unsigned long id; // ID of the post
+    bool spoiler;
+    FileType file_type, thumb_type;
+    uint16_t dims[4];
+    char sha1[40]; // SHA1 hash of the source file
+
+    GalleryImage(unsigned long id, const Image&);
+
+    std::string_view get_sha1() const { return { sha1, sizeof(sha1) }; }
+
+    // Returns the path to the thumbnail or a placeholder, if the image has no
+    // thumbnail or is spoilered
+    std::string thumb_path() const;
+
+    // Returns the path to the source file
+    std::string source_path() const;
+};
+
+// Update the image index of a post's thread, after its image was inserted or
+// deleted. Threads are only indexed, once displayed in gallery mode.
+void index_gallery_image(const Post&);
+
+// Free the image indexes of all threads
+void clear_gallery();
+
+// Grid of the images of a thread, that replaces its posts in gallery mode.
+// Like CatalogView, only the rows within or near the viewport are rendered and
+// the skipped rows are substituted with padding.
+class GalleryView : public brunhild::View {
+public:
+    const unsigned long thread;
+
+    GalleryView(unsigned long thread);
+    ~GalleryView();
+
+    void write_html(brunhild::Rope&);
+
+    // Render the rows near the viewport, if they changed since the last patch
+    void patch();
+
+    // Force the next patch to rerender all rows
+    void invalidate() { columns = 0; }
+
+private:
+    // Rendered range of rows. Before the first patch, the grid geometry is
+    // not known and a fixed number of images is rendered instead.
+    size_t first_row = 0, last_row = 0, columns = 0;
+
+    // Write images in the range [start, end) to s
+    void write_cells(brunhild::Rope& s, size_t start, size_t end);
+};
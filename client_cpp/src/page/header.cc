@@ -3,6 +3,7 @@
 #include "../lang.hh"
 #include "../local_storage.hh"
 #include "../state.hh"
+#include "chrome.hh"
 #include "page.hh"
 #include <algorithm>
 #include <memory>
@@ -74,11 +75,21 @@ void BoardNavigation::init()
     });
 }
 
+static constexpr chrome::Part navigation_parts[] = {
+    chrome::text("["),
+    chrome::slot(), // Board links
+    chrome::text("] [<a class=\"board-selection bold mono\">"),
+    chrome::slot(), // Board selection toggle
+    chrome::text("</a>]"),
+};
+static_assert(chrome::slot_count(navigation_parts) == 2);
+
+static const chrome::Fragment navigation(navigation_parts);
+
 Node BoardNavigation::render()
 {
-    std::ostringstream s;
+    brunhild::Rope s;
     const bool catalog = point_to_catalog();
-    s << '[';
     bool first = true;
     for (auto& b : selected_boards) {
         if (first) {
@@ -92,9 +103,8 @@ Node BoardNavigation::render()
         }
         s << "\">" << b << "</a>";
     }
-    s << "] [<a class=\"board-selection bold mono\">" << (bsf ? "-" : "+")
-      << "</a>]";
-    return { "nav", { { "id", "board-navigation" } }, s.str() };
+    return { "nav", { { "id", "board-navigation" } },
+        navigation.str({ s.take(), bsf ? "-" : "+" }) };
 }
 
 BoardSelectionForm::BoardSelectionForm()
@@ -151,7 +161,7 @@ Node BoardSelectionForm::render_inputs()
                 {
                     { "type", "text" }, { "class", "full-width" },
                     { "name", "search" },
-                    { "placeholder", lang.ui.at("search") },
+                    { "placeholder", lang.ui[UIKey::search] },
                 },
             },
             { "br" },
@@ -209,7 +219,7 @@ Node BoardSelectionForm::render_controls()
     }
     auto n = Form::render_controls();
     n.children.push_back({
-        "label", {}, { { "input", attrs, lang.ui.at("pointToCatalog") } },
+        "label", {}, { { "input", attrs, lang.ui[UIKey::pointToCatalog] } },
     });
     return n;
 }
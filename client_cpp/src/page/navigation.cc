@@ -1,14 +1,28 @@
 #include "../connection/connection.hh"
 #include "../connection/sync.hh"
 #include "../db.hh"
+#include "../http.hh"
+#include "../page/board.hh"
+#include "../page/catalog.hh"
+#include "../page/gallery.hh"
 #include "../page/page.hh"
 #include "../page/thread.hh"
 #include "../state.hh"
 #include "../util.hh"
+#include "cache.hh"
 #include "scroll.hh"
 #include <emscripten.h>
 #include <emscripten/bind.h>
 #include <string>
+#include <unordered_map>
+
+// Maximum number of concurrent prefetch requests
+static const size_t max_prefetches = 2;
+
+// Running prefetch requests by JSON API URL
+static std::unordered_map<std::string, unsigned> prefetches;
+
+static void init_prefetch();
 
 void init_navigation()
 {
@@ -27,6 +41,7 @@ void init_navigation()
                 if (e.which != 1 || e.ctrlKey || t.tagName != 'A'
                     || t.getAttribute('target') == '_blank'
                     || t.getAttribute('download')
+                    || t.classList.contains('expand-thread')
                     || !t.href.startsWith(location.origin)) {
                     return;
                 }
@@ -51,6 +66,108 @@ void init_navigation()
             },
             { passive : true });
     });
+    init_prefetch();
+}
+
+// Prefetch the data of pages linked to by hovered or touched links into the
+// page cache, so navigating to them is instant
+static void init_prefetch()
+{
+    EM_ASM({
+        // Hover time in milliseconds, before the link is prefetched
+        var delay = 80;
+        var timer = 0;
+
+        var target = function(e)
+        {
+            var t = e.target;
+            if (t.tagName != 'A' || t.getAttribute('target') == '_blank'
+                || t.getAttribute('download') || !t.href
+                || !t.href.startsWith(location.origin)) {
+                return null;
+            }
+            return t.href.slice(location.origin.length);
+        };
+
+        document.addEventListener('mouseover', function(e) {
+            var href = target(e);
+            if (href) {
+                clearTimeout(timer);
+                timer = setTimeout(function() {
+                    Module.prefetch_page(href);
+                }, delay);
+            }
+        }, { passive : true });
+        document.addEventListener('mouseout', function(e) {
+            var href = target(e);
+            if (href) {
+                clearTimeout(timer);
+                Module.cancel_prefetch(href);
+            }
+        }, { passive : true });
+        document.addEventListener('touchstart', function(e) {
+            var href = target(e);
+            if (href) {
+                Module.prefetch_page(href);
+            }
+        }, { passive : true });
+    });
+}
+
+// Returns the JSON API URL of a page's data or an empty string, if the page
+// can not be prefetched
+static std::string json_url(const Page& p)
+{
+    if (p.board.empty() || p.catalog) {
+        return "";
+    }
+    std::string url = "/json/boards/" + p.board + '/';
+    if (p.thread) {
+        url += brunhild::int_to_string(p.thread);
+        if (p.last_100) {
+            url += "?last=100";
+        }
+    } else if (p.page) {
+        url += "?page=" + brunhild::int_to_string(p.page);
+    }
+    return url;
+}
+
+static void prefetch_page(std::string href)
+{
+    // Post IDs can only be loaded with an open database
+    if (conn_SM.state() != ConnState::synced) {
+        return;
+    }
+    const Page p(href);
+    if (p.same_page(page) || is_cached(p)) {
+        return;
+    }
+    const auto url = json_url(p);
+    if (url.empty() || prefetches.count(url)
+        || prefetches.size() >= max_prefetches) {
+        return;
+    }
+    prefetches[url] = http_request(url, [=](unsigned short code, auto data) {
+        prefetches.erase(url);
+        if (code == 200) {
+            cache_page_data(p, data);
+        }
+    });
+}
+
+static void cancel_prefetch(std::string href)
+{
+    auto it = prefetches.find(json_url(Page(href)));
+    if (it != prefetches.end()) {
+        http_abort(it->second);
+        prefetches.erase(it);
+    }
+}
+
+static void push_state(const std::string& href)
+{
+    EM_ASM({ history.pushState(null, null, UTF8ToString($0)); }, href.c_str());
 }
 
 // Determine, if href points to a resource on the.
@@ -64,10 +181,7 @@ static void try_navigate_page(std::string href, bool need_push)
     Page next_state(href);
 
     // Does the link point to the same page as this one?
-    const bool same_page = next_state.catalog == page.catalog
-        && next_state.last_100 == page.last_100 && next_state.page == page.page
-        && next_state.thread == page.thread && next_state.board == page.board;
-    if (same_page) {
+    if (next_state.same_page(page)) {
         if (!posts.count(next_state.post)) {
             return;
         }
@@ -80,24 +194,36 @@ static void try_navigate_page(std::string href, bool need_push)
     }
 
     // TODO: Reset postform
+    cache_page();
     page = next_state;
-    posts.clear();
-    threads.clear();
     ThreadView::clear();
+    clear_board_index();
+    clear_catalog();
+    clear_gallery();
 
     // TODO: New server configuration propagation. Need hash comparison on
     // server.
 
+    const auto full_href = location_origin + href;
+    if (restore_page(page)) {
+        // Post IDs of cached threads are already loaded. Render right away.
+        // Posts received on sync are merged into the rendered page.
+        render_page();
+        if (need_push) {
+            push_state(full_href);
+        }
+        conn_SM.feed(ConnEvent::switch_sync);
+        return;
+    }
+
     // TODO: Display loading animation
 
-    auto wg
-        = new WaitGroup(2, [ full_href = location_origin + href, need_push ]() {
-              render_page();
-              if (need_push) {
-                  EM_ASM({ history.pushState(null, null, UTF8ToString($0)); },
-                      full_href.c_str());
-              }
-          });
+    auto wg = new WaitGroup(2, [full_href, need_push]() {
+        render_page();
+        if (need_push) {
+            push_state(full_href);
+        }
+    });
     load_post_ids(wg);
     conn_SM.feed(ConnEvent::switch_sync);
     conn_SM.once(ConnState::synced, [=]() { wg->done(); });
@@ -106,4 +232,6 @@ static void try_navigate_page(std::string href, bool need_push)
 EMSCRIPTEN_BINDINGS(module_navigation)
 {
     emscripten::function("try_navigate_page", &try_navigate_page);
+    emscripten::function("prefetch_page", &prefetch_page);
+    emscripten::function("cancel_prefetch", &cancel_prefetch);
 }
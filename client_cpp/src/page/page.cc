@@ -81,11 +81,11 @@ void push_board_hover_info(brunhild::Children& ch)
     const char* tag = page.thread ? "span" : "aside";
     if (board_config.notice != "") {
         ch.push_back(render_hover_reveal(
-            tag, board_config.notice, lang.ui.at("showNotice")));
+            tag, board_config.notice, lang.ui[UIKey::showNotice]));
     }
     if (board_config.rules != "") {
-        ch.push_back(
-            render_hover_reveal(tag, board_config.rules, lang.ui.at("rules")));
+        ch.push_back(render_hover_reveal(
+            tag, board_config.rules, lang.ui[UIKey::rules]));
     }
 }
 
@@ -114,10 +114,10 @@ std::vector<brunhild::View*> PageView::get_list()
 {
     auto top = top_controls();
     if (board_config.notice != "") {
-        top.push_back(new HoverTooltip("showNotice", board_config.notice));
+        top.push_back(new HoverTooltip(UIKey::showNotice, board_config.notice));
     }
     if (board_config.rules != "") {
-        top.push_back(new HoverTooltip("rules", board_config.rules));
+        top.push_back(new HoverTooltip(UIKey::rules, board_config.rules));
     }
 
     std::vector<brunhild::View*> vec = {
@@ -157,11 +157,11 @@ Button::Button(std::string text, std::optional<std::string> href)
 {
 }
 
-HoverTooltip::HoverTooltip(std::string label_id, std::string text)
+HoverTooltip::HoverTooltip(UIKey label, std::string text)
     : NodeView({
           "aside", { { "class", "hover-reveal glass" } },
           {
-              { "span", { { "class", "act" } }, lang.ui.at(label_id) },
+              { "span", { { "class", "act" } }, lang.ui[label] },
               { "span", { { "class", "popup-menu glass" } }, text, true },
           },
       })
@@ -69,5 +69,5 @@ public:
 // Static control that reveals text on hover
 class HoverTooltip : public brunhild::NodeView {
 public:
-    HoverTooltip(std::string label_id, std::string text);
+    HoverTooltip(UIKey label, std::string text);
 };
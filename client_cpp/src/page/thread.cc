@@ -1,63 +1,107 @@
 #include "thread.hh"
 #include "../../brunhild/mutations.hh"
 #include "../lang.hh"
+#include "../options/options.hh"
+#include "../posts/search.hh"
+#include "../posts/seen.hh"
 #include "../state.hh"
+#include "../timers.hh"
+#include "chrome.hh"
+#include "gallery.hh"
 #include "page.hh"
 #include <ctime>
-#include <optional>
+#include <memory>
 #include <sstream>
 
-using brunhild::Node;
 using std::string;
 
+// Post container of the current thread page
+static std::unique_ptr<ThreadView> thread_view;
+
+// Static markup of the thread page surrounding the post container
+
+static constexpr chrome::Part top_parts[] = {
+    chrome::text("<span class=\"aside-container top-margin\">"
+                 "<span class=act><a href=\"#bottom\">"),
+    chrome::ui(UIKey::bottom),
+    chrome::text("</a></span><span class=act><a href=\".\">"),
+    chrome::ui(UIKey::return_),
+    chrome::text("</a></span><span class=act><a href=\"catalog\">"),
+    chrome::ui(UIKey::catalog),
+    chrome::text("</a></span><span class=act id=expand-images><a>"),
+    chrome::posts(PostsKey::expandImages),
+    chrome::text("</a></span>"),
+    chrome::slot(), // Board hover information
+    chrome::text("</span><hr>"),
+};
+static_assert(chrome::slot_count(top_parts) == 1);
+
+static constexpr chrome::Part reply_parts[] = {
+    chrome::text("<aside class=\"act posting glass\"><a>"),
+    chrome::ui(UIKey::reply),
+    chrome::text("</a></aside>"),
+};
+
+static constexpr chrome::Part bottom_parts[] = {
+    chrome::text("<hr><span class=aside-container id=bottom>"
+                 "<span class=act><a href=\".\">"),
+    chrome::ui(UIKey::return_),
+    chrome::text("</a></span><span class=act><a href=\"catalog\">"),
+    chrome::ui(UIKey::catalog),
+    chrome::text("</a></span><span class=act><a href=\"#top\">"),
+    chrome::ui(UIKey::top),
+    chrome::text("</a></span><span class=act><a href=\""),
+    chrome::slot(), // Last 100 posts URL
+    chrome::text("\">"),
+    chrome::ui(UIKey::last),
+    chrome::text(" 100</a></span>"
+                 "<span id=lock style=\"visibility: hidden;\">"),
+    chrome::ui(UIKey::lockedToBottom),
+    chrome::text("</span></span>"),
+};
+static_assert(chrome::slot_count(bottom_parts) == 1);
+
+static const chrome::Fragment thread_top(top_parts), reply_button(reply_parts),
+    thread_bottom(bottom_parts);
+
 void render_thread()
 {
     // TODO: Disable live posting toggle in non-live threads
 
     const Thread& thread = threads.at(page.thread);
-    brunhild::Rope s;
-
-    Node n("span", { { "class", "aside-container top-margin" } },
-        {
-            render_button("#bottom", lang.ui.at("bottom")),
-            render_button(".", lang.ui.at("return")),
-            { "span", "TODO: Catalog" },
-            // render_button("catalog", lang.ui.at("catalog")),
-            render_button(std::nullopt, lang.posts.at("expandImages")),
-        });
-    push_board_hover_info(n.children);
-    n.write_html(s);
-
-    s << "<hr>";
-
-    // TODO: Store this somewhere
-    auto tv = new ThreadView(page.thread, "thread-container");
-    tv->write_html(s);
+    brunhild::Rope s, hover;
+
+    brunhild::Children hover_info;
+    push_board_hover_info(hover_info);
+    for (auto& n : hover_info) {
+        n.write_html(hover);
+    }
+    thread_top.write(s, { hover.take() });
+
+    thread_view.reset(new ThreadView(page.thread, "thread-container"));
+    thread_view->write_html(s);
     s << "<div id=\"bottom-spacer\"></div>";
 
     if (!thread.locked) {
-        Node({
-                 "aside",
-                 { { "class", "act posting glass" } },
-                 { { "a", lang.ui.at("reply") } },
-             })
-            .write_html(s);
+        reply_button.write(s);
+    }
+
+    std::ostringstream url;
+    url << '/' << page.board << '/' << page.thread << "?last=100#bottom";
+    thread_bottom.write(s, { url.str() });
+
+    brunhild::set_inner_html("threads", s.take());
+}
+
+// An update of the thread expiry estimate is scheduled
+static bool expiry_scheduled = false;
+
+static void refresh_post_counter(uint64_t)
+{
+    expiry_scheduled = false;
+    if (page.thread) {
+        render_post_counter();
     }
-    s << "<hr>";
-
-    n = Node("span", { { "class", "aside-container" }, { "id", "bottom" } });
-    n.children.push_back(render_button(".", lang.ui.at("return")));
-    n.children.push_back({ "span", "TODO: Catalog" });
-    n.children.push_back(render_button("#top", lang.ui.at("top")));
-    n.children.push_back(render_last_100_link(page.board, page.thread));
-    n.children.push_back({
-        "span",
-        { { "id", "lock" }, { "style", "visibility: hidden;" } },
-        lang.ui.at("lockedToBottom"),
-    });
-    n.write_html(s);
-
-    brunhild::set_inner_html("threads", s.str());
 }
 
 void render_post_counter()
@@ -88,7 +132,13 @@ void render_post_counter()
             if (days > 1) {
                 s << (int)(days) << 'd';
             } else {
-                s << (int)(days / 24) << 'h';
+                s << (int)(days * 24) << 'h';
+            }
+
+            // The estimate has a resolution of one hour
+            if (!expiry_scheduled) {
+                expiry_scheduled = true;
+                schedule(std::time(0) + 3600, &refresh_post_counter);
             }
         }
     }
@@ -102,38 +152,126 @@ ThreadView::ThreadView(unsigned long thread_id, std::string id)
     ThreadView::instances[thread_id] = this;
 }
 
+void ThreadView::clear()
+{
+    thread_view.reset();
+    ThreadView::instances.clear();
+    clear_search_indexes();
+}
+
+ThreadView::~ThreadView()
+{
+    if (auto it = instances.find(thread_id);
+        it != instances.end() && it->second == this) {
+        instances.erase(it);
+    }
+}
+
 std::vector<Post*> ThreadView::get_list()
 {
-    std::vector<Post*> re;
-    re.reserve(1 << 9);
-    for (auto& [_, p] : posts) {
-        if (p.op == thread_id) {
-            re.push_back(&posts.at(p.id));
-        }
+    if (auto it = thread_posts.find(thread_id); it != thread_posts.end()) {
+        return it->second;
     }
-    return re;
+    return {};
+}
+
+void ThreadView::init()
+{
+    // Posts inserted after the initial render are always rendered right away
+    const auto list = get_list();
+    if (list.size() > eager_posts) {
+        defer_before = list[list.size() - eager_posts]->id;
+    }
+    ListView::init();
+    defer_before = 0;
 }
 
 std::shared_ptr<PostView> ThreadView::create_child(Post* p)
 {
-    return p->views.emplace_back(new PostView(p->id));
+    auto& v = p->views.emplace_back(new PostView(p->id));
+    if (p->id < defer_before && p->id != p->op && p->id != page.post) {
+        v->defer();
+    }
+    track_seen(*v);
+    return v;
+}
+
+// Static buttons of the thread page controls. The first slot receives the ID
+// attribute of the view.
+
+static constexpr chrome::Part bottom_button_parts[] = {
+    chrome::text("<span"),
+    chrome::slot(),
+    chrome::text(" class=act><a href=\"#bottom\">"),
+    chrome::ui(UIKey::bottom),
+    chrome::text("</a></span>"),
+};
+
+static constexpr chrome::Part top_button_parts[] = {
+    chrome::text("<span"),
+    chrome::slot(),
+    chrome::text(" class=act><a href=\"#top\">"),
+    chrome::ui(UIKey::top),
+    chrome::text("</a></span>"),
+};
+
+static constexpr chrome::Part return_button_parts[] = {
+    chrome::text("<span"),
+    chrome::slot(),
+    chrome::text(" class=act><a href=\".\">"),
+    chrome::ui(UIKey::return_),
+    chrome::text("</a></span>"),
+};
+
+static constexpr chrome::Part catalog_button_parts[] = {
+    chrome::text("<span"),
+    chrome::slot(),
+    chrome::text(" class=act><a href=catalog>"),
+    chrome::ui(UIKey::catalog),
+    chrome::text("</a></span>"),
+};
+
+static constexpr chrome::Part lock_parts[] = {
+    chrome::text("<span"),
+    chrome::slot(),
+    chrome::text(" style=\"visibility: hidden;\">"),
+    chrome::ui(UIKey::lockedToBottom),
+    chrome::text("</span>"),
+};
+
+static constexpr chrome::Part search_parts[] = {
+    chrome::text("<span"),
+    chrome::slot(),
+    chrome::text("><input type=search placeholder=\""),
+    chrome::ui(UIKey::search),
+    chrome::text("\"></span>"),
+};
+
+static const chrome::Fragment bottom_button(bottom_button_parts),
+    top_button(top_button_parts), return_button(return_button_parts),
+    catalog_button(catalog_button_parts), lock_indicator(lock_parts),
+    search_input(search_parts);
+
+brunhild::View* ThreadPageView::thread_container()
+{
+    if (options.gallery_mode_toggle) {
+        return new GalleryView(page.thread);
+    }
+    return new ThreadView(page.thread);
 }
 
 std::vector<brunhild::View*> ThreadPageView::top_controls()
 {
-    return { new Button(lang.ui.at("bottom"), "#bottom"),
-        new Button(lang.ui.at("return"), "."),
-        new Button(lang.ui.at("catalog"), "catalog") };
+    return { new chrome::StaticView(bottom_button),
+        new chrome::StaticView(return_button),
+        new chrome::StaticView(catalog_button),
+        new chrome::StaticView(search_input, {}, "thread-search") };
 }
 
 std::vector<brunhild::View*> ThreadPageView::bottom_controls()
 {
-    return { new Button(lang.ui.at("top"), "#top"),
-        new Button(lang.ui.at("return"), "."),
-        new Button(lang.ui.at("catalog"), "catalog"),
-        new brunhild::NodeView({
-            "span",
-            { { "id", "lock" }, { "style", "visibility: hidden;" } },
-            lang.ui.at("lockedToBottom"),
-        }) };
+    return { new chrome::StaticView(top_button),
+        new chrome::StaticView(return_button),
+        new chrome::StaticView(catalog_button),
+        new chrome::StaticView(lock_indicator, {}, "lock") };
 }
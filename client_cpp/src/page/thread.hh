@@ -16,13 +16,24 @@ class ThreadView : public brunhild::ListView<Post, PostView> {
 public:
     const unsigned long thread_id;
 
-    ThreadView(unsigned long thread_id, std::string id = brunhild::new_id());
+    ThreadView(unsigned long thread_id, std::string id = "");
+    ~ThreadView();
 
     // All existing instaces
     static inline std::map<unsigned long, ThreadView*> instances;
-    static void clear() { ThreadView::instances.clear(); }
+
+    // Free the view of the current thread page and forget all instances
+    static void clear();
 
 protected:
+    // Number of posts at the end of the thread, that are rendered right away.
+    // All other posts are deferred until they near the viewport.
+    static const size_t eager_posts = 20;
+
+    // Posts with lower IDs are deferred on creation
+    unsigned long defer_before = 0;
+
+    void init();
     virtual std::vector<Post*> get_list();
     std::shared_ptr<PostView> create_child(Post* p);
 };
@@ -30,7 +41,7 @@ protected:
 // Contains the post-related portion of the thread page
 class ThreadPageView : public PageView {
 protected:
-    brunhild::View* thread_container() { return new ThreadView(page.thread); }
+    brunhild::View* thread_container();
     std::vector<brunhild::View*> top_controls();
     std::vector<brunhild::View*> bottom_controls();
 };
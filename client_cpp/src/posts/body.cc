@@ -1,9 +1,11 @@
 #include "../lang.hh"
+#include "../options/options.hh"
 #include "../state.hh"
 #include "../util.hh"
 #include "etc.hh"
 #include "url.hh"
 #include "view.hh"
+#include <array>
 #include <cctype>
 #include <optional>
 #include <string>
@@ -45,59 +47,142 @@ void parse_string(string_view frag, D sep, function<void(string_view)> on_frag,
     }
 }
 
+// Returns the key of the post data and global state, that the tokens of a
+// closed body depend on
+static uint64_t body_tokens_key(const Post& p)
+{
+    uint64_t h = 1;
+    for (uint64_t v : { uint64_t(p.versions.body), uint64_t(boards.size()),
+             uint64_t(config.links.size()),
+             uint64_t(options.strict_url_validation) }) {
+        h = h * 1000003 ^ v;
+    }
+    return h;
+}
+
 Node PostView::render_body()
 {
     Node n("blockquote");
     if (!m->body.size()) {
+        body_lines.clear();
         return n;
     }
     state.reset(&n);
 
-    bool first = true;
-    parse_string(string_view(m->body), '\n', [this, &first](string_view line) {
-        state.quote = false;
+    // Closed bodies are tokenized by the first render. Following renders
+    // replay the tokens and only parse hash commands.
+    recording_tokens = false;
+    if (!m->editing) {
+        recording_tokens = m->body_tokens_key != body_tokens_key(*m);
+        token_cursor = 0;
+    }
 
-        // Prevent successive empty lines
-        if (!first) {
-            if (state.successive_newlines < 2) {
-                state.append({ "br" });
-            }
-        } else {
-            first = false;
-        }
-        if (!line.size()) {
-            state.successive_newlines++;
+    // Only open posts are cached, as they are the ones patched on every
+    // keystroke. Closed posts also depend on links and inlined posts.
+    const bool cache = m->editing;
+    if (!cache || body_lines_rb_text != board_config.rb_text
+        || body_lines_mine != post_ids.mine.size()) {
+        body_lines.clear();
+        body_lines_rb_text = board_config.rb_text;
+        body_lines_mine = post_ids.mine.size();
+    }
+
+    // Lines ending before the first byte changed since the last render need no
+    // comparison
+    const string_view body = m->body;
+    const size_t changed = body_lines.size()
+        ? m->body.changed_since(body_lines_revision)
+        : 0;
+    body_lines_revision = m->body.revision();
+
+    size_t i = 0;
+    auto on_line = [this, &n, &i, cache, body, changed](string_view line) {
+        const bool first = !i;
+        if (!cache) {
+            render_body_line(line, first);
+            i++;
             return;
         }
 
-        state.successive_newlines = 0;
-        if (line[0] == '>') {
-            state.quote = true;
-            state.append({ "em" }, true);
-        }
-        auto states = state.as_array();
-        for (int i = 0; i < (int)states.size(); i++) {
-            if (states[i]) {
-                state.append(opening_tags[i], true);
+        const auto start = state.line_state();
+        if (i < body_lines.size()) {
+            auto& cached = body_lines[i];
+            const size_t end = line.data() + line.size() - body.data();
+            if (cached.start == start
+                && (end < changed || cached.text == line)) {
+                n.children.insert(
+                    n.children.end(), cached.nodes.begin(), cached.nodes.end());
+                state.restore(cached.end);
+                i++;
+                return;
             }
+            // Any following lines depend on this one
+            body_lines.resize(i);
         }
 
-        parse_code(line, [this](string_view frag) {
-            m->editing ? parse_temp_links(frag) : parse_fragment(frag);
-        });
+        const size_t from = n.children.size();
+        render_body_line(line, first);
+        auto& cached = body_lines.emplace_back(BodyLine{ string(line), start,
+            state.line_state(),
+            brunhild::Children(brunhild::Allocator<Node>(nullptr)) });
+        cached.nodes.reserve(n.children.size() - from);
+        for (size_t j = from; j < n.children.size(); j++) {
+            cached.nodes.push_back(n.children[j]);
+            cached.nodes.back().adopt();
+        }
+        i++;
+    };
+    parse_string(body, '\n', on_line);
+    if (body_lines.size() > i) {
+        body_lines.resize(i);
+    }
+    if (recording_tokens) {
+        recording_tokens = false;
+        recorded_tokens.shrink_to_fit();
+        m->body_tokens = std::move(recorded_tokens);
+        m->body_tokens_key = body_tokens_key(*m);
+        recorded_tokens = {};
+    }
+    return n;
+}
 
-        // Close any unclosed tags
-        states = state.as_array(); // State might have changed during parsing
-        for (auto s : states) {
-            if (s) {
-                state.ascend();
-            }
+void PostView::render_body_line(string_view line, bool first)
+{
+    state.quote = false;
+
+    // Prevent successive empty lines
+    if (!first && state.successive_newlines < 2) {
+        state.append({ "br" });
+    }
+    if (!line.size()) {
+        state.successive_newlines++;
+        return;
+    }
+
+    state.successive_newlines = 0;
+    if (line[0] == '>') {
+        state.quote = true;
+        state.append({ "em" }, true);
+    }
+    auto states = state.as_array();
+    for (int i = 0; i < (int)states.size(); i++) {
+        if (states[i]) {
+            state.append(opening_tags[i], true);
         }
-        if (state.quote) {
+    }
+
+    parse_formatting(line);
+
+    // Close any unclosed tags
+    states = state.as_array(); // State might have changed during parsing
+    for (auto s : states) {
+        if (s) {
             state.ascend();
         }
-    });
-    return n;
+    }
+    if (state.quote) {
+        state.ascend();
+    }
 }
 
 void PostView::wrap_tags(int level)
@@ -119,88 +204,95 @@ void PostView::wrap_tags(int level)
     }
 }
 
-void PostView::parse_code(string_view frag, PostView::OnFrag fn)
+// Returns a table of bytes, that can start a formatting delimiter
+static constexpr std::array<bool, 256> delimiter_leads()
 {
-    parse_string(frag, "``",
-        [this, fn](string_view frag) {
-            if (state.code) {
-                // Strip quotes
-                size_t num_quotes = 0;
-                while (frag.size() && frag[0] == '>') {
-                    frag = frag.substr(1);
-                }
-                if (num_quotes) {
-                    string s;
-                    s.reserve(4 * num_quotes);
-                    for (size_t i = 0; i <= num_quotes; i++) {
-                        s += "&gt;";
-                    }
-                    state.append({ "span", s });
-                }
-
-                highlight_syntax(frag);
-            } else {
-                parse_spoilers(frag, fn);
-            }
-        },
-        [this]() { state.code = !state.code; });
+    std::array<bool, 256> t{};
+    for (unsigned char ch : { '`', '*', '@', '~', '^' }) {
+        t[ch] = true;
+    }
+    return t;
 }
 
-void PostView::parse_spoilers(string_view frag, PostView::OnFrag fn)
-{
-    parse_string(frag, "**",
-        [this, fn](string_view frag) { parse_bolds(frag, fn); },
-        [this]() {
-            wrap_tags(0);
-            state.spoiler = !state.spoiler;
-        });
-}
+static constexpr auto is_delimiter_lead = delimiter_leads();
 
-void PostView::parse_bolds(string_view frag, PostView::OnFrag fn)
+// Returns the formatting level of the two byte delimiter starting at s or -1,
+// if none. Code tags are level tag_depth.
+static inline int delimiter_level(const char* s)
 {
-    parse_string(frag, "@@",
-        [this, fn](string_view frag) { parse_italics(frag, fn); },
-        [this]() {
-            wrap_tags(1);
-            state.bold = !state.bold;
-        });
+    switch (s[0]) {
+    case '`':
+        return s[1] == '`' ? TextState::tag_depth : -1;
+    case '*':
+        return s[1] == '*' ? 0 : -1;
+    case '@':
+        return s[1] == '@' ? 1 : -1;
+    case '~':
+        return s[1] == '~' ? 2 : -1;
+    case '^':
+        switch (s[1]) {
+        case 'r':
+            return 3;
+        case 'b':
+            return 4;
+        }
+    }
+    return -1;
 }
 
-void PostView::parse_italics(string_view frag, PostView::OnFrag fn)
+void PostView::parse_formatting(string_view line)
 {
-    parse_string(frag, "~~",
-        [this, fn](string_view frag) { parse_reds(frag, fn); },
-        [this]() {
-            wrap_tags(2);
-            state.italic = !state.italic;
-        });
-}
+    size_t start = 0, // Start of the current fragment
+        i = 0;
+    // All delimiters are 2 bytes long
+    while (i + 1 < line.size()) {
+        if (!is_delimiter_lead[static_cast<unsigned char>(line[i])]) {
+            i++;
+            continue;
+        }
+        const int level = delimiter_level(line.data() + i);
+        // Only code tags are recognized inside code blocks
+        if (level == -1 || (state.code && level != TextState::tag_depth)) {
+            i++;
+            continue;
+        }
 
-void PostView::parse_reds(string_view frag, PostView::OnFrag fn)
-{
-    if (board_config.rb_text) {
-        parse_string(frag, "^r",
-            [this, fn](string_view frag) { parse_blues(frag, fn); },
-            [this]() {
-                wrap_tags(3);
-                state.red = !state.red;
-            });
-    } else {
-        parse_string(frag, "^r",
-            [this, fn](string_view frag) { parse_blues(frag, fn); });
+        parse_formatted_fragment(line.substr(start, i - start));
+        if (level == TextState::tag_depth) {
+            state.code = !state.code;
+        } else if (level < 3 || board_config.rb_text) {
+            // Red and blue text tags are stripped, if disabled on the board
+            wrap_tags(level);
+            state.toggle(level);
+        }
+        i += 2;
+        start = i;
     }
+    parse_formatted_fragment(line.substr(start));
 }
 
-void PostView::parse_blues(string_view frag, PostView::OnFrag fn)
+void PostView::parse_formatted_fragment(string_view frag)
 {
-    if (board_config.rb_text) {
-        parse_string(frag, "^b", fn, [this]() {
-            wrap_tags(4);
-            state.blue = !state.blue;
-        });
-    } else {
-        parse_string(frag, "^b", fn);
+    if (!state.code) {
+        m->editing ? parse_temp_links(frag) : parse_fragment(frag);
+        return;
+    }
+
+    // Strip quotes
+    size_t num_quotes = 0;
+    while (frag.size() && frag[0] == '>') {
+        frag = frag.substr(1);
+    }
+    if (num_quotes) {
+        string s;
+        s.reserve(4 * num_quotes);
+        for (size_t i = 0; i <= num_quotes; i++) {
+            s += "&gt;";
+        }
+        state.append({ "span", s });
     }
+
+    highlight_syntax(frag);
 }
 
 // Return, if b is a punctuation char
@@ -243,20 +335,16 @@ static inline tuple<char, string_view, char> split_punctuation(string_view word)
     return { lead, word, trail };
 }
 
-void PostView::parse_words(string_view frag, PostView::OnFrag fn)
+template <class F> void PostView::parse_words(string_view frag, F fn)
 {
-    bool first = true;
     state.buf.reserve(frag.size());
 
-    parse_string(frag, " ", [this, &first, fn](string_view frag) {
-        if (!first) {
-            state.buf += ' ';
-        } else {
-            first = false;
-        }
+    while (1) {
+        const size_t i = frag.find(' ');
 
         // Split leading and trailing punctuation, if any
-        auto[lead_punct, word, trail_punct] = split_punctuation(frag);
+        auto[lead_punct, word, trail_punct]
+            = split_punctuation(frag.substr(0, i));
         if (lead_punct) {
             state.buf += lead_punct;
         }
@@ -264,7 +352,13 @@ void PostView::parse_words(string_view frag, PostView::OnFrag fn)
         if (trail_punct) {
             state.buf += trail_punct;
         }
-    });
+
+        if (i == string::npos) {
+            break;
+        }
+        state.buf += ' ';
+        frag = frag.substr(i + 1);
+    }
 
     // Append any leftover text
     state.flush_text();
@@ -313,11 +407,11 @@ static optional<tuple<int, unsigned long>> parse_post_link(string_view word)
 // Render a temporary link for open posts
 static Node render_temp_link(unsigned long id)
 {
-    const string id_str = std::to_string(id);
+    const string id_str = brunhild::int_to_string(id);
     string text = ">>" + id_str;
     if (post_ids.mine.count(id)) {
         text += ' ';
-        text += lang.posts.at("you");
+        text += lang.posts[PostsKey::you];
     }
     return {
         "a",
@@ -348,61 +442,9 @@ void PostView::parse_temp_links(string_view frag)
     });
 }
 
-// Parse a line fragment of a closed post
-void PostView::parse_fragment(string_view frag)
-{
-    parse_words(frag, [this](string_view word) {
-        if (!word.size()) {
-            return;
-        }
-
-        bool matched = false;
-        switch (word[0]) {
-        case '>':
-            // Post links
-            if (auto l = parse_post_link(word)) {
-                auto[count, id] = *l;
-
-                // In case the server parsed this differently.
-                // Maybe older version.
-                if (m->links.count(id)) {
-                    state.append(render_link(id, m->links[id]), false, count);
-                    matched = true;
-                    break;
-                }
-            }
-
-            // Internal and custom reference URLs
-            if (auto l = parse_reference(word)) {
-                auto[count, n] = *l;
-                state.append(n, false, count);
-                matched = true;
-            }
-            break;
-        case '#':
-            if (state.quote) {
-                break;
-            }
-            // Hash commands
-            if (auto n = parse_commands(word)) {
-                state.append(*n);
-                matched = true;
-            }
-            break;
-        default:
-            // Generic HTTP(S)/FTP(S) URLs, magnet links and embeds
-            if (auto n = parse_url(word)) {
-                state.append(*n);
-                matched = true;
-            }
-        }
-        if (!matched) {
-            state.buf += word;
-        }
-    });
-}
-
-optional<tuple<int, Node>> PostView::parse_reference(string_view word)
+// Parse internally-defined or board reference URL.
+// Returns preceding '>' count and target URL, if matched.
+static optional<tuple<int, Atom>> parse_reference(string_view word)
 {
     int gts = strip_gt(word);
     if (gts < 3) {
@@ -423,22 +465,121 @@ optional<tuple<int, Node>> PostView::parse_reference(string_view word)
         }
     }
 
-    string href;
     const string s(word);
     if (boards.count(s)) { // Linking a board
-        href.reserve(s.size() + 2);
-        href = '/' + s + '/';
-    } else if (config.links.count(s)) { // Custom external URL
-        href = config.links.at(s);
-    } else {
+        return { { gts, Atom('/' + s + '/') } };
+    }
+    if (auto it = config.links.find(s); it != config.links.end()) {
+        return { { gts, Atom(it->second) } }; // Custom external URL
+    }
+    return nullopt;
+}
+
+optional<BodyToken> PostView::resolve_word(string_view word)
+{
+    BodyToken t{};
+    t.offset = word.data() - string_view(m->body).data();
+    switch (word[0]) {
+    case '>':
+        // Post links
+        if (auto l = parse_post_link(word)) {
+            auto [count, id] = *l;
+
+            // In case the server parsed this differently.
+            // Maybe older version.
+            if (m->links.count(id)) {
+                t.type = BodyToken::Type::post_link;
+                t.gts = count;
+                t.id = id;
+                return t;
+            }
+        }
+
+        // Internal and custom reference URLs
+        if (auto l = parse_reference(word)) {
+            t.type = BodyToken::Type::reference;
+            std::tie(t.gts, t.href) = *l;
+            return t;
+        }
+        return nullopt;
+    case '#':
         return nullopt;
+    default: {
+        // Generic HTTP(S)/FTP(S) URLs, magnet links and embeds
+        const auto info = classify_url(word);
+        if (!info.valid) {
+            return nullopt;
+        }
+        if (info.embed) {
+            t.type = BodyToken::Type::embed;
+            t.id = static_cast<unsigned long>(*info.embed);
+        } else {
+            t.type = BodyToken::Type::url;
+        }
+        return t;
     }
+    }
+}
+
+void PostView::render_token(const BodyToken& t, string_view word)
+{
+    switch (t.type) {
+    case BodyToken::Type::post_link:
+        state.append(render_link(t.id, m->links[t.id]), false, t.gts);
+        break;
+    case BodyToken::Type::reference:
+        // Text is the word without any extra '>'
+        state.append(::render_link(string_view(t.href.str()),
+                         word.substr(t.gts)),
+            false, t.gts);
+        break;
+    case BodyToken::Type::url:
+        state.append(render_url(word));
+        break;
+    case BodyToken::Type::embed:
+        state.append(render_url(word, static_cast<Provider>(t.id)));
+        break;
+    }
+}
+
+// Parse a line fragment of a closed post
+void PostView::parse_fragment(string_view frag)
+{
+    parse_words(frag, [this](string_view word) {
+        if (!word.size()) {
+            return;
+        }
 
-    string text;
-    text.reserve(word.size() + 5);
-    text = ">>>/" + s + "/";
+        if (recording_tokens) {
+            if (auto t = resolve_word(word)) {
+                render_token(*t, word);
+                recorded_tokens.push_back(*t);
+                return;
+            }
+        } else {
+            // Tokens are ordered by offset and so are the words of a render
+            const auto& tokens = m->body_tokens;
+            const uint32_t offset = word.data() - string_view(m->body).data();
+            while (token_cursor < tokens.size()
+                && tokens[token_cursor].offset < offset) {
+                token_cursor++;
+            }
+            if (token_cursor < tokens.size()
+                && tokens[token_cursor].offset == offset) {
+                render_token(tokens[token_cursor++], word);
+                return;
+            }
+        }
 
-    return { { gts, ::render_link(string_view(href), text) } };
+        // Hash commands
+        if (word[0] == '#' && !state.quote) {
+            if (auto n = parse_commands(word)) {
+                state.append(*n);
+                return;
+            }
+        }
+        state.buf += word;
+    });
 }
 
 Node PostView::render_link(unsigned long id, const LinkData& data)
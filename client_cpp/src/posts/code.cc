@@ -1,59 +1,93 @@
+#include "../highlight/highlight.hh"
+#include "../state.hh"
 #include "view.hh"
-#include <algorithm>
-#include <cctype>
-#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef LAZY_MODULES
+#include <emscripten.h>
+#include <emscripten/bind.h>
 #include <unordered_set>
+#endif
 
 using std::string;
+using std::string_view;
+
+#ifdef LAZY_MODULES
 
-enum token_type { unmatched, identifier, quoted, double_quoted, comment };
+// The highlighter side module is loaded on first use. Code tags are rendered
+// without highlighting till then.
+static enum { not_loaded, loading, loaded } highlighter = not_loaded;
 
-// Return, if char could be a part of an identifier in most languages
-static bool is_identifier_char(const char b)
+// Posts rendered without highlighting, that must be rendered again, once the
+// side module is loaded
+static std::unordered_set<unsigned long> unhighlighted;
+
+static void on_highlighter_loaded()
 {
-    return isalnum(b) || b == '_' || b == '$';
+    highlighter = loaded;
+    for (auto id : unhighlighted) {
+        if (auto p = posts.find(id); p) {
+            p->touch(Post::body_section);
+            p->patch();
+        }
+    }
+    unhighlighted.clear();
 }
 
-// Return, if word is one of the supported keywords
-static bool is_keyword(const std::string& word)
+static void load_highlighter()
 {
-    // Sorted for fast binary searching
-    const static string keywords[] = { "NULL", "NaN", "abstract", "alias",
-        "and", "arguments", "array", "asm", "assert", "async", "auto", "await",
-        "base", "begin", "bool", "boolean", "break", "byte", "case", "catch",
-        "char", "checked", "class", "clone", "compl", "const", "constexpr",
-        "continue", "debugger", "decimal", "declare", "default", "defer",
-        "deinit", "delegate", "delete", "do", "double", "echo", "elif", "else",
-        "elseif", "elsif", "end", "ensure", "enum", "event", "except", "exec",
-        "explicit", "export", "extends", "extension", "extern", "fallthrough",
-        "false", "final", "finally", "fixed", "float", "fn", "for", "foreach",
-        "friend", "from", "func", "function", "global", "go", "goto", "guard",
-        "if", "impl", "implements", "implicit", "import", "in", "include",
-        "inline", "inout", "instanceof", "int", "interface", "internal", "is",
-        "lambda", "let", "lock", "long", "module", "mut", "mutable",
-        "namespace", "native", "new", "next", "nil", "not", "null", "object",
-        "operator", "or", "out", "override", "package", "params", "private",
-        "protected", "protocol", "pub", "public", "raise", "readonly", "redo",
-        "ref", "register", "repeat", "require", "rescue", "restrict", "retry",
-        "return", "sbyte", "sealed", "short", "signed", "sizeof", "static",
-        "str", "string", "struct", "subscript", "super", "switch",
-        "synchronized", "template", "then", "throws", "transient", "true",
-        "try", "type", "typealias", "typedef", "typeid", "typename", "typeof",
-        "uint", "unchecked", "undef", "undefined", "union", "unless",
-        "unsigned", "until", "use", "using", "var", "virtual", "void",
-        "volatile", "when", "where", "while", "with", "xor", "yield" };
-
-    return std::binary_search(std::begin(keywords), std::end(keywords), word);
+    highlighter = loading;
+    EM_ASM({
+        fetch('/assets/wasm/highlight.wasm')
+            .then(function(res) {
+                if (!res.ok) {
+                    throw new Error('highlight.wasm: ' + res.status);
+                }
+                return res.arrayBuffer();
+            })
+            .then(function(buf) {
+                return loadWebAssemblyModule(
+                    new Uint8Array(buf), { loadAsync : true });
+            })
+            .then(function(exports) {
+                Module._highlight_code = exports._highlight_code;
+                Module.on_highlighter_loaded();
+            })
+            .catch(function(err) { console.error(err); });
+    });
 }
 
-// Return, if char is one of the supported operators
-static bool is_operator(const char b)
+// Split frag into tokens, if the side module is loaded
+static size_t tokenize(string_view frag, CodeToken* tokens, unsigned long id)
+{
+    if (highlighter == loaded) {
+        return EM_ASM_INT(
+            { return Module._highlight_code($0, $1, $2); }, frag.data(),
+            frag.size(), tokens);
+    }
+    if (highlighter == not_loaded) {
+        load_highlighter();
+    }
+    unhighlighted.insert(id);
+    return 0;
+}
+
+EMSCRIPTEN_BINDINGS(module_code)
+{
+    emscripten::function("on_highlighter_loaded", &on_highlighter_loaded);
+}
+
+#else
+
+static size_t tokenize(string_view frag, CodeToken* tokens, unsigned long)
 {
-    const static char operators[] = { '!', '%', '&', '*', '+', '-', '/', ':',
-        '<', '=', '>', '?', '@', '^', '|', '~' };
-    return std::binary_search(std::begin(operators), std::end(operators), b);
+    return highlight_code(frag.data(), frag.size(), tokens);
 }
 
+#endif
+
 void PostView::highlight_syntax(std::string_view frag)
 {
     if (!frag.size()) {
@@ -62,104 +96,44 @@ void PostView::highlight_syntax(std::string_view frag)
     state.append({ "code", { { "class", "code-tag" } } }, true);
     state.buf.reserve(64);
 
-    auto wrap_operator = [this](char op) {
-        state.append(
-            { "span", { { "class", "ms-operator" } }, string(1, op), true });
-    };
-
-    string token;
-    token.reserve(64);
-    token_type type = unmatched;
-    char prev = 0;
-    char b = 0;
-    char next = 0;
-    for (size_t i = 0; i < frag.size(); i++) {
-        b = frag[i];
-        next = i != frag.size() - 1 ? frag[i + 1] : 0;
-
-        switch (type) {
-        case unmatched:
-            switch (b) {
-            case '/':
-                if (next == '/') {
-                    type = comment;
-                    state.append(
-                        { "span", { { "class", "ms-comment" } } }, true);
-                    state.buf += "//";
-                    i++;
-                } else {
-                    wrap_operator('/');
-                }
-                break;
-            case '\'':
-                type = quoted;
-                state.append({ "span", { { "class", "ms-string" } } }, true);
-                state.buf += b;
-                break;
-            case '"':
-                type = double_quoted;
-                state.append({ "span", { { "class", "ms-string" } } }, true);
-                state.buf += b;
-                break;
-            default:
-                if (is_operator(b)) {
-                    wrap_operator(b);
-                } else if (is_identifier_char(b)) {
-                    type = identifier;
-                    token += b;
-                } else {
-                    state.buf += b;
-                }
-            }
-            break;
-        case identifier:
-            token += b;
-            if (!is_identifier_char(next)) {
-                if (next == '(') {
-                    state.append({ "span", { { "class", "ms-function" } },
-                        token, true });
-                } else if (is_keyword(token)) {
-                    state.append({ "span", { { "class", "ms-operator" } },
-                        token, true });
-                } else {
-                    state.buf += token;
-                }
-                type = unmatched;
-                token.clear();
-            }
+    static std::vector<CodeToken> tokens;
+    if (tokens.size() < frag.size()) {
+        tokens.resize(frag.size());
+    }
+    const size_t n = tokenize(frag, tokens.data(), m->id);
+    if (!n) {
+        state.buf += frag;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i < n; i++) {
+        const auto [kind, end] = tokens[i];
+        const auto text = frag.substr(start, end - start);
+        start = end;
+
+        switch (kind) {
+        case code_plain:
+            state.buf += text;
             break;
-        case quoted:
-            state.buf += b;
-            if (b == '\'' && prev != '\\') {
-                type = unmatched;
-                state.ascend();
-            }
+        case code_operator:
+            state.append({ "span", { { "class", "ms-operator" } },
+                string(text), true });
             break;
-        case double_quoted:
-            state.buf += b;
-            if (b == '"' && prev != '\\') {
-                type = unmatched;
-                state.ascend();
-            }
+        case code_function:
+            state.append({ "span", { { "class", "ms-function" } },
+                string(text), true });
             break;
-        case comment:
-            state.buf += b;
-            // We only have line-terminated commnets and those are terminated
-            // upstream the call stack
+        case code_string:
+        case code_comment:
+            state.append({ "span",
+                             { { "class",
+                                 kind == code_string ? "ms-string"
+                                                     : "ms-comment" } } },
+                true);
+            state.buf += text;
+            state.ascend();
             break;
         }
-
-        prev = b;
-    }
-
-    // Flush any remaining buffer
-    if (type == identifier) {
-        state.buf += token;
-    }
-
-    // Close open tags
-    if (type != unmatched) {
-        state.ascend();
     }
     state.ascend();
 }
@@ -1,15 +1,17 @@
 // Hash command parsing and rendering
 
 #include "commands.hh"
+#include "../../brunhild/mutations.hh"
 #include "../lang.hh"
 #include "../state.hh"
+#include "../timers.hh"
 #include "view.hh"
+#include <array>
 #include <cctype>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
 #include <unordered_map>
-#include <utility>
 
 using std::nullopt;
 using std::optional;
@@ -18,30 +20,70 @@ using std::string;
 using std::string_view;
 using std::unordered_map;
 
-// IDs of posts, that are pending a rerender to update the syncwatch and the
-// time they should be rerender at. Specifying a timestamp helps avoid useless
-// subtree diffs.
-static unordered_map<unsigned long, time_t> pending_rerender;
+// Rendered syncwatch counter, that is patched every second until finished
+struct Syncwatch {
+    brunhild::Handle handle;
+    std::array<unsigned long, 5> params; // Hours, minutes, seconds, start, end
+    bool scheduled; // An update is scheduled
+};
+
+// Syncwatches by post ID in the upper and command index in the lower 32 bits.
+// The handle of a syncwatch is retained across rerenders of its post.
+static unordered_map<uint64_t, Syncwatch> syncwatches;
+
+// Format the text of a syncwatch at server time now. Returns, if the
+// syncwatch has finished.
+static bool format_syncwatch(
+    ostringstream& s, const std::array<unsigned long, 5>& params)
+{
+    using std::setw;
+
+    const auto [hours, min, sec, start, end] = params;
+    const unsigned long now = std::time(0) + server_time_offset;
+    if (now > end) {
+        s << lang.ui[UIKey::finished];
+        return true;
+    }
+    if (now < start) {
+        s << start - now;
+    } else {
+        unsigned long diff = now - start;
+        const auto hours_elapsed = diff / 3600;
+        diff %= 3600;
+        const auto min_elapsed = diff / 60;
+        diff %= 60;
+
+        s << std::setfill('0') << setw(2) << hours_elapsed << ':' << setw(2)
+          << min_elapsed << ':' << setw(2) << diff << " / " << setw(2) << hours
+          << ':' << setw(2) << min << ':' << setw(2) << sec;
+    }
+    return false;
+}
 
-void rerender_syncwatches()
+// Patch only the counter text of a syncwatch
+static void update_syncwatch(uint64_t key)
 {
-    if (!pending_rerender.size()) {
+    auto it = syncwatches.find(key);
+    if (it == syncwatches.end()) {
         return;
     }
+    auto& sw = it->second;
+    sw.scheduled = false;
 
-    // Prevent modifications from patching affecting the iterated map
-    unordered_map<unsigned long, time_t> m(pending_rerender);
-    const auto now = std::time(0);
-
-    for (auto[id, when] : m) {
-        if (now >= when) {
-            pending_rerender.erase(id);
+    // Posts might have been removed by now
+    if (!posts.find(key >> 32)) {
+        syncwatches.erase(it);
+        return;
+    }
 
-            // Posts might have been removed by now
-            if (posts.count(id)) {
-                posts.at(id).patch();
-            }
-        }
+    ostringstream s;
+    const bool finished = format_syncwatch(s, sw.params);
+    brunhild::set_inner_html(sw.handle, s.str());
+    if (finished) {
+        syncwatches.erase(it);
+    } else {
+        sw.scheduled = true;
+        schedule(std::time(0) + 1, &update_syncwatch, key);
     }
 }
 
@@ -49,21 +91,19 @@ void rerender_syncwatches()
 // Rejects numbers longer than 5 digits.
 static optional<unsigned> parse_uint(string_view& word)
 {
-    string num;
-    num.reserve(5);
-
-    while (word.size()) {
-        if (isdigit(word[0])) {
-            num += word[0];
-            word = word.substr(1);
-        } else {
-            break;
+    unsigned num = 0;
+    size_t i = 0;
+    for (; i < word.size() && isdigit(word[i]); i++) {
+        if (i == 5) {
+            return nullopt;
         }
+        num = num * 10 + (word[i] - '0');
     }
-    if (num.size() > 5 || !num.size()) {
+    if (!i) {
         return nullopt;
     }
-    return { std::stoul(num) };
+    word = word.substr(i);
+    return { num };
 }
 
 // If num is made of the same digit repeating
@@ -84,10 +124,41 @@ static bool check_em(unsigned num)
     }
 }
 
-// Parse dice rolls and return inner command string and formatting class, if
+// Returns the formatting class of a dice roll
+static const char* dice_class(unsigned dice, unsigned faces, unsigned sum)
+{
+    const unsigned max_roll = dice * faces;
+    if (max_roll < 10 || faces == 1) { // no special formatting for small rolls
+        return "";
+    }
+    if (max_roll == sum) {
+        return "super_roll";
+    }
+    if (sum == dice) {
+        return "kuso_roll";
+    }
+    if (sum == 69 || sum == 6969) {
+        return "lewd_roll";
+    }
+    if (check_em(sum)) {
+        if (sum < 100) {
+            return "dubs_roll";
+        }
+        if (sum < 1000) {
+            return "trips_roll";
+        }
+        if (sum < 10000) {
+            return "quads_roll";
+        }
+        return "rainbow_roll";
+    }
+    return "";
+}
+
+// Parse dice rolls and write the command text and formatting class to r, if
 // matched
-static std::pair<string, string> parse_dice(
-    string& name, string_view word, const Command& val)
+static bool parse_dice(string_view name, string_view word, const Command& val,
+    Command::Rendered& r)
 {
     unsigned dice = 1;
     unsigned faces = 0;
@@ -97,10 +168,10 @@ static std::pair<string, string> parse_dice(
         if (auto d = parse_uint(word)) {
             dice = *d;
         } else {
-            return {};
+            return false;
         }
         if (!word.size() || word[0] != 'd') {
-            return {};
+            return false;
         }
         word = word.substr(1);
     }
@@ -108,114 +179,57 @@ static std::pair<string, string> parse_dice(
     if (auto f = parse_uint(word)) { // Must consume the rest of the text
         faces = *f;
     } else {
-        return {};
+        return false;
     }
     if (word.size() || dice > 10 || faces > 10000) {
-        return {};
+        return false;
     }
 
     // Rebuild command syntax
-    name.clear();
+    auto& s = r.text;
+    s = '#';
     if (dice != 1) {
-        name += std::to_string(dice);
+        s += std::to_string(dice);
     }
-    name += 'd' + std::to_string(faces);
+    s += 'd';
+    s += std::to_string(faces);
+    s += " (";
 
-    ostringstream os;
     unsigned sum = 0;
     for (auto roll : std::get<std::array<uint16_t, 10>>(val.val)) {
         if (!roll) { // Array is zero padded
             break;
         }
         if (sum) {
-            os << " + ";
+            s += " + ";
         }
         sum += roll;
-        os << roll;
+        s += std::to_string(roll);
     }
     if (dice > 1) {
-        os << " = " << sum;
+        s += " = ";
+        s += std::to_string(sum);
     }
-
-    // Determine roll formatting class
-    string cls;
-    const unsigned max_roll = dice * faces;
-    if (max_roll >= 10 && faces != 1) { // no special formatting for small rolls
-        if (max_roll == sum) {
-            cls = "super_roll";
-        } else if (sum == dice) {
-            cls = "kuso_roll";
-        } else if (sum == 69 || sum == 6969) {
-            cls = "lewd_roll";
-        } else if (check_em(sum)) {
-            if (sum < 100) {
-                cls = "dubs_roll";
-            } else if (sum < 1000) {
-                cls = "trips_roll";
-            } else if (sum < 10000) {
-                cls = "quads_roll";
-            } else {
-                cls = "rainbow_roll";
-            }
-        }
+    if (!sum && dice == 1) { // No result to display
+        return false;
     }
+    s += ')';
 
-    return { os.str(), cls };
+    r.cls = dice_class(dice, faces, sum);
+    return true;
 }
 
-optional<Node> PostView::parse_commands(string_view word)
+// Write the text and formatting class of a non-dice command to r, if matched
+static bool parse_command(
+    string_view name, const Command& val, Command::Rendered& r)
 {
-    // Guard against invalid dice rolls
-    if (state.dice_index >= m->commands.size()) {
-        return nullopt;
-    }
-
-    // Strip leading hash
-    word = word.substr(1);
-
-    // Attempt to read command name
-    string name;
-    name.reserve(word.size());
-    while (word.size()) {
-        const char ch = word[0];
-        if (islower(ch) || ch == '8') {
-            name += ch;
-            word = word.substr(1);
-        } else {
-            break;
-        }
-    }
-
-// Did not consume entire expression and no arguments possible
-// -> it's invalid
-#define check_consumed                                                         \
-    if (word.size()) {                                                         \
-        return nullopt;                                                        \
-    }
-
     string inner;
-    string cls;
-    auto const& val = m->commands[state.dice_index];
-
-    // Protect from index shifts on board_config.pyu toggle
-    if (!board_config.pyu) {
-        switch (val.typ) {
-        case Command::Type::pyu:
-        case Command::Type::pcount:
-            state.dice_index++;
-            return std::nullopt;
-        }
-    }
-
+    r.cls = "";
     if (name == "flip") {
-        check_consumed;
         inner = std::get<bool>(val.val) ? "flap" : "flop";
     } else if (name == "8ball") {
-        check_consumed;
         inner = brunhild::escape(val.eight_ball);
     } else if (name == "pyu" || name == "pcount" || name == "rcount") {
-        check_consumed;
-
         switch (val.typ) {
         case Command::Type::pyu:
         case Command::Type::pcount:
@@ -227,37 +241,86 @@ optional<Node> PostView::parse_commands(string_view word)
             inner = std::to_string(std::get<unsigned long>(val.val));
         }
     } else if (name == "roulette") {
-        check_consumed;
         const auto arr = std::get<std::array<uint8_t, 2>>(val.val);
         inner = std::to_string(arr[0]) + '/' + std::to_string(arr[1]);
         if (arr[0] == 1) {
-            cls = "dead";
+            r.cls = "dead";
         }
-    } else if (name == "sw") {
-        return parse_syncwatch(word);
-    } else {
-        auto p = parse_dice(name, word, val);
-        inner = p.first;
-        cls = p.second;
     }
     if (inner == "") {
+        return false;
+    }
+
+    auto& s = r.text;
+    s.reserve(name.size() + inner.size() + 4);
+    s = '#';
+    s += name;
+    s += " (";
+    s += inner;
+    s += ')';
+    return true;
+}
+
+optional<Node> PostView::parse_commands(string_view word)
+{
+    // Guard against invalid dice rolls
+    if (state.dice_index >= m->commands.size()) {
         return nullopt;
     }
+    auto& val = m->commands[state.dice_index];
 
-    state.dice_index++;
-    ostringstream os;
-    os << '#' << name << " (" << inner << ')';
+    // Protect from index shifts on board_config.pyu toggle
+    if (!board_config.pyu) {
+        switch (val.typ) {
+        case Command::Type::pyu:
+        case Command::Type::pcount:
+            state.dice_index++;
+            return std::nullopt;
+        }
+    }
+
+    if (!val.rendered || val.rendered->source != word) {
+        // Strip leading hash
+        string_view rest = word.substr(1);
 
-    return { { "strong", { { "class", cls } }, os.str(), true } };
+        // Attempt to read command name
+        size_t i = 0;
+        while (i < rest.size() && (islower(rest[i]) || rest[i] == '8')) {
+            i++;
+        }
+        const string_view name = rest.substr(0, i);
+        rest = rest.substr(i);
+
+        // Syncwatches are patched every second and never memoized
+        if (name == "sw") {
+            return parse_syncwatch(rest);
+        }
+
+        Command::Rendered r;
+        bool ok;
+        if (name == "flip" || name == "8ball" || name == "pyu"
+            || name == "pcount" || name == "rcount" || name == "roulette") {
+            // Did not consume entire expression and no arguments possible
+            // -> it's invalid
+            ok = !rest.size() && parse_command(name, val, r);
+        } else {
+            ok = val.typ == Command::Type::dice
+                && parse_dice(name, rest, val, r);
+        }
+        if (!ok) {
+            return nullopt;
+        }
+        r.source = word;
+        val.rendered = std::move(r);
+    }
+
+    state.dice_index++;
+    return { { "strong", { { "class", val.rendered->cls } },
+        val.rendered->text, true } };
 }
 
-// TODO: Also need to figure out, how to handle updating these on countdown.
-// Perhaps a global registry, that gets flushed on page re-render?
-// Probably a good idea to hook these before RAF execution.
 optional<Node> PostView::parse_syncwatch(std::string_view frag)
 {
-    using std::setw;
-
     // Parse and validate
     if (!frag.size()) {
         return nullopt;
@@ -298,41 +361,27 @@ optional<Node> PostView::parse_syncwatch(std::string_view frag)
         }
     }
 
-    // Format inner string
-    // TODO: Apply offset from server clock
-    const auto[hours, min, sec, start, end]
-        = std::get<std::array<unsigned long, 5>>(
-            m->commands[state.dice_index++].val);
-    const unsigned long now = std::time(0) + server_time_offset;
+    const unsigned index = state.dice_index++;
+    const uint64_t key = uint64_t(m->id) << 32 | index;
+    auto& sw = syncwatches[key];
+    if (!sw.handle) {
+        sw.handle = brunhild::new_handle();
+    }
+    sw.params = std::get<std::array<unsigned long, 5>>(m->commands[index].val);
     ostringstream s;
-    if (now > end) {
-        s << lang.ui.at("finished");
-    } else {
-        if (now < start) {
-            s << start - now;
-        } else {
-            unsigned long diff = now - start;
-            const auto hours_elapsed = diff / 3600;
-            diff %= 3600;
-            const auto min_elapsed = diff / 60;
-            diff %= 60;
-
-            s << std::setfill('0') << setw(2) << hours_elapsed << ':' << setw(2)
-              << min_elapsed << ':' << setw(2) << diff << " / " << setw(2)
-              << hours << ':' << setw(2) << min << ':' << setw(2) << sec;
-        }
-
-        // Schedule next render to update counter
-        pending_rerender[m->id] = now + 1;
+    if (!format_syncwatch(s, sw.params) && !sw.scheduled) {
+        // Only the counter is patched on following ticks
+        sw.scheduled = true;
+        schedule(std::time(0) + 1, &update_syncwatch, key);
     }
 
+    Node counter("strong", { { "class", "embed syncwatch" } }, s.str());
+    counter.handle = sw.handle;
     return {
         {
             "em", {},
             {
-                {
-                    "strong", { { "class", "embed syncwatch" } }, s.str(),
-                },
+                counter,
             },
         },
     };
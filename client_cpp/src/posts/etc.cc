@@ -10,38 +10,59 @@ using std::string;
 using std::string_view;
 
 // Renders "56 minutes ago" or "in 56 minutes" like relative time text
-// Units is the index used to retrieve the language pack value for unit
-// pluralization.
-static string ago(time_t n, string units, bool is_future)
+// Units is the language pack key used for unit pluralization.
+static string ago(time_t n, PluralKey units, bool is_future)
 {
     auto count = pluralize(n, units);
-    return is_future ? lang.posts.at("in") + " " + count
-                     : count + " " + lang.posts.at("ago");
+    return is_future ? lang.posts[PostsKey::in] + " " + count
+                     : count + " " + lang.posts[PostsKey::ago];
 }
 
-string relative_time(time_t then)
+// Unit, count and direction of a relative timestamp
+struct RelativeTime {
+    int unit; // Index into the units of relative_time() or -1 for "just now"
+    time_t count;
+    bool is_future;
+};
+
+static RelativeTime split_relative_time(time_t then)
 {
     auto now = (float)std::time(0);
     auto t = (now - (float)then) / 60;
     auto is_future = false;
     if (t < 1) {
         if (t > -5) { // Assume to be client clock imprecision
-            return lang.posts.at("justNow");
+            return { -1, 0, false };
         }
         is_future = true;
         t = -t;
     }
 
     const int divide[4] = { 60, 24, 30, 12 };
-    const static string unit[4] = { "minute", "hour", "day", "month" };
     for (int i = 0; i < 4; i++) {
         if (t < divide[i]) {
-            return ago(t, unit[i], is_future);
+            return { i, time_t(t), is_future };
         }
         t /= divide[i];
     }
+    return { 4, time_t(t), is_future };
+}
 
-    return ago(t, "year", is_future);
+string relative_time(time_t then)
+{
+    const static PluralKey unit[5] = { PluralKey::minute, PluralKey::hour,
+        PluralKey::day, PluralKey::month, PluralKey::year };
+    const auto r = split_relative_time(then);
+    if (r.unit == -1) {
+        return lang.posts[PostsKey::justNow];
+    }
+    return ago(r.count, unit[r.unit], r.is_future);
+}
+
+int64_t relative_time_bucket(time_t then)
+{
+    const auto r = split_relative_time(then);
+    return (int64_t(r.count) * 8 + r.unit + 1) * 2 + r.is_future;
 }
 
 std::string absolute_thread_url(unsigned long id, string board)
@@ -54,7 +75,7 @@ std::string absolute_thread_url(unsigned long id, string board)
 Node render_post_link(unsigned long id, const LinkData& data)
 {
     const bool cross_thread = data.op != page.thread;
-    const string id_str = std::to_string(id);
+    const string id_str = brunhild::int_to_string(id);
 
     std::ostringstream url;
     if (cross_thread) {
@@ -68,7 +89,7 @@ Node render_post_link(unsigned long id, const LinkData& data)
         text << " ➡";
     }
     if (post_ids.mine.count(id)) { // Post, the user made
-        text << ' ' << lang.posts.at("you");
+        text << ' ' << lang.posts[PostsKey::you];
     }
 
     Node n = Node("em");
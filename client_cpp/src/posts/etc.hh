@@ -4,6 +4,7 @@
 #include "models.hh"
 #include "view.hh"
 #include <ctime>
+#include <stdint.h>
 #include <emscripten/val.h>
 #include <string>
 #include <string_view>
@@ -17,6 +18,10 @@ const brunhild::Node delete_toggle = brunhild::Node("input",
 // Renders readable elapsed time since Unix timestamp then
 std::string relative_time(time_t then);
 
+// Returns a key of the unit and count relative_time() would render. The text
+// only changes, when the key does.
+int64_t relative_time_bucket(time_t then);
+
 // Generate absolute URL of a thread
 std::string absolute_thread_url(unsigned long id, std::string board);
 
@@ -5,268 +5,284 @@
 #include "view.hh"
 #include <array>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
-struct code_hash {
-    std::size_t operator()(const std::array<char, 2>& c) const
-    {
-        return (c[0] << 8) | c[1];
-    }
+// Country code and English name
+struct Country {
+    char code[3];
+    std::string_view name;
+};
+
+static constexpr Country country_list[] = {
+    { "ad", "Andorra" },
+    { "ae", "United Arab Emirates" },
+    { "af", "Afghanistan" },
+    { "ag", "Antigua and Barbuda" },
+    { "ai", "Anguilla" },
+    { "al", "Albania" },
+    { "am", "Armenia" },
+    { "ao", "Angola" },
+    { "aq", "Antarctica" },
+    { "ar", "Argentina" },
+    { "as", "American Samoa" },
+    { "at", "Austria" },
+    { "au", "Australia" },
+    { "aw", "Aruba" },
+    { "ax", "Aland Islands !" },
+    { "az", "Azerbaijan" },
+    { "ba", "Bosnia and Herzegovina" },
+    { "bb", "Barbados" },
+    { "bd", "Bangladesh" },
+    { "be", "Belgium" },
+    { "bf", "Burkina Faso" },
+    { "bg", "Bulgaria" },
+    { "bh", "Bahrain" },
+    { "bi", "Burundi" },
+    { "bj", "Benin" },
+    { "bl", "Saint Barthélemy" },
+    { "bm", "Bermuda" },
+    { "bn", "Brunei Darussalam" },
+    { "bo", "Bolivia" },
+    { "bq", "Bonaire" },
+    { "br", "Brazil" },
+    { "bs", "Bahamas" },
+    { "bt", "Bhutan" },
+    { "bv", "Bouvet Island" },
+    { "bw", "Botswana" },
+    { "by", "Belarus" },
+    { "bz", "Belize" },
+    { "ca", "Canada" },
+    { "cc", "Cocos (Keeling) Islands" },
+    { "cd", "Congo" },
+    { "cf", "Central African Republic" },
+    { "cg", "Congo" },
+    { "ch", "Switzerland" },
+    { "ci", "Cote d'Ivoire !" },
+    { "ck", "Cook Islands" },
+    { "cl", "Chile" },
+    { "cm", "Cameroon" },
+    { "cn", "China" },
+    { "co", "Colombia" },
+    { "cr", "Costa Rica" },
+    { "cu", "Cuba" },
+    { "cv", "Cabo Verde" },
+    { "cw", "Curaçao" },
+    { "cx", "Christmas Island" },
+    { "cy", "Cyprus" },
+    { "cz", "Czechia" },
+    { "de", "Germany" },
+    { "dj", "Djibouti" },
+    { "dk", "Denmark" },
+    { "dm", "Dominica" },
+    { "do", "Dominican Republic" },
+    { "dz", "Algeria" },
+    { "ec", "Ecuador" },
+    { "ee", "Estonia" },
+    { "eg", "Egypt" },
+    { "eh", "Western Sahara" },
+    { "er", "Eritrea" },
+    { "es", "Spain" },
+    { "et", "Ethiopia" },
+    { "fi", "Finland" },
+    { "fj", "Fiji" },
+    { "fk", "Falkland Islands (Malvinas)" },
+    { "fm", "Micronesia" },
+    { "fo", "Faroe Islands" },
+    { "fr", "France" },
+    { "ga", "Gabon" },
+    { "gb", "United Kingdom" },
+    { "gd", "Grenada" },
+    { "ge", "Georgia" },
+    { "gf", "French Guiana" },
+    { "gg", "Guernsey" },
+    { "gh", "Ghana" },
+    { "gi", "Gibraltar" },
+    { "gl", "Greenland" },
+    { "gm", "Gambia" },
+    { "gn", "Guinea" },
+    { "gp", "Guadeloupe" },
+    { "gq", "Equatorial Guinea" },
+    { "gr", "Greece" },
+    { "gs", "South Georgia and the South Sandwich Islands" },
+    { "gt", "Guatemala" },
+    { "gu", "Guam" },
+    { "gw", "Guinea-Bissau" },
+    { "gy", "Guyana" },
+    { "hk", "Hong Kong" },
+    { "hm", "Heard Island and McDonald Islands" },
+    { "hn", "Honduras" },
+    { "hr", "Croatia" },
+    { "ht", "Haiti" },
+    { "hu", "Hungary" },
+    { "id", "Indonesia" },
+    { "ie", "Ireland" },
+    { "il", "Israel" },
+    { "im", "Isle of Man" },
+    { "in", "India" },
+    { "io", "British Indian Ocean Territory" },
+    { "iq", "Iraq" },
+    { "ir", "Iran" },
+    { "is", "Iceland" },
+    { "it", "Italy" },
+    { "je", "Jersey" },
+    { "jm", "Jamaica" },
+    { "jo", "Jordan" },
+    { "jp", "Japan" },
+    { "ke", "Kenya" },
+    { "kg", "Kyrgyzstan" },
+    { "kh", "Cambodia" },
+    { "ki", "Kiribati" },
+    { "km", "Comoros" },
+    { "kn", "Saint Kitts and Nevis" },
+    { "kp", "Democratic People's Republic of Korea" },
+    { "kr", "Republic of Korea" },
+    { "kw", "Kuwait" },
+    { "ky", "Cayman Islands" },
+    { "kz", "Kazakhstan" },
+    { "la", "Lao People's Democratic Republic" },
+    { "lb", "Lebanon" },
+    { "lc", "Saint Lucia" },
+    { "li", "Liechtenstein" },
+    { "lk", "Sri Lanka" },
+    { "lr", "Liberia" },
+    { "ls", "Lesotho" },
+    { "lt", "Lithuania" },
+    { "lu", "Luxembourg" },
+    { "lv", "Latvia" },
+    { "ly", "Libya" },
+    { "ma", "Morocco" },
+    { "mc", "Monaco" },
+    { "md", "Moldova" },
+    { "me", "Montenegro" },
+    { "mf", "Saint Martin (French part)" },
+    { "mg", "Madagascar" },
+    { "mh", "Marshall Islands" },
+    { "mk", "Macedonia" },
+    { "ml", "Mali" },
+    { "mm", "Myanmar" },
+    { "mn", "Mongolia" },
+    { "mo", "Macao" },
+    { "mp", "Northern Mariana Islands" },
+    { "mq", "Martinique" },
+    { "mr", "Mauritania" },
+    { "ms", "Montserrat" },
+    { "mt", "Malta" },
+    { "mu", "Mauritius" },
+    { "mv", "Maldives" },
+    { "mw", "Malawi" },
+    { "mx", "Mexico" },
+    { "my", "Malaysia" },
+    { "mz", "Mozambique" },
+    { "na", "Namibia" },
+    { "nc", "New Caledonia" },
+    { "ne", "Niger" },
+    { "nf", "Norfolk Island" },
+    { "ng", "Nigeria" },
+    { "ni", "Nicaragua" },
+    { "nl", "Netherlands" },
+    { "no", "Norway" },
+    { "np", "Nepal" },
+    { "nr", "Nauru" },
+    { "nu", "Niue" },
+    { "nz", "New Zealand" },
+    { "om", "Oman" },
+    { "pa", "Panama" },
+    { "pe", "Peru" },
+    { "pf", "French Polynesia" },
+    { "pg", "Papua New Guinea" },
+    { "ph", "Philippines" },
+    { "pk", "Pakistan" },
+    { "pl", "Poland" },
+    { "pm", "Saint Pierre and Miquelon" },
+    { "pn", "Pitcairn" },
+    { "pr", "Puerto Rico" },
+    { "ps", "Palestine" },
+    { "pt", "Portugal" },
+    { "pw", "Palau" },
+    { "py", "Paraguay" },
+    { "qa", "Qatar" },
+    { "re", "Reunion !" },
+    { "ro", "Romania" },
+    { "rs", "Serbia" },
+    { "ru", "Russian Federation" },
+    { "rw", "Rwanda" },
+    { "sa", "Saudi Arabia" },
+    { "sb", "Solomon Islands" },
+    { "sc", "Seychelles" },
+    { "sd", "Sudan" },
+    { "se", "Sweden" },
+    { "sg", "Singapore" },
+    { "sh", "Saint Helena" },
+    { "si", "Slovenia" },
+    { "sj", "Svalbard and Jan Mayen" },
+    { "sk", "Slovakia" },
+    { "sl", "Sierra Leone" },
+    { "sm", "San Marino" },
+    { "sn", "Senegal" },
+    { "so", "Somalia" },
+    { "sr", "Suriname" },
+    { "ss", "South Sudan" },
+    { "st", "Sao Tome and Principe" },
+    { "sv", "El Salvador" },
+    { "sx", "Sint Maarten (Dutch part)" },
+    { "sy", "Syrian Arab Republic" },
+    { "sz", "Swaziland" },
+    { "tc", "Turks and Caicos Islands" },
+    { "td", "Chad" },
+    { "tf", "French Southern Territories" },
+    { "tg", "Togo" },
+    { "th", "Thailand" },
+    { "tj", "Tajikistan" },
+    { "tk", "Tokelau" },
+    { "tl", "Timor-Leste" },
+    { "tm", "Turkmenistan" },
+    { "tn", "Tunisia" },
+    { "to", "Tonga" },
+    { "tr", "Turkey" },
+    { "tt", "Trinidad and Tobago" },
+    { "tv", "Tuvalu" },
+    { "tw", "Taiwan" },
+    { "tz", "Tanzania" },
+    { "ua", "Ukraine" },
+    { "ug", "Uganda" },
+    { "um", "United States Minor Outlying Islands" },
+    { "us", "United States of America" },
+    { "uy", "Uruguay" },
+    { "uz", "Uzbekistan" },
+    { "va", "Holy See" },
+    { "vc", "Saint Vincent and the Grenadines" },
+    { "ve", "Venezuela" },
+    { "vg", "British Virgin Islands" },
+    { "vi", "U.S. Virgin Islands" },
+    { "vn", "Viet Nam" },
+    { "vu", "Vanuatu" },
+    { "wf", "Wallis and Futuna" },
+    { "ws", "Samoa" },
+    { "ye", "Yemen" },
+    { "yt", "Mayotte" },
+    { "za", "South Africa" },
+    { "zm", "Zambia" },
+    { "zw", "Zimbabwe" },
 };
 
-// Maps country codes to English names
-const static std::unordered_map<std::array<char, 2>, std::string, code_hash>
-    countries = {
-        { { { 'a', 'd' } }, "Andorra" },
-        { { { 'a', 'e' } }, "United Arab Emirates" },
-        { { { 'a', 'f' } }, "Afghanistan" },
-        { { { 'a', 'g' } }, "Antigua and Barbuda" },
-        { { { 'a', 'i' } }, "Anguilla" },
-        { { { 'a', 'l' } }, "Albania" },
-        { { { 'a', 'm' } }, "Armenia" },
-        { { { 'a', 'o' } }, "Angola" },
-        { { { 'a', 'q' } }, "Antarctica" },
-        { { { 'a', 'r' } }, "Argentina" },
-        { { { 'a', 's' } }, "American Samoa" },
-        { { { 'a', 't' } }, "Austria" },
-        { { { 'a', 'u' } }, "Australia" },
-        { { { 'a', 'w' } }, "Aruba" },
-        { { { 'a', 'x' } }, "Aland Islands !" },
-        { { { 'a', 'z' } }, "Azerbaijan" },
-        { { { 'b', 'a' } }, "Bosnia and Herzegovina" },
-        { { { 'b', 'b' } }, "Barbados" },
-        { { { 'b', 'd' } }, "Bangladesh" },
-        { { { 'b', 'e' } }, "Belgium" },
-        { { { 'b', 'f' } }, "Burkina Faso" },
-        { { { 'b', 'g' } }, "Bulgaria" },
-        { { { 'b', 'h' } }, "Bahrain" },
-        { { { 'b', 'i' } }, "Burundi" },
-        { { { 'b', 'j' } }, "Benin" },
-        { { { 'b', 'l' } }, "Saint Barthélemy" },
-        { { { 'b', 'm' } }, "Bermuda" },
-        { { { 'b', 'n' } }, "Brunei Darussalam" },
-        { { { 'b', 'o' } }, "Bolivia" },
-        { { { 'b', 'q' } }, "Bonaire" },
-        { { { 'b', 'r' } }, "Brazil" },
-        { { { 'b', 's' } }, "Bahamas" },
-        { { { 'b', 't' } }, "Bhutan" },
-        { { { 'b', 'v' } }, "Bouvet Island" },
-        { { { 'b', 'w' } }, "Botswana" },
-        { { { 'b', 'y' } }, "Belarus" },
-        { { { 'b', 'z' } }, "Belize" },
-        { { { 'c', 'a' } }, "Canada" },
-        { { { 'c', 'c' } }, "Cocos (Keeling) Islands" },
-        { { { 'c', 'd' } }, "Congo" },
-        { { { 'c', 'f' } }, "Central African Republic" },
-        { { { 'c', 'g' } }, "Congo" },
-        { { { 'c', 'h' } }, "Switzerland" },
-        { { { 'c', 'i' } }, "Cote d'Ivoire !" },
-        { { { 'c', 'k' } }, "Cook Islands" },
-        { { { 'c', 'l' } }, "Chile" },
-        { { { 'c', 'm' } }, "Cameroon" },
-        { { { 'c', 'n' } }, "China" },
-        { { { 'c', 'o' } }, "Colombia" },
-        { { { 'c', 'r' } }, "Costa Rica" },
-        { { { 'c', 'u' } }, "Cuba" },
-        { { { 'c', 'v' } }, "Cabo Verde" },
-        { { { 'c', 'w' } }, "Curaçao" },
-        { { { 'c', 'x' } }, "Christmas Island" },
-        { { { 'c', 'y' } }, "Cyprus" },
-        { { { 'c', 'z' } }, "Czechia" },
-        { { { 'd', 'e' } }, "Germany" },
-        { { { 'd', 'j' } }, "Djibouti" },
-        { { { 'd', 'k' } }, "Denmark" },
-        { { { 'd', 'm' } }, "Dominica" },
-        { { { 'd', 'o' } }, "Dominican Republic" },
-        { { { 'd', 'z' } }, "Algeria" },
-        { { { 'e', 'c' } }, "Ecuador" },
-        { { { 'e', 'e' } }, "Estonia" },
-        { { { 'e', 'g' } }, "Egypt" },
-        { { { 'e', 'h' } }, "Western Sahara" },
-        { { { 'e', 'r' } }, "Eritrea" },
-        { { { 'e', 's' } }, "Spain" },
-        { { { 'e', 't' } }, "Ethiopia" },
-        { { { 'f', 'i' } }, "Finland" },
-        { { { 'f', 'j' } }, "Fiji" },
-        { { { 'f', 'k' } }, "Falkland Islands (Malvinas)" },
-        { { { 'f', 'm' } }, "Micronesia" },
-        { { { 'f', 'o' } }, "Faroe Islands" },
-        { { { 'f', 'r' } }, "France" },
-        { { { 'g', 'a' } }, "Gabon" },
-        { { { 'g', 'b' } }, "United Kingdom" },
-        { { { 'g', 'd' } }, "Grenada" },
-        { { { 'g', 'e' } }, "Georgia" },
-        { { { 'g', 'f' } }, "French Guiana" },
-        { { { 'g', 'g' } }, "Guernsey" },
-        { { { 'g', 'h' } }, "Ghana" },
-        { { { 'g', 'i' } }, "Gibraltar" },
-        { { { 'g', 'l' } }, "Greenland" },
-        { { { 'g', 'm' } }, "Gambia" },
-        { { { 'g', 'n' } }, "Guinea" },
-        { { { 'g', 'p' } }, "Guadeloupe" },
-        { { { 'g', 'q' } }, "Equatorial Guinea" },
-        { { { 'g', 'r' } }, "Greece" },
-        { { { 'g', 's' } }, "South Georgia and the South Sandwich Islands" },
-        { { { 'g', 't' } }, "Guatemala" },
-        { { { 'g', 'u' } }, "Guam" },
-        { { { 'g', 'w' } }, "Guinea-Bissau" },
-        { { { 'g', 'y' } }, "Guyana" },
-        { { { 'h', 'k' } }, "Hong Kong" },
-        { { { 'h', 'm' } }, "Heard Island and McDonald Islands" },
-        { { { 'h', 'n' } }, "Honduras" },
-        { { { 'h', 'r' } }, "Croatia" },
-        { { { 'h', 't' } }, "Haiti" },
-        { { { 'h', 'u' } }, "Hungary" },
-        { { { 'i', 'd' } }, "Indonesia" },
-        { { { 'i', 'e' } }, "Ireland" },
-        { { { 'i', 'l' } }, "Israel" },
-        { { { 'i', 'm' } }, "Isle of Man" },
-        { { { 'i', 'n' } }, "India" },
-        { { { 'i', 'o' } }, "British Indian Ocean Territory" },
-        { { { 'i', 'q' } }, "Iraq" },
-        { { { 'i', 'r' } }, "Iran" },
-        { { { 'i', 's' } }, "Iceland" },
-        { { { 'i', 't' } }, "Italy" },
-        { { { 'j', 'e' } }, "Jersey" },
-        { { { 'j', 'm' } }, "Jamaica" },
-        { { { 'j', 'o' } }, "Jordan" },
-        { { { 'j', 'p' } }, "Japan" },
-        { { { 'k', 'e' } }, "Kenya" },
-        { { { 'k', 'g' } }, "Kyrgyzstan" },
-        { { { 'k', 'h' } }, "Cambodia" },
-        { { { 'k', 'i' } }, "Kiribati" },
-        { { { 'k', 'm' } }, "Comoros" },
-        { { { 'k', 'n' } }, "Saint Kitts and Nevis" },
-        { { { 'k', 'p' } }, "Democratic People's Republic of Korea" },
-        { { { 'k', 'r' } }, "Republic of Korea" },
-        { { { 'k', 'w' } }, "Kuwait" },
-        { { { 'k', 'y' } }, "Cayman Islands" },
-        { { { 'k', 'z' } }, "Kazakhstan" },
-        { { { 'l', 'a' } }, "Lao People's Democratic Republic" },
-        { { { 'l', 'b' } }, "Lebanon" },
-        { { { 'l', 'c' } }, "Saint Lucia" },
-        { { { 'l', 'i' } }, "Liechtenstein" },
-        { { { 'l', 'k' } }, "Sri Lanka" },
-        { { { 'l', 'r' } }, "Liberia" },
-        { { { 'l', 's' } }, "Lesotho" },
-        { { { 'l', 't' } }, "Lithuania" },
-        { { { 'l', 'u' } }, "Luxembourg" },
-        { { { 'l', 'v' } }, "Latvia" },
-        { { { 'l', 'y' } }, "Libya" },
-        { { { 'm', 'a' } }, "Morocco" },
-        { { { 'm', 'c' } }, "Monaco" },
-        { { { 'm', 'd' } }, "Moldova" },
-        { { { 'm', 'e' } }, "Montenegro" },
-        { { { 'm', 'f' } }, "Saint Martin (French part)" },
-        { { { 'm', 'g' } }, "Madagascar" },
-        { { { 'm', 'h' } }, "Marshall Islands" },
-        { { { 'm', 'k' } }, "Macedonia" },
-        { { { 'm', 'l' } }, "Mali" },
-        { { { 'm', 'm' } }, "Myanmar" },
-        { { { 'm', 'n' } }, "Mongolia" },
-        { { { 'm', 'o' } }, "Macao" },
-        { { { 'm', 'p' } }, "Northern Mariana Islands" },
-        { { { 'm', 'q' } }, "Martinique" },
-        { { { 'm', 'r' } }, "Mauritania" },
-        { { { 'm', 's' } }, "Montserrat" },
-        { { { 'm', 't' } }, "Malta" },
-        { { { 'm', 'u' } }, "Mauritius" },
-        { { { 'm', 'v' } }, "Maldives" },
-        { { { 'm', 'w' } }, "Malawi" },
-        { { { 'm', 'x' } }, "Mexico" },
-        { { { 'm', 'y' } }, "Malaysia" },
-        { { { 'm', 'z' } }, "Mozambique" },
-        { { { 'n', 'a' } }, "Namibia" },
-        { { { 'n', 'c' } }, "New Caledonia" },
-        { { { 'n', 'e' } }, "Niger" },
-        { { { 'n', 'f' } }, "Norfolk Island" },
-        { { { 'n', 'g' } }, "Nigeria" },
-        { { { 'n', 'i' } }, "Nicaragua" },
-        { { { 'n', 'l' } }, "Netherlands" },
-        { { { 'n', 'o' } }, "Norway" },
-        { { { 'n', 'p' } }, "Nepal" },
-        { { { 'n', 'r' } }, "Nauru" },
-        { { { 'n', 'u' } }, "Niue" },
-        { { { 'n', 'z' } }, "New Zealand" },
-        { { { 'o', 'm' } }, "Oman" },
-        { { { 'p', 'a' } }, "Panama" },
-        { { { 'p', 'e' } }, "Peru" },
-        { { { 'p', 'f' } }, "French Polynesia" },
-        { { { 'p', 'g' } }, "Papua New Guinea" },
-        { { { 'p', 'h' } }, "Philippines" },
-        { { { 'p', 'k' } }, "Pakistan" },
-        { { { 'p', 'l' } }, "Poland" },
-        { { { 'p', 'm' } }, "Saint Pierre and Miquelon" },
-        { { { 'p', 'n' } }, "Pitcairn" },
-        { { { 'p', 'r' } }, "Puerto Rico" },
-        { { { 'p', 's' } }, "Palestine" },
-        { { { 'p', 't' } }, "Portugal" },
-        { { { 'p', 'w' } }, "Palau" },
-        { { { 'p', 'y' } }, "Paraguay" },
-        { { { 'q', 'a' } }, "Qatar" },
-        { { { 'r', 'e' } }, "Reunion !" },
-        { { { 'r', 'o' } }, "Romania" },
-        { { { 'r', 's' } }, "Serbia" },
-        { { { 'r', 'u' } }, "Russian Federation" },
-        { { { 'r', 'w' } }, "Rwanda" },
-        { { { 's', 'a' } }, "Saudi Arabia" },
-        { { { 's', 'b' } }, "Solomon Islands" },
-        { { { 's', 'c' } }, "Seychelles" },
-        { { { 's', 'd' } }, "Sudan" },
-        { { { 's', 'e' } }, "Sweden" },
-        { { { 's', 'g' } }, "Singapore" },
-        { { { 's', 'h' } }, "Saint Helena" },
-        { { { 's', 'i' } }, "Slovenia" },
-        { { { 's', 'j' } }, "Svalbard and Jan Mayen" },
-        { { { 's', 'k' } }, "Slovakia" },
-        { { { 's', 'l' } }, "Sierra Leone" },
-        { { { 's', 'm' } }, "San Marino" },
-        { { { 's', 'n' } }, "Senegal" },
-        { { { 's', 'o' } }, "Somalia" },
-        { { { 's', 'r' } }, "Suriname" },
-        { { { 's', 's' } }, "South Sudan" },
-        { { { 's', 't' } }, "Sao Tome and Principe" },
-        { { { 's', 'v' } }, "El Salvador" },
-        { { { 's', 'x' } }, "Sint Maarten (Dutch part)" },
-        { { { 's', 'y' } }, "Syrian Arab Republic" },
-        { { { 's', 'z' } }, "Swaziland" },
-        { { { 't', 'c' } }, "Turks and Caicos Islands" },
-        { { { 't', 'd' } }, "Chad" },
-        { { { 't', 'f' } }, "French Southern Territories" },
-        { { { 't', 'g' } }, "Togo" },
-        { { { 't', 'h' } }, "Thailand" },
-        { { { 't', 'j' } }, "Tajikistan" },
-        { { { 't', 'k' } }, "Tokelau" },
-        { { { 't', 'l' } }, "Timor-Leste" },
-        { { { 't', 'm' } }, "Turkmenistan" },
-        { { { 't', 'n' } }, "Tunisia" },
-        { { { 't', 'o' } }, "Tonga" },
-        { { { 't', 'r' } }, "Turkey" },
-        { { { 't', 't' } }, "Trinidad and Tobago" },
-        { { { 't', 'v' } }, "Tuvalu" },
-        { { { 't', 'w' } }, "Taiwan" },
-        { { { 't', 'z' } }, "Tanzania" },
-        { { { 'u', 'a' } }, "Ukraine" },
-        { { { 'u', 'g' } }, "Uganda" },
-        { { { 'u', 'm' } }, "United States Minor Outlying Islands" },
-        { { { 'u', 's' } }, "United States of America" },
-        { { { 'u', 'y' } }, "Uruguay" },
-        { { { 'u', 'z' } }, "Uzbekistan" },
-        { { { 'v', 'a' } }, "Holy See" },
-        { { { 'v', 'c' } }, "Saint Vincent and the Grenadines" },
-        { { { 'v', 'e' } }, "Venezuela" },
-        { { { 'v', 'g' } }, "British Virgin Islands" },
-        { { { 'v', 'i' } }, "U.S. Virgin Islands" },
-        { { { 'v', 'n' } }, "Viet Nam" },
-        { { { 'v', 'u' } }, "Vanuatu" },
-        { { { 'w', 'f' } }, "Wallis and Futuna" },
-        { { { 'w', 's' } }, "Samoa" },
-        { { { 'y', 'e' } }, "Yemen" },
-        { { { 'y', 't' } }, "Mayotte" },
-        { { { 'z', 'a' } }, "South Africa" },
-        { { { 'z', 'm' } }, "Zambia" },
-        { { { 'z', 'w' } }, "Zimbabwe" },
-    };
+// English names of countries directly indexed by the letters of their codes
+static constexpr auto countries = []() {
+    std::array<std::string_view, 26 * 26> t{};
+    for (auto& c : country_list) {
+        t[(c.code[0] - 'a') * 26 + c.code[1] - 'a'] = c.name;
+    }
+    return t;
+}();
+
+// Returns the English name of a country by code or an empty view, if unknown
+static std::string_view country_name(std::string_view code)
+{
+    if (code.size() != 2 || code[0] < 'a' || code[0] > 'z' || code[1] < 'a'
+        || code[1] > 'z') {
+        return {};
+    }
+    return countries[(code[0] - 'a') * 26 + code[1] - 'a'];
+}
 
 Node PostView::render_header()
 {
@@ -277,7 +293,7 @@ Node PostView::render_header()
 
     if (m->id == m->op && !page.thread && page.board == "all") {
         n.children.push_back(
-            { "b", { { "class", "board" } }, '/' + m->board + '/' });
+            { "b", { { "class", "board" } }, '/' + m->board.str() + '/' });
     }
     if (m->sticky) {
         n.children.push_back({
@@ -312,20 +328,21 @@ Node PostView::render_header()
         n.children.push_back({ "h3", s, true });
     }
     n.children.push_back(render_name());
-    if (const auto f = m->flag; f && f->size() == 2) {
-        const std::array<char, 2> key = { { (*f)[0], (*f)[1] } };
+    if (m->flag && m->flag->str().size() == 2) {
+        auto const& f = m->flag->str();
+        const auto name = country_name(f);
         n.children.push_back({
             "img",
             {
                 { "class", "flag" },
-                { "src", "/assets/flags/" + *f + ".svg" },
-                { "title", countries.count(key) ? countries.at(key) : *f },
+                { "src", "/assets/flags/" + f + ".svg" },
+                { "title", name.size() ? std::string(name) : f },
             },
         });
     }
     n.children.push_back(render_time());
 
-    const auto id_str = std::to_string(m->id);
+    const auto id_str = brunhild::int_to_string(m->id);
     std::string url = "#p" + id_str;
     if (!page.thread) {
         url = absolute_thread_url(m->id, m->board) + "?last=100" + url;
@@ -353,9 +370,13 @@ Node PostView::render_header()
     });
 
     if (m->id == m->op && !page.thread && !page.catalog) {
-        n.children.push_back({ "span", {},
-            brunhild::Children({ render_expand_link(m->board, m->id),
-                render_last_100_link(m->board, m->id) }) });
+        // Expanded inline on the board index. See init_board().
+        auto expand = render_expand_link(m->board, m->id);
+        auto last_100 = render_last_100_link(m->board, m->id);
+        expand.children[0].attrs["class"] = "expand-thread";
+        last_100.children[0].attrs["class"] = "expand-thread";
+        n.children.push_back(
+            { "span", {}, brunhild::Children({ expand, last_100 }) });
     }
 
     n.children.push_back({ "a", { { "class", "control svg-link" } },
@@ -373,13 +394,14 @@ Node PostView::render_name()
     }
 
     if (options.anonymise) {
-        n.children = { Node("span", lang.posts.at("anon")) };
+        n.children = { Node("span", lang.posts[PostsKey::anon]) };
         return n;
     }
 
     if (m->name || !m->trip) {
-        n.children.push_back(m->name ? Node("span", *m->name, true)
-                                     : Node("span", lang.posts.at("anon")));
+        n.children.push_back(m->name
+                ? Node("span", *m->name, true)
+                : Node("span", lang.posts[PostsKey::anon]));
     }
     if (m->trip) {
         n.children.push_back({ "code", "!" + *m->trip, true });
@@ -389,31 +411,76 @@ Node PostView::render_name()
     }
     if (m->auth) {
         n.attrs["class"] += " admin";
-        n.children.push_back({ "span", "## " + lang.posts.at(*m->auth) });
+        // Staff titles match the language pack keys of their labels
+        const auto& title = m->auth->str();
+        const auto key = lang.posts.find(title);
+        n.children.push_back(
+            { "span", "## " + (key ? lang.posts[*key] : title) });
     }
     if (post_ids.mine.count(m->id)) {
-        n.children.push_back({ "i", lang.posts.at("you") });
+        n.children.push_back({ "i", lang.posts[PostsKey::you] });
     }
 
     return n;
 }
 
-Node PostView::render_time()
+bool PostView::update_time_cache()
 {
     using std::setw;
 
-    auto then = std::localtime(&m->time);
+    auto& c = time_cache;
+    bool changed = false;
+    if (c.time != m->time || c.lang_generation != lang.generation) {
+        c.time = m->time;
+        c.lang_generation = lang.generation;
+        c.rel_bucket = -1;
+        changed = true;
 
-    // Renders classic absolute timestamp
-    std::ostringstream abs;
-    abs << std::setfill('0') << setw(2) << then->tm_mday << ' '
-        << lang.calendar[then->tm_mon] << ' ' << 1900 + then->tm_year << " ("
-        << lang.week[then->tm_wday] << ") " << setw(2) << then->tm_hour << ':'
-        << setw(2) << then->tm_min << ':' << setw(2) << then->tm_sec;
+        // Renders classic absolute timestamp
+        auto then = std::localtime(&m->time);
+        std::ostringstream abs;
+        abs << std::setfill('0') << setw(2) << then->tm_mday << ' '
+            << lang.calendar[then->tm_mon] << ' ' << 1900 + then->tm_year
+            << " (" << lang.week[then->tm_wday] << ") " << setw(2)
+            << then->tm_hour << ':' << setw(2) << then->tm_min << ':'
+            << setw(2) << then->tm_sec;
+        c.abs = abs.str();
+    }
 
-    const auto rel = relative_time(m->time);
+    const auto bucket = relative_time_bucket(m->time);
+    if (bucket != c.rel_bucket) {
+        c.rel_bucket = bucket;
+        c.rel = relative_time(m->time);
+        changed = true;
+    }
+    return changed;
+}
+
+Node PostView::render_time()
+{
+    update_time_cache();
+    auto& c = time_cache;
+    Node n("time", { { "title", options.relative_time ? c.abs : c.rel } },
+        options.relative_time ? c.rel : c.abs);
 
-    return Node("time",
-        { { "title", options.relative_time ? abs.str() : rel } },
-        options.relative_time ? rel : abs.str());
+    // The header is stringified, so the element needs a fixed handle to be
+    // patched separately
+    if (!time_handle) {
+        time_handle = brunhild::new_handle();
+    }
+    n.handle = time_handle;
+    return n;
+}
+
+void PostView::refresh_time()
+{
+    if (deferred || !time_handle || !(m = get_model())
+        || !update_time_cache()) {
+        return;
+    }
+    auto& c = time_cache;
+    brunhild::set_inner_html(
+        time_handle, options.relative_time ? c.rel : c.abs);
+    brunhild::set_attr(
+        time_handle, "title", options.relative_time ? c.abs : c.rel);
 }
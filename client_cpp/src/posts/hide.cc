@@ -1,57 +1,76 @@
+#include "../db.hh"
 #include "../options/options.hh"
 #include "../state.hh"
 #include "models.hh"
-#include <optional>
-#include <unordered_set>
+#include <vector>
 
-// Recursively gather links of posts linking to the parent post
-static void recurse_backlinks(
-    const std::map<unsigned long, LinkData>& backlinks,
-    std::optional<std::unordered_set<unsigned long>>& to_hide)
+// Hide all posts linking to the posts in queue, recursively, by walking the
+// backlink graph. Each loaded post is visited at most once. Returns the posts,
+// that were not hidden before.
+static std::vector<Post*> propagate_hidden(std::vector<unsigned long> queue)
 {
-    for (auto & [ id, _ ] : backlinks) {
-        // Skip posts already marked as hidden. Those will have or have already
-        // had posts linking them marked recursively by other calls
-        if (!post_ids.hidden.count(id) && posts.count(id)) {
-            post_ids.hidden.insert(id);
-            if (to_hide) {
-                to_hide->insert(id);
+    std::vector<bool> visited(posts.slot_count());
+    for (auto id : queue) {
+        if (const auto h = posts.handle(id); h != PostStore::none) {
+            visited[h] = true;
+        }
+    }
+
+    std::vector<Post*> changed;
+    while (queue.size()) {
+        const auto id = queue.back();
+        queue.pop_back();
+        for (auto& [linker, _] : link_graph.backlinks(id)) {
+            const auto h = posts.handle(linker);
+            if (h == PostStore::none || visited[h]) {
+                continue;
+            }
+            visited[h] = true;
+            if (post_ids.hidden.insert(linker)) {
+                changed.push_back(posts.get(h));
             }
-            recurse_backlinks(posts.at(id).backlinks, to_hide);
+            queue.push_back(linker);
         }
     }
+    return changed;
 }
 
 void recurse_hidden_posts()
 {
-    std::optional<std::unordered_set<unsigned long>> to_hide;
-    const bool recurse = options.hide_recursively;
-    for (auto const & [ id, p ] : posts) {
+    if (!options.hide_recursively) {
+        return;
+    }
+    std::vector<unsigned long> hidden;
+    for (auto const & [ id, _ ] : posts) {
         if (post_ids.hidden.count(id)) {
-            if (recurse) {
-                recurse_backlinks(p.backlinks, to_hide);
-            }
+            hidden.push_back(id);
         }
     }
+    propagate_hidden(std::move(hidden));
 }
 
 void hide_recursively(Post& post)
 {
-    std::optional<std::unordered_set<unsigned long>> to_hide = { { {} } };
     post_ids.hidden.insert(post.id);
-    if (options.hide_recursively) {
-        recurse_backlinks(post.backlinks, to_hide);
-    } else {
-        // Still patch all links to this post
-        for (auto & [ id, _ ] : posts) {
-            to_hide->insert(id);
+    post.patch();
+
+    // Posts linking this post need to rerender their links, even if they are
+    // not hidden themselves
+    for (auto& [id, _] : link_graph.backlinks(post.id)) {
+        if (auto p = posts.find(id); p) {
+            p->patch();
         }
     }
 
-    post.patch();
-    for (auto id : *to_hide) {
-        if (posts.count(id)) {
-            posts.at(id).patch();
+    if (options.hide_recursively) {
+        for (auto p : propagate_hidden({ post.id })) {
+            p->patch();
         }
     }
 }
+
+void hide_post(Post& post)
+{
+    store_post_id(StorageType::hidden, post.id, post.op);
+    hide_recursively(post);
+}
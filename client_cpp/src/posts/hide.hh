@@ -10,3 +10,7 @@ void recurse_hidden_posts();
 // Hide all posts that reply to post recursively, if enabled. Otherwise just
 // hide this one post.
 void hide_recursively(Post& post);
+
+// Hide a post by user request and persist it to the database. Posts hidden
+// recursively are not persisted.
+void hide_post(Post& post);
@@ -31,9 +31,9 @@ Node PostView::render_figcaption()
             "a",
             {
                 { "class", "image-toggle act" },
-                { "data-id", std::to_string(m->id) },
+                { "data-id", m->id },
             },
-            lang.posts.at(reveal_thumbnail ? "hide" : "show"),
+            lang.posts[reveal_thumbnail ? PostsKey::hide : PostsKey::show],
         });
     }
     if (img.thumb_type != FileType::no_file && img.file_type != FileType::pdf) {
@@ -199,7 +199,9 @@ Node PostView::render_file_info()
 }
 
 // Render unexpanded file thumbnail image
-static Node render_thumbnail(const Image& img)
+// Render a thumbnail image.
+// eager: thumbnail is expected to be in the viewport on load
+static Node render_thumbnail(const Image& img, bool eager = false)
 {
     string thumb;
     uint16_t h, w;
@@ -228,14 +230,24 @@ static Node render_thumbnail(const Image& img)
         h = img.dims[3];
     }
 
-    return {
+    Node n = {
         "img",
         {
             { "src", thumb },
-            { "width", std::to_string(w) },
-            { "height", std::to_string(h) },
+            { "width", w },
+            { "height", h },
         },
     };
+
+    // Let the browser fetch thumbnails by distance to the viewport and decode
+    // them off the main thread
+    n.attrs["decoding"] = "async";
+    if (eager) {
+        n.attrs["fetchpriority"] = "high";
+    } else if (options.lazy_thumbnails) {
+        n.attrs["loading"] = "lazy";
+    }
+    return n;
 }
 
 // Format audio volume option setter to string
@@ -244,9 +256,10 @@ static string format_volume_setter()
     return "this.volume=" + std::to_string((float)options.audio_volume / 100);
 }
 
-// Render expanded file image, video or audio
+// Render expanded file image, video or audio.
+// stream: leave loading the source image to the batch expansion loader
 static void render_expanded(
-    const Image& img, Node& inner, optional<Node>& audio)
+    const Image& img, Node& inner, optional<Node>& audio, bool stream)
 {
     const auto src = img.source_path();
 
@@ -273,7 +286,7 @@ static void render_expanded(
                 },
             },
         };
-        inner = render_thumbnail(img);
+        inner = render_thumbnail(img, true);
         return;
     case FileType::webm:
     render_video:
@@ -294,7 +307,15 @@ static void render_expanded(
     inner.attrs["class"] = options.inline_fit == Options::FittingMode::width
         ? "fit-to-width"
         : "fit-to-screen";
-    inner.attrs["src"] = src;
+    if (stream && inner.tag == brunhild::Tag("img")) {
+        // Show the thumbnail upscaled, until the source is loaded
+        if (img.thumb_type != FileType::no_file && !img.spoiler) {
+            inner.attrs["src"] = img.thumb_path();
+        }
+        inner.attrs["data-src"] = src;
+    } else {
+        inner.attrs["src"] = src;
+    }
 }
 
 std::tuple<Node, optional<Node>> PostView::render_image()
@@ -304,12 +325,13 @@ std::tuple<Node, optional<Node>> PostView::render_image()
     optional<Node> audio;
 
     if (expanded) {
-        render_expanded(img, inner, audio);
+        render_expanded(img, inner, audio, stream_source);
     } else {
-        inner = render_thumbnail(img);
+        // The post linked to by the URL is scrolled to on load
+        inner = render_thumbnail(img, m->id == page.post);
     }
 
-    const string id_str = std::to_string(m->id);
+    const string id_str = brunhild::int_to_string(m->id);
     inner.attrs["data-id"] = id_str;
     Node n({
         "figure",
@@ -327,9 +349,144 @@ std::tuple<Node, optional<Node>> PostView::render_image()
         },
     });
     n.stringify_subtree();
+
+    // Allows patching the figure separately on batch expansion
+    if (!figure_handle) {
+        figure_handle = brunhild::new_handle();
+    }
+    n.handle = figure_handle;
     return { n, audio };
 }
 
+// Find a node in a subtree by its element handle
+static Node* find_node(Node& n, brunhild::Handle h)
+{
+    if (n.handle == h) {
+        return &n;
+    }
+    for (auto& ch : n.children) {
+        if (auto found = find_node(ch, h)) {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+void PostView::patch_figure()
+{
+    if (!(m = get_model()) || !m->image) {
+        return;
+    }
+    auto old = figure_handle && !deferred ? find_node(saved, figure_handle)
+                                          : nullptr;
+    if (!old) {
+        // Rendered later, so the batch loader would miss the source
+        stream_source = false;
+        if (!deferred) {
+            patch();
+        }
+        return;
+    }
+
+    // Keep the saved tree in sync, so the next full patch does not redundantly
+    // set the figure again
+    brunhild::RenderScope scope;
+    auto [figure, _] = render_image();
+    if (old->inner_html != figure.inner_html) {
+        old->inner_html = std::move(figure.inner_html);
+        brunhild::set_inner_html(figure_handle, *old->inner_html);
+    }
+}
+
+// Returns, if the image is expanded by the [Expand Images] toggle
+static bool is_batch_expandable(const Image& img)
+{
+    switch (img.file_type) {
+    case FileType::jpg:
+    case FileType::png:
+    case FileType::gif:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void toggle_expand_all(emscripten::val& event)
+{
+    static bool expand_all = false;
+    expand_all = !expand_all;
+
+    for (auto && [ id, p ] : posts) {
+        if (!p.image || !is_batch_expandable(*p.image)) {
+            continue;
+        }
+        for (auto& v : p.views) {
+            if (v->expanded != expand_all) {
+                v->expanded = expand_all;
+                v->stream_source = expand_all;
+                v->patch_figure();
+            }
+        }
+    }
+
+    const auto& text = lang.posts[expand_all ? PostsKey::contractImages
+                                             : PostsKey::expandImages];
+    brunhild::set_inner_html("expand-images", "<a>" + text + "</a>");
+    if (!expand_all) {
+        return;
+    }
+
+    // Load expanded sources in order of distance to the viewport with a
+    // concurrency limit. Runs after the DOM mutations are flushed on this
+    // animation frame.
+    EM_ASM({
+        requestAnimationFrame(function() {
+            var s = window.__expand_stream;
+            if (!s) {
+                s = window.__expand_stream = ({ queue : [], active : 0 });
+            }
+            var h = window.innerHeight;
+            var dist = new Map();
+            var els = document.querySelectorAll('figure img[data-src]');
+            for (var i = 0; i < els.length; i++) {
+                var r = els[i].getBoundingClientRect();
+                dist.set(els[i],
+                    r.bottom < 0 ? -r.bottom : Math.max(r.top - h, 0));
+            }
+            s.queue = Array.prototype.slice.call(els);
+            s.queue.sort(function(a, b) { return dist.get(a) - dist.get(b); });
+
+            function next()
+            {
+                while (s.active < 4 && s.queue.length) {
+                    load(s.queue.shift());
+                }
+            }
+
+            function load(el)
+            {
+                var src = el.getAttribute('data-src');
+                if (!src || !el.isConnected) {
+                    return; // Collapsed or removed since
+                }
+                s.active++;
+                var img = new Image();
+                img.onload = img.onerror = function() {
+                    s.active--;
+                    if (el.getAttribute('data-src') == src) {
+                        el.src = src;
+                        el.removeAttribute('data-src');
+                    }
+                    next();
+                };
+                img.src = src;
+            }
+
+            next();
+        });
+    });
+}
+
 // Match view with image or return
 #define MATCH_WITH_IMAGE(event)                                                \
     auto res = match_view(event);                                              \
@@ -372,11 +529,12 @@ void handle_image_click(emscripten::val& event)
     }
 
     view->expanded = !view->expanded;
+    view->stream_source = false;
     if (options.inline_fit == Options::FittingMode::width
         && !options.gallery_mode_toggle
         && img.dims[1]
             > emscripten::val::global("window")["innerHeight"].as<unsigned>()) {
-        brunhild::scroll_into_view(view->id);
+        brunhild::scroll_into_view(view->handle);
     }
     view->patch();
 }
@@ -7,3 +7,7 @@ void handle_image_click(emscripten::val&);
 
 // Reveal/hide thumbnail by clicking [Show]/[Hide] in hidden thumbnail mode
 void toggle_hidden_thumbnail(emscripten::val&);
+
+// Expand or contract all images on [Expand Images] click. Only the figures of
+// affected posts are patched and the sources are loaded a few at a time.
+void toggle_expand_all(emscripten::val&);
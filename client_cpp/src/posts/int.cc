@@ -1,12 +1,42 @@
 #include "../../brunhild/events.hh"
+#include "../state.hh"
+#include "../timers.hh"
 #include "image.hh"
+#include "preview.hh"
+#include "retention.hh"
+#include "search.hh"
+#include "seen.hh"
+#include "view.hh"
+#include <ctime>
 #include <emscripten.h>
 
 using brunhild::register_handler;
 
+// Patch relative timestamps of all rendered posts, that changed since the
+// last tick. Relative timestamps have a resolution of one minute at best, so
+// this runs at the start of each minute.
+static void refresh_relative_times(uint64_t)
+{
+    if (!EM_ASM_INT({ return document.hidden ? 1 : 0; })) {
+        for (auto && [ id, p ] : posts) {
+            for (auto& v : p.views) {
+                v->refresh_time();
+            }
+        }
+    }
+    schedule((std::time(0) / 60 + 1) * 60, &refresh_relative_times);
+}
+
 void init_posts()
 {
     register_handler(
         "click", &handle_image_click, "figure img, figure video, figure a");
     register_handler("click", &toggle_hidden_thumbnail, ".image-toggle");
+    register_handler("click", &toggle_expand_all, "#expand-images a");
+    register_handler("mouseover", &show_link_preview, "a.post-link");
+    register_handler("mouseout", &hide_link_preview, "a.post-link");
+    schedule((std::time(0) / 60 + 1) * 60, &refresh_relative_times);
+    init_retention();
+    init_seen();
+    init_search();
 }
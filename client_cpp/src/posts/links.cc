@@ -0,0 +1,34 @@
+#include "links.hh"
+#include "../state.hh"
+#include <algorithm>
+
+void LinkGraph::add(const Post& p)
+{
+    for (auto&& [target_id, _] : p.links) {
+        auto& bl = index[target_id];
+
+        // Linking posts mostly arrive in ascending ID order
+        auto it = bl.end();
+        if (bl.size() && bl.back().first >= p.id) {
+            it = std::lower_bound(bl.begin(), bl.end(), p.id,
+                [](auto& b, unsigned long id) { return b.first < id; });
+        }
+        if (it != bl.end() && it->first == p.id) {
+            continue;
+        }
+        bl.insert(it, { p.id, { false, p.op, p.board } });
+
+        if (auto target = posts.find(target_id); target) {
+            target->patch();
+        }
+    }
+}
+
+const Backlinks& LinkGraph::backlinks(unsigned long id) const
+{
+    static const Backlinks none;
+    if (auto it = index.find(id); it != index.end()) {
+        return it->second;
+    }
+    return none;
+}
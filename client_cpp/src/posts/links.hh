@@ -0,0 +1,28 @@
+#pragma once
+
+#include "models.hh"
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Posts linking to a post, sorted by ID of the linking post
+typedef std::vector<std::pair<unsigned long, LinkData>> Backlinks;
+
+// Inverse index of links between posts. Backlinks are registered as soon as
+// the linking post is known, independent of the linked post being loaded, so
+// the index is built in the same pass posts are decoded in.
+class LinkGraph {
+public:
+    // Register all links of a post as backlinks of the linked posts and
+    // schedule patches of any loaded linked posts
+    void add(const Post&);
+
+    // Returns backlinks of a post by ID
+    const Backlinks& backlinks(unsigned long id) const;
+
+    // Remove all backlinks
+    void clear() { index.clear(); }
+
+private:
+    std::unordered_map<unsigned long, Backlinks> index;
+};
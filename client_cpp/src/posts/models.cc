@@ -22,6 +22,12 @@ using std::string;
         key = j.at(#key).get<string>();                                        \
     }
 
+// Same as parse_opt, but interns the string as an Atom
+#define PARSE_OPT_ATOM(key)                                                    \
+    if (j.count(#key)) {                                                       \
+        key = Atom(j.at(#key).get<string>());                                  \
+    }
+
 Image::Image(nlohmann::json& j)
 {
     PARSE_OPT(audio);
@@ -83,6 +89,72 @@ Command::Command(nlohmann::json& j)
     }
 }
 
+Image::Image(SnapshotReader& r)
+{
+    const uint8_t flags = r.byte();
+    audio = flags & image_audio;
+    video = flags & image_video;
+    spoiler = flags & image_spoiler;
+    file_type = static_cast<FileType>(r.byte());
+    thumb_type = static_cast<FileType>(r.byte());
+    for (auto& d : dims) {
+        d = r.varint();
+    }
+    length = r.varint();
+    size = r.varint();
+    if (flags & image_has_artist) {
+        artist = string(r.string());
+    }
+    if (flags & image_has_title) {
+        title = string(r.string());
+    }
+    md5 = r.string();
+    sha1 = r.string();
+    name = r.string();
+}
+
+Command::Command(SnapshotReader& r)
+{
+    typ = static_cast<Type>(r.byte());
+    switch (typ) {
+    case Type::flip:
+        val = bool(r.byte());
+        break;
+    case Type::eight_ball:
+        eight_ball = r.string_ref().value_or("");
+        break;
+    case Type::pyu:
+    case Type::pcount:
+    case Type::rcount:
+        val = (unsigned long)(r.varint());
+        break;
+    case Type::sync_watch: {
+        std::array<unsigned long, 5> arr;
+        for (auto& v : arr) {
+            v = r.varint();
+        }
+        val = arr;
+    } break;
+    case Type::dice: {
+        std::array<uint16_t, 10> arr = { { 0 } };
+        const auto size = r.varint();
+        if (size > arr.size()) {
+            r.fail();
+            break;
+        }
+        for (unsigned i = 0; i < size; i++) {
+            arr[i] = r.varint();
+        }
+        val = arr;
+    } break;
+    case Type::roulette:
+        val = std::array<uint8_t, 2>({ { r.byte(), r.byte() } });
+        break;
+    default:
+        r.fail();
+    }
+}
+
 string Image::image_root() const
 {
     if (config.image_root_override != "") {
@@ -109,6 +181,7 @@ string Image::source_path() const
 
 void Post::extend(nlohmann::json& j)
 {
+    touch(all_sections);
     PARSE_OPT(editing);
     PARSE_OPT(deleted);
     PARSE_OPT(sage);
@@ -120,33 +193,82 @@ void Post::extend(nlohmann::json& j)
     PARSE_OPT(op);
     time = j["time"];
 
-    body = j["body"];
-    PARSE_OPT(board);
+    body = j["body"].get<std::string>();
+    PARSE_OPT_ATOM(board);
     PARSE_OPT_STRING(name);
     PARSE_OPT_STRING(trip);
-    PARSE_OPT_STRING(auth);
-    PARSE_OPT_STRING(flag);
+    PARSE_OPT_ATOM(auth);
+    PARSE_OPT_ATOM(flag);
 
-    if (j.count("image")) {
+    // The server encodes posts without an image with a null image
+    if (j.count("image") && !j["image"].is_null()) {
         image = Image(j["image"]);
     }
     parse_commands(j);
     parse_links(j);
 }
 
+Post::Post(SnapshotReader& r)
+{
+    touch(all_sections);
+    const uint8_t flags = r.byte();
+    editing = flags & post_editing;
+    deleted = flags & post_deleted;
+    sage = flags & post_sage;
+    banned = flags & post_banned;
+
+    id = r.post_id();
+    time = r.varint();
+    name = r.string_ref();
+    trip = r.string_ref();
+    auth = r.atom_ref();
+    flag = r.atom_ref();
+    poster_id = r.string_ref();
+    body = r.string();
+
+    const auto link_count = r.varint();
+    if (link_count > r.remaining()) {
+        r.fail();
+        return;
+    }
+    links.reserve(link_count);
+    for (uint64_t i = 0; i < link_count && r.ok(); i++) {
+        const unsigned long id = r.varint();
+        const unsigned long op = r.varint();
+        links[id] = { false, op, r.atom_ref().value_or(Atom()) };
+    }
+
+    const auto command_count = r.varint();
+    if (command_count > r.remaining()) {
+        r.fail();
+        return;
+    }
+    commands.reserve(command_count);
+    for (uint64_t i = 0; i < command_count && r.ok(); i++) {
+        commands.push_back(Command(r));
+    }
+
+    if (flags & post_has_image) {
+        image = Image(r);
+    }
+}
+
 void Post::parse_links(nlohmann::json& j)
 {
+    touch(body_section);
     if (j.count("links")) {
         auto& l = j["links"];
         links.reserve(l.size());
         for (auto& val : l) {
-            links[val["id"]] = { false, val["op"], val["board"] };
+            links[val["id"]]
+                = { false, val["op"], Atom(val["board"].get<string>()) };
         }
     }
 }
 
 void Post::parse_commands(nlohmann::json& j)
 {
+    touch(body_section);
     if (j.count("commands")) {
         auto& c = j["commands"];
         commands.clear(); // Not to duplicate existing entries
@@ -162,12 +284,8 @@ void Post::propagate_links()
 
     // TODO: Notify about replies, if this post links to one of the user's posts
 
+    link_graph.add(*this);
     for (auto&& [id, _] : links) {
-        if (posts.count(id)) {
-            auto& target = posts.at(id);
-            target.backlinks[this->id] = LinkData { false, op, board };
-            target.patch();
-        }
         if (post_ids.hidden.count(id)) {
             hide_recursively(*this);
         }
@@ -177,12 +295,28 @@ void Post::propagate_links()
 void Post::patch()
 {
     for (auto& v : views) {
-        v->patch();
+        v->schedule_patch();
     }
 }
 
 void Post::close()
 {
     editing = false;
+    touch(body_section);
     patch();
 }
+
+void Post::touch(unsigned sections)
+{
+    static unsigned counter = 0;
+    source_hash = 0;
+    if (sections & header_section) {
+        versions.header = ++counter;
+    }
+    if (sections & image_section) {
+        versions.image = ++counter;
+    }
+    if (sections & body_section) {
+        versions.body = ++counter;
+    }
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "../atom.hh"
+#include "../snapshot.hh"
+#include "text.hh"
 #include <array>
 #include <functional>
 #include <map>
@@ -72,6 +75,9 @@ struct Image {
     // Parse from JSON
     Image(nlohmann::json&);
 
+    // Decode from binary snapshot
+    Image(SnapshotReader&);
+
     // Returns the path to this files's thumbnail
     std::string thumb_path() const;
 
@@ -104,8 +110,22 @@ public:
         val;
     std::string eight_ball; // Result of #8ball command
 
+    // Render-ready text and formatting class of the command
+    struct Rendered {
+        std::string source, // Body word the command was matched against
+            text; // Command and its result as displayed
+        const char* cls;
+    };
+
+    // Set on the first render of the command. The words of a closed post
+    // never change, so following renders only compare the source word.
+    std::optional<Rendered> rendered;
+
     // Parse from JSON
     Command(nlohmann::json&);
+
+    // Decode from binary snapshot
+    Command(SnapshotReader&);
 };
 
 // Data associated with link to another post. Is always pared in a map with
@@ -117,11 +137,21 @@ struct LinkData {
     // Parent thread ID of the post
     unsigned long op;
     // Parent board id
-    std::string board;
+    Atom board;
 };
 
 class PostView;
 
+// Word of a closed post's body, that the body parser resolved to a post link,
+// reference or URL. Words without a token are plain text or hash commands.
+struct BodyToken {
+    enum class Type : uint8_t { post_link, reference, url, embed } type;
+    uint8_t gts; // Extra '>' preceding a post link or reference
+    uint32_t offset; // Byte offset of the word in the body
+    unsigned long id; // ID of the linked post or the embed Provider
+    Atom href; // Target URL of a reference
+};
+
 // Generic post model
 struct Post {
     // Post is currrently being edited
@@ -149,40 +179,68 @@ struct Post {
 
     time_t time;
 
-    std::string body, board;
+    PostBody body;
+    Atom board;
 
     std::optional<std::string> name, // Name of poster
         trip, // Trip code of poster
-        auth, // Staff title of poster
-        flag, // Country code of poster
         poster_id; // Thread-level poster ID
+    std::optional<Atom> auth, // Staff title of poster
+        flag; // Country code of poster
 
     std::vector<Command> commands; // Results of hash commands
 
-    // Posts linking to this post. Backlinks need to be sorted, thus std::map.
-    std::map<unsigned long, LinkData> backlinks;
-
     std::unordered_map<unsigned long, LinkData>
         links; // Posts linked by this post
 
+    // Tokens of the closed body in order of offset, produced by the first
+    // render after closing. Valid, while body_tokens_key matches the current
+    // key. See PostView::parse_fragment().
+    std::vector<BodyToken> body_tokens;
+    uint64_t body_tokens_key = 0;
+
     // Views associated to this post. There can be multiple, because of various
     // previews and such.
     std::vector<std::shared_ptr<PostView>> views;
 
+    // Sections of a post, that views memoize separately
+    enum Section : unsigned {
+        header_section = 1,
+        image_section = 1 << 1,
+        body_section = 1 << 2,
+        all_sections = header_section | image_section | body_section,
+    };
+
+    // Versions of the data rendered in each section. Drawn from a global
+    // counter, so replacing a post with a new one also invalidates any
+    // sections memoized by views of the old one.
+    struct Versions {
+        unsigned header = 0, image = 0, body = 0;
+    } versions;
+
+    // Hash of the sync data the post was decoded from or 0, if the post has
+    // been modified since. Lets resyncs skip posts, that did not change.
+    uint64_t source_hash = 0;
+
     Post() = default;
 
     // Parse from JSON
     Post(nlohmann::json& j) { extend(j); }
 
+    // Decode from binary snapshot. Board and parent thread are set by the
+    // caller.
+    Post(SnapshotReader&);
+
     // Extend post data by parsing new values from JSON
     void extend(nlohmann::json&);
 
-    // Patches all views associated with this post
+    // Schedules a patch of all views associated with this post on the next
+    // animation frame
     void patch();
 
     // Check if this post replied to one of the user's posts and trigger
     // handlers.
-    // Set and render backlinks on any linked posts.
+    // Register backlinks on any linked posts and schedule their patches.
     void propagate_links();
 
     // Parse link data from JSON
@@ -193,6 +251,10 @@ struct Post {
 
     // Close a post being edited
     void close();
+
+    // Assign new versions to the changed sections and reset source_hash. Must
+    // be called after modifying post data, that is rendered in a section.
+    void touch(unsigned sections);
 };
 
 #include "view.hh"
@@ -208,6 +270,6 @@ struct Thread {
         image_ctr, // Number of images in thread
         reply_time, // Unix timestamp of last reply
         bump_time; // Unix timestamp of last bump
-    std::string board, // Parent board
-        subject; // Thread subject
+    Atom board; // Parent board
+    std::string subject; // Thread subject
 };
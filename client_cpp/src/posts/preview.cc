@@ -0,0 +1,123 @@
+#include "preview.hh"
+#include "../state.hh"
+#include "view.hh"
+#include <list>
+#include <stdint.h>
+
+using emscripten::val;
+
+// Maximum number of cached previews
+static const size_t max_previews = 64;
+
+struct Preview {
+    unsigned long id;
+
+    // Post section versions, backlink count and rendering state the HTML was
+    // rendered with
+    Post::Versions versions;
+    size_t backlinks;
+    uint64_t epoch;
+
+    std::string html;
+};
+
+// Cached previews ordered from most to least recently used
+static std::list<Preview> previews;
+
+const std::string* preview_html(unsigned long id)
+{
+    auto p = posts.find(id);
+    if (!p) {
+        return nullptr;
+    }
+    const auto& v = p->versions;
+    const size_t backlinks = link_graph.backlinks(id).size();
+    const uint64_t epoch = render_epoch();
+
+    for (auto it = previews.begin(); it != previews.end(); ++it) {
+        if (it->id != id) {
+            continue;
+        }
+        previews.splice(previews.begin(), previews, it);
+        auto& c = previews.front();
+        if (c.versions.header == v.header && c.versions.image == v.image
+            && c.versions.body == v.body && c.backlinks == backlinks
+            && c.epoch == epoch) {
+            return &c.html;
+        }
+        previews.pop_front();
+        break;
+    }
+
+    // Render with a transient view, that is never inserted into the DOM and
+    // thus never patched
+    PostView view(id);
+    brunhild::Rope s;
+    auto n = static_cast<brunhild::VirtualView&>(view).render();
+    n.attrs["class"] += " preview";
+    n.write_html(s);
+
+    previews.push_front({ id, v, backlinks, epoch, s.take() });
+    if (previews.size() > max_previews) {
+        previews.pop_back();
+    }
+    return &previews.front().html;
+}
+
+// Extract the target post ID from the href of a post link
+static unsigned long link_target(val& link)
+{
+    const auto href = link.call<std::string>("getAttribute", val("href"));
+    const auto i = href.rfind("#p");
+    if (i == std::string::npos) {
+        return 0;
+    }
+    unsigned long id = 0;
+    for (auto it = href.begin() + i + 2; it != href.end(); ++it) {
+        if (*it < '0' || *it > '9') {
+            return 0;
+        }
+        id = id * 10 + (*it - '0');
+    }
+    return id;
+}
+
+void show_link_preview(val& event)
+{
+    auto link = event["target"];
+    const auto html = preview_html(link_target(link));
+    if (!html) {
+        return;
+    }
+    auto overlay = val::global("document").call<val>(
+        "getElementById", val("hover-overlay"));
+    if (overlay.isNull()) {
+        return;
+    }
+    overlay.set("innerHTML", *html);
+    auto el = overlay["firstElementChild"];
+    if (el.isNull()) {
+        return;
+    }
+
+    // Position above the link or below it, if cut off at the top. The left
+    // offset must be set first, as it affects the height of the preview.
+    auto rect = link.call<val>("getBoundingClientRect");
+    auto style = el["style"];
+    style.set("left", std::to_string(rect["left"].as<double>()) + "px");
+    const double height = el["offsetHeight"].as<double>();
+    double top = rect["top"].as<double>() - height - 5;
+    if (top < 0) {
+        top += height + 23;
+    }
+    style.set("top", std::to_string(top) + "px");
+}
+
+void hide_link_preview(val& event)
+{
+    auto overlay = val::global("document").call<val>(
+        "getElementById", val("hover-overlay"));
+    if (!overlay.isNull()) {
+        overlay.set("innerHTML", val(""));
+    }
+}
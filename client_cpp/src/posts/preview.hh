@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../../brunhild/events.hh"
+#include <string>
+
+// Returns the rendered HTML of a post for previews or nullptr, if the post is
+// not loaded. The HTML is cached per post and rendered anew only after any of
+// the post's sections or the global rendering state change.
+const std::string* preview_html(unsigned long id);
+
+// Show a preview of the linked post over a hovered post link
+void show_link_preview(emscripten::val& event);
+
+// Remove any post link preview, when the cursor leaves the link
+void hide_link_preview(emscripten::val& event);
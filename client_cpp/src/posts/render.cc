@@ -1,3 +1,4 @@
+#include "../../brunhild/profile.hh"
 #include "../lang.hh"
 #include "../options/options.hh"
 #include "../state.hh"
@@ -17,14 +18,10 @@ static optional<Node> render_omitted(unsigned long id, std::string board)
     }
     auto const& t = threads.at(id);
 
-    // Collect all posts for this thread
-    std::vector<Post*> owned;
-    owned.reserve(32);
-    for (auto & [ _, p ] : posts) {
-        if (p.op == id) {
-            owned.push_back(&p);
-        }
-    }
+    // All loaded posts of this thread
+    static const std::vector<Post*> none;
+    auto it = thread_posts.find(id);
+    auto const& owned = it != thread_posts.end() ? it->second : none;
 
     // Calculate omitted posts and images
     long omit = long(t.post_ctr) - owned.size();
@@ -41,26 +38,80 @@ static optional<Node> render_omitted(unsigned long id, std::string board)
     }
 
     std::ostringstream s;
-    s << pluralize(omit, "post") << ' ' << lang.posts.at("and") << ' '
-      << pluralize(image_omit, "image") << ' ' << lang.posts.at("omitted");
+    s << pluralize(omit, PluralKey::post) << ' ' << lang.posts[PostsKey::and_]
+      << ' ' << pluralize(image_omit, PluralKey::image) << ' '
+      << lang.posts[PostsKey::omitted];
     return {
         {
             "span", { { "class", "omit spaced" } },
             // Disambiguate constructor
             brunhild::Children({
                 { "span", s.str() },
-                render_button(
-                    absolute_thread_url(id, board), lang.posts.at("seeAll")),
+                render_button(absolute_thread_url(id, board),
+                    lang.posts[PostsKey::seeAll]),
             }),
         },
     };
 }
 
+uint64_t render_epoch()
+{
+    uint64_t h = lang.generation;
+    for (uint64_t v : { uint64_t(page.thread), uint64_t(page.catalog),
+             uint64_t(post_ids.mine.size()), uint64_t(post_ids.hidden.size()),
+             uint64_t(board_config.rb_text) }) {
+        h = h * 1000003 ^ v;
+    }
+    return h;
+}
+
+template <class F> Node PostView::memoize(Memo& memo, unsigned version, F fn)
+{
+    const auto epoch = render_epoch();
+    if (version && memo.version == version && memo.epoch == epoch) {
+        return memo.node;
+    }
+    Node n = fn();
+    if (version) {
+        memo.version = version;
+        memo.epoch = epoch;
+        memo.node = n;
+        memo.node.adopt();
+    }
+    return n;
+}
+
+Node PostView::render_placeholder()
+{
+    // Rough line count of the body, assuming ~80 characters per line
+    unsigned lines = 1 + m->body.size() / 80;
+    for (char ch : m->body) {
+        if (ch == '\n') {
+            lines++;
+        }
+    }
+    unsigned height = lines * 20;
+    if (m->image && height < m->image->dims[3]) {
+        height = m->image->dims[3]; // Thumbnail height
+    }
+    height += 40; // Header and padding
+
+    const auto style = "height: " + brunhild::int_to_string(height) + "px;";
+    return { "article",
+        { { "class", "glass placeholder" }, { "style", style } } };
+}
+
 Node PostView::render(Post* m)
 {
+    static brunhild::profile::Metric metric("render");
+    brunhild::profile::Scope scope(metric);
+
     if (post_ids.hidden.count(m->id)) {
         return { "article", { { "hidden", "" } } };
     }
+    if (deferred) {
+        return render_placeholder();
+    }
 
     Node n = { "article", { { "class", "glass" } } };
     n.children.reserve(4);
@@ -75,12 +126,20 @@ Node PostView::render(Post* m)
         n.attrs["class"] += " deleted";
         n.children.push_back(delete_toggle);
     }
-    n.children.push_back(render_header());
+    n.children.push_back(
+        memoize(header_memo, m->versions.header, [this]() {
+            return render_header();
+        }));
 
     brunhild::Children pc_ch;
     pc_ch.reserve(2);
     if (m->image) {
-        n.children.push_back(render_figcaption());
+        n.children.push_back(
+            memoize(figcaption_memo, m->versions.image, [this]() {
+                auto n = render_figcaption();
+                n.stringify_subtree();
+                return n;
+            }));
         if ((!options.hide_thumbs && !options.work_mode_toggle)
             || reveal_thumbnail) {
             auto[figure, audio] = render_image();
@@ -92,10 +151,20 @@ Node PostView::render(Post* m)
             }
         }
     }
-    pc_ch.push_back(render_body());
+    // Open posts cache body lines themselves and inlined posts are stateful.
+    // Toggling the inlining of a link must touch the body section.
+    if (m->editing || !inlined_posts.empty()) {
+        pc_ch.push_back(render_body());
+    } else {
+        pc_ch.push_back(memoize(body_memo, m->versions.body, [this]() {
+            auto n = render_body();
+            n.stringify_subtree();
+            return n;
+        }));
+    }
     if (m->banned) {
-        n.children.push_back(
-            { "b", { { "class", "admin banned" } }, lang.posts.at("banned") });
+        n.children.push_back({ "b", { { "class", "admin banned" } },
+            lang.posts[PostsKey::banned] });
     }
     n.children.push_back({ "div", { { "class", "post-container" } }, pc_ch });
 
@@ -104,12 +173,19 @@ Node PostView::render(Post* m)
             n.children.push_back(*omit);
         }
     }
-    if (m->backlinks.size()) {
-        Node bl("span", { { "class", "backlinks" } });
-        for (auto && [ id, data ] : m->backlinks) {
-            bl.children.push_back(render_link(id, data));
-        }
-        n.children.push_back(bl);
+    // Backlinks are only ever added, so their count is their version
+    if (auto const& backlinks = link_graph.backlinks(m->id);
+        backlinks.size()) {
+        const unsigned version = inlined_posts.empty() ? backlinks.size() : 0;
+        n.children.push_back(
+            memoize(backlinks_memo, version, [this, &backlinks]() {
+                Node bl("span", { { "class", "backlinks" } });
+                for (auto && [ id, data ] : backlinks) {
+                    auto& ch = bl.children.emplace_back(render_link(id, data));
+                    ch.key = brunhild::int_to_string(id);
+                }
+                return bl;
+            }));
     }
 
     return n;
@@ -0,0 +1,106 @@
+#include "retention.hh"
+#include "../state.hh"
+#include "../timers.hh"
+#include "view.hh"
+#include <algorithm>
+#include <ctime>
+#include <emscripten.h>
+#include <memory>
+#include <vector>
+
+// Approximate memory budget of rendered post views in bytes
+static const size_t budget = 8 << 20;
+
+// Posts within this many viewport heights of the viewport are never compacted
+static const float keep_screens = 3;
+
+// Interval between retention passes in seconds
+static const time_t interval = 30;
+
+// Rendered post view and its distance from the viewport
+struct Candidate {
+    PostView* view;
+    size_t size;
+    float distance;
+};
+
+// Measure the distance of the elements of views from the viewport in viewport
+// heights with a single JS call. Elements not in the DOM get a negative
+// distance.
+static std::vector<float> measure(const std::vector<uint32_t>& handles)
+{
+    std::vector<float> dist(handles.size());
+    EM_ASM(
+        {
+            var handles = HEAPU32.subarray($0 >> 2, ($0 >> 2) + $2);
+            var out = HEAPF32.subarray($1 >> 2, ($1 >> 2) + $2);
+            var vh = window.innerHeight || 1;
+            for (var i = 0; i < $2; i++) {
+                var el = document.getElementById('bh-' + handles[i]);
+                if (!el) {
+                    out[i] = -1;
+                    continue;
+                }
+                var r = el.getBoundingClientRect();
+                if (r.bottom < 0) {
+                    out[i] = -r.bottom / vh;
+                } else if (r.top > vh) {
+                    out[i] = (r.top - vh) / vh;
+                } else {
+                    out[i] = 0;
+                }
+            }
+        },
+        handles.data(), dist.data(), handles.size());
+    return dist;
+}
+
+static void run_retention(uint64_t)
+{
+    schedule(std::time(0) + interval, &run_retention);
+
+    // Views only held by their post are no longer part of any page
+    std::vector<PostView*> views;
+    std::vector<uint32_t> handles;
+    for (auto && [ _, p ] : posts) {
+        auto& vs = p.views;
+        vs.erase(std::remove_if(vs.begin(), vs.end(),
+                     [](auto& v) { return v.use_count() == 1; }),
+            vs.end());
+        for (auto& v : vs) {
+            views.push_back(v.get());
+            handles.push_back(v->handle);
+        }
+    }
+    if (views.empty()) {
+        return;
+    }
+
+    const auto dist = measure(handles);
+    size_t total = 0;
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < views.size(); i++) {
+        const size_t size = views[i]->estimate_size();
+        total += size;
+        if (dist[i] > keep_screens) {
+            candidates.push_back({ views[i], size, dist[i] });
+        }
+    }
+    if (total <= budget) {
+        return;
+    }
+
+    // Compact the most distant posts first
+    std::sort(candidates.begin(), candidates.end(),
+        [](auto& a, auto& b) { return a.distance > b.distance; });
+    for (auto& c : candidates) {
+        if (total <= budget) {
+            break;
+        }
+        if (c.view->compact()) {
+            total -= c.size - c.view->estimate_size();
+        }
+    }
+}
+
+void init_retention() { schedule(std::time(0) + interval, &run_retention); }
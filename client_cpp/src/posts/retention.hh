@@ -0,0 +1,5 @@
+#pragma once
+
+// Periodically free post views no longer in the DOM and compact rendered posts
+// far from the viewport, while their views exceed a memory budget
+void init_retention();
@@ -0,0 +1,343 @@
+#include "search.hh"
+#include "../../brunhild/events.hh"
+#include "../page/thread.hh"
+#include "../state.hh"
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using std::string;
+using std::string_view;
+
+// Sorted IDs of posts containing an indexed value
+typedef std::vector<unsigned long> Postings;
+
+// Incrementally built search index of a single thread. Postings are only ever
+// added, so they can contain posts, that no longer match. All candidates are
+// verified against the post before being displayed.
+struct Index {
+    // Posts by trigrams of their closed lowercased bodies
+    std::unordered_map<uint32_t, Postings> trigrams;
+
+    // Posts by lowercased name, trip and poster ID
+    std::unordered_map<string, Postings> names, trips, poster_ids;
+
+    // Posts by file type of their image
+    std::unordered_map<FileType, Postings> file_types;
+
+    struct Entry {
+        Post::Versions versions;
+        bool body_indexed = false;
+    };
+
+    // Post section versions, the index was last updated with
+    std::unordered_map<unsigned long, Entry> indexed;
+
+    // Posts, that are still open, and whose bodies are not in trigrams
+    std::unordered_set<unsigned long> open;
+};
+
+// Search indexes by thread. Threads are only indexed on their first search.
+static std::unordered_map<unsigned long, Index> indexes;
+
+// Lowercase ASCII letters. Other UTF-8 bytes are matched as is.
+static string fold(string_view s)
+{
+    string out(s);
+    for (auto& c : out) {
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+    }
+    return out;
+}
+
+static uint32_t trigram(const char* s)
+{
+    return uint32_t(uint8_t(s[0])) << 16 | uint32_t(uint8_t(s[1])) << 8
+        | uint8_t(s[2]);
+}
+
+// Insert id into sorted postings. Posts are mostly indexed in ascending order,
+// so this is nearly always an append.
+static void add(Postings& p, unsigned long id)
+{
+    if (p.empty() || p.back() < id) {
+        p.push_back(id);
+        return;
+    }
+    auto it = std::lower_bound(p.begin(), p.end(), id);
+    if (it == p.end() || *it != id) {
+        p.insert(it, id);
+    }
+}
+
+static void index_body(Index& ix, unsigned long id, string_view body)
+{
+    const auto s = fold(body);
+    if (s.size() < 3) {
+        return;
+    }
+    std::vector<uint32_t> keys;
+    keys.reserve(s.size() - 2);
+    for (size_t i = 0; i + 3 <= s.size(); i++) {
+        keys.push_back(trigram(s.data() + i));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    for (auto k : keys) {
+        add(ix.trigrams[k], id);
+    }
+}
+
+// Index all sections of p, that changed since it was last indexed
+static void index_into(Index& ix, const Post& p)
+{
+    auto [it, inserted] = ix.indexed.try_emplace(p.id);
+    auto& e = it->second;
+
+    if (inserted || e.versions.header != p.versions.header) {
+        if (p.name) {
+            add(ix.names[fold(*p.name)], p.id);
+        }
+        if (p.trip) {
+            add(ix.trips[fold(*p.trip)], p.id);
+        }
+        if (p.poster_id) {
+            add(ix.poster_ids[fold(*p.poster_id)], p.id);
+        }
+    }
+    if ((inserted || e.versions.image != p.versions.image) && p.image) {
+        add(ix.file_types[p.image->file_type], p.id);
+    }
+    if (p.editing) {
+        e.body_indexed = false;
+        ix.open.insert(p.id);
+    } else if (!e.body_indexed || e.versions.body != p.versions.body) {
+        index_body(ix, p.id, p.body);
+        e.body_indexed = true;
+        ix.open.erase(p.id);
+    }
+    e.versions = p.versions;
+}
+
+void index_post(const Post& p)
+{
+    if (auto it = indexes.find(p.op); it != indexes.end()) {
+        index_into(it->second, p);
+    }
+}
+
+void clear_search_indexes() { indexes.clear(); }
+
+// Parsed search query. All terms must match.
+struct Query {
+    std::vector<string> terms; // Lowercased body substrings
+    std::optional<string> name, trip, poster_id;
+    std::optional<FileType> file_type;
+    bool invalid = false; // Contains an unknown file type
+
+    Query(string_view s)
+    {
+        const auto q = fold(s);
+        size_t i = 0;
+        while (i < q.size()) {
+            if (q[i] == ' ' || q[i] == '\t' || q[i] == '\n') {
+                i++;
+                continue;
+            }
+            auto end = q.find_first_of(" \t\n", i);
+            if (end == string::npos) {
+                end = q.size();
+            }
+            parse_term(string_view(q).substr(i, end - i));
+            i = end;
+        }
+    }
+
+    bool empty() const
+    {
+        return terms.empty() && !name && !trip && !poster_id && !file_type
+            && !invalid;
+    }
+
+    bool matches(const Post& p) const
+    {
+        if (name && (!p.name || fold(*p.name) != *name)) {
+            return false;
+        }
+        if (trip && (!p.trip || fold(*p.trip) != *trip)) {
+            return false;
+        }
+        if (poster_id && (!p.poster_id || fold(*p.poster_id) != *poster_id)) {
+            return false;
+        }
+        if (file_type && (!p.image || p.image->file_type != *file_type)) {
+            return false;
+        }
+        if (terms.size()) {
+            const auto body = fold(p.body);
+            for (auto& t : terms) {
+                if (body.find(t) == string::npos) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    void parse_term(string_view t)
+    {
+        const auto colon = t.find(':');
+        if (colon != string_view::npos && colon + 1 < t.size()) {
+            const auto key = t.substr(0, colon);
+            const string val(t.substr(colon + 1));
+            if (key == "name") {
+                name = val;
+                return;
+            } else if (key == "trip") {
+                trip = val;
+                return;
+            } else if (key == "id") {
+                poster_id = val;
+                return;
+            } else if (key == "type") {
+                for (auto & [ type, ext ] : file_extentions) {
+                    if (ext == val) {
+                        file_type = type;
+                        return;
+                    }
+                }
+                invalid = true;
+                return;
+            }
+        }
+        terms.emplace_back(t);
+    }
+};
+
+// Intersect the candidate set with postings p. A missing list matches nothing.
+static void narrow(std::optional<Postings>& cand, const Postings* p)
+{
+    if (!p) {
+        cand = Postings();
+        return;
+    }
+    if (!cand) {
+        cand = *p;
+        return;
+    }
+    Postings out;
+    std::set_intersection(cand->begin(), cand->end(), p->begin(), p->end(),
+        std::back_inserter(out));
+    *cand = std::move(out);
+}
+
+template <class K>
+static const Postings* lookup(
+    const std::unordered_map<K, Postings>& m, const K& key)
+{
+    auto it = m.find(key);
+    return it != m.end() ? &it->second : nullptr;
+}
+
+// Returns IDs of all posts of the thread matching q
+static std::unordered_set<unsigned long> run(
+    Index& ix, unsigned long thread, const Query& q)
+{
+    std::unordered_set<unsigned long> matched;
+    if (q.invalid) {
+        return matched;
+    }
+
+    std::optional<Postings> cand;
+    if (q.name) {
+        narrow(cand, lookup(ix.names, *q.name));
+    }
+    if (q.trip) {
+        narrow(cand, lookup(ix.trips, *q.trip));
+    }
+    if (q.poster_id) {
+        narrow(cand, lookup(ix.poster_ids, *q.poster_id));
+    }
+    if (q.file_type) {
+        narrow(cand, lookup(ix.file_types, *q.file_type));
+    }
+
+    // Terms shorter than a trigram are only verified
+    bool by_body = false;
+    for (auto& t : q.terms) {
+        for (size_t i = 0; i + 3 <= t.size(); i++) {
+            by_body = true;
+            narrow(cand, lookup(ix.trigrams, trigram(t.data() + i)));
+            if (cand->empty()) {
+                break;
+            }
+        }
+    }
+    if (by_body) {
+        // Bodies of open posts are not indexed
+        cand->insert(cand->end(), ix.open.begin(), ix.open.end());
+    }
+
+    if (cand) {
+        for (auto id : *cand) {
+            auto p = posts.find(id);
+            if (p && p->op == thread && q.matches(*p)) {
+                matched.insert(id);
+            }
+        }
+    } else {
+        for (auto p : thread_posts[thread]) {
+            if (q.matches(*p)) {
+                matched.insert(p->id);
+            }
+        }
+    }
+    return matched;
+}
+
+void search_thread(string_view query)
+{
+    auto it = ThreadView::instances.find(page.thread);
+    if (it == ThreadView::instances.end() || !it->second) {
+        return;
+    }
+    auto view = it->second;
+
+    Query q(query);
+    if (q.empty()) {
+        view->filter({});
+        return;
+    }
+
+    // Also catches up with posts replaced by resynchronisation, that were not
+    // passed to index_post()
+    auto& ix = indexes[page.thread];
+    unsigned long max_id = 0;
+    for (auto p : thread_posts[page.thread]) {
+        index_into(ix, *p);
+        max_id = std::max(max_id, p->id);
+    }
+
+    // Posts inserted after the search are matched as they are rendered
+    view->filter([matched = run(ix, page.thread, q), max_id, q](Post* p) {
+        if (p->id > max_id) {
+            return q.matches(*p);
+        }
+        return matched.count(p->id) != 0;
+    });
+}
+
+void init_search()
+{
+    brunhild::register_handler("input",
+        [](auto& event) {
+            search_thread(event["target"]["value"].template as<string>());
+        },
+        "#thread-search input");
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "models.hh"
+#include <string_view>
+
+// Add a new or changed post to the search index of its thread, if the thread
+// has been searched already. Bodies of open posts are indexed on close.
+void index_post(const Post&);
+
+// Filter the posts of the current thread page by query. Only posts matching
+// all terms of the query are displayed. Terms can be plain text contained in
+// the post body or one of:
+//   name:<name> trip:<trip> id:<poster ID> type:<file extension>
+// An empty query shows all posts again.
+void search_thread(std::string_view query);
+
+// Free all search indexes
+void clear_search_indexes();
+
+// Register the search input handler
+void init_search();
@@ -0,0 +1,118 @@
+#include "seen.hh"
+#include "../../brunhild/mutations.hh"
+#include "../db.hh"
+#include "../state.hh"
+#include <emscripten.h>
+#include <emscripten/bind.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// IDs of the posts of tracked views by view handle
+static std::unordered_map<brunhild::Handle, unsigned long> tracked;
+
+// Tracked views currently intersecting the viewport
+static std::unordered_set<brunhild::Handle> in_view;
+
+// Posts inserted since the page was loaded, that have not been seen yet
+static std::unordered_set<unsigned long> unread;
+
+// Unread count last written to the tab title
+static size_t rendered_unread = 0;
+
+static void render_unread()
+{
+    if (unread.size() == rendered_unread) {
+        return;
+    }
+    rendered_unread = unread.size();
+    EM_ASM(
+        {
+            // Regex literals are mangled by stringification of the macro
+            var base = document.title.replace(new RegExp('^\\(\\d+\\) '), '');
+            document.title = ($0 ? '(' + $0 + ') ' : '') + base;
+        },
+        rendered_unread);
+}
+
+// Mark all tracked views in the viewport as seen, if the page is visible
+static void mark_in_view()
+{
+    if (in_view.empty() || EM_ASM_INT({ return document.hidden ? 1 : 0; })) {
+        return;
+    }
+    for (auto h : in_view) {
+        auto it = tracked.find(h);
+        if (it == tracked.end()) {
+            continue;
+        }
+        const auto id = it->second;
+        if (auto p = posts.find(id); p) {
+            p->seen = true;
+            store_post_id(StorageType::seen_posts, id, p->op);
+        }
+        unread.erase(id);
+        tracked.erase(it);
+        brunhild::untrack_visibility(h);
+    }
+    in_view.clear();
+    render_unread();
+}
+
+static void on_visibility_changes(const uint32_t* records, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        const brunhild::Handle h = records[i * 2];
+        if (records[i * 2 + 1]) {
+            in_view.insert(h);
+        } else {
+            in_view.erase(h);
+        }
+    }
+    mark_in_view();
+}
+
+void track_seen(PostView& v)
+{
+    if (post_ids.seen_posts.count(v.model_id)) {
+        return;
+    }
+    tracked[v.handle] = v.model_id;
+    brunhild::track_visibility(v.handle);
+}
+
+void untrack_seen(PostView& v)
+{
+    if (tracked.erase(v.handle)) {
+        in_view.erase(v.handle);
+        brunhild::untrack_visibility(v.handle);
+    }
+}
+
+void add_unread(const Post& p)
+{
+    if (post_ids.seen_posts.count(p.id) || post_ids.mine.count(p.id)) {
+        return;
+    }
+    unread.insert(p.id);
+    render_unread();
+}
+
+EMSCRIPTEN_BINDINGS(module_seen)
+{
+    emscripten::function("mark_in_view", &mark_in_view);
+}
+
+void init_seen()
+{
+    brunhild::set_visibility_listener(&on_visibility_changes);
+
+    // Posts in view of a hidden tab are seen, once the tab is shown
+    EM_ASM({
+        document.addEventListener('visibilitychange', function() {
+            if (!document.hidden) {
+                Module.mark_in_view();
+            }
+        });
+    });
+}
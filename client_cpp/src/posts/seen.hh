@@ -0,0 +1,16 @@
+#pragma once
+
+#include "view.hh"
+
+// Track, when the post of a view is first seen by the user. Seen posts are
+// persisted and no longer counted as unread.
+void track_seen(PostView&);
+
+// Stop tracking a view before it is destroyed
+void untrack_seen(PostView&);
+
+// Count a post inserted into a live thread as unread, until it is seen
+void add_unread(const Post&);
+
+// Register the visibility listener of post views
+void init_seen();
@@ -0,0 +1,185 @@
+#include "store.hh"
+
+PostStore::PostStore(PostStore&& other) { *this = std::move(other); }
+
+PostStore& PostStore::operator=(PostStore&& other)
+{
+    chunks = std::move(other.chunks);
+    free_slots = std::move(other.free_slots);
+    buckets = std::move(other.buckets);
+    bucket_shift = other.bucket_shift;
+    slots_used = std::exchange(other.slots_used, 0);
+    live = std::exchange(other.live, 0);
+    other.clear();
+    return *this;
+}
+
+PostStore::iterator::iterator(PostStore* store, Handle i)
+    : store(store)
+    , i(i)
+{
+    skip();
+}
+
+PostStore::Entry PostStore::iterator::operator*() const
+{
+    auto& s = store->slot(i);
+    return { s.id, s.post };
+}
+
+PostStore::iterator& PostStore::iterator::operator++()
+{
+    i++;
+    skip();
+    return *this;
+}
+
+void PostStore::iterator::skip()
+{
+    while (i < store->slots_used && !store->slot(i).id) {
+        i++;
+    }
+}
+
+size_t PostStore::bucket_of(unsigned long id) const
+{
+    // Fibonacci hashing. Post IDs are mostly sequential, so spread them. The
+    // high bits of the product depend on all bits of the ID.
+    return (uint32_t(id) * 2654435769u) >> bucket_shift;
+}
+
+PostStore::Handle PostStore::handle(unsigned long id) const
+{
+    if (!id || buckets.empty()) {
+        return none;
+    }
+    for (size_t i = bucket_of(id);; i = (i + 1) & (buckets.size() - 1)) {
+        auto& b = buckets[i];
+        if (b.id == id) {
+            return b.slot;
+        }
+        if (!b.id) {
+            return none;
+        }
+    }
+}
+
+Post* PostStore::find(unsigned long id)
+{
+    const auto h = handle(id);
+    return h == none ? nullptr : &slot(h).post;
+}
+
+Post* PostStore::get(Handle h)
+{
+    if (h >= slots_used) {
+        return nullptr;
+    }
+    auto& s = slot(h);
+    return s.id ? &s.post : nullptr;
+}
+
+void PostStore::grow_buckets()
+{
+    std::vector<Bucket> old;
+    old.swap(buckets);
+    buckets.resize(old.size() ? old.size() * 2 : 256);
+    bucket_shift = 32;
+    for (size_t n = buckets.size(); n > 1; n >>= 1) {
+        bucket_shift--;
+    }
+    for (auto& b : old) {
+        if (b.id) {
+            size_t i = bucket_of(b.id);
+            while (buckets[i].id) {
+                i = (i + 1) & (buckets.size() - 1);
+            }
+            buckets[i] = b;
+        }
+    }
+}
+
+PostStore::Handle PostStore::allocate_slot()
+{
+    if (free_slots.size()) {
+        const auto h = free_slots.back();
+        free_slots.pop_back();
+        return h;
+    }
+    if (slots_used == chunks.size() * chunk_size) {
+        chunks.emplace_back(new Slot[chunk_size]);
+    }
+    return slots_used++;
+}
+
+std::pair<Post*, bool> PostStore::insert_or_assign(unsigned long id, Post&& p)
+{
+    if (const auto h = handle(id); h != none) {
+        auto& s = slot(h);
+        s.post = std::move(p);
+        return { &s.post, false };
+    }
+
+    // Keep load factor under 1/2
+    if ((live + 1) * 2 > buckets.size()) {
+        grow_buckets();
+    }
+    const auto h = allocate_slot();
+    auto& s = slot(h);
+    s.id = id;
+    s.post = std::move(p);
+    live++;
+
+    size_t i = bucket_of(id);
+    while (buckets[i].id) {
+        i = (i + 1) & (buckets.size() - 1);
+    }
+    buckets[i] = { id, h };
+    return { &s.post, true };
+}
+
+void PostStore::erase(unsigned long id)
+{
+    if (!id || buckets.empty()) {
+        return;
+    }
+    const size_t mask = buckets.size() - 1;
+    size_t i = bucket_of(id);
+    while (buckets[i].id != id) {
+        if (!buckets[i].id) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    auto& s = slot(buckets[i].slot);
+    s.id = 0;
+    s.post = Post();
+    free_slots.push_back(buckets[i].slot);
+    live--;
+
+    // Backward shift deletion keeps probe sequences intact without tombstones
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!buckets[j].id) {
+            break;
+        }
+        const size_t home = bucket_of(buckets[j].id);
+        // Move entry to the hole, if the hole lies in its probe sequence
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            buckets[i] = buckets[j];
+            i = j;
+        }
+    }
+    buckets[i] = {};
+}
+
+void PostStore::clear()
+{
+    chunks.clear();
+    free_slots.clear();
+    buckets.clear();
+    slots_used = 0;
+    live = 0;
+}
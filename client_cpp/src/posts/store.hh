@@ -0,0 +1,122 @@
+#pragma once
+
+#include "models.hh"
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// Collection of post models. Posts are stored in fixed size chunks of slots,
+// so their addresses remain stable for their entire lifetime and iteration is
+// mostly linear in memory. Post IDs are mapped to slots with an open
+// addressing hash table.
+class PostStore {
+public:
+    // Stable handle of a post slot. Slots are reused after a post is removed,
+    // so the ID of the post should be verified on access through a retained
+    // handle.
+    typedef uint32_t Handle;
+
+    // Invalid handle
+    static constexpr Handle none = UINT32_MAX;
+
+    // Entry as returned by iteration
+    struct Entry {
+        const unsigned long first;
+        Post& second;
+    };
+
+    class iterator {
+    public:
+        iterator(PostStore* store, Handle i);
+
+        Entry operator*() const;
+        iterator& operator++();
+        bool operator!=(const iterator& other) const { return i != other.i; }
+
+    private:
+        PostStore* store;
+        Handle i;
+
+        // Advance to the next live slot, if the current one is not live
+        void skip();
+    };
+
+    PostStore() = default;
+    PostStore(const PostStore&) = delete;
+    PostStore& operator=(const PostStore&) = delete;
+
+    // Moving keeps the addresses of all posts
+    PostStore(PostStore&&);
+    PostStore& operator=(PostStore&&);
+
+    iterator begin() { return { this, 0 }; }
+    iterator end() { return { this, Handle(slots_used) }; }
+
+    // Number of posts stored
+    size_t size() const { return live; }
+
+    // Upper bound of all handles. Used to size arrays indexed by handle.
+    size_t slot_count() const { return slots_used; }
+
+    // Returns 1, if a post with the ID is stored, 0 otherwise
+    size_t count(unsigned long id) const { return handle(id) != none; }
+
+    // Returns post by ID or nullptr, if none
+    Post* find(unsigned long id);
+
+    // Returns post by ID. The post must exist.
+    Post& at(unsigned long id) { return *find(id); }
+
+    // Returns the handle of the post with the ID or none
+    Handle handle(unsigned long id) const;
+
+    // Returns post by handle or nullptr, if the slot is not occupied
+    Post* get(Handle);
+
+    // Insert a post or replace an existing one with the same ID. Returns the
+    // stored post and if it was newly inserted.
+    std::pair<Post*, bool> insert_or_assign(unsigned long id, Post&&);
+
+    // Remove post by ID, if any
+    void erase(unsigned long id);
+
+    // Remove all posts and free all memory at once
+    void clear();
+
+private:
+    struct Slot {
+        unsigned long id = 0; // 0 marks an unoccupied slot
+        Post post;
+    };
+
+    // Bucket of the ID -> slot hash table. A zero ID marks an empty bucket.
+    struct Bucket {
+        unsigned long id = 0;
+        Handle slot = none;
+    };
+
+    // Slots per chunk. Must be a power of 2.
+    static constexpr size_t chunk_size = 128;
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    size_t slots_used = 0, // Slots ever allocated from chunks
+        live = 0; // Occupied slots
+    std::vector<Handle> free_slots;
+    std::vector<Bucket> buckets;
+
+    // 32 - log2 of the bucket count. Selects the high bits of the hash.
+    unsigned bucket_shift = 32;
+
+    Slot& slot(Handle h) { return chunks[h / chunk_size][h % chunk_size]; }
+
+    // Returns the bucket index an ID hashes to
+    size_t bucket_of(unsigned long id) const;
+
+    // Double the hash table size and reinsert all entries
+    void grow_buckets();
+
+    // Allocate a slot for a new post
+    Handle allocate_slot();
+};
@@ -0,0 +1,89 @@
+#include "text.hh"
+#include "../../utf8/utf8.h"
+#include <algorithm>
+
+// Source of text revisions
+static unsigned revision_counter = 0;
+
+PostBody& PostBody::operator=(std::string_view s)
+{
+    text = s;
+    index.clear();
+    edits.clear();
+    _revision = base_revision = ++revision_counter;
+    return *this;
+}
+
+void PostBody::append(std::string_view s)
+{
+    const size_t pos = text.size();
+    text += s;
+    record_edit(pos);
+}
+
+void PostBody::backspace()
+{
+    if (!text.size()) {
+        return;
+    }
+    auto it = text.end();
+    utf8::unchecked::prior(it);
+    text.erase(it, text.end());
+    record_edit(text.size());
+}
+
+void PostBody::splice(size_t start, size_t len, std::string_view s)
+{
+    const size_t from = byte_offset(start);
+    const size_t to = byte_offset(start + len);
+    text.replace(from, to - from, s);
+    record_edit(from);
+}
+
+size_t PostBody::byte_offset(size_t ch)
+{
+    if (index.empty()) {
+        index.push_back(0);
+    }
+    const size_t i = std::min(ch / index_interval, index.size() - 1);
+    size_t n = i * index_interval;
+    auto it = text.begin() + index[i];
+    while (n < ch && it != text.end()) {
+        utf8::unchecked::next(it);
+        if (++n % index_interval == 0 && n / index_interval == index.size()) {
+            index.push_back(it - text.begin());
+        }
+    }
+    return it - text.begin();
+}
+
+void PostBody::record_edit(size_t pos)
+{
+    // Character offsets preceding pos are unchanged
+    while (index.size() && index.back() > pos) {
+        index.pop_back();
+    }
+
+    _revision = ++revision_counter;
+    if (edits.size() == max_edits) {
+        base_revision = edits.front().first;
+        edits.erase(edits.begin());
+    }
+    edits.push_back({ _revision, pos });
+}
+
+size_t PostBody::changed_since(unsigned rev) const
+{
+    if (rev == _revision) {
+        return std::string::npos;
+    }
+    if (rev < base_revision || rev > _revision) {
+        return 0;
+    }
+    size_t pos = std::string::npos;
+    for (auto it = edits.rbegin(); it != edits.rend() && it->first > rev;
+         ++it) {
+        pos = std::min<size_t>(pos, it->second);
+    }
+    return pos;
+}
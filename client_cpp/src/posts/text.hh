@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// UTF-8 text of a post's body. Edits of open posts address the text by
+// character position, so a sparse index of character to byte offsets is kept to
+// avoid walking the text from the start on each edit. Edits are applied in
+// place and the first changed byte of each is recorded for the incremental body
+// renderer.
+class PostBody {
+public:
+    PostBody() = default;
+
+    // Replace the entire text
+    PostBody& operator=(std::string_view);
+
+    operator std::string_view() const { return text; }
+    size_t size() const { return text.size(); }
+    const char* begin() const { return text.data(); }
+    const char* end() const { return text.data() + text.size(); }
+
+    // Append UTF-8 encoded text
+    void append(std::string_view);
+
+    // Remove the last character, if any
+    void backspace();
+
+    // Replace len characters at character position start with UTF-8 encoded
+    // text. Mimics JS Array.splice().
+    void splice(size_t start, size_t len, std::string_view text);
+
+    // Returns the current revision of the text. Revisions are drawn from a
+    // global counter, so revisions of different bodies never match.
+    unsigned revision() const { return _revision; }
+
+    // Returns the first byte offset, that possibly changed since revision rev.
+    // Returns 0, if rev is not in the recorded edit history, and
+    // std::string::npos, if nothing changed.
+    size_t changed_since(unsigned rev) const;
+
+private:
+    // Number of characters between indexed character offsets
+    static const size_t index_interval = 64;
+
+    // Maximum number of recorded edits
+    static const size_t max_edits = 32;
+
+    std::string text;
+
+    // Byte offsets of every index_interval-th character. Only the prefix
+    // preceding any edits is retained and it is extended lazily.
+    std::vector<uint32_t> index;
+
+    unsigned _revision = 0,
+             base_revision = 0; // Revision preceding the recorded edits
+
+    // Revisions and first changed byte offsets of the most recent edits
+    std::vector<std::pair<unsigned, uint32_t>> edits;
+
+    // Returns the byte offset of character position ch or the end of the text
+    size_t byte_offset(size_t ch);
+
+    // Record an edit, that changed the text starting at byte offset pos
+    void record_edit(size_t pos);
+};
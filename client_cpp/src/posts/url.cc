@@ -1,8 +1,11 @@
 #include "url.hh"
+#include "../options/options.hh"
+#include "../util.hh"
 #include "etc.hh"
-#include <algorithm>
+#include <cctype>
 #include <emscripten.h>
 #include <sstream>
+#include <stdint.h>
 #include <tuple>
 #include <unordered_map>
 
@@ -15,11 +18,139 @@ using std::string_view;
 
 // TODO: Add Coub.com
 
-// Types of supported embed providers
-enum class Provider { Youtube, Soundcloud, Vimeo };
+// Classifications of previously seen words by hash. Strict validation and
+// embed matching call into JS, so these are cached across re-renders.
+static std::unordered_map<uint64_t, URLInfo> url_cache;
+
+// Return, if s starts with prefix
+static bool starts_with(string_view s, string_view prefix)
+{
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+// Return, if ch may appear anywhere in an accepted URL. Non-ASCII bytes are
+// percent-encoded by browsers.
+static bool is_url_char(char ch)
+{
+    const auto b = uint8_t(ch);
+    if (b >= 0x80) {
+        return true;
+    }
+    if (b <= ' ' || b == 0x7f) {
+        return false;
+    }
+    switch (ch) {
+    case '"':
+    case '<':
+    case '>':
+    case '\\':
+    case '^':
+    case '`':
+    case '{':
+    case '|':
+    case '}':
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Return, if ch may appear in a host name, that is not an IPv6 address
+static bool is_host_char(char ch)
+{
+    return uint8_t(ch) >= 0x80 || (ch >= 'a' && ch <= 'z')
+        || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '-'
+        || ch == '.' || ch == '_' || ch == '%';
+}
+
+// Validate the authority of a hierarchical URL without the leading "//"
+static bool scan_authority(string_view auth)
+{
+    if (auto at = auth.rfind('@'); at != string_view::npos) {
+        auth = auth.substr(at + 1);
+    }
+    if (auth.empty()) {
+        return false;
+    }
+
+    size_t i = 0;
+    if (auth[0] == '[') { // IPv6
+        i = auth.find(']');
+        if (i == string_view::npos || i == 1) {
+            return false;
+        }
+        for (size_t j = 1; j < i; j++) {
+            const char ch = auth[j];
+            if (!isxdigit(uint8_t(ch)) && ch != ':' && ch != '.') {
+                return false;
+            }
+        }
+        i++;
+    } else {
+        while (i < auth.size() && is_host_char(auth[i])) {
+            i++;
+        }
+        if (!i) {
+            return false;
+        }
+    }
+
+    // Optional port
+    if (i == auth.size()) {
+        return true;
+    }
+    if (auth[i] != ':' || auth.size() - i - 1 > 5) {
+        return false;
+    }
+    for (i++; i < auth.size(); i++) {
+        if (!isdigit(uint8_t(auth[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Allocation-free validation of URLs with the accepted schemes
+static bool scan_url(string_view url)
+{
+    static constexpr string_view hierarchical[]
+        = { "http://", "https://", "ftp://", "ftps://" };
+    static constexpr string_view opaque[] = { "magnet:?", "bitcoin:" };
+
+    string_view rest;
+    bool has_authority = false;
+    for (auto pre : hierarchical) {
+        if (starts_with(url, pre)) {
+            rest = url.substr(pre.size());
+            has_authority = true;
+            break;
+        }
+    }
+    if (!has_authority) {
+        for (auto pre : opaque) {
+            if (starts_with(url, pre)) {
+                rest = url.substr(pre.size());
+                break;
+            }
+        }
+    }
+    if (rest.empty()) {
+        return false;
+    }
+
+    for (char ch : rest) {
+        if (!is_url_char(ch)) {
+            return false;
+        }
+    }
+    if (!has_authority) {
+        return true;
+    }
+    return scan_authority(rest.substr(0, rest.find_first_of("/?#")));
+}
 
 // Call into JS to validate URL. Keeps us from depending on a parsing library
-// and increasing binary size.
+// and increasing binary size. Only used in strict validation mode.
 static bool validate_url(string_view url)
 {
     return (bool)EM_ASM_INT(
@@ -68,13 +199,9 @@ static Node format_noembed(const Provider prov, const string href)
     };
 }
 
-// Parse for presence of embed links. Returns Node, if valid URL found.
-static optional<Node> parse_embeds(string_view word)
+// Match a valid URL against the embed provider patterns
+static optional<Provider> match_embed(string_view word)
 {
-    if (!validate_url(word)) {
-        return nullopt;
-    }
-
     // URL matching patterns for their respective providers
     const static std::tuple<Provider, char const*> patterns[4] = {
         { Provider::Youtube,
@@ -95,32 +222,44 @@ static optional<Node> parse_embeds(string_view word)
             },
             pat, href.c_str());
         if (match) {
-            return { format_noembed(prov, href) };
+            return prov;
         }
     }
 
     return nullopt;
 }
 
-optional<Node> parse_url(string_view word)
+// Consults the cache first
+URLInfo classify_url(string_view word)
 {
-    if (auto n = parse_embeds(word)) {
-        return n;
+    URLInfo info;
+    if (!scan_url(word)) {
+        return info;
     }
 
-    const static string allowed_prefixes[5]
-        = { "http:", "https:", "ftp:", "ftps:", "bitcoin:" };
+    const uint64_t key = fnv1a(word, options.strict_url_validation);
+    if (auto it = url_cache.find(key); it != url_cache.end()) {
+        return it->second;
+    }
 
-    bool valid = false;
-    for (auto& pre : allowed_prefixes) {
-        if (std::equal(pre.begin(), pre.end(), word.begin())) {
-            valid = true;
-            break;
-        }
+    info.valid = !options.strict_url_validation || validate_url(word);
+    if (info.valid && word[0] == 'h') {
+        info.embed = match_embed(word);
+    }
+
+    // Prevent unbounded growth on long-lived pages
+    if (url_cache.size() >= 1 << 12) {
+        url_cache.clear();
     }
-    if (!valid || !validate_url(word)) {
-        return nullopt;
+    url_cache[key] = info;
+    return info;
+}
+
+Node render_url(string_view word, optional<Provider> embed)
+{
+    if (embed) {
+        return format_noembed(*embed, string(word));
     }
     // Don't open a new tab for magnet links
-    return { render_link(word, word, word[0] != 'm') };
+    return render_link(word, word, word[0] != 'm');
 }
@@ -2,8 +2,25 @@
 
 #include "../../brunhild/node.hh"
 #include <optional>
+#include <stdint.h>
 #include <string_view>
 
-// Parse word for possible URL handling. Returns link or embed Node, if matched.
-// The validation is very trivial and mainly just checks for inline JS.
-std::optional<brunhild::Node> parse_url(std::string_view word);
+// Types of supported embed providers
+enum class Provider : uint8_t { Youtube, Soundcloud, Vimeo };
+
+// Result of classifying a word as a URL
+struct URLInfo {
+    bool valid = false;
+    std::optional<Provider> embed;
+};
+
+// Validate and classify a word as a URL. Accepts HTTP(S), FTP(S), magnet and
+// bitcoin URLs. The validation is done in wasm and mainly checks for inline JS
+// and malformed hosts. If strict URL validation is enabled, URLs are
+// additionally parsed by the browser.
+URLInfo classify_url(std::string_view word);
+
+// Render a word, that was classified as a valid URL, as a link or embed.
+// embed is the word's embed provider, if any.
+brunhild::Node render_url(
+    std::string_view word, std::optional<Provider> embed = std::nullopt);
@@ -1,9 +1,70 @@
 #include "view.hh"
 #include "../state.hh"
+#include "seen.hh"
 
 Post* PostView::get_model()
 {
-    return posts.count(model_id) ? &posts.at(model_id) : NULL;
+    // Slots can be reused, so verify the cached handle still points to the
+    // same post
+    if (auto p = posts.get(slot); p && p->id == model_id) {
+        return p;
+    }
+    slot = posts.handle(model_id);
+    return posts.get(slot);
+}
+
+PostView::~PostView()
+{
+    untrack_seen(*this);
+    if (deferred) {
+        brunhild::cancel_on_visible(handle);
+    }
+}
+
+void PostView::defer()
+{
+    deferred = true;
+    brunhild::on_visible(handle, [this]() {
+        deferred = false;
+        schedule_patch();
+    });
+}
+
+bool PostView::compact()
+{
+    if (deferred) {
+        return true;
+    }
+    auto p = get_model();
+    if (!p || p->editing || expanded || inlined_posts.size()) {
+        return false;
+    }
+
+    header_memo = Memo();
+    figcaption_memo = Memo();
+    body_memo = Memo();
+    backlinks_memo = Memo();
+    body_lines.clear();
+    body_lines.shrink_to_fit();
+    time_cache = TimeCache();
+    defer();
+    schedule_patch();
+    return true;
+}
+
+size_t PostView::estimate_size()
+{
+    if (deferred) {
+        return sizeof(PostView);
+    }
+
+    // The body is held as the diff tree, the memo and, for open posts, the
+    // cached lines. Nodes roughly double the size of the text.
+    size_t n = sizeof(PostView) + 1024;
+    if (auto p = get_model()) {
+        n += p->body.size() * (p->editing ? 6 : 4);
+    }
+    return n;
 }
 
 void PostView::patch()
@@ -34,6 +95,55 @@ void TextState::reset(Node* root)
     parents.push_back(root);
 }
 
+TextState::LineState TextState::line_state() const
+{
+    return { spoiler, code, bold, italic, red, blue, have_syncwatch,
+        successive_newlines, dice_index };
+}
+
+void TextState::restore(const LineState& s)
+{
+    spoiler = s.spoiler;
+    code = s.code;
+    bold = s.bold;
+    italic = s.italic;
+    red = s.red;
+    blue = s.blue;
+    have_syncwatch = s.have_syncwatch;
+    successive_newlines = s.successive_newlines;
+    dice_index = s.dice_index;
+}
+
+bool TextState::LineState::operator==(const LineState& o) const
+{
+    return spoiler == o.spoiler && code == o.code && bold == o.bold
+        && italic == o.italic && red == o.red && blue == o.blue
+        && have_syncwatch == o.have_syncwatch
+        && successive_newlines == o.successive_newlines
+        && dice_index == o.dice_index;
+}
+
+void TextState::toggle(int level)
+{
+    switch (level) {
+    case 0:
+        spoiler = !spoiler;
+        break;
+    case 1:
+        bold = !bold;
+        break;
+    case 2:
+        italic = !italic;
+        break;
+    case 3:
+        red = !red;
+        break;
+    case 4:
+        blue = !blue;
+        break;
+    }
+}
+
 void TextState::append(Node n, bool descend, unsigned gt_count)
 {
     // Append escaped '>'
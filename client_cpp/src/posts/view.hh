@@ -3,6 +3,7 @@
 #include "../../brunhild/view.hh"
 #include "models.hh"
 #include <memory>
+#include <stdint.h>
 
 using brunhild::Node;
 
@@ -24,6 +25,21 @@ public:
     // Used for building text nodes. Flushed on append() or ascend().
     std::string buf;
 
+    // Parsing state carried over from one line to the next
+    struct LineState {
+        bool spoiler, code, bold, italic, red, blue, have_syncwatch;
+        int successive_newlines;
+        size_t dice_index;
+
+        bool operator==(const LineState& other) const;
+    };
+
+    // Returns the state carried over to the next line
+    LineState line_state() const;
+
+    // Restore state carried over from a previous line
+    void restore(const LineState&);
+
     // Reset to initial values and sets Node as the new root parent.
     void reset(Node* root);
 
@@ -44,6 +60,9 @@ public:
     // <em> not included, as it is line-based.
     static const int tag_depth = 5;
 
+    // Toggle formatting flag by its level in as_array()
+    void toggle(int level);
+
     // Returns all flags as array ordered by parent to child
     inline std::array<bool, tag_depth> as_array() const
     {
@@ -57,6 +76,9 @@ private:
     std::vector<Node*> parents;
 };
 
+// Hash of the global state, that affects the rendering of post sections
+uint64_t render_epoch();
+
 class PostView : public brunhild::ModelView<Post> {
     using brunhild::ModelView<Post>::render;
 
@@ -65,7 +87,10 @@ public:
     const unsigned long model_id;
 
     bool expanded = false, // Expand image thumbnail to full view
-        reveal_thumbnail = false; // Reveal a hidden image with [Show]
+        reveal_thumbnail = false, // Reveal a hidden image with [Show]
+        deferred = false, // Only a placeholder is rendered. See defer().
+        // Expanded image source is loaded by the batch expansion loader
+        stream_source = false;
 
     // id: parent model id
     PostView(unsigned long model_id)
@@ -73,22 +98,109 @@ public:
     {
     }
 
+    ~PostView();
+
+    // Render only a placeholder of estimated height, until the post nears the
+    // viewport. Must be called before the view is first rendered.
+    void defer();
+
     // Patch the current contents of the post into the DOM.
     // If the post is currently inlined into another post, this method will
     // delegate the patch to the topmost parent.
     void patch();
 
+    // Patch only the <time> element of a rendered post, if the text of its
+    // relative timestamp changed
+    void refresh_time();
+
+    // Patch only the figure of the post's image. Falls back to a full patch,
+    // if the figure is not rendered.
+    void patch_figure();
+
+    // Free the rendered subtree and all render caches and replace the post
+    // with a placeholder, until it nears the viewport again. Returns false,
+    // if the view holds state, that can not be rendered anew.
+    bool compact();
+
+    // Approximate memory used by the view's rendered subtree and caches
+    size_t estimate_size();
+
     Post* get_model();
 
 private:
     TextState state;
 
+    // Cached handle of the model in the post store
+    uint32_t slot = UINT32_MAX;
+
+    // Parse result of a single line of an open post's body
+    struct BodyLine {
+        std::string text;
+        TextState::LineState start, end; // State before and after the line
+        brunhild::Children nodes; // Nodes appended to the blockquote
+    };
+
+    // Cached lines of an open post's body. Lines are reparsed only when their
+    // text or the state carried over from the previous line changes.
+    std::vector<BodyLine> body_lines;
+
+    // Global configuration the cached body lines were rendered with
+    bool body_lines_rb_text = false;
+    size_t body_lines_mine = 0;
+
+    // Revision of the post's body the cached lines were rendered from
+    unsigned body_lines_revision = 0;
+
+    // Tokens of a closed body are being recorded by the current render.
+    // Otherwise the model's tokens are replayed.
+    bool recording_tokens = false;
+
+    // Tokens recorded by the current render
+    std::vector<BodyToken> recorded_tokens;
+
+    // Index of the next model token to replay
+    size_t token_cursor = 0;
+
     // Posts inlined into this post's links
     std::unordered_map<unsigned long, std::unique_ptr<PostView>> inlined_posts;
 
+    // Formatted timestamps of the post. The absolute one only changes with
+    // the language and the relative one with its relative_time_bucket().
+    struct TimeCache {
+        time_t time = 0;
+        unsigned lang_generation = 0;
+        int64_t rel_bucket = -1;
+        std::string abs, rel;
+    } time_cache;
+
+    // Handles of the rendered <time> and <figure> elements or 0
+    brunhild::Handle time_handle = 0, figure_handle = 0;
+
+    // Memoized rendered section of the post. Valid, while the version of the
+    // section on the model and the global state affecting rendering are
+    // unchanged.
+    struct Memo {
+        unsigned version = 0; // 0 marks an empty memo
+        uint64_t epoch = 0;
+        Node node;
+    };
+    Memo header_memo, figcaption_memo, body_memo, backlinks_memo;
+
+    // Return the memoized section or render it with fn and memoize it.
+    // A zero version disables memoization.
+    template <class F> Node memoize(Memo&, unsigned version, F fn);
+
     // Generates the model's node tree
     Node render(Post*);
 
+    // Posts inserted into a thread clone the skeleton of the article, the
+    // post container and their children. Header, figure and body are filled
+    // in as inner HTML.
+    size_t template_depth() const { return 3; }
+
+    // Render an empty post of estimated height in place of a deferred post
+    Node render_placeholder();
+
     // Render the header on top of the post
     Node render_header();
 
@@ -98,6 +210,9 @@ private:
     // Renders a time element. Can be either absolute or relative.
     Node render_time();
 
+    // Update time_cache, if outdated. Returns, if anything changed.
+    bool update_time_cache();
+
     // Render the information caption above the image.
     Node render_figcaption();
 
@@ -113,6 +228,9 @@ private:
     // Render the text body of a post
     Node render_body();
 
+    // Parse one line of a post's body into the state's current parent
+    void render_body_line(std::string_view line, bool first);
+
     // Parse temporary links in open posts, that still may be edited
     void parse_temp_links(std::string_view);
 
@@ -122,38 +240,28 @@ private:
     // Highlight common programming code syntax
     void highlight_syntax(std::string_view);
 
-    // Function run on a separated string fragment
-    typedef std::function<void(std::string_view)> OnFrag;
-
-    // Detect and format code tags. Call fn on unmatched sub-fragments.
-    void parse_code(std::string_view frag, OnFrag fn);
+    // Detect and format code, spoiler, bold, italic, red and blue text tags on
+    // a line in a single pass. Unformatted fragments are passed on to
+    // parse_formatted_fragment().
+    void parse_formatting(std::string_view line);
 
-    // Inject spoiler tags and call fn on the remaining parts
-    void parse_spoilers(std::string_view frag, OnFrag fn);
+    // Parse a fragment of a line between formatting tags
+    void parse_formatted_fragment(std::string_view frag);
 
     // Open and close any tags up to level, if they are set.
     // Increment level by 1 for each tag deeper you go.
     void wrap_tags(int level);
 
-    // Inject bold tags and call fn on the remaining parts
-    void parse_bolds(std::string_view frag, OnFrag fn);
-
-    // Inject italic tags and call fn on the remaining parts
-    void parse_italics(std::string_view frag, OnFrag fn);
-
-    // Inject red color tags and call fn on the remaining parts
-    void parse_reds(std::string_view frag, OnFrag fn);
-
-    // Inject red color tags and call fn on the remaining parts
-    void parse_blues(std::string_view frag, OnFrag fn);
-
     // Parse a string into words and call fn on each word.
     // Handles space padding and leading/trailing punctuation.
-    void parse_words(std::string_view frag, OnFrag fn);
+    template <class F> void parse_words(std::string_view frag, F fn);
+
+    // Resolve a word of a closed post to a post link, reference or URL token,
+    // if it is one
+    std::optional<BodyToken> resolve_word(std::string_view word);
 
-    // Parse internally-defined or board reference URL.
-    // Returns preceding '>' count and link Node, if matched.
-    std::optional<std::tuple<int, Node>> parse_reference(std::string_view word);
+    // Render a resolved word into the state's current parent
+    void render_token(const BodyToken&, std::string_view word);
 
     // Renders link to other posts and any inlined posts inside
     Node render_link(unsigned long id, const LinkData& data);
@@ -0,0 +1,97 @@
+#include "sha1.hh"
+#include <algorithm>
+#include <cstring>
+
+static inline uint32_t rotl(uint32_t x, int n) { return x << n | x >> (32 - n); }
+
+void SHA1::process(const uint8_t* block)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = uint32_t(block[i * 4]) << 24 | uint32_t(block[i * 4 + 1]) << 16
+            | uint32_t(block[i * 4 + 2]) << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    auto round = [&](uint32_t f, uint32_t k, uint32_t w) {
+        const uint32_t t = rotl(a, 5) + f + e + k + w;
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    };
+
+    // Separate loops per round function keep the branches out of the hot path
+    for (int i = 0; i < 20; i++) {
+        round((b & c) | (~b & d), 0x5A827999, w[i]);
+    }
+    for (int i = 20; i < 40; i++) {
+        round(b ^ c ^ d, 0x6ED9EBA1, w[i]);
+    }
+    for (int i = 40; i < 60; i++) {
+        round((b & c) | (b & d) | (c & d), 0x8F1BBCDC, w[i]);
+    }
+    for (int i = 60; i < 80; i++) {
+        round(b ^ c ^ d, 0xCA62C1D6, w[i]);
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+void SHA1::update(const uint8_t* data, size_t len)
+{
+    length += len;
+    if (buffered) {
+        const size_t n = std::min(len, sizeof(buf) - buffered);
+        memcpy(buf + buffered, data, n);
+        buffered += n;
+        data += n;
+        len -= n;
+        if (buffered < sizeof(buf)) {
+            return;
+        }
+        process(buf);
+        buffered = 0;
+    }
+
+    // Whole blocks are processed straight from the input
+    for (; len >= 64; data += 64, len -= 64) {
+        process(data);
+    }
+    memcpy(buf, data, len);
+    buffered = len;
+}
+
+std::string SHA1::hex_digest()
+{
+    const uint64_t bits = length * 8;
+    const uint8_t pad = 0x80;
+    update(&pad, 1);
+    const uint8_t zero = 0;
+    while (buffered != 56) {
+        update(&zero, 1);
+    }
+    uint8_t len_be[8];
+    for (int i = 0; i < 8; i++) {
+        len_be[i] = bits >> (56 - i * 8);
+    }
+    update(len_be, 8);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string s;
+    s.reserve(40);
+    for (auto word : h) {
+        for (int i = 28; i >= 0; i -= 4) {
+            s += digits[(word >> i) & 0xF];
+        }
+    }
+    return s;
+}
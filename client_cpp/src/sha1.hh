@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Incremental SHA-1 hasher
+class SHA1 {
+public:
+    // Feed the next len bytes of the message
+    void update(const uint8_t* data, size_t len);
+
+    // Finish hashing and return the lower case hex digest. The hasher must not
+    // be used afterwards.
+    std::string hex_digest();
+
+private:
+    std::array<uint32_t, 5> h
+        = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t buf[64];
+    size_t buffered = 0;
+    uint64_t length = 0; // Message length in bytes
+
+    // Process a 64 byte block
+    void process(const uint8_t* block);
+};
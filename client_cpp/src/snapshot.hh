@@ -0,0 +1,134 @@
+// Decoding of binary thread and board page snapshots
+//
+// Snapshot layout:
+//
+// snapshot := version:byte page_total:varint strings thread_count:varint
+//             thread*
+// strings  := count:varint string*
+// thread   := flags:byte id post_ctr image_ctr time reply_time bump_time
+//             board:ref subject:string post_count:varint post*
+// post     := flags:byte id_delta:varint time:varint name:ref trip:ref
+//             auth:ref flag:ref poster_id:ref body:string links commands
+//             image?
+// links    := count:varint (id:varint op:varint board:ref)*
+// commands := count:varint (type:byte value)*
+// image    := flags:byte file_type:byte thumb_type:byte dims:varint[4]
+//             length:varint size:varint artist:string? title:string?
+//             md5:string sha1:string name:string
+//
+// The first post of each thread is its OP, on both board and thread pages.
+// Post IDs are encoded as the difference to the previous post's ID in the
+// thread or to the thread ID for the OP. Repeated strings like boards, names
+// and flags are stored once in the string table and referenced by their
+// index + 1. A reference of 0 means no string.
+//
+// Encoded by common.EncodeSnapshot() on the server.
+
+#pragma once
+
+#include "atom.hh"
+#include "connection/binary.hh"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Version of the snapshot format, this client can decode
+const uint8_t snapshot_version = 1;
+
+// Bit flags of the thread flags field
+enum ThreadFlags : uint8_t {
+    thread_deleted = 1,
+    thread_locked = 1 << 1,
+    thread_sticky = 1 << 2,
+};
+
+// Bit flags of the post flags field
+enum PostFlags : uint8_t {
+    post_editing = 1,
+    post_deleted = 1 << 1,
+    post_sage = 1 << 2,
+    post_banned = 1 << 3,
+    post_has_image = 1 << 4,
+};
+
+// Bit flags of the image flags field
+enum ImageFlags : uint8_t {
+    image_audio = 1,
+    image_video = 1 << 1,
+    image_spoiler = 1 << 2,
+    image_has_artist = 1 << 3,
+    image_has_title = 1 << 4,
+};
+
+// Reader of a binary snapshot with access to its string table
+class SnapshotReader : public BinaryReader {
+public:
+    // ID of the last decoded post or thread
+    unsigned long last_id = 0;
+
+    SnapshotReader(const uint8_t* buf, size_t size)
+        : BinaryReader(buf, size)
+    {
+    }
+
+    // Read the string table. Must be called before any string references are
+    // read.
+    void read_strings()
+    {
+        const auto n = varint();
+        if (n > remaining()) { // Every string takes at least one byte
+            fail();
+            return;
+        }
+        strings.reserve(n);
+        for (uint64_t i = 0; i < n && ok(); i++) {
+            strings.push_back(string());
+        }
+    }
+
+    // Read a reference to a string in the string table
+    std::optional<std::string> string_ref()
+    {
+        const auto i = varint();
+        if (!i) {
+            return std::nullopt;
+        }
+        if (i > strings.size()) {
+            fail();
+            return std::nullopt;
+        }
+        return std::string(strings[i - 1]);
+    }
+
+    // Read a reference to a string in the string table and intern it. Each
+    // table entry is interned at most once.
+    std::optional<Atom> atom_ref()
+    {
+        const auto i = varint();
+        if (!i) {
+            return std::nullopt;
+        }
+        if (i > strings.size()) {
+            fail();
+            return std::nullopt;
+        }
+        if (atoms.size() < i) {
+            atoms.resize(strings.size());
+        }
+        auto& a = atoms[i - 1];
+        if (!a) {
+            a = Atom(strings[i - 1]);
+        }
+        return a;
+    }
+
+    // Read a delta-encoded post ID
+    unsigned long post_id() { return last_id += varint(); }
+
+private:
+    std::vector<std::string_view> strings;
+
+    // Interned string table entries
+    std::vector<std::optional<Atom>> atoms;
+};
@@ -1,81 +1,241 @@
 #include "state.hh"
+#include "../brunhild/profile.hh"
+#include "json_scan.hh"
 #include "lang.hh"
 #include "options/options.hh"
+#include "page/catalog.hh"
 #include "page/page.hh"
 #include "posts/models.hh"
+#include "snapshot.hh"
 #include "util.hh"
+#include <algorithm>
 #include <array>
 #include <emscripten.h>
 #include <emscripten/bind.h>
 #include <map>
+#include <stdlib.h>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 using emscripten::val;
 using nlohmann::json;
 using std::string;
 
-// Inverse map of posts linking posts by post ID.
-// <linked_post_id <linker_post_id, {false, linker_post_thread_id}>>
-typedef std::unordered_map<unsigned long, std::map<unsigned long, LinkData>>
-    Backlinks;
-
-// Places inverse post links into backlinks for later assignment to individual
-// post models
-static void extract_backlinks(const Post& p, Backlinks& backlinks)
+// Decode a single post from its raw JSON text and add it to the post
+// collection
+static void extract_post(
+    std::string_view data, Atom board, unsigned long thread_id)
 {
-    for (auto&& [target_id, _] : p.links) {
-        backlinks[target_id][p.id] = { false, p.op, p.board };
-    }
+    auto j = json::parse(data);
+    Post p(j);
+    p.board = board;
+    p.op = thread_id;
+    p.source_hash = fnv1a(data);
+    link_graph.add(p);
+    add_post(std::move(p));
 }
 
-// Extract thread data from JSON and populate post collection.
-// Places inverse post links into backlinks for later assignment to individual
-// post models.
-static void extract_thread(json& j, Backlinks& backlinks)
+// Extract thread data from raw JSON text and populate post collection.
+// Only one post is decoded into a JSON DOM at a time.
+// thread_page: data is in the thread page format with the OP as the first post
+static bool extract_thread(std::string_view data, bool thread_page)
 {
+    // Split off the post array and decode all other thread fields
+    json meta = json::object();
+    std::vector<std::string_view> post_data;
+    const bool ok = json_scan::for_each_member(
+        data, [&](std::string_view key, std::string_view val) {
+            if (key == "posts") {
+                if (!json_scan::for_each_element(val,
+                        [&](std::string_view p) { post_data.push_back(p); })) {
+                    post_data.clear();
+                }
+            } else {
+                meta[string(key)] = json::parse(val);
+            }
+        });
+    if (!ok || (thread_page && !post_data.size())) {
+        return false;
+    }
+
     // TODO: Homogenize board and thread page data structure
-    auto thread = ThreadDecoder(j);
-    auto op = page.thread ? thread.posts[0] : Post(j);
-    const string board = thread.board;
+    auto thread = ThreadDecoder(meta);
+    const Atom board = thread.board;
+    Post op;
+    if (thread_page) {
+        auto j = json::parse(post_data[0]);
+        op = Post(j);
+        op.source_hash = fnv1a(post_data[0]);
+    } else {
+        // Board page OPs are stored inline with the thread metadata
+        op = Post(meta);
+        op.source_hash = fnv1a(data);
+    }
     const unsigned long thread_id = op.id;
+    thread.id = thread_id;
     op.op = thread_id;
     op.board = board;
-    extract_backlinks(op, backlinks);
-    (threads)[thread_id] = static_cast<Thread>(thread);
-    (posts)[thread_id] = std::move(op);
-
-    for (auto post : thread.posts) {
-        post.board = board;
-        post.op = thread_id;
-        extract_backlinks(post, backlinks);
-        (posts)[post.id] = post;
+    link_graph.add(op);
+    threads[thread_id] = static_cast<Thread>(thread);
+    add_post(std::move(op));
+
+    auto& index = thread_posts[thread_id];
+    index.reserve(index.size() + post_data.size());
+    for (size_t i = thread_page ? 1 : 0; i < post_data.size(); i++) {
+        extract_post(post_data[i], board, thread_id);
     }
+    return true;
+}
+
+Post& add_post(Post&& p)
+{
+    const auto id = p.id;
+    const auto op = p.op;
+    if (auto old = posts.find(id); old) {
+        if (p.source_hash && p.source_hash == old->source_hash) {
+            return *old;
+        }
+        p.views = std::move(old->views);
+    }
+    auto [ptr, inserted] = posts.insert_or_assign(id, std::move(p));
+    if (!inserted) {
+        // Address is stable for the lifetime of the post, so the index already
+        // contains it
+        ptr->patch();
+        return *ptr;
+    }
+
+    // Posts mostly arrive in ascending ID order
+    auto& index = thread_posts[op];
+    if (!index.size() || index.back()->id < id) {
+        index.push_back(ptr);
+    } else {
+        index.insert(std::lower_bound(index.begin(), index.end(), id,
+                         [](Post* p, unsigned long id) { return p->id < id; }),
+            ptr);
+    }
+    return *ptr;
+}
+
+void clear_posts()
+{
+    posts.clear();
+    thread_posts.clear();
+    link_graph.clear();
 }
 
 void load_posts(std::string_view data)
 {
-    Backlinks backlinks;
-    backlinks.reserve(128);
-    auto j = json::parse(data);
+    static brunhild::profile::Metric metric("load_posts");
+    brunhild::profile::Scope scope(metric);
+
     if (page.thread) {
-        extract_thread(j, backlinks);
+        if (!extract_thread(data, true)) {
+            console::error("malformed thread data");
+        }
     } else {
-        page.page_total = j["pages"];
-        for (auto& thread : j["threads"]) {
-            extract_thread(thread, backlinks);
+        if (page.catalog) {
+            catalog.clear();
         }
+        bool threads_ok = true;
+        const bool ok = json_scan::for_each_member(
+            data, [&](std::string_view key, std::string_view val) {
+                if (key == "pages") {
+                    page.page_total = json::parse(val);
+                } else if (key == "threads") {
+                    threads_ok = json_scan::for_each_element(
+                        val, [&](std::string_view thread) {
+                            if (!(page.catalog
+                                        ? extract_catalog_thread(thread)
+                                        : extract_thread(thread, false))) {
+                                threads_ok = false;
+                            }
+                        });
+                }
+            });
+        if (!ok || !threads_ok) {
+            console::error("malformed board page data");
+        }
+    }
+}
 
-        // TODO: Catalog pages
+bool load_thread(std::string_view data) { return extract_thread(data, true); }
+
+void load_snapshot(std::string_view data)
+{
+    SnapshotReader r(
+        reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    if (const auto v = r.byte(); v != snapshot_version) {
+        console::error("unsupported snapshot version: " + std::to_string(v));
+        return;
     }
+    const unsigned page_total = r.varint();
+
+    // Post string references are only meaningful with the same string table,
+    // so it seeds the hash of each post's bytes
+    auto consumed = [&]() { return data.size() - r.remaining(); };
+    const size_t strings_start = consumed();
+    r.read_strings();
+    const uint64_t strings_hash
+        = fnv1a(data.substr(strings_start, consumed() - strings_start));
 
-    // Assign backlinks to their post models
-    for (auto [target_id, data] : backlinks) {
-        if (posts.count(target_id)) {
-            posts.at(target_id).backlinks = std::move(data);
+    const auto thread_count = r.varint();
+    for (uint64_t i = 0; i < thread_count && r.ok(); i++) {
+        auto thread = ThreadDecoder(r);
+        const auto post_count = r.varint();
+        if (!post_count || post_count > r.remaining()) {
+            r.fail();
+            break;
         }
+        threads[thread.id] = static_cast<Thread>(thread);
+
+        auto& index = thread_posts[thread.id];
+        index.reserve(index.size() + post_count);
+        r.last_id = thread.id;
+        for (uint64_t j = 0; j < post_count && r.ok(); j++) {
+            const size_t start = consumed();
+            Post p(r);
+            p.board = thread.board;
+            p.op = thread.id;
+            const auto src = data.substr(start, consumed() - start);
+            p.source_hash = fnv1a(src, strings_hash);
+            link_graph.add(p);
+            add_post(std::move(p));
+        }
+    }
+    if (!r.ok()) {
+        console::error("malformed snapshot");
+    }
+    if (!page.thread) {
+        page.page_total = page_total;
+    }
+}
+
+// Load posts from the snapshot embedded into the page by the server, if any
+static void load_embedded_snapshot()
+{
+    size_t size = 0;
+    auto buf = (char*)EM_ASM_INT(
+        {
+            var el = document.getElementById("snapshot-data");
+            if (!el) {
+                return 0;
+            }
+            var s = atob(el.textContent.trim());
+            var buf = Module._malloc(s.length);
+            for (var i = 0; i < s.length; i++) {
+                HEAPU8[buf + i] = s.charCodeAt(i);
+            }
+            HEAPU32[$0 >> 2] = s.length;
+            return buf;
+        },
+        &size);
+    if (buf) {
+        load_snapshot(std::string_view(buf, size));
+        free(buf);
     }
 }
 
@@ -85,6 +245,9 @@ void load_state()
 
     debug = val::global("location")["search"].as<string>().find("debug=true")
         != string::npos;
+    brunhild::profile::enabled = debug
+        || val::global("location")["search"].as<string>().find("profile=true")
+            != string::npos;
     auto location = val::global("location");
     location_origin = location["origin"].as<string>();
     page = { location["href"].as<string>().substr(location_origin.size()) };
@@ -96,6 +259,12 @@ void load_state()
     }
 
     config = { get_inner_html("conf-data") };
+    if (EM_ASM_INT(
+            { return !!document.getElementById("board-conf-data"); })) {
+        board_config = { json::parse(get_inner_html("board-conf-data")) };
+    }
+
+    load_embedded_snapshot();
 }
 
 Config::Config(const c_string_view& s)
@@ -221,9 +390,12 @@ Page::Page(const string& href)
     }
 }
 
-void add_to_storage(int typ, const std::vector<unsigned long> ids)
+// Bulk insert post IDs into one of the post ID sets. Takes ownership of a
+// malloc()ed uint32_t array passed as int.
+static void add_to_storage(int typ, int ids_ptr, int n)
 {
-    std::unordered_set<unsigned long>* set = nullptr;
+    auto ids = reinterpret_cast<uint32_t*>(ids_ptr);
+    IDSet* set = nullptr;
     switch (static_cast<StorageType>(typ)) {
     case StorageType::mine:
         set = &post_ids.mine;
@@ -238,13 +410,12 @@ void add_to_storage(int typ, const std::vector<unsigned long> ids)
         set = &post_ids.hidden;
         break;
     }
-    set->reserve(set->size() + ids.size());
-    set->insert(ids.begin(), ids.end());
+    set->insert(ids, n);
+    free(ids);
 }
 
 EMSCRIPTEN_BINDINGS(module_state)
 {
-    emscripten::register_vector<unsigned long>("VectorUint64");
     emscripten::function("add_to_storage", &add_to_storage);
 }
 
@@ -260,21 +431,33 @@ ThreadDecoder::ThreadDecoder(json& j)
     OPT_DECODE(locked)
     OPT_DECODE(sticky)
 
-    // Redundant field on thread pages
-    id = page.thread ? page.thread : (unsigned long)(j["id"]);
+    // Redundant field on thread pages. Set from the OP by extract_thread().
+    if (j.count("id")) {
+        id = j["id"];
+    }
 
     post_ctr = j["postCtr"];
     image_ctr = j["imageCtr"];
     time = j["time"];
     reply_time = j["replyTime"];
     bump_time = j["bumpTime"];
-    board = j["board"];
+    board = Atom(j["board"].get<string>());
     subject = j["subject"];
-    if (!page.catalog) {
-        auto& p = j.at("posts");
-        posts.reserve(p.size());
-        for (auto& data : p) {
-            posts.push_back(Post(data));
-        }
-    }
+}
+
+ThreadDecoder::ThreadDecoder(SnapshotReader& r)
+{
+    const uint8_t flags = r.byte();
+    deleted = flags & thread_deleted;
+    locked = flags & thread_locked;
+    sticky = flags & thread_sticky;
+
+    id = r.varint();
+    post_ctr = r.varint();
+    image_ctr = r.varint();
+    time = r.varint();
+    reply_time = r.varint();
+    bump_time = r.varint();
+    board = r.atom_ref().value_or(Atom());
+    subject = r.string();
 }
@@ -1,16 +1,37 @@
 #pragma once
 
+#include "id_set.hh"
+#include "posts/links.hh"
 #include "posts/models.hh"
+#include "posts/store.hh"
 #include "util.hh"
 #include <map>
 #include <nlohmann/json.hpp>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 // Contains all posts currently loaded on the page. Posts might or might not
 // be actually displayed.
-inline std::map<unsigned long, Post> posts;
+inline PostStore posts;
+
+// Posts of each thread sorted by post ID. Maintained by add_post() and
+// clear_posts().
+inline std::unordered_map<unsigned long, std::vector<Post*>> thread_posts;
+
+// Backlinks of all loaded posts. Maintained by the post loaders,
+// Post::propagate_links() and clear_posts().
+inline LinkGraph link_graph;
+
+// Insert or replace a post in the global post collection and the per-thread
+// index. Post::op must be set. A replaced post hands its views to the new one
+// and they are patched. Posts with a matching source_hash are not replaced.
+Post& add_post(Post&&);
+
+// Remove all posts from the global post collection, the per-thread index and
+// the link graph
+void clear_posts();
 
 // Caches the origin of the page
 inline std::string location_origin;
@@ -70,6 +91,14 @@ public:
     Page() {}
 
     Page(const std::string&);
+
+    // Returns, if both describe the same page, disregarding the linked post
+    bool same_page(const Page& other) const
+    {
+        return catalog == other.catalog && last_100 == other.last_100
+            && page == other.page && thread == other.thread
+            && board == other.board;
+    }
 };
 
 // Describes the current page
@@ -83,9 +112,17 @@ void load_state();
 // to do this and configuration fetches in one request.
 void load_posts(std::string_view data);
 
+// Load the metadata and posts of a single thread from its thread page JSON
+// into the post collections, without changing the current page. Returns false,
+// if the data is malformed.
+bool load_thread(std::string_view data);
+
+// Load posts from a binary page snapshot. See snapshot.hh.
+void load_snapshot(std::string_view data);
+
 // Stores post ID of various catagories
 struct PostIDs {
-    std::unordered_set<unsigned long> mine, // Post, the user has created
+    IDSet mine, // Post, the user has created
         seen_replies, // Replies to the user's posts, the user has seen
         seen_posts, // Posts the user has seen
         hidden; // Posts the user has hidden
@@ -96,12 +133,13 @@ inline PostIDs post_ids;
 // Types of post ID storage in the database
 enum class StorageType : int { mine, seen_replies, seen_posts, hidden };
 
-// Used to decode thread JSON
+// Used to decode thread metadata. Posts are decoded separately.
 // TODO: Get rid of this in favour of a binary decoder
 class ThreadDecoder : public Thread {
 public:
-    std::vector<Post> posts;
-
     // Parse from JSON
     ThreadDecoder(nlohmann::json& j);
+
+    // Decode from binary snapshot
+    ThreadDecoder(SnapshotReader&);
 };
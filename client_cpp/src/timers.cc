@@ -0,0 +1,76 @@
+#include "timers.hh"
+#include <emscripten.h>
+#include <emscripten/bind.h>
+#include <functional>
+#include <queue>
+#include <vector>
+
+struct Timer {
+    time_t when;
+    TimerFn fn;
+    uint64_t arg;
+
+    bool operator>(const Timer& other) const { return when > other.when; }
+};
+
+// Pending timers with the earliest on top
+static std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>>
+    timers;
+
+// Due time of the armed JS timeout or 0
+static time_t armed_at = 0;
+
+// ID of the armed JS timeout
+static int timeout_id = 0;
+
+// Arm the JS timeout for the earliest timer, unless it is already armed for
+// that time or earlier
+static void arm()
+{
+    if (timers.empty()) {
+        return;
+    }
+    const time_t when = timers.top().when;
+    if (armed_at && armed_at <= when) {
+        return;
+    }
+    if (armed_at) {
+        EM_ASM_INT({ clearTimeout($0); }, timeout_id);
+    }
+    armed_at = when;
+    timeout_id = EM_ASM_INT(
+        {
+            return setTimeout(function() { Module.run_timers(); },
+                Math.max(0, $0 * 1000 - Date.now()));
+        },
+        double(when));
+}
+
+void schedule(time_t when, TimerFn fn, uint64_t arg)
+{
+    timers.push({ when, fn, arg });
+    arm();
+}
+
+static void run_timers()
+{
+    armed_at = 0;
+
+    // Timers scheduled by the executed functions only run on the next wake
+    const time_t now = std::time(0);
+    std::vector<Timer> due;
+    while (!timers.empty() && timers.top().when <= now) {
+        due.push_back(timers.top());
+        timers.pop();
+    }
+    for (auto& t : due) {
+        t.fn(t.arg);
+    }
+
+    arm();
+}
+
+EMSCRIPTEN_BINDINGS(module_timers)
+{
+    emscripten::function("run_timers", &run_timers);
+}
@@ -0,0 +1,14 @@
+// Scheduling of time-driven DOM updates
+
+#pragma once
+
+#include <ctime>
+#include <stdint.h>
+
+// Function executed, when a timer is due. Receives the argument passed to
+// schedule().
+typedef void (*TimerFn)(uint64_t arg);
+
+// Run fn(arg) at or after the Unix time `when`. All timers share a min-heap
+// and a single JS timeout, that only wakes at the earliest due time.
+void schedule(time_t when, TimerFn fn, uint64_t arg = 0);
@@ -0,0 +1,350 @@
+#include "upload.hh"
+#include "../brunhild/events.hh"
+#include "../brunhild/mutations.hh"
+#include "sha1.hh"
+#include <emscripten.h>
+#include <emscripten/bind.h>
+#include <stdlib.h>
+#include <string>
+
+// Size of the file slices read for hashing. The UI is yielded to between
+// slices.
+static const size_t chunk_size = 1 << 20;
+
+// Files larger than this, that the server does not have, are uploaded in
+// resumable chunks before the form is sent
+static const size_t chunked_threshold = 1 << 20;
+
+// Maximum number of chunks uploaded concurrently
+static const unsigned chunk_concurrency = 3;
+
+// Maximum number of consecutive failed requests before the upload is abandoned
+static const unsigned max_upload_failures = 8;
+
+// A form submission is in progress
+static bool submitting = false;
+
+// Last rendered upload progress in percent or -1, if none
+static int upload_percent = -1;
+
+// Hasher of the file selected in the submitted form
+static SHA1 hasher;
+
+// Submit the new thread form. If token is not empty, the selected file is
+// replaced with the image allocation token.
+static void send_thread_form(std::string token)
+{
+    EM_ASM(
+        {
+            var form = document.getElementById('new-thread-form');
+            var file = window.__upload_file;
+            window.__upload_file = null;
+            if (!form) {
+                Module.on_thread_form_sent();
+                return;
+            }
+            var data = new FormData(form);
+            var token = UTF8ToString($0);
+            if (token && file) {
+                data.delete('image');
+                data.set('imageToken', token);
+                data.set('imageName', file.name);
+            }
+            fetch('/api/create-thread',
+                { method : 'POST', body : data, credentials : 'same-origin' })
+                .then(function(res) {
+                    if (res.ok) {
+                        location.href = res.url;
+                    } else {
+                        return res.text().then(function(t) { alert(t); });
+                    }
+                })
+                .catch(function(err) { alert(err); })
+                .then(function() { Module.on_thread_form_sent(); });
+        },
+        token.c_str());
+}
+
+static void on_thread_form_sent()
+{
+    submitting = false;
+    if (upload_percent != -1) {
+        upload_percent = -1;
+        brunhild::set_inner_html("upload-progress", "");
+    }
+}
+
+// Render upload progress. Only percentage changes produce DOM mutations, which
+// are further coalesced into a single write per frame.
+static void on_upload_progress(double done, double total)
+{
+    const int percent = total > 0 ? int(done / total * 100) : 0;
+    if (percent == upload_percent) {
+        return;
+    }
+    upload_percent = percent;
+    brunhild::set_inner_html(
+        "upload-progress", " " + std::to_string(percent) + "%");
+}
+
+// Upload the selected file in chunks and then submit the form with the
+// resulting allocation token. Failed chunks are retried with exponential
+// backoff. After each failure the set of chunks the server has received is
+// fetched again, so the upload resumes where it left off.
+static void upload_chunked()
+{
+    EM_ASM(
+        {
+            var file = window.__upload_file;
+            var concurrency = $0;
+            var maxFailures = $1;
+            var base = '/api/upload-chunked/';
+            var post = function(url, body)
+            {
+                return fetch(base + url,
+                    { method : 'POST', body : body, credentials : 'same-origin' });
+            };
+            var abort = function(err)
+            {
+                window.__upload_file = null;
+                alert(err);
+                Module.on_thread_form_sent();
+            };
+            // Reject with the response body on non-network errors. These are
+            // not retried.
+            var check = function(res)
+            {
+                return res.text().then(function(t) {
+                    if (!res.ok) {
+                        throw { fatal : t };
+                    }
+                    return t;
+                });
+            };
+
+            post('start?size=' + file.size)
+                .then(check)
+                .then(function(t) {
+                    var up = JSON.parse(t);
+                    var id = encodeURIComponent(up.id);
+                    var size = up.chunkSize;
+                    var count = Math.ceil(file.size / size);
+                    var pending = [];
+                    for (var i = count - 1; i >= 0; i--) {
+                        pending.push(i);
+                    }
+                    var active = 0;
+                    var done = 0;
+                    var failures = 0;
+                    var state = 'run'; // 'run', 'resync' or 'stop'
+
+                    var report = function()
+                    {
+                        Module.on_upload_progress(
+                            Math.min(done * size, file.size), file.size);
+                    };
+                    var fail = function(err)
+                    {
+                        if (state == 'stop') {
+                            return;
+                        }
+                        if (err && err.fatal !== undefined) {
+                            state = 'stop';
+                            abort(err.fatal);
+                        } else if (++failures > maxFailures) {
+                            state = 'stop';
+                            abort(err);
+                        } else if (state == 'run') {
+                            state = 'resync';
+                        }
+                    };
+                    // Rebuild the pending set from the chunks the server
+                    // has received
+                    var resync = function()
+                    {
+                        setTimeout(function() {
+                            fetch(base + 'status?id=' + id,
+                                { credentials : 'same-origin' })
+                                .then(check)
+                                .then(function(t) {
+                                    pending = [];
+                                    done = 0;
+                                    for (var i = t.length - 1; i >= 0; i--) {
+                                        if (t[i] == '1') {
+                                            done++;
+                                        } else {
+                                            pending.push(i);
+                                        }
+                                    }
+                                    state = 'run';
+                                    report();
+                                    pump();
+                                })
+                                .catch(function(err) {
+                                    fail(err);
+                                    if (state != 'stop') {
+                                        resync();
+                                    }
+                                });
+                        },
+                            Math.min(30000, 1000 << failures));
+                    };
+                    var send = function(i)
+                    {
+                        active++;
+                        var end = Math.min((i + 1) * size, file.size);
+                        post('chunk?id=' + id + '&chunk=' + i,
+                            file.slice(i * size, end))
+                            .then(check)
+                            .then(function() {
+                                done++;
+                                failures = 0;
+                                report();
+                            })
+                            .catch(fail)
+                            .then(function() {
+                                active--;
+                                pump();
+                            });
+                    };
+                    var pump = function()
+                    {
+                        if (state == 'stop') {
+                            return;
+                        }
+                        if (state == 'resync') {
+                            // Wait for in-flight chunks to settle first
+                            if (!active) {
+                                resync();
+                            }
+                            return;
+                        }
+                        while (active < concurrency && pending.length) {
+                            send(pending.pop());
+                        }
+                        if (!active && !pending.length) {
+                            state = 'stop';
+                            post('finish?id=' + id)
+                                .then(check)
+                                .then(function(token) {
+                                    Module.send_thread_form(token);
+                                })
+                                .catch(function(err) {
+                                    abort(err.fatal !== undefined ? err.fatal
+                                                                  : err);
+                                });
+                        }
+                    };
+
+                    report();
+                    pump();
+                })
+                .catch(function(err) {
+                    abort(err.fatal !== undefined ? err.fatal : err);
+                });
+        },
+        chunk_concurrency, max_upload_failures);
+}
+
+// Feed a slice of the selected file at ptr to the hasher and free it
+static void hash_upload_chunk(uintptr_t ptr, size_t len)
+{
+    auto buf = reinterpret_cast<uint8_t*>(ptr);
+    hasher.update(buf, len);
+    free(buf);
+}
+
+// Ask the server for an allocation token of the hashed file. If the server does
+// not have it, large files are uploaded in chunks and small files are sent with
+// the form.
+static void finish_upload_hash()
+{
+    const auto digest = hasher.hex_digest();
+    EM_ASM(
+        {
+            fetch('/api/upload-hash', {
+                method : 'POST',
+                body : UTF8ToString($0),
+                credentials : 'same-origin'
+            })
+                .then(function(res) {
+                    return res.text().then(function(t) {
+                        return res.status == 200 ? t : '';
+                    });
+                })
+                .catch(function() { return ''; })
+                .then(function(token) {
+                    if (!token && window.__upload_file.size > $1) {
+                        Module.upload_chunked();
+                    } else {
+                        Module.send_thread_form(token);
+                    }
+                });
+        },
+        digest.c_str(), chunked_threshold);
+}
+
+static void submit_thread_form(emscripten::val&)
+{
+    if (submitting) {
+        return;
+    }
+    submitting = true;
+
+    const bool has_file = EM_ASM_INT({
+        var form = document.getElementById('new-thread-form');
+        var input = form && form.querySelector('input[name=image]');
+        window.__upload_file = (input && input.files[0]) || null;
+        return window.__upload_file ? 1 : 0;
+    });
+    if (!has_file) {
+        send_thread_form("");
+        return;
+    }
+
+    // Stream the file into the hasher slice by slice
+    hasher = SHA1();
+    EM_ASM(
+        {
+            var file = window.__upload_file;
+            var size = $0;
+            var off = 0;
+            var next = function()
+            {
+                if (off >= file.size) {
+                    Module.finish_upload_hash();
+                    return;
+                }
+                var end = Math.min(off + size, file.size);
+                new Response(file.slice(off, end))
+                    .arrayBuffer()
+                    .then(function(buf) {
+                        var a = new Uint8Array(buf);
+                        var ptr = Module._malloc(a.length);
+                        HEAPU8.set(a, ptr);
+                        Module.hash_upload_chunk(ptr, a.length);
+                        off = end;
+                        setTimeout(next, 0);
+                    })
+                    .catch(function() { Module.send_thread_form(''); });
+            };
+            next();
+        },
+        chunk_size);
+}
+
+EMSCRIPTEN_BINDINGS(module_upload)
+{
+    emscripten::function("send_thread_form", &send_thread_form);
+    emscripten::function("on_thread_form_sent", &on_thread_form_sent);
+    emscripten::function("hash_upload_chunk", &hash_upload_chunk);
+    emscripten::function("finish_upload_hash", &finish_upload_hash);
+    emscripten::function("on_upload_progress", &on_upload_progress);
+    emscripten::function("upload_chunked", &upload_chunked);
+}
+
+void init_upload()
+{
+    brunhild::register_handler(
+        "submit", &submit_thread_form, "#new-thread-form");
+}
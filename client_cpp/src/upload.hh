@@ -0,0 +1,7 @@
+// Submission of post forms with image uploads
+
+#pragma once
+
+// Register the submit handler of the new thread form. Selected files are
+// hashed first and only uploaded, if the server does not already have them.
+void init_upload();
@@ -24,13 +24,13 @@ c_string_view get_inner_html(const string& id)
         id.c_str()));
 }
 
-string pluralize(int n, string word)
+string pluralize(int n, PluralKey word)
 {
     std::string s;
     s.reserve(32);
     s = std::to_string(n) + ' ';
 
-    auto& ln = lang.plurals.at(word);
+    auto& ln = lang.plurals[word];
     switch (n) {
     case 1:
     case -1:
@@ -88,7 +88,7 @@ brunhild::Children render_submit(bool cancel)
     ch.push_back({
         "input",
         {
-            { "type", "submit" }, { "value", lang.ui.at("submit") },
+            { "type", "submit" }, { "value", lang.ui[UIKey::submit] },
         },
     });
     if (cancel) {
@@ -96,7 +96,7 @@ brunhild::Children render_submit(bool cancel)
             "input",
             {
                 { "type", "button" }, { "name", "cancel" },
-                { "value", lang.ui.at("submit") },
+                { "value", lang.ui[UIKey::submit] },
             },
         });
     }
@@ -121,14 +121,14 @@ Node render_expand_link(string board, unsigned long id)
 {
     std::ostringstream s;
     s << '/' << board << '/' << id;
-    return render_button(s.str(), lang.posts.at("expand"));
+    return render_button(s.str(), lang.posts[PostsKey::expand]);
 }
 
 Node render_last_100_link(string board, unsigned long id)
 {
     std::ostringstream s;
     s << '/' << board << '/' << id << "?last=100#bottom";
-    return render_button(s.str(), lang.ui.at("last") + " 100");
+    return render_button(s.str(), lang.ui[UIKey::last] + " 100");
 }
 
 void alert(std::string msg)
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "../brunhild/node.hh"
+#include "lang.hh"
 #include <cctype>
 #include <functional>
+#include <stdint.h>
 #include <optional>
 #include <ostream>
 #include <sstream>
@@ -45,7 +47,7 @@ c_string_view get_inner_html(const std::string& id);
 
 // Return either the singular or plural form of a translation, depending on n.
 // word is the index used for finding the localization tuple.
-std::string pluralize(int n, std::string word);
+std::string pluralize(int n, PluralKey word);
 
 // Renders a clickable button element.
 // If href = std::nullopt, no href property is set on the link.
@@ -106,6 +108,16 @@ void alert(std::string);
 // Convert string to lowercase
 std::string to_lower(const std::string&);
 
+// Seeded FNV-1a hash of a byte string
+inline uint64_t fnv1a(std::string_view s, uint64_t seed = 0)
+{
+    uint64_t h = 14695981039346656037ull ^ seed;
+    for (char ch : s) {
+        h = (h ^ uint8_t(ch)) * 1099511628211ull;
+    }
+    return h;
+}
+
 // Run function an all parts of string-like T split by separator sep
 template <class T, class U>
 inline void split_string(
@@ -0,0 +1,116 @@
+package common
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"strconv"
+	"unicode/utf8"
+)
+
+// Binary websocket frames are requested by clients with the "binary" flag of
+// their first synchronisation request.
+//
+// A frame is a one byte MessageType followed by type-specific fields. Integers
+// are unsigned LEB128 varints. Strings are UTF-8 prefixed with their varint
+// byte length. Appends, backspaces, spoilers, splices, sync counts and
+// concatenations have dedicated encodings. All other types carry the JSON
+// payload of their text message.
+//
+// All message types are below '0', so the first byte tells binary frames apart
+// from text messages, which start with a two digit decimal type.
+
+var errMalformedMessage = errors.New("malformed message")
+
+// IsBinaryMessage returns, if msg is a binary frame
+func IsBinaryMessage(msg []byte) bool {
+	return len(msg) != 0 && msg[0] < '0'
+}
+
+// EncodeBinaryMessage transcodes an encoded text message to a binary frame
+func EncodeBinaryMessage(msg []byte) ([]byte, error) {
+	return appendBinaryMessage(make([]byte, 0, len(msg)), msg)
+}
+
+// Append the binary frame of text message msg to w
+func appendBinaryMessage(w, msg []byte) ([]byte, error) {
+	if len(msg) < 2 {
+		return nil, errMalformedMessage
+	}
+	typ, err := strconv.ParseUint(string(msg[:2]), 10, 8)
+	if err != nil || typ >= '0' {
+		return nil, errMalformedMessage
+	}
+	data := msg[2:]
+	w = append(w, byte(typ))
+
+	switch MessageType(typ) {
+	case MessageAppend:
+		var m [2]uint64
+		err = json.Unmarshal(data, &m)
+		if err != nil {
+			return nil, err
+		}
+		var char [utf8.UTFMax]byte
+		n := utf8.EncodeRune(char[:], rune(m[1]))
+		w = appendUvarint(w, m[0])
+		w = appendString(w, char[:n])
+	case MessageBackspace, MessageSpoiler:
+		id, err := strconv.ParseUint(string(data), 10, 64)
+		if err != nil {
+			return nil, errMalformedMessage
+		}
+		w = appendUvarint(w, id)
+	case MessageSplice:
+		var m struct {
+			ID         uint64 `json:"id"`
+			Start, Len uint64
+			Text       string
+		}
+		err = json.Unmarshal(data, &m)
+		if err != nil {
+			return nil, err
+		}
+		w = appendUvarint(w, m.ID)
+		w = appendUvarint(w, m.Start)
+		w = appendUvarint(w, m.Len)
+		w = appendString(w, []byte(m.Text))
+	case MessageSyncCount:
+		var m struct {
+			Active, Total uint64
+		}
+		err = json.Unmarshal(data, &m)
+		if err != nil {
+			return nil, err
+		}
+		w = appendUvarint(w, m.Active)
+		w = appendUvarint(w, m.Total)
+	case MessageConcat:
+		// Length-prefixed sub-frames
+		var msgs []string
+		err = json.Unmarshal(data, &msgs)
+		if err != nil {
+			return nil, err
+		}
+		var sub []byte
+		for _, m := range msgs {
+			sub, err = appendBinaryMessage(sub[:0], []byte(m))
+			if err != nil {
+				return nil, err
+			}
+			w = appendString(w, sub)
+		}
+	default:
+		w = append(w, data...)
+	}
+	return w, nil
+}
+
+func appendUvarint(w []byte, n uint64) []byte {
+	var buf [binary.MaxVarintLen64]byte
+	return append(w, buf[:binary.PutUvarint(buf[:], n)]...)
+}
+
+func appendString(w, s []byte) []byte {
+	return append(appendUvarint(w, uint64(len(s))), s...)
+}
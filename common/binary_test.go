@@ -0,0 +1,99 @@
+package common
+
+import (
+	"testing"
+
+	. "github.com/bakape/meguca/test"
+)
+
+func TestEncodeBinaryMessage(t *testing.T) {
+	t.Parallel()
+
+	cases := [...]struct {
+		name     string
+		in       string
+		out      []byte
+		hasError bool
+	}{
+		{
+			name: "append",
+			in:   `02[300,1234]`,
+			out:  []byte{2, 0xac, 0x02, 2, 0xd3, 0x92},
+		},
+		{
+			name: "backspace",
+			in:   `03300`,
+			out:  []byte{3, 0xac, 0x02},
+		},
+		{
+			name: "spoiler",
+			in:   `077`,
+			out:  []byte{7, 7},
+		},
+		{
+			name: "splice",
+			in:   `04{"id":1,"start":2,"len":3,"text":"abc"}`,
+			out:  []byte{4, 1, 2, 3, 3, 'a', 'b', 'c'},
+		},
+		{
+			name: "sync count",
+			in:   `35{"active":1,"total":200}`,
+			out:  []byte{35, 1, 0xc8, 0x01},
+		},
+		{
+			name: "concat",
+			in:   `33["03300","077"]`,
+			out:  []byte{33, 3, 3, 0xac, 0x02, 2, 7, 7},
+		},
+		{
+			name: "JSON payload",
+			in:   `30{"a":1}`,
+			out:  []byte("\x1e{\"a\":1}"),
+		},
+		{
+			name:     "too short",
+			in:       `0`,
+			hasError: true,
+		},
+		{
+			name:     "invalid type",
+			in:       `xx`,
+			hasError: true,
+		},
+		{
+			name:     "malformed payload",
+			in:       `02[300`,
+			hasError: true,
+		},
+		{
+			name:     "malformed concatenated message",
+			in:       `33["03300","0"]`,
+			hasError: true,
+		},
+	}
+
+	for i := range cases {
+		c := cases[i]
+		t.Run(c.name, func(t *testing.T) {
+			t.Parallel()
+
+			buf, err := EncodeBinaryMessage([]byte(c.in))
+			if c.hasError {
+				if err == nil {
+					t.Fatal("expected error")
+				}
+				return
+			}
+			if err != nil {
+				t.Fatal(err)
+			}
+			AssertBufferEquals(t, buf, c.out)
+			if !IsBinaryMessage(buf) {
+				t.Fatal("not detected as binary")
+			}
+			if IsBinaryMessage([]byte(c.in)) {
+				t.Fatal("text message detected as binary")
+			}
+		})
+	}
+}
@@ -0,0 +1,253 @@
+package common
+
+// Binary snapshots of board and thread pages are embedded into the wasm
+// client's page and sent in place of JSON on board page synchronisation with
+// binary frames. They are decoded without an intermediate JSON DOM.
+//
+// snapshot := version:byte page_total:varint strings thread_count:varint
+//             thread*
+// strings  := count:varint string*
+// thread   := flags:byte id post_ctr image_ctr time reply_time bump_time
+//             board:ref subject:string post_count:varint post*
+// post     := flags:byte id_delta:varint time:varint name:ref trip:ref
+//             auth:ref flag:ref poster_id:ref body:string links commands
+//             image?
+// links    := count:varint (id:varint op:varint board:ref)*
+// commands := count:varint (type:byte value)*
+// image    := flags:byte file_type:byte thumb_type:byte dims:varint[4]
+//             length:varint size:varint artist:string? title:string?
+//             md5:string sha1:string name:string
+//
+// The first post of each thread is its OP, on both board and thread pages.
+// Post IDs are encoded as the difference to the previous post's ID in the
+// thread or to the thread ID for the OP. Repeated strings like boards, names
+// and flags are stored once in the string table and referenced by their
+// index + 1. A reference of 0 means no string. Integers and strings are
+// encoded like in binary websocket frames.
+
+// SnapshotVersion is the version of the binary snapshot format
+const SnapshotVersion = 1
+
+// Bit flags of the thread flags field
+const (
+	snapshotThreadDeleted = 1 << iota
+	snapshotThreadLocked
+	snapshotThreadSticky
+)
+
+// Bit flags of the post flags field
+const (
+	snapshotPostEditing = 1 << iota
+	snapshotPostDeleted
+	snapshotPostSage
+	snapshotPostBanned
+	snapshotPostHasImage
+)
+
+// Bit flags of the image flags field
+const (
+	snapshotImageAudio = 1 << iota
+	snapshotImageVideo
+	snapshotImageSpoiler
+	snapshotImageHasArtist
+	snapshotImageHasTitle
+)
+
+// EncodeSnapshot encodes a board or thread page as a binary snapshot. Thread
+// pages are encoded as a board with a single thread.
+func EncodeSnapshot(b Board) []byte {
+	var e snapshotEncoder
+	e.refs = make(map[string]uint64)
+
+	e.uvarint(uint64(len(b.Threads)))
+	for i := range b.Threads {
+		e.thread(&b.Threads[i])
+	}
+
+	w := make([]byte, 0, len(e.body)+len(e.strings)*8+16)
+	w = append(w, SnapshotVersion)
+	w = appendUvarint(w, uint64(b.Pages))
+	w = appendUvarint(w, uint64(len(e.strings)))
+	for _, s := range e.strings {
+		w = appendString(w, []byte(s))
+	}
+	return append(w, e.body...)
+}
+
+// Encodes everything past the string table, while building it
+type snapshotEncoder struct {
+	body    []byte
+	strings []string
+	refs    map[string]uint64
+}
+
+func (e *snapshotEncoder) byte(b byte) {
+	e.body = append(e.body, b)
+}
+
+func (e *snapshotEncoder) uvarint(n uint64) {
+	e.body = appendUvarint(e.body, n)
+}
+
+func (e *snapshotEncoder) string(s string) {
+	e.body = appendString(e.body, []byte(s))
+}
+
+// Encode a reference to s in the string table. Empty strings are encoded as
+// no string.
+func (e *snapshotEncoder) ref(s string) {
+	if s == "" {
+		e.byte(0)
+		return
+	}
+	i, ok := e.refs[s]
+	if !ok {
+		e.strings = append(e.strings, s)
+		i = uint64(len(e.strings))
+		e.refs[s] = i
+	}
+	e.uvarint(i)
+}
+
+func (e *snapshotEncoder) thread(t *Thread) {
+	var flags byte
+	if t.IsDeleted() {
+		flags |= snapshotThreadDeleted
+	}
+	if t.Locked {
+		flags |= snapshotThreadLocked
+	}
+	if t.Sticky {
+		flags |= snapshotThreadSticky
+	}
+	e.byte(flags)
+
+	e.uvarint(t.ID)
+	e.uvarint(uint64(t.PostCtr))
+	e.uvarint(uint64(t.ImageCtr))
+	e.uvarint(uint64(t.Time))
+	e.uvarint(uint64(t.ReplyTime))
+	e.uvarint(uint64(t.BumpTime))
+	e.ref(t.Board)
+	e.string(t.Subject)
+
+	e.uvarint(uint64(len(t.Posts) + 1))
+	last := t.ID
+	e.post(&t.Post, &last)
+	for i := range t.Posts {
+		e.post(&t.Posts[i], &last)
+	}
+}
+
+func (e *snapshotEncoder) post(p *Post, last *uint64) {
+	var flags byte
+	if p.Editing {
+		flags |= snapshotPostEditing
+	}
+	if p.Sage {
+		flags |= snapshotPostSage
+	}
+	for _, m := range p.Moderation {
+		switch m.Type {
+		case DeletePost:
+			flags |= snapshotPostDeleted
+		case BanPost:
+			flags |= snapshotPostBanned
+		}
+	}
+	if p.Image != nil {
+		flags |= snapshotPostHasImage
+	}
+	e.byte(flags)
+
+	e.uvarint(p.ID - *last)
+	*last = p.ID
+	e.uvarint(uint64(p.Time))
+	e.ref(p.Name)
+	e.ref(p.Trip)
+	e.ref(p.Auth)
+	e.ref(p.Flag)
+	e.ref("") // Poster IDs are not exposed by the server
+	e.string(p.Body)
+
+	e.uvarint(uint64(len(p.Links)))
+	for _, l := range p.Links {
+		e.uvarint(l.ID)
+		e.uvarint(l.OP)
+		e.ref(l.Board)
+	}
+
+	e.uvarint(uint64(len(p.Commands)))
+	for i := range p.Commands {
+		e.command(&p.Commands[i])
+	}
+
+	if p.Image != nil {
+		e.image(p.Image)
+	}
+}
+
+func (e *snapshotEncoder) command(c *Command) {
+	e.byte(byte(c.Type))
+	switch c.Type {
+	case Flip:
+		if c.Flip {
+			e.byte(1)
+		} else {
+			e.byte(0)
+		}
+	case EightBall:
+		e.ref(c.Eightball)
+	case Pyu, Pcount, Rcount:
+		e.uvarint(c.Pyu)
+	case SyncWatch:
+		for _, v := range c.SyncWatch {
+			e.uvarint(v)
+		}
+	case Dice:
+		e.uvarint(uint64(len(c.Dice)))
+		for _, v := range c.Dice {
+			e.uvarint(uint64(v))
+		}
+	case Roulette:
+		e.byte(c.Roulette[0])
+		e.byte(c.Roulette[1])
+	}
+}
+
+func (e *snapshotEncoder) image(img *Image) {
+	var flags byte
+	if img.Audio {
+		flags |= snapshotImageAudio
+	}
+	if img.Video {
+		flags |= snapshotImageVideo
+	}
+	if img.Spoiler {
+		flags |= snapshotImageSpoiler
+	}
+	if img.Artist != "" {
+		flags |= snapshotImageHasArtist
+	}
+	if img.Title != "" {
+		flags |= snapshotImageHasTitle
+	}
+	e.byte(flags)
+
+	e.byte(img.FileType)
+	e.byte(img.ThumbType)
+	for _, d := range img.Dims {
+		e.uvarint(uint64(d))
+	}
+	e.uvarint(uint64(img.Length))
+	e.uvarint(uint64(img.Size))
+	if img.Artist != "" {
+		e.string(img.Artist)
+	}
+	if img.Title != "" {
+		e.string(img.Title)
+	}
+	e.string(img.MD5)
+	e.string(img.SHA1)
+	e.string(img.Name)
+}
@@ -0,0 +1,88 @@
+package common
+
+import (
+	"testing"
+
+	. "github.com/bakape/meguca/test"
+)
+
+func TestEncodeSnapshot(t *testing.T) {
+	t.Parallel()
+
+	b := Board{
+		Pages: 2,
+		Threads: []Thread{
+			{
+				Sticky:    true,
+				PostCtr:   2,
+				ImageCtr:  1,
+				ReplyTime: 5,
+				BumpTime:  4,
+				Subject:   "s",
+				Board:     "a",
+				Post: Post{
+					ID:   100,
+					Time: 3,
+					Body: "op",
+					Name: "anon",
+					Links: []Link{
+						{
+							ID:    101,
+							OP:    100,
+							Board: "a",
+						},
+					},
+					Commands: []Command{
+						{
+							Type: Flip,
+							Flip: true,
+						},
+					},
+					Image: &Image{
+						Spoiler: true,
+						ImageCommon: ImageCommon{
+							FileType: PNG,
+							Dims:     [4]uint16{1, 2, 3, 4},
+							Size:     300,
+							MD5:      "m",
+							SHA1:     "h",
+						},
+						Name: "f",
+					},
+				},
+				Posts: []Post{
+					{
+						ID:   101,
+						Time: 4,
+						Body: "r",
+						Name: "anon",
+						Sage: true,
+						Moderation: []ModerationEntry{
+							{
+								Type: DeletePost,
+							},
+						},
+					},
+				},
+			},
+		},
+	}
+
+	std := []byte{
+		SnapshotVersion, 2,
+		// String table
+		2, 1, 'a', 4, 'a', 'n', 'o', 'n',
+		// Thread
+		1, snapshotThreadSticky, 100, 2, 1, 3, 5, 4, 1, 1, 's', 2,
+		// OP
+		snapshotPostHasImage, 0, 3, 2, 0, 0, 0, 0, 2, 'o', 'p',
+		1, 101, 100, 1,
+		1, byte(Flip), 1,
+		snapshotImageSpoiler, PNG, JPEG, 1, 2, 3, 4, 0, 0xac, 0x02,
+		1, 'm', 1, 'h', 1, 'f',
+		// Reply
+		snapshotPostDeleted | snapshotPostSage, 1, 4, 2, 0, 0, 0, 0, 1, 'r',
+		0, 0,
+	}
+	AssertBufferEquals(t, EncodeSnapshot(b), std)
+}
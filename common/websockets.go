@@ -86,6 +86,7 @@ type Client interface {
 	Redirect(board string)
 	IP() string
 	LastTime() int64
+	Binary() bool
 	Close(error)
 }
 
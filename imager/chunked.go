@@ -0,0 +1,352 @@
+package imager
+
+import (
+	"encoding/json"
+	"errors"
+	"io"
+	"io/ioutil"
+	"net/http"
+	"os"
+	"strconv"
+	"sync"
+	"time"
+
+	"github.com/bakape/meguca/auth"
+	"github.com/bakape/meguca/common"
+	"github.com/bakape/meguca/config"
+)
+
+// Chunked uploads let clients send a file as fixed-size chunks in any order
+// and in parallel. After a reconnect the client queries, which chunks the
+// server already has, and only sends the rest. Once all chunks are received,
+// the assembled file is processed like a regular upload.
+
+const (
+	// Size of all chunks but the last one
+	chunkSize = 1 << 20
+
+	// Chunked uploads idle for longer are discarded
+	chunkedUploadTimeout = time.Hour
+
+	// Maximum number of concurrent chunked uploads per IP
+	maxChunkedUploadsPerIP = 4
+)
+
+var (
+	chunkedUploads   = make(map[string]*chunkedUpload)
+	chunkedUploadsMu sync.Mutex
+
+	errUnknownUpload = common.StatusError{
+		errors.New("unknown upload"),
+		404,
+	}
+	errIncompleteUpload = common.StatusError{
+		errors.New("upload incomplete"),
+		400,
+	}
+	errInvalidChunk   = common.StatusError{errors.New("invalid chunk"), 400}
+	errInvalidSize    = common.StatusError{errors.New("invalid size"), 400}
+	errTooManyUploads = common.StatusError{
+		errors.New("too many concurrent uploads"),
+		429,
+	}
+)
+
+// File being assembled from chunks in a temporary file
+type chunkedUpload struct {
+	sync.Mutex
+	ip       string // IP of the uploader. Only it can access the upload.
+	file     *os.File
+	size     int64
+	received []bool
+	missing  int
+	lastUsed time.Time
+}
+
+// Discard idle chunked uploads
+func init() {
+	go func() {
+		for range time.Tick(time.Minute * 10) {
+			chunkedUploadsMu.Lock()
+			for id, u := range chunkedUploads {
+				u.Lock()
+				expired := time.Since(u.lastUsed) > chunkedUploadTimeout
+				u.Unlock()
+				if expired {
+					delete(chunkedUploads, id)
+					u.close()
+				}
+			}
+			chunkedUploadsMu.Unlock()
+		}
+	}()
+}
+
+func newChunkedUpload(ip string, size int64) (u *chunkedUpload, err error) {
+	f, err := ioutil.TempFile("", "meguca-upload-")
+	if err != nil {
+		return
+	}
+	err = f.Truncate(size)
+	if err != nil {
+		f.Close()
+		os.Remove(f.Name())
+		return
+	}
+	n := int((size + chunkSize - 1) / chunkSize)
+	u = &chunkedUpload{
+		ip:       ip,
+		file:     f,
+		size:     size,
+		received: make([]bool, n),
+		missing:  n,
+		lastUsed: time.Now(),
+	}
+	return
+}
+
+// Write chunk i of the upload read from r. Chunks can be written
+// concurrently.
+func (u *chunkedUpload) writeChunk(i int, r io.Reader) (err error) {
+	if i < 0 || i >= len(u.received) {
+		return errInvalidChunk
+	}
+	off := int64(i) * chunkSize
+	n := u.size - off
+	if n > chunkSize {
+		n = chunkSize
+	}
+
+	// Chunks must be of exact size
+	buf := make([]byte, n+1)
+	read, err := io.ReadFull(r, buf)
+	switch err {
+	case io.EOF, io.ErrUnexpectedEOF:
+		if int64(read) != n {
+			return errInvalidChunk
+		}
+		err = nil
+	case nil:
+		return errInvalidChunk
+	default:
+		return
+	}
+	_, err = u.file.WriteAt(buf[:n], off)
+	if err != nil {
+		return
+	}
+
+	u.Lock()
+	defer u.Unlock()
+	if !u.received[i] {
+		u.received[i] = true
+		u.missing--
+	}
+	u.lastUsed = time.Now()
+	return
+}
+
+// Returns a string of '1' for each received and '0' for each missing chunk
+func (u *chunkedUpload) status() string {
+	u.Lock()
+	defer u.Unlock()
+	buf := make([]byte, len(u.received))
+	for i, r := range u.received {
+		if r {
+			buf[i] = '1'
+		} else {
+			buf[i] = '0'
+		}
+	}
+	return string(buf)
+}
+
+func (u *chunkedUpload) isComplete() bool {
+	u.Lock()
+	defer u.Unlock()
+	return u.missing == 0
+}
+
+// Close and remove the temporary file
+func (u *chunkedUpload) close() {
+	u.file.Close()
+	os.Remove(u.file.Name())
+}
+
+// Register a new chunked upload under a random ID, unless its uploader
+// already has the maximum number of uploads in progress
+func registerChunkedUpload(u *chunkedUpload) (id string, err error) {
+	id, err = auth.RandomID(32)
+	if err != nil {
+		return
+	}
+
+	chunkedUploadsMu.Lock()
+	defer chunkedUploadsMu.Unlock()
+	n := 0
+	for _, other := range chunkedUploads {
+		if other.ip == u.ip {
+			n++
+		}
+	}
+	if n >= maxChunkedUploadsPerIP {
+		return "", errTooManyUploads
+	}
+	chunkedUploads[id] = u
+	return
+}
+
+// Validate the uploader and return its IP and the upload ID from the "id"
+// query parameter
+func parseChunkedUploadRequest(r *http.Request) (ip, id string, err error) {
+	err = validateUploader(r)
+	if err != nil {
+		return
+	}
+	ip, err = auth.GetIP(r)
+	if err != nil {
+		return
+	}
+	id = r.URL.Query().Get("id")
+	return
+}
+
+// Look up a chunked upload by the "id" query parameter. Uploads of other
+// clients are treated as nonexistent.
+func getChunkedUpload(r *http.Request) (u *chunkedUpload, id string, err error) {
+	ip, id, err := parseChunkedUploadRequest(r)
+	if err != nil {
+		return
+	}
+	return lookUpChunkedUpload(ip, id)
+}
+
+func lookUpChunkedUpload(ip, id string) (*chunkedUpload, string, error) {
+	chunkedUploadsMu.Lock()
+	defer chunkedUploadsMu.Unlock()
+	u, ok := chunkedUploads[id]
+	if !ok || u.ip != ip {
+		return nil, "", errUnknownUpload
+	}
+	return u, id, nil
+}
+
+// Remove a complete chunked upload from the registry and return it. The
+// lookup, completeness check and removal happen under one lock, so only one
+// caller can take the upload.
+func takeChunkedUpload(ip, id string) (*chunkedUpload, error) {
+	chunkedUploadsMu.Lock()
+	defer chunkedUploadsMu.Unlock()
+	u, ok := chunkedUploads[id]
+	if !ok || u.ip != ip {
+		return nil, errUnknownUpload
+	}
+	if !u.isComplete() {
+		return nil, errIncompleteUpload
+	}
+	delete(chunkedUploads, id)
+	return u, nil
+}
+
+// StartChunkedUpload allocates a chunked upload of the file size passed in
+// the "size" query parameter and responds with its ID and the chunk size.
+// The upload is bound to the IP of the client.
+func StartChunkedUpload(w http.ResponseWriter, r *http.Request) {
+	var id string
+	err := func() (err error) {
+		err = validateUploader(r)
+		if err != nil {
+			return
+		}
+		ip, err := auth.GetIP(r)
+		if err != nil {
+			return
+		}
+		size, err := strconv.ParseInt(r.URL.Query().Get("size"), 10, 64)
+		if err != nil || size <= 0 {
+			return errInvalidSize
+		}
+		if uint(size) > config.Get().MaxSize<<20 {
+			return common.StatusError{errTooLarge, 413}
+		}
+
+		u, err := newChunkedUpload(ip, size)
+		if err != nil {
+			return
+		}
+		id, err = registerChunkedUpload(u)
+		if err != nil {
+			u.close()
+		}
+		return
+	}()
+	if err != nil {
+		LogError(w, r, err)
+		return
+	}
+
+	w.Header().Set("Content-Type", "application/json")
+	json.NewEncoder(w).Encode(struct {
+		ID        string `json:"id"`
+		ChunkSize int    `json:"chunkSize"`
+	}{id, chunkSize})
+}
+
+// UploadChunk writes the chunk with the index in the "chunk" query parameter
+// to the upload with the ID in the "id" query parameter
+func UploadChunk(w http.ResponseWriter, r *http.Request) {
+	err := func() (err error) {
+		u, _, err := getChunkedUpload(r)
+		if err != nil {
+			return
+		}
+		i, err := strconv.Atoi(r.URL.Query().Get("chunk"))
+		if err != nil {
+			return errInvalidChunk
+		}
+		return u.writeChunk(i, http.MaxBytesReader(w, r.Body, chunkSize+1))
+	}()
+	if err != nil {
+		LogError(w, r, err)
+	}
+}
+
+// ChunkedUploadStatus responds with the received chunks of the upload with
+// the ID in the "id" query parameter
+func ChunkedUploadStatus(w http.ResponseWriter, r *http.Request) {
+	u, _, err := getChunkedUpload(r)
+	if err != nil {
+		LogError(w, r, err)
+		return
+	}
+	w.Write([]byte(u.status()))
+}
+
+// FinishChunkedUpload processes the assembled file of a complete chunked
+// upload and responds with the image allocation token
+func FinishChunkedUpload(w http.ResponseWriter, r *http.Request) {
+	var token string
+	err := func() (err error) {
+		ip, id, err := parseChunkedUploadRequest(r)
+		if err != nil {
+			return
+		}
+		u, err := takeChunkedUpload(ip, id)
+		if err != nil {
+			return
+		}
+		defer u.close()
+
+		res := <-requestThumbnailing(u.file, int(u.size))
+		token, err = res.imageID, res.err
+		if err != nil {
+			return
+		}
+		return incrementSpamScore(r)
+	}()
+	if err != nil {
+		LogError(w, r, err)
+	} else {
+		w.Write([]byte(token))
+	}
+}
@@ -0,0 +1,196 @@
+package imager
+
+import (
+	"bytes"
+	"net/http/httptest"
+	"sort"
+	"sync"
+	"testing"
+
+	"github.com/bakape/meguca/auth"
+	"github.com/bakape/meguca/config"
+	"github.com/bakape/meguca/imager/assets"
+	"github.com/bakape/meguca/test"
+	"github.com/bakape/meguca/test/test_db"
+)
+
+func TestChunkedUpload(t *testing.T) {
+	const size = chunkSize*2 + 10
+	data := make([]byte, size)
+	for i := range data {
+		data[i] = byte(i)
+	}
+
+	u, err := newChunkedUpload("::1", size)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer u.close()
+
+	// Out of order
+	for _, i := range []int{2, 0} {
+		end := (i + 1) * chunkSize
+		if end > size {
+			end = size
+		}
+		err := u.writeChunk(i, bytes.NewReader(data[i*chunkSize:end]))
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+	if s := u.status(); s != "101" {
+		t.Fatalf("unexpected status: %s", s)
+	}
+	if u.isComplete() {
+		t.Fatal("upload should not be complete")
+	}
+
+	// Invalid chunks
+	cases := [...]struct {
+		name string
+		i    int
+		data []byte
+	}{
+		{"index out of range", 3, nil},
+		{"too short", 1, data[:10]},
+		{"too long", 1, data[:chunkSize+1]},
+	}
+	for i := range cases {
+		c := cases[i]
+		t.Run(c.name, func(t *testing.T) {
+			err := u.writeChunk(c.i, bytes.NewReader(c.data))
+			if err != errInvalidChunk {
+				t.Fatalf("unexpected error: %v", err)
+			}
+		})
+	}
+
+	err = u.writeChunk(1, bytes.NewReader(data[chunkSize:chunkSize*2]))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !u.isComplete() {
+		t.Fatal("upload should be complete")
+	}
+	buf := make([]byte, size)
+	if _, err := u.file.ReadAt(buf, 0); err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(buf, data) {
+		t.Fatal("assembled file does not match")
+	}
+}
+
+func TestChunkedUploadLimits(t *testing.T) {
+	const ip = "::1"
+	var ids []string
+	defer func() {
+		for _, id := range ids {
+			u, _, err := lookUpChunkedUpload(ip, id)
+			if err == nil {
+				chunkedUploadsMu.Lock()
+				delete(chunkedUploads, id)
+				chunkedUploadsMu.Unlock()
+				u.close()
+			}
+		}
+	}()
+
+	register := func(ip string) error {
+		u, err := newChunkedUpload(ip, 1)
+		if err != nil {
+			t.Fatal(err)
+		}
+		id, err := registerChunkedUpload(u)
+		if err != nil {
+			u.close()
+			return err
+		}
+		ids = append(ids, id)
+		return nil
+	}
+
+	for i := 0; i < maxChunkedUploadsPerIP; i++ {
+		if err := register(ip); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if err := register(ip); err != errTooManyUploads {
+		t.Fatalf("unexpected error: %v", err)
+	}
+
+	t.Run("bound to uploader", func(t *testing.T) {
+		if _, _, err := lookUpChunkedUpload(ip, ids[0]); err != nil {
+			t.Fatal(err)
+		}
+		_, _, err := lookUpChunkedUpload("127.0.0.1", ids[0])
+		if err != errUnknownUpload {
+			t.Fatalf("unexpected error: %v", err)
+		}
+	})
+}
+
+func TestConcurrentChunkedUploadFinish(t *testing.T) {
+	test_db.ClearTables(t, "images")
+	resetDirs(t)
+	config.Set(config.Configs{
+		Public: config.Public{
+			MaxSize: 10,
+		},
+	})
+
+	newFinishRequest := func(id string) *httptest.ResponseRecorder {
+		rec := httptest.NewRecorder()
+		FinishChunkedUpload(rec, httptest.NewRequest("POST", "/?id="+id, nil))
+		return rec
+	}
+
+	ip, err := auth.GetIP(httptest.NewRequest("POST", "/", nil))
+	if err != nil {
+		t.Fatal(err)
+	}
+	data := test.ReadSample(t, assets.StdJPEG.Name)
+	u, err := newChunkedUpload(ip, int64(len(data)))
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = u.writeChunk(0, bytes.NewReader(data))
+	if err != nil {
+		t.Fatal(err)
+	}
+	id, err := registerChunkedUpload(u)
+	if err != nil {
+		u.close()
+		t.Fatal(err)
+	}
+
+	// Only one of the requests may take the upload
+	var (
+		wg    sync.WaitGroup
+		codes [2]int
+		token string
+	)
+	for i := range codes {
+		wg.Add(1)
+		go func(i int) {
+			defer wg.Done()
+			rec := newFinishRequest(id)
+			codes[i] = rec.Code
+			if rec.Code == 200 {
+				token = rec.Body.String()
+			}
+		}(i)
+	}
+	wg.Wait()
+
+	sort.Ints(codes[:])
+	if codes != [2]int{200, 404} {
+		t.Fatalf("unexpected status codes: %v", codes)
+	}
+	if token == "" {
+		t.Fatal("no image token")
+	}
+	if _, _, err := lookUpChunkedUpload(ip, id); err != errUnknownUpload {
+		t.Fatalf("upload not removed: %v", err)
+	}
+}
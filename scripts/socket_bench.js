@@ -0,0 +1,333 @@
+#!/usr/bin/env node
+// Records /api/socket traffic of a live page and replays it against the wasm
+// client in a headless browser, to benchmark the client under real load.
+//
+// Record a trace of a page for a number of seconds:
+//   socket_bench.js record <page URL> <trace.json> [seconds]
+// Replay a trace at 1x, 10x and maximum speed against a local server, that
+// serves the client assets:
+//   socket_bench.js replay <trace.json> [server URL] [--json]
+//
+// The replayed page is loaded with "?profile=true", so the client collects its
+// render and patch metrics. A stubbed WebSocket delivers the recorded frames
+// with their original timing, scaled by the speed, after the client sends its
+// synchronisation request.
+
+"use strict"
+
+const fs = require("fs")
+const puppeteer = require("puppeteer")
+
+const speeds = [1, 10, Infinity]
+
+// Time to wait for the client to settle after the last frame in milliseconds
+const settleTime = 1000
+
+// Duration above which a frame is counted as janky in milliseconds
+const jankThreshold = 50
+
+main().catch(err => {
+    console.error(err)
+    process.exit(1)
+})
+
+async function main() {
+    const [cmd, ...args] = process.argv.slice(2)
+    switch (cmd) {
+        case "record":
+            if (args.length < 2) {
+                usage()
+            }
+            await record(args[0], args[1], parseFloat(args[2]) || 60)
+            break
+        case "replay": {
+            const json = args.includes("--json")
+            const rest = args.filter(a => a !== "--json")
+            if (rest.length < 1) {
+                usage()
+            }
+            await replay(rest[0], rest[1] || "http://localhost:8000", json)
+            break
+        }
+        default:
+            usage()
+    }
+}
+
+function usage() {
+    console.error("usage:\n"
+        + "  socket_bench.js record <page URL> <trace.json> [seconds]\n"
+        + "  socket_bench.js replay <trace.json> [server URL] [--json]")
+    process.exit(2)
+}
+
+// Record the page's markup and all frames received on its socket
+async function record(url, path, seconds) {
+    const browser = await puppeteer.launch()
+    try {
+        const page = await browser.newPage()
+        let html = ""
+        page.on("response", async res => {
+            if (res.request().resourceType() === "document" && !html) {
+                html = await res.text()
+            }
+        })
+
+        // Shared sockets would hide the frames in another tab's context
+        await page.evaluateOnNewDocument(() => {
+            delete window.BroadcastChannel
+            window.__trace = []
+            const Native = window.WebSocket
+            window.WebSocket = function (path) {
+                const ws = new Native(path)
+                ws.addEventListener("message", e => {
+                    const t = performance.now()
+                    if (typeof e.data === "string") {
+                        window.__trace.push({ t, data: e.data })
+                        return
+                    }
+                    const bytes = new Uint8Array(e.data)
+                    let s = ""
+                    for (let i = 0; i < bytes.length; i++) {
+                        s += String.fromCharCode(bytes[i])
+                    }
+                    window.__trace.push({ t, binary: btoa(s) })
+                })
+                return ws
+            }
+            window.WebSocket.prototype = Native.prototype
+        })
+
+        await page.goto(url, { waitUntil: "load" })
+        await new Promise(resolve => setTimeout(resolve, seconds * 1000))
+        const frames = await page.evaluate(() => window.__trace)
+        const t0 = frames.length ? frames[0].t : 0
+        for (let f of frames) {
+            f.t -= t0
+        }
+        fs.writeFileSync(path, JSON.stringify({ url, html, frames }))
+        console.log(`recorded ${frames.length} frames to ${path}`)
+    } finally {
+        await browser.close()
+    }
+}
+
+// Replay a trace at all speeds and report the results
+async function replay(path, server, json) {
+    const trace = JSON.parse(fs.readFileSync(path, "utf8"))
+    const results = []
+    for (let speed of speeds) {
+        results.push(await replayAt(trace, server, speed))
+    }
+    if (json) {
+        console.log(JSON.stringify(results, null, "\t"))
+    } else {
+        for (let r of results) {
+            printResult(r)
+        }
+    }
+}
+
+async function replayAt(trace, server, speed) {
+    const browser = await puppeteer.launch()
+    try {
+        const page = await browser.newPage()
+        const origin = new URL(trace.url).origin
+        const pageURL = new URL(trace.url)
+        pageURL.searchParams.set("profile", "true")
+
+        // Serve the recorded markup and load everything else from the local
+        // server
+        await page.setRequestInterception(true)
+        page.on("request", req => {
+            if (req.resourceType() === "document") {
+                req.respond({
+                    status: 200,
+                    contentType: "text/html; charset=utf-8",
+                    body: trace.html,
+                })
+            } else if (req.url().startsWith(origin)) {
+                req.continue({ url: server + req.url().slice(origin.length) })
+            } else {
+                req.continue()
+            }
+        })
+
+        await page.evaluateOnNewDocument(installStub, trace.frames,
+            speed === Infinity ? 0 : speed)
+        await page.goto(pageURL.href, { waitUntil: "load" })
+        await page.waitForFunction(() => window.__bench.done, {
+            timeout: 0,
+            polling: 100,
+        })
+        await new Promise(resolve => setTimeout(resolve, settleTime))
+
+        const r = await page.evaluate(collect, jankThreshold)
+        r.speed = speed === Infinity ? "max" : speed + "x"
+        return r
+    } finally {
+        await browser.close()
+    }
+}
+
+// Runs in the page. Replaces WebSocket with a stub, that replays the frames,
+// and starts collecting frame times and long tasks.
+function installStub(frames, speed) {
+    delete window.BroadcastChannel
+    const bench = window.__bench = {
+        done: false,
+        start: 0,
+        end: 0,
+        frameTimes: [],
+        longTasks: [],
+        heapStart: 0,
+        jsHeapStart: 0,
+    }
+
+    let last = 0
+    function onFrame(t) {
+        if (last && bench.start && !bench.end) {
+            bench.frameTimes.push(t - last)
+        }
+        last = t
+        requestAnimationFrame(onFrame)
+    }
+    requestAnimationFrame(onFrame)
+
+    if (window.PerformanceObserver) {
+        try {
+            new PerformanceObserver(list => {
+                for (let e of list.getEntries()) {
+                    if (bench.start && !bench.end) {
+                        bench.longTasks.push(e.duration)
+                    }
+                }
+            }).observe({ entryTypes: ["longtask"] })
+        } catch (e) {
+            // Long Tasks API not supported
+        }
+    }
+
+    function decode(f) {
+        if (f.data !== undefined) {
+            return f.data
+        }
+        const s = atob(f.binary)
+        const buf = new Uint8Array(s.length)
+        for (let i = 0; i < s.length; i++) {
+            buf[i] = s.charCodeAt(i)
+        }
+        return buf.buffer
+    }
+
+    // Deliver all frames relative to the start time, scaled by speed. At
+    // maximum speed the frames are delivered back to back.
+    function play(ws) {
+        bench.start = performance.now()
+        bench.heapStart = window.HEAPU8 ? HEAPU8.length : 0
+        bench.jsHeapStart = performance.memory
+            ? performance.memory.usedJSHeapSize
+            : 0
+        let i = 0
+        function next() {
+            while (i < frames.length) {
+                const f = frames[i]
+                if (speed) {
+                    const due = bench.start + f.t / speed
+                    const wait = due - performance.now()
+                    if (wait > 1) {
+                        setTimeout(next, wait)
+                        return
+                    }
+                }
+                i++
+                ws.onmessage && ws.onmessage({ data: decode(f) })
+                if (!speed) {
+                    // Still yield to the event loop, so the client can run
+                    // its frame loop
+                    setTimeout(next, 0)
+                    return
+                }
+            }
+            bench.end = performance.now()
+            bench.done = true
+        }
+        next()
+    }
+
+    function Stub() {
+        this.readyState = 0
+        this.bufferedAmount = 0
+        this.binaryType = "blob"
+        this.started = false
+        setTimeout(() => {
+            this.readyState = 1
+            this.onopen && this.onopen({})
+        }, 0)
+    }
+    Stub.prototype.send = function () {
+        // The recorded frames start with the response to the synchronisation
+        // request
+        if (!this.started) {
+            this.started = true
+            play(this)
+        }
+    }
+    Stub.prototype.close = function () {
+        this.readyState = 3
+    }
+    Stub.prototype.addEventListener = function () { }
+    Stub.CONNECTING = 0
+    Stub.OPEN = 1
+    Stub.CLOSING = 2
+    Stub.CLOSED = 3
+    window.WebSocket = Stub
+}
+
+// Runs in the page. Returns the collected results.
+function collect(jankThreshold) {
+    const b = window.__bench
+    const sorted = b.frameTimes.slice().sort((a, b) => a - b)
+    function percentile(p) {
+        if (!sorted.length) {
+            return 0
+        }
+        return sorted[Math.min(sorted.length - 1,
+            Math.floor(sorted.length * p))]
+    }
+    return {
+        duration: b.end - b.start,
+        frames: sorted.length,
+        frameTime: {
+            p50: percentile(0.5),
+            p95: percentile(0.95),
+            p99: percentile(0.99),
+            max: sorted.length ? sorted[sorted.length - 1] : 0,
+        },
+        jankyFrames: sorted.filter(t => t > jankThreshold).length,
+        longTasks: b.longTasks.length,
+        longTaskTime: b.longTasks.reduce((a, b) => a + b, 0),
+        metrics: JSON.parse(Module.profile_totals()),
+        heapGrowth: (window.HEAPU8 ? HEAPU8.length : 0) - b.heapStart,
+        jsHeapGrowth: performance.memory
+            ? performance.memory.usedJSHeapSize - b.jsHeapStart
+            : null,
+    }
+}
+
+function printResult(r) {
+    const ms = n => n.toFixed(1) + " ms"
+    const mib = n => n === null ? "n/a" : (n / (1 << 20)).toFixed(2) + " MiB"
+    console.log(`== ${r.speed}: ${ms(r.duration)}, ${r.frames} frames`)
+    console.log(`frame time: p50 ${ms(r.frameTime.p50)}, `
+        + `p95 ${ms(r.frameTime.p95)}, p99 ${ms(r.frameTime.p99)}, `
+        + `max ${ms(r.frameTime.max)}, `
+        + `${r.jankyFrames} over ${jankThreshold} ms`)
+    console.log(`long tasks: ${r.longTasks} (${ms(r.longTaskTime)})`)
+    console.log(`heap growth: wasm ${mib(r.heapGrowth)}, `
+        + `JS ${mib(r.jsHeapGrowth)}`)
+    for (let name in r.metrics) {
+        const [calls, time] = r.metrics[name]
+        console.log(`  ${name}: ${calls} (${ms(time)})`)
+    }
+}
@@ -35,8 +35,25 @@ func boardHTML(w http.ResponseWriter, r *http.Request, b string, catalog bool) {
 
 	theme := resolveTheme(r, b)
 	if isWasm(r) {
+		// Catalog threads do not have a snapshot format
+		var snapshot []byte
+		if !catalog {
+			_, data, _, err := cache.GetJSONAndData(
+				boardCacheArgs(r, b, catalog))
+			switch err {
+			case nil:
+			case cache.ErrPageOverflow:
+				text404(w)
+				return
+			default:
+				httpError(w, r, err)
+				return
+			}
+			snapshot = common.EncodeSnapshot(data.(cache.PageStore).Data)
+		}
 		setHTMLHeaders(w)
-		templates.WriteIndexWasm(w, theme)
+		templates.WriteIndexWasm(w, theme,
+			config.GetBoardConfigs(b).JSON, snapshot)
 		return
 	}
 
@@ -105,14 +122,23 @@ func threadHTML(w http.ResponseWriter, r *http.Request) {
 
 	b := extractParam(r, "board")
 	theme := resolveTheme(r, b)
+	lastN := detectLastN(r)
+	k := cache.ThreadKey(id, lastN)
 	if isWasm(r) {
+		_, data, _, err := cache.GetJSONAndData(k, cache.ThreadFE)
+		if err != nil {
+			httpError(w, r, err)
+			return
+		}
+		snapshot := common.EncodeSnapshot(common.Board{
+			Threads: []common.Thread{data.(common.Thread)},
+		})
 		setHTMLHeaders(w)
-		templates.WriteIndexWasm(w, theme)
+		templates.WriteIndexWasm(w, theme,
+			config.GetBoardConfigs(b).JSON, snapshot)
 		return
 	}
 
-	lastN := detectLastN(r)
-	k := cache.ThreadKey(id, lastN)
 	html, data, ctr, err := cache.GetHTML(k, cache.ThreadFE)
 	if err != nil {
 		httpError(w, r, err)
@@ -107,7 +107,7 @@ func parsePostCreationForm(w http.ResponseWriter, r *http.Request,
 	}
 
 	// Handle image, if any, and extract file name
-	var token string
+	var token, name string
 	_, header, err := r.FormFile("image")
 	switch err {
 	case nil:
@@ -115,8 +115,17 @@ func parsePostCreationForm(w http.ResponseWriter, r *http.Request,
 		if err != nil {
 			return
 		}
+		name = header.Filename
 	case http.ErrMissingFile:
 		err = nil
+		// File already stored on the server and allocated by its hash through
+		// /api/upload-hash
+		token = f.Get("imageToken")
+		name = f.Get("imageName")
+		if token != "" && name == "" {
+			err = common.ErrInvalidInput("no image name")
+			return
+		}
 	default:
 		return
 	}
@@ -125,7 +134,7 @@ func parsePostCreationForm(w http.ResponseWriter, r *http.Request,
 		req.Image = websockets.ImageRequest{
 			Spoiler: f.Get("spoiler") == "on",
 			Token:   token,
-			Name:    header.Filename,
+			Name:    name,
 		}
 	}
 
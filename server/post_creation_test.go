@@ -0,0 +1,104 @@
+package server
+
+import (
+	"bytes"
+	"database/sql"
+	"mime/multipart"
+	"net/http/httptest"
+	"strconv"
+	"strings"
+	"testing"
+
+	"github.com/bakape/meguca/common"
+	"github.com/bakape/meguca/db"
+	"github.com/bakape/meguca/test/test_db"
+)
+
+// Images allocated by hash are posted with their token and name instead of
+// the file
+func TestCreateThreadWithImageToken(t *testing.T) {
+	test_db.ClearTables(t, "boards", "images")
+	writeSampleBoard(t)
+	disableCaptcha()
+
+	img := common.ImageCommon{
+		SHA1:     "012a2f912c9ee93ceb0ccb8684a29ec571990a94",
+		FileType: common.JPEG,
+		Dims:     [4]uint16{1, 1, 1, 1},
+		MD5:      "YOQQklgfezKbBXuEAsqopw",
+		Size:     300792,
+	}
+	if err := db.WriteImage(img); err != nil {
+		t.Fatal(err)
+	}
+	newToken := func() (token string) {
+		err := db.InTransaction(false, func(tx *sql.Tx) (err error) {
+			token, err = db.NewImageToken(tx, img.SHA1)
+			return
+		})
+		if err != nil {
+			t.Fatal(err)
+		}
+		return
+	}
+
+	cases := [...]struct {
+		name, token, imageName string
+		code                   int
+	}{
+		{"valid token", newToken(), "foo.jpg", 303},
+		{"unknown token", strings.Repeat("a", 86), "foo.jpg", 400},
+		{"missing name", newToken(), "", 400},
+	}
+
+	for i := range cases {
+		c := cases[i]
+		t.Run(c.name, func(t *testing.T) {
+			var body bytes.Buffer
+			w := multipart.NewWriter(&body)
+			fields := map[string]string{
+				"board":      "a",
+				"subject":    "subject",
+				"imageToken": c.token,
+				"imageName":  c.imageName,
+			}
+			for k, v := range fields {
+				if err := w.WriteField(k, v); err != nil {
+					t.Fatal(err)
+				}
+			}
+			if err := w.Close(); err != nil {
+				t.Fatal(err)
+			}
+			req := httptest.NewRequest("POST", "/api/create-thread", &body)
+			req.Header.Set("Content-Type", w.FormDataContentType())
+			rec := httptest.NewRecorder()
+
+			router.ServeHTTP(rec, req)
+
+			assertCode(t, rec, c.code)
+			if c.code != 303 {
+				return
+			}
+
+			var id uint64
+			for _, c := range rec.Result().Cookies() {
+				if c.Name == "addMine" {
+					id, _ = strconv.ParseUint(c.Value, 10, 64)
+				}
+			}
+			thread, err := db.GetThread(id, 0)
+			if err != nil {
+				t.Fatal(err)
+			}
+			switch {
+			case thread.Image == nil:
+				t.Fatal("no image inserted")
+			case thread.Image.SHA1 != img.SHA1:
+				t.Fatalf("unexpected image: %s", thread.Image.SHA1)
+			case thread.Image.Name != "foo":
+				t.Fatalf("unexpected image name: %s", thread.Image.Name)
+			}
+		})
+	}
+}
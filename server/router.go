@@ -95,6 +95,10 @@ func createRouter() http.Handler {
 		// All upload images
 		api.POST("/upload", imager.NewImageUpload)
 		api.POST("/upload-hash", imager.UploadImageHash)
+		api.POST("/upload-chunked/start", imager.StartChunkedUpload)
+		api.POST("/upload-chunked/chunk", imager.UploadChunk)
+		api.GET("/upload-chunked/status", imager.ChunkedUploadStatus)
+		api.POST("/upload-chunked/finish", imager.FinishChunkedUpload)
 		api.POST("/create-thread", createThread)
 		api.POST("/create-reply", createReply)
 
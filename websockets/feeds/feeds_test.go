@@ -35,6 +35,49 @@ func TestWriteMultipleToBuffer(t *testing.T) {
 	}
 }
 
+// Client recording sent messages
+type mockClient struct {
+	binary bool
+	sent   [][]byte
+}
+
+func (c *mockClient) Send(msg []byte) {
+	c.sent = append(c.sent, msg)
+}
+
+func (c *mockClient) Redirect(string) {}
+
+func (c *mockClient) IP() string {
+	return ""
+}
+
+func (c *mockClient) LastTime() int64 {
+	return 0
+}
+
+func (c *mockClient) Binary() bool {
+	return c.binary
+}
+
+func (c *mockClient) Close(error) {}
+
+func TestSendToAllBinary(t *testing.T) {
+	t.Parallel()
+
+	text, bin := &mockClient{}, &mockClient{binary: true}
+	var f baseFeed
+	f.init()
+	f.addClient(text)
+	f.addClient(bin)
+
+	f.sendToAll([]byte(`33["03300"]`))
+	if len(text.sent) != 1 || len(bin.sent) != 1 {
+		t.Fatal("message not sent to all clients")
+	}
+	test.AssertBufferEquals(t, text.sent[0], []byte(`33["03300"]`))
+	test.AssertBufferEquals(t, bin.sent[0], []byte{33, 3, 3, 0xac, 0x02})
+}
+
 func TestHandleModeration(t *testing.T) {
 	Clear()
 	test_db.ClearTables(t, "boards")
@@ -83,9 +83,23 @@ func (b *baseFeed) removeClient(c common.Client) bool {
 	return true
 }
 
-// Send a message to all connected clients
+// Send a message to all connected clients. The message is transcoded at most
+// once for all clients receiving binary frames.
 func (b *baseFeed) sendToAll(msg []byte) {
+	var bin []byte
 	for c := range b.clients {
-		c.Send(msg)
+		if !c.Binary() {
+			c.Send(msg)
+			continue
+		}
+		if bin == nil {
+			var err error
+			bin, err = common.EncodeBinaryMessage(msg)
+			if err != nil {
+				// Sent as text
+				bin = msg
+			}
+		}
+		c.Send(bin)
 	}
 }
@@ -6,6 +6,7 @@ import (
 	"encoding/json"
 	"github.com/bakape/meguca/common"
 	"github.com/bakape/meguca/websockets/feeds"
+	"time"
 )
 
 // Decode message JSON into the supplied type. Will augment, once we switch to
@@ -35,8 +36,9 @@ func (c *Client) runHandler(typ common.MessageType, msg []byte) error {
 	case common.MessageInsertImage:
 		return c.insertImage(data)
 	case common.MessageNOOP:
-		// No operation message handler. Used as a one way pseudo-ping.
-		return nil
+		// Heartbeat. Respond with the server time, so the client can measure
+		// the round trip and detect dead connections.
+		return c.sendMessage(common.MessageServerTime, time.Now().Unix())
 	case common.MessageSpoiler:
 		return c.spoilerImage()
 	case common.MessageMeguTV:
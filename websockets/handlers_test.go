@@ -2,9 +2,13 @@ package websockets
 
 import (
 	"encoding/json"
+	"strconv"
 	"testing"
+	"time"
 
+	"github.com/bakape/meguca/common"
 	. "github.com/bakape/meguca/test"
+	"github.com/gorilla/websocket"
 )
 
 func marshalJSON(t testing.TB, msg interface{}) []byte {
@@ -37,3 +41,40 @@ func TestDecodeMessage(t *testing.T) {
 		LogUnexpected(t, std, msg)
 	}
 }
+
+func TestNOPHandler(t *testing.T) {
+	t.Parallel()
+
+	sv := newWSServer(t)
+	defer sv.Close()
+	cl, wcl := sv.NewClient()
+	cl.gotFirstMessage = true
+
+	start := time.Now().Unix()
+	msg, err := common.EncodeMessage(common.MessageNOOP, nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := cl.handleMessage(websocket.TextMessage, msg); err != nil {
+		t.Fatal(err)
+	}
+
+	// Replied to with the current server time
+	typ, res, err := wcl.ReadMessage()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if typ != websocket.TextMessage {
+		t.Fatalf("invalid received message format: %d", typ)
+	}
+	if s := string(res[:2]); s != "36" {
+		t.Fatalf("unexpected message type: %s", s)
+	}
+	now, err := strconv.ParseInt(string(res[2:]), 10, 64)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if now < start || now > time.Now().Unix() {
+		t.Fatalf("server time out of range: %d", now)
+	}
+}
@@ -18,6 +18,8 @@ type syncRequest struct {
 	Page, ProtocolVersion uint
 	Thread                uint64
 	Board                 string
+	// Client requests binary frames. See common.EncodeBinaryMessage.
+	Binary bool
 }
 
 type reclaimRequest struct {
@@ -50,6 +52,11 @@ func (c *Client) synchronise(data []byte) error {
 		return err
 	}
 
+	// Frames already transcoded for a binary client are still sent as binary
+	// after a switch to text frames. Clients, that request text frames, never
+	// request binary ones, so this does not happen in practice.
+	c.setBinary(msg.Binary)
+
 	if msg.ProtocolVersion == common.ProtocolVersion {
 		buf, err := common.EncodeMessage(common.MessageConfigs,
 			config.GetBoardConfigs(msg.Board).BoardConfigs)
@@ -90,7 +97,17 @@ func (c *Client) registerSync(req syncRequest) (err error) {
 	} else {
 		f = cache.BoardPageFE
 	}
-	json, _, _, err := cache.GetJSONAndData(key, f)
+	json, data, _, err := cache.GetJSONAndData(key, f)
+	if err != nil {
+		return
+	}
+
+	// Binary clients decode board pages from a snapshot. Catalog threads do
+	// not have a snapshot format.
+	if c.binary && !req.Catalog {
+		buf := common.EncodeSnapshot(data.(cache.PageStore).Data)
+		return c.send(append([]byte{byte(common.MessageSynchronise)}, buf...))
+	}
 	return c.send(common.PrependMessageType(common.MessageSynchronise, json))
 }
 
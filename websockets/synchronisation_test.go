@@ -3,6 +3,7 @@ package websockets
 import (
 	"database/sql"
 	"github.com/bakape/meguca/auth"
+	"github.com/bakape/meguca/cache"
 	"github.com/bakape/meguca/common"
 	"github.com/bakape/meguca/db"
 	"github.com/bakape/meguca/imager/assets"
@@ -63,6 +64,68 @@ func TestSyncToBoard(t *testing.T) {
 	assertMessage(t, wcl, "30null")
 }
 
+func TestBinarySyncToBoard(t *testing.T) {
+	feeds.Clear()
+	setBoardConfigs(t, false)
+
+	sv := newWSServer(t)
+	defer sv.Close()
+	cl, wcl := sv.NewClient()
+
+	msg := syncRequest{
+		Board:  "a",
+		Binary: true,
+	}
+	if err := cl.synchronise(marshalJSON(t, msg)); err != nil {
+		t.Fatal(err)
+	}
+	if !cl.Binary() {
+		t.Fatal("binary frames not requested")
+	}
+
+	typ, buf, err := wcl.ReadMessage()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if typ != websocket.BinaryMessage {
+		t.Fatalf("invalid received message format: %d", typ)
+	}
+	AssertBufferEquals(t, buf, []byte("\x1enull"))
+}
+
+func TestBinarySyncToBoardSnapshot(t *testing.T) {
+	feeds.Clear()
+	cache.Clear()
+	test_db.ClearTables(t, "boards")
+	test_db.WriteSampleBoard(t)
+	test_db.WriteSampleThread(t)
+
+	sv := newWSServer(t)
+	defer sv.Close()
+	cl, wcl := sv.NewClient()
+	cl.setBinary(true)
+
+	err := cl.registerSync(syncRequest{
+		Board:           "a",
+		ProtocolVersion: common.ProtocolVersion,
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	typ, buf, err := wcl.ReadMessage()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if typ != websocket.BinaryMessage {
+		t.Fatalf("invalid received message format: %d", typ)
+	}
+	if len(buf) < 2 || buf[0] != byte(common.MessageSynchronise) ||
+		buf[1] != common.SnapshotVersion {
+		t.Fatalf("not a snapshot frame: %v", buf)
+	}
+}
+
 func skipMessage(t *testing.T, con *websocket.Conn) {
 	t.Helper()
 	_, _, err := con.ReadMessage()
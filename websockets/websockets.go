@@ -68,6 +68,8 @@ type Client struct {
 	ip string
 	// Client last post time
 	lastTime int64
+	// Client receives messages as binary frames
+	binary bool
 	// Internal message receiver channel
 	receive chan receivedMessage
 	// Only used to pass messages from the Send method.
@@ -229,9 +231,20 @@ func (c *Client) Send(msg []byte) {
 	}
 }
 
-// Sends a message to the client. Not safe for concurrent use.
+// Sends a message to the client. Text messages are transcoded for clients
+// receiving binary frames. Messages without a binary encoding are sent as
+// text, which such clients still accept. Not safe for concurrent use.
 func (c *Client) send(msg []byte) error {
-	return c.conn.WriteMessage(websocket.TextMessage, msg)
+	if c.binary && !common.IsBinaryMessage(msg) {
+		if bin, err := common.EncodeBinaryMessage(msg); err == nil {
+			msg = bin
+		}
+	}
+	typ := websocket.TextMessage
+	if common.IsBinaryMessage(msg) {
+		typ = websocket.BinaryMessage
+	}
+	return c.conn.WriteMessage(typ, msg)
 }
 
 // Format a message type as JSON and send it to the client. Not safe for
@@ -361,3 +374,16 @@ func (c *Client) setLastTime() {
 	defer c.mu.Unlock()
 	c.lastTime = time.Now().Unix()
 }
+
+// Binary returns, if the client receives messages as binary frames
+func (c *Client) Binary() bool {
+	c.mu.RLock()
+	defer c.mu.RUnlock()
+	return c.binary
+}
+
+func (c *Client) setBinary(binary bool) {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	c.binary = binary
+}